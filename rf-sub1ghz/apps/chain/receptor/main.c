@@ -28,8 +28,14 @@
 
 #include "core/system.h"
 #include "core/systick.h"
+#include "core/scheduler.h"
+#include "drivers/timers.h"
 #include "core/pio.h"
 #include "lib/stdio.h"
+#include "lib/ringbuf.h"
+#include "lib/pktpool.h"
+#include "lib/trace.h"
+#include "lib/sdlog.h"
 #include "drivers/serial.h"
 #include "drivers/gpio.h"
 #include "drivers/ssp.h"
@@ -37,6 +43,7 @@
 
 #include "drivers/adc.h"
 #include "extdrv/cc1101.h"
+#include "extdrv/sdmmc.h"
 #include "extdrv/status_led.h"
 #include "extdrv/bme280_humidity_sensor.h"
 #include "extdrv/ssd130x_oled_driver.h"
@@ -89,6 +96,23 @@
 // Display flag: set to 1 when we need to update the Adafruit screen display
 static volatile uint32_t update_display = 0;
 
+/* Tasks and their events. Received packets are forwarded to UART by the UART task so
+ * that the radio task never waits for the UART. */
+#define RF_TASK_PRIO    0
+#define UART_TASK_PRIO  1
+#define STORE_TASK_PRIO 2
+static int rf_task_num = -1;
+static int uart_task_num = -1;
+static int store_task_num = -1;
+#define RF_EVT_RX     (0x01 << 0)
+#define RF_EVT_TX     (0x01 << 1)
+#define UART_EVT_FORWARD  (0x01 << 0)
+#define UART_EVT_TRACE    (0x01 << 1)
+/* Radio state check period, in ms */
+#define RF_CHECK_PERIOD  50
+/* Store and forward task period, in ms. One logged block is replayed on each period. */
+#define STORE_PERIOD  500
+
 /***************************************************************************** */
 /* Pins configuration */
 /* pins blocks are passed to set_pins() for pins configuration.
@@ -125,6 +149,15 @@ const struct pio status_led_red = LPC_GPIO_0_29;
 
 const struct pio button = LPC_GPIO_0_12; // ISP button
 
+// SD card used to store the readings while the Raspberry Pi link is down.
+// It shares the SPI bus with the CC1101.
+struct sdmmc_card sd_card = {
+	.ssp_bus_num = 0,
+	.card_type = MMC_CARDTYPE_UNKNOWN,
+	.block_size = SDLOG_BLOCK_SIZE,
+	.chip_select = LPC_GPIO_0_18,
+};
+
 
 /***************************************************************************** */
 /* Basic system init and configuration */
@@ -141,7 +174,7 @@ void system_init()
 
 	/* System tick timer MUST be configured and running in order to use the sleeping
 	 * functions */
-	systick_timer_on(1); /* 1ms */
+	systick_tickless_on(LPC_TIMER_32B1); /* 1ms, wakes up on deadlines only */
 	systick_start();
 
 	// Clearing the LEDs
@@ -153,10 +186,16 @@ void system_init()
 /* RF Communication */
 #define RF_BUFF_LEN 64
 
-static volatile int check_rx = 0;
+/* Radio packets buffers, and queues of received packets (buffer indexes) to forward to
+ * UART. Alarms have their own queue, which is always emptied first. */
+#define RF_NB_PKTS  4
+PKTPOOL_DECLARE(rf_pkts, RF_NB_PKTS, RF_BUFF_LEN);
+RINGBUF_DECLARE(rf_rx_queue, RF_NB_PKTS);
+RINGBUF_DECLARE(rf_alarm_queue, RF_NB_PKTS);
+
 void rf_rx_calback(uint32_t gpio)
 {
-	check_rx = 1;
+	sched_post(rf_task_num, RF_EVT_RX);
 }
 
 static uint8_t rf_specific_settings[] = {
@@ -212,18 +251,200 @@ typedef struct opayload_t
 	char third;
 } opayload_t;
 
+/* Message types, in the two high bits of the second payload byte : the checksum byte
+ * for values (always 00 there) and the first letter for order requests ('H', 'L' and 'T'
+ * are all 01). Alarms are sent with the priority flag. Alarms, values and stored values
+ * are acknowledged with the same type and the ACK flag. */
+#define MSG_TYPE_MASK      (0x03 << 6)
+#define MSG_TYPE_VALUES    (0x00 << 6)
+#define MSG_TYPE_ORDER     (0x01 << 6)
+#define MSG_TYPE_ALARM     (0x02 << 6)
+#define MSG_TYPE_STORED    (0x03 << 6)
+#define MSG_FLAG_PRIORITY  (0x01 << 5)
+#define MSG_FLAG_ACK       (0x01 << 4)
+
+// Alarms received from the sensors
+typedef struct apayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;      // Alarm number, echoed in the acknowledge
+	char channel;     // 'T', 'H' or 'L', as for the display order
+	uint8_t alarms;   // Conditions raised : 1 high, 2 low, 4 rise, 8 fall
+	uint8_t boot;     // Changes when the sensor restarts (and its alarm numbers with it)
+	int32_t value;    // Value which raised the alarm
+} apayload_t;
+
+// Values stored by the sensors while we did not acknowledge them, sent again later
+typedef struct spayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;      // Record number, echoed in the acknowledge
+	uint8_t boot;     // Changes when the sensor restarts (and its record numbers with it)
+	uint32_t age;     // Seconds since the reading, STORED_AGE_UNKNOWN if not known
+	uint32_t tmp;
+	uint16_t hmd;
+	uint32_t lux;
+} spayload_t;
+#define STORED_AGE_UNKNOWN  0xFFFFFFFF
+
+// Acknowledges sent to the sensors
+typedef struct kpayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;
+	char channel;
+} kpayload_t;
+
 // This will be used to transfer data from where we got it (rf) to the USB (UART0)
 static volatile vpayload_t cc_tx_vpayload;
 
+/* Acknowledge a packet of type "type" to sensor "dest". The sensors send alarms and stored
+ * values again until they get the acknowledge, and store the values which are not
+ * acknowledged. */
+static void send_ack(char dest, char type, uint8_t seq, char channel)
+{
+	uint8_t cc_tx_data[sizeof(kpayload_t) + 2];
+	kpayload_t ack;
+	uint8_t status = 0;
+	int ret = 0;
+
+	ack.source = MODULE_ADDRESS;
+	ack.type = (type | MSG_FLAG_ACK);
+	ack.seq = seq;
+	ack.channel = channel;
+	memcpy(&cc_tx_data[2], &ack, sizeof(kpayload_t));
+	cc_tx_data[0] = sizeof(kpayload_t) + 1;
+	cc_tx_data[1] = dest;
+
+	if (cc1101_tx_fifo_state() != 0) {
+		cc1101_flush_tx_fifo();
+	}
+	TRACE_EVT(TRACE_ID_RF_TX, ((cc_tx_data[0] << 8) | cc_tx_data[1]));
+	ret = cc1101_send_packet(cc_tx_data, (sizeof(kpayload_t) + 2));
+	if (ret < 0) {
+		gpio_clear(status_led_green);
+		gpio_set(status_led_red);
+		return;
+	}
+	/* The radio gets back to RX once the acknowledge is sent */
+	do {
+		status = (cc1101_read_status() & CC1101_STATE_MASK);
+	} while (status == CC1101_STATE_TX);
+}
+
+/* Last alarm and last stored values forwarded for each sensor, to drop the ones sent
+ * again because the acknowledge got lost. The entry of a sensor is reset when its boot
+ * number changes, and the oldest entry is reused when all are taken. */
+#define RF_NB_SOURCES  8
+struct rf_source {
+	uint8_t valid;
+	char source;
+	uint8_t boot;
+	uint8_t seq;
+};
+struct rf_sources {
+	struct rf_source entry[RF_NB_SOURCES];
+	uint8_t next;
+};
+static struct rf_sources alarm_sources;
+static struct rf_sources stored_sources;
+
+static struct rf_source* rf_source_get(struct rf_sources* table, char source)
+{
+	struct rf_source* src = NULL;
+	int i = 0;
+
+	for (i = 0; i < RF_NB_SOURCES; i++) {
+		if (table->entry[i].valid && (table->entry[i].source == source)) {
+			return &table->entry[i];
+		}
+	}
+	src = &table->entry[table->next];
+	table->next = (table->next + 1) % RF_NB_SOURCES;
+	src->valid = 0;
+	src->source = source;
+	return src;
+}
+
+/* Queue a received alarm for the UART task and acknowledge it.
+ * The acknowledge is only sent once the alarm is queued (or if it has already been
+ * forwarded) : the sensor sends it again until acknowledged, so an alarm which could not
+ * be queued is not lost.
+ * Returns 1 if the packet has been queued, 0 if it must be released. */
+static int handle_alarm(struct pktbuf* pkt)
+{
+	struct rf_source* src = NULL;
+	apayload_t alarm;
+
+	memcpy(&alarm, &pkt->data[2], sizeof(apayload_t));
+	src = rf_source_get(&alarm_sources, alarm.source);
+	if (src->valid && (src->boot == alarm.boot) && (src->seq == alarm.seq)) {
+		send_ack(alarm.source, MSG_TYPE_ALARM, alarm.seq, alarm.channel);
+		return 0;
+	}
+	if (ringbuf_push(&rf_alarm_queue, pkt->idx) != 0) {
+		return 0;
+	}
+	src->valid = 1;
+	src->boot = alarm.boot;
+	src->seq = alarm.seq;
+	send_ack(alarm.source, MSG_TYPE_ALARM, alarm.seq, alarm.channel);
+	return 1;
+}
+
+/* Queue received values for the UART task and acknowledge them, as for alarms. Stored
+ * values already forwarded are only acknowledged again.
+ * Returns 1 if the packet has been queued, 0 if it must be released. */
+static int handle_values(struct pktbuf* pkt)
+{
+	struct rf_source* src = NULL;
+	spayload_t rec;
+
+	if ((pkt->data[3] & MSG_TYPE_MASK) != MSG_TYPE_STORED) {
+		if (ringbuf_push(&rf_rx_queue, pkt->idx) != 0) {
+			return 0;
+		}
+		send_ack(pkt->data[2], MSG_TYPE_VALUES, 0, 0);
+		return 1;
+	}
+	memcpy(&rec, &pkt->data[2], sizeof(spayload_t));
+	src = rf_source_get(&stored_sources, rec.source);
+	if (src->valid && (src->boot == rec.boot) && (src->seq == rec.seq)) {
+		send_ack(rec.source, MSG_TYPE_STORED, rec.seq, 0);
+		return 0;
+	}
+	if (ringbuf_push(&rf_rx_queue, pkt->idx) != 0) {
+		return 0;
+	}
+	src->valid = 1;
+	src->boot = rec.boot;
+	src->seq = rec.seq;
+	send_ack(rec.source, MSG_TYPE_STORED, rec.seq, 0);
+	return 1;
+}
+
 // Function called when data comes from the radio
 void handle_rf_rx_data(void)
 {
-	uint8_t data[RF_BUFF_LEN];
+	struct pktbuf* pkt = NULL;
+	int ret = 0;
 	uint8_t status = 0;
 
+	pkt = pktpool_alloc(&rf_pkts);
+	if (pkt == NULL) {
+		/* No buffer available, the packet will be flushed from the FIFO */
+		cc1101_flush_rx_fifo();
+		cc1101_enter_rx_mode();
+		return;
+	}
+
 	/* Check for received packet (and get it if any) */
-	cc1101_receive_packet(data, RF_BUFF_LEN, &status);
-	
+	ret = cc1101_receive_packet(pkt->data, RF_BUFF_LEN, &status);
+	TRACE_EVT(TRACE_ID_RF_RX, (((ret & 0xFF) << 8) | pkt->data[2]));
+
 	/* Go back to RX mode */
 	cc1101_enter_rx_mode();
 
@@ -231,90 +452,218 @@ void handle_rf_rx_data(void)
     uprintf(UART0, "RF: ret:%d, st: %d.\n\r", ret, status);
 #endif
 
+    // Address verification, and queue the packet for the UART task
+	pkt->len = (ret > 0) ? ret : 0;
+	if ((ret <= 0) || (pkt->data[1] != MODULE_ADDRESS)) {
+		pktpool_put(&rf_pkts, pkt);
+		return;
+	}
+	if ((pkt->data[3] & (MSG_TYPE_MASK | MSG_FLAG_PRIORITY)) == (MSG_TYPE_ALARM | MSG_FLAG_PRIORITY)) {
+		// Alarms have their own queue, forwarded before any other data
+		if (handle_alarm(pkt)) {
+			sched_post(uart_task_num, UART_EVT_FORWARD);
+			return;
+		}
+	} else if (handle_values(pkt)) {
+		sched_post(uart_task_num, UART_EVT_FORWARD);
+		return;
+	}
+	pktpool_put(&rf_pkts, pkt);
+}
+
+// Forward a received payload on the USB (UART0)
+void forward_rf_rx_data(const uint8_t* payload)
+{
     // We instantate it locally so we don't mess up with volatile data (yet :))
 	vpayload_t received_payload;
 
-    // Address verification
-	if(data[1] == MODULE_ADDRESS)
-	{
-        // We use the led to signal we're handling the data.
-        // However, it barely blinks so it's barely noticeable, but still.
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
+	// We use the led to signal we're handling the data.
+	// However, it barely blinks so it's barely noticeable, but still.
+	gpio_clear(status_led_green);
+	gpio_set(status_led_red);
+
+	// Copy the received data in our own struct so we can handle it better
+	memcpy(&received_payload, payload, sizeof(vpayload_t));
+
+	// I couldn't manage to handle checksum verification in time,
+	// so this is merely a relic from it, unfortunately.
+	char checksumByte[8];
+	snprintf(checksumByte, sizeof(checksumByte), "%c%c%c%c%c%c%c%c",
+		(received_payload.checksum&0x80)?'1':'0',
+		(received_payload.checksum&0x40)?'1':'0',
+		(received_payload.checksum&0x20)?'1':'0',
+		(received_payload.checksum&0x10)?'1':'0',
+		(received_payload.checksum&0x08)?'1':'0',
+		(received_payload.checksum&0x04)?'1':'0',
+		(received_payload.checksum&0x02)?'1':'0',
+		(received_payload.checksum&0x01)?'1':'0'
+	);
+
+	// Sending our sensors values on the USB, which will then
+	// be handled on the Raspberry Pi and then to the app.
+	// Values are in tenths of units.
+	char tmp_str[12], hmd_str[12];
+	snprintf_fixed(tmp_str, sizeof(tmp_str), received_payload.tmp, 1);
+	snprintf_fixed(hmd_str, sizeof(hmd_str), received_payload.hmd, 1);
+	uprintf(UART0, "%s;%d.0;%s;", tmp_str, received_payload.lux, hmd_str);
+
+	// We're done handling the data, so we're resetting the LEDs.
+	gpio_clear(status_led_red);
+	gpio_set(status_led_green);
+}
+
 
-        // Copy the received data in our own struct so we can handle it better
-		memcpy(&received_payload, &data[2], sizeof(vpayload_t));
-		
-        // I couldn't manage to handle checksum verification in time,
-        // so this is merely a relic from it, unfortunately.
-		char checksumByte[8];
-		snprintf(checksumByte, sizeof(checksumByte), "%c%c%c%c%c%c%c%c",
-			(received_payload.checksum&0x80)?'1':'0',
-			(received_payload.checksum&0x40)?'1':'0',
-			(received_payload.checksum&0x20)?'1':'0',
-			(received_payload.checksum&0x10)?'1':'0',
-			(received_payload.checksum&0x08)?'1':'0',
-			(received_payload.checksum&0x04)?'1':'0',
-			(received_payload.checksum&0x02)?'1':'0',
-			(received_payload.checksum&0x01)?'1':'0'
-		);
-
-        // Sending our sensors values on the USB, which will then
-        // be handled on the Raspberry Pi and then to the app.
-		uprintf(UART0, "%d.%d;%d.0;%d.%d;", 
-			received_payload.tmp/10, received_payload.tmp%10,
-			received_payload.lux,
-			received_payload.hmd/10, received_payload.hmd%10);
-
-        // We're done handling the data, so we're resetting the LEDs.
-		gpio_clear(status_led_red);
-		gpio_set(status_led_green);
-	}	   
+// Forward a received alarm on the USB (UART0)
+void forward_alarm(const uint8_t* payload)
+{
+	apayload_t alarm;
+	char value_str[12];
+
+	memcpy(&alarm, payload, sizeof(apayload_t));
+	// Values are in tenths of units, except for luminosity
+	snprintf_fixed(value_str, sizeof(value_str), alarm.value, ((alarm.channel == 'L') ? 0 : 1));
+	uprintf(UART0, "ALM;%c;%d;%s;", alarm.channel, alarm.alarms, value_str);
 }
 
+// Forward values stored by a sensor, "delay" is the time they waited here, in seconds
+void forward_stored(const uint8_t* payload, uint32_t delay)
+{
+	spayload_t rec;
+	vpayload_t values;
 
-/* Data sent on radio comes from the UART, put any data received from UART in
- * cc_tx_buff and send when either '\r' or '\n' is received.
- * This function is very simple and data received between cc_tx flag set and
- * cc_ptr rewind to 0 may be lost. */
-static volatile uint32_t cc_tx = 0;
-static volatile uint8_t cc_tx_buff[RF_BUFF_LEN];
-static volatile uint8_t cc_ptr = 0;
-static volatile unsigned char cc_checksum = 0;
-void handle_uart_cmd(uint8_t c)
+	memcpy(&rec, payload, sizeof(spayload_t));
+	if ((rec.age == STORED_AGE_UNKNOWN) || (delay == STORED_AGE_UNKNOWN)) {
+		uprintf(UART0, "RPL;?;");
+	} else {
+		uprintf(UART0, "RPL;%u;", (rec.age + delay));
+	}
+	values.source = rec.source;
+	values.checksum = 0;
+	values.tmp = rec.tmp;
+	values.hmd = rec.hmd;
+	values.lux = rec.lux;
+	forward_rf_rx_data((uint8_t*)&values);
+}
+
+
+/******************************************************************************/
+/* Store and forward
+ * Store and forward needs the Raspberry Pi to send the "LNK" command periodically. Once
+ * it has been received, and then not received for LINK_TIMEOUT ms, the received readings
+ * are still sent on the UART but also stored on the SD card, and they are replayed once
+ * the link is back, one block every STORE_PERIOD so that live readings keep going through.
+ * Until the first "LNK" the link is considered up, so nothing gets stored for a host
+ * which does not send it.
+ * Replayed records are sent as "RPL;<age>;" followed by the record as sent live. The age
+ * is in seconds. Record timestamps are in ms since boot, so the age is only known for the
+ * records stored since the last reset, and is "?" for the older ones.
+ * Values stored by the sensors are forwarded in the same format, with the age they give
+ * (plus the time they waited here when replayed).
+ * The records waiting in RAM are written to the card every SDLOG_FLUSH_PERIOD ms at
+ * most, to limit the loss on power failure.
+ */
+#define LINK_TIMEOUT  (10 * 1000)
+#define SDLOG_FLUSH_PERIOD  (60 * 1000)
+#define SDLOG_FIRST_BLOCK  2048
+#define SDLOG_NB_BLOCKS    8192  /* 4 MB */
+static uint32_t sdlog_buf[SDLOG_BLOCK_SIZE / 4];
+static struct sdlog rf_log;
+static uint8_t sdlog_ok = 0;
+static uint32_t sdlog_boot_seq = 0;  /* First block written since boot */
+static uint8_t replay_age_known = 0;
+static volatile uint32_t link_last_seen = 0;
+static volatile uint8_t link_seen = 0;
+
+void storage_config(void)
 {
-#ifdef DEBUG
-    uprintf(UART0, "Received command : %c, buffer size: %d.\n\r",c,cc_ptr);
-#endif
+	int i = 0, ret = 0;
 
-	// Data
-	// Most of the data is handled in the main loop, so we just use it as it is
-	// passed here
-	if (cc_ptr < RF_BUFF_LEN)
-	{
-		cc_tx_buff[cc_ptr++] = c;
+	if (sdmmc_init(&sd_card) != 0) {
+		return;
+	}
+	do {
+		msleep(10);
+		ret = sdmmc_init_wait_card_ready(&sd_card);
+	} while ((ret != 0) && (i++ < 100));
+	if ((ret != 0) || (sdmmc_init_end(&sd_card) != 0)) {
+		return;
+	}
+	if (sdlog_init(&rf_log, &sd_card, SDLOG_FIRST_BLOCK, SDLOG_NB_BLOCKS,
+					(uint8_t*)sdlog_buf) == 0) {
+		sdlog_boot_seq = rf_log.head_seq;
+		sdlog_ok = 1;
+	}
+}
+
+static int link_is_up(void)
+{
+	return (!link_seen || ((systick_get_tick_count() - link_last_seen) < LINK_TIMEOUT));
+}
+
+void replay_record(uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	if (len == sizeof(spayload_t)) {
+		forward_stored(data, (replay_age_known ?
+						((systick_get_tick_count() - timestamp) / 1000) : STORED_AGE_UNKNOWN));
+		return;
+	}
+	if ((len != sizeof(vpayload_t)) && (len != sizeof(apayload_t))) {
+		return;
+	}
+	if (replay_age_known) {
+		uprintf(UART0, "RPL;%u;", ((systick_get_tick_count() - timestamp) / 1000));
 	} else {
-		// Reset the pointer
-		cc_ptr = 0;
+		uprintf(UART0, "RPL;?;");
 	}
-	if ((c == '\n') || (c == '\r') || (cc_ptr>=3)) {
-        // Using the leds again to signal we're ready to send
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
+	if (len == sizeof(vpayload_t)) {
+		forward_rf_rx_data(data);
+	} else {
+		forward_alarm(data);
+	}
+}
 
-        // Setting the "please send me" flag
-		cc_tx = 1;
+/* Store task : writes the stored readings to the card and replays them */
+void store_task(uint32_t events)
+{
+	static uint32_t last_flush = 0;
+	uint32_t now = systick_get_tick_count();
+
+	if (sdlog_ok == 0) {
+		return;
+	}
+	if (!link_is_up()) {
+		if ((now - last_flush) >= SDLOG_FLUSH_PERIOD) {
+			sdlog_flush(&rf_log);
+			last_flush = now;
+		}
+		return;
+	}
+	if (sdlog_flush(&rf_log) == 0) {
+		/* Blocks from sdlog_boot_seq on have been written since boot */
+		replay_age_known = ((int32_t)(rf_log.tail_seq - sdlog_boot_seq) >= 0);
+		sdlog_replay(&rf_log, replay_record);
+	}
+	last_flush = now;
+}
 
-        // Resetting the pointer
-		cc_ptr = 0;
 
-        // Resetting the leds
-		gpio_clear(status_led_red);
-		gpio_set(status_led_green);
+/* Data sent on radio comes from the UART. Commands are made of three chars, and any
+ * data received from UART is queued in uart_rx until the radio task gets to handle it.
+ * End of line chars resynchronise the commands. */
+#define CMD_LEN  3
+RINGBUF_DECLARE(uart_rx, 32);
+static volatile unsigned char cc_checksum = 0;
+void handle_uart_cmd(uint8_t c)
+{
+	// Bytes which do not fit are dropped and counted by the ring buffer
+	ringbuf_push(&uart_rx, c);
+	if ((c == '\n') || (c == '\r') || (ringbuf_count(&uart_rx) >= CMD_LEN)) {
+		// Asking the radio task to handle the command
+		sched_post(rf_task_num, RF_EVT_TX);
 	}
 }
 
-void send_on_rf(void)
+void send_on_rf(const uint8_t* cmd)
 {
 	uint8_t cc_tx_data[sizeof(opayload_t) + 2];
 	int ret = 0;
@@ -323,9 +672,9 @@ void send_on_rf(void)
 	/* Create a local copy */
 	// Source address
 	opayload.source = MODULE_ADDRESS;
-	opayload.first = cc_tx_buff[0];
-	opayload.second = cc_tx_buff[1];
-	opayload.third = cc_tx_buff[2];
+	opayload.first = cmd[0];
+	opayload.second = cmd[1];
+	opayload.third = cmd[2];
 
     // Preparing our packet by copying our payload inside
     // 0 and 1 indexes are for length and destination, respectively
@@ -341,6 +690,7 @@ void send_on_rf(void)
 	if (cc1101_tx_fifo_state() != 0) {
 		cc1101_flush_tx_fifo();
 	}
+	TRACE_EVT(TRACE_ID_RF_TX, ((cc_tx_data[0] << 8) | cc_tx_data[1]));
 	ret = cc1101_send_packet(cc_tx_data, (sizeof(opayload_t) + 2));
 	if(ret < 0)
 	{
@@ -355,57 +705,132 @@ void send_on_rf(void)
 #endif
 }
 
+/**************************************************************************** */
+/* Radio task : handles received packets and UART commands, and keeps the radio in RX
+ * state. */
+void rf_task(uint32_t events)
+{
+	static uint8_t cmd[CMD_LEN];
+	static uint8_t cmd_len = 0;
+	uint8_t status = 0;
+	uint8_t c = 0;
+
+	/* Get commands received on UART */
+	while (ringbuf_pop(&uart_rx, &c) == 0) {
+		if ((c == '\n') || (c == '\r')) {
+			cmd_len = 0;
+			continue;
+		}
+		cmd[cmd_len++] = c;
+		if ((cmd_len == CMD_LEN) && (strncmp((char*)cmd, "TRC", CMD_LEN) == 0)) {
+			// Trace dump request (build with TRACE_ENABLE=1), not for the sensors
+			sched_post(uart_task_num, UART_EVT_TRACE);
+			cmd_len = 0;
+		} else if ((cmd_len == CMD_LEN) && (strncmp((char*)cmd, "LNK", CMD_LEN) == 0)) {
+			// Raspberry Pi link keep-alive, not for the sensors
+			link_last_seen = systick_get_tick_count();
+			link_seen = 1;
+			cmd_len = 0;
+		} else if (cmd_len == CMD_LEN) {
+#ifdef DEBUG
+			uprintf(UART0, "Received command : %c%c%c.\n\r", cmd[0], cmd[1], cmd[2]);
+#endif
+			// Using the leds again to signal we're sending
+			gpio_clear(status_led_green);
+			gpio_set(status_led_red);
+			send_on_rf(cmd);
+			gpio_clear(status_led_red);
+			gpio_set(status_led_green);
+			cmd_len = 0;
+		}
+	}
+
+	/* Do not leave radio in an unknown or unwated state */
+	do
+	{
+		status = (cc1101_read_status() & CC1101_STATE_MASK);
+	} while (status == CC1101_STATE_TX);
+
+	if (status != CC1101_STATE_RX) {
+		static uint8_t loop = 0;
+		loop++;
+		if (loop > 10)
+		{
+			if (cc1101_rx_fifo_state() != 0)
+			{
+				cc1101_flush_rx_fifo();
+			}
+			cc1101_enter_rx_mode();
+			loop = 0;
+		}
+	}
+
+	if (events & RF_EVT_RX) {
+		handle_rf_rx_data();
+	}
+}
+
+/* UART task : forwards the received packets on the USB. Waiting alarms are forwarded
+ * before each values packet, including the ones received while forwarding. */
+void uart_task(uint32_t events)
+{
+	uint8_t idx = 0;
+
+	while (1) {
+		struct pktbuf* pkt = NULL;
+		uint8_t len = 0;
+		if (ringbuf_pop(&rf_alarm_queue, &idx) == 0) {
+			pkt = pktpool_buf(&rf_pkts, idx);
+			len = sizeof(apayload_t);
+			forward_alarm(&pkt->data[2]);
+		} else if (ringbuf_pop(&rf_rx_queue, &idx) == 0) {
+			pkt = pktpool_buf(&rf_pkts, idx);
+			if ((pkt->data[3] & MSG_TYPE_MASK) == MSG_TYPE_STORED) {
+				len = sizeof(spayload_t);
+				forward_stored(&pkt->data[2], 0);
+			} else {
+				len = sizeof(vpayload_t);
+				forward_rf_rx_data(&pkt->data[2]);
+			}
+		} else {
+			break;
+		}
+		if (sdlog_ok && !link_is_up()) {
+			sdlog_append(&rf_log, systick_get_tick_count(), &pkt->data[2], len);
+		}
+		pktpool_put(&rf_pkts, pkt);
+	}
+	if (events & UART_EVT_TRACE) {
+		trace_drain(UART0);
+	}
+#ifdef DEBUG
+	uprintf(UART0, "RF packets: %d/%d used, %d failures.\n\r",
+			rf_pkts.high_water, RF_NB_PKTS, rf_pkts.alloc_failures);
+#endif
+}
+
 /**************************************************************************** */
 int main(void)
 {
 	// Setup phase
 	system_init();
+	rf_task_num = sched_add_task(rf_task, RF_TASK_PRIO);
+	sched_set_timer(rf_task_num, RF_CHECK_PERIOD, RF_CHECK_PERIOD);
+	uart_task_num = sched_add_task(uart_task, UART_TASK_PRIO);
+	store_task_num = sched_add_task(store_task, STORE_TASK_PRIO);
+	sched_set_timer(store_task_num, STORE_PERIOD, STORE_PERIOD);
 	uart_on(UART0, 115200, handle_uart_cmd);
 	i2c_on(I2C0, I2C_CLK_100KHz, I2C_MASTER);
 	ssp_master_on(0, LPC_SSP_FRAME_SPI, 8, 4*1000*1000); /* bus_num, frame_type, data_width, rate */
 
+	/* Store and forward. Done first to get the card chip select inactive. */
+	storage_config();
 	/* Radio */
 	rf_config();
 
 	// When everything is up and running, we use the green LED
 	gpio_set(status_led_green);
 
-	while (1)
-	{
-		uint8_t status = 0;
-
-		/* RF */
-		if (cc_tx == 1) 
-		{
-			send_on_rf();
-			cc_tx = 0;
-		}
-
-		/* Do not leave radio in an unknown or unwated state */
-		do
-		{
-			status = (cc1101_read_status() & CC1101_STATE_MASK);
-		} while (status == CC1101_STATE_TX);
-
-		if (status != CC1101_STATE_RX) {
-			static uint8_t loop = 0;
-			loop++;
-			if (loop > 10)
-			{
-				if (cc1101_rx_fifo_state() != 0)
-				{
-					cc1101_flush_rx_fifo();
-				}
-				cc1101_enter_rx_mode();
-				loop = 0;
-			}
-		}
-
-		if (check_rx == 1)
-		{
-			handle_rf_rx_data();
-			check_rx = 0;
-		}
-	}
+	sched_run();
 	return 0;
-}
\ No newline at end of file
+}
@@ -28,8 +28,18 @@
 
 #include "core/system.h"
 #include "core/systick.h"
+#include "core/scheduler.h"
+#include "drivers/timers.h"
 #include "core/pio.h"
+#include "core/iap.h"
 #include "lib/stdio.h"
+#include "lib/pktpool.h"
+#include "lib/prof.h"
+#include "lib/trace.h"
+#include "lib/errno.h"
+#include "lib/flashlog.h"
+#include "lib/filter.h"
+#include "lib/alarm.h"
 #include "drivers/serial.h"
 #include "drivers/gpio.h"
 #include "drivers/ssp.h"
@@ -38,6 +48,7 @@
 #include "drivers/adc.h"
 #include "extdrv/cc1101.h"
 #include "extdrv/status_led.h"
+#include "extdrv/sensor.h"
 #include "extdrv/bme280_humidity_sensor.h"
 #include "extdrv/ssd130x_oled_driver.h"
 #include "extdrv/ssd130x_oled_buffer.h"
@@ -73,6 +84,7 @@
 #define ERROR_TSL256X_READ	11
 #define ERROR_BME280_CONFIG   20
 #define ERROR_BME280_READ	 21
+#define ERROR_VEML6070_READ   25
 
 // Communication errors go from 30-39
 #define ERROR_CC1101_SEND	 30
@@ -87,11 +99,27 @@
 // Part ID is 0x3640c02b
 // UID: 0x0211f5f5 - 0x4e434314 - 0x00393536 - 0x54002249
 
-// Initialize the sensors values
+// Initialize the sensors values (pressure in Pa)
 uint16_t uv = 0, ir = 0, humidity = 0;
 uint32_t pressure = 0, temp = 0, lux = 0;
 
-static volatile uint32_t update_display = 0;
+/* Tasks : the radio has the highest priority so that RX latency only depends on the
+ * duration of the longest sensors or display task run. */
+#define RF_TASK_PRIO       0
+#define SENSORS_TASK_PRIO  1
+#define DISPLAY_TASK_PRIO  2
+static int rf_task_num = -1;
+static int display_task_num = -1;
+static int sensors_task_num = -1;
+
+/* Tasks events */
+#define RF_EVT_RX          (0x01 << 0)
+#define RF_EVT_TX          (0x01 << 1)
+#define RF_EVT_DRAIN       (0x01 << 2)
+#define RF_EVT_ALARM       (0x01 << 3)
+#define DISPLAY_EVT_FRAME  (0x01 << 0)
+#define SENSORS_EVT_PROF   (0x01 << 0)
+#define SENSORS_EVT_TRACE  (0x01 << 1)
 
 /***************************************************************************** */
 /* Pins configuration */
@@ -145,7 +173,7 @@ void system_init()
 
 	/* System tick timer MUST be configured and running in order to use the sleeping
 	 * functions */
-	systick_timer_on(1); /* 1ms */
+	systick_tickless_on(LPC_TIMER_32B1); /* 1ms, wakes up on deadlines only */
 	systick_start();
 
 	// // Clearing the LEDs
@@ -160,7 +188,14 @@ void system_init()
 /* Adafruit Oled Display */
 
 #define DISPLAY_ADDR 0x7A
-static uint8_t gddram[ 4 + GDDRAM_SIZE ];
+// Called from the I2C interrupt when a display page has been sent
+void display_frame_notify(void)
+{
+	sched_post(display_task_num, DISPLAY_EVT_FRAME);
+}
+
+static uint8_t gddram[ SSD130x_BUFFER_SIZE ];
+static uint8_t frame_buff[ SSD130x_FRAME_BUFF_SIZE ];
 struct oled_display display = {
 	.bus_type = SSD130x_BUS_I2C,
 	.address = DISPLAY_ADDR,
@@ -174,46 +209,39 @@ struct oled_display display = {
 	.display_offset_dir = SSD130x_MOVE_TOP,
 	.display_offset = 4,
 	.gddram = gddram,
+	.async = 1,
+	.frame_buff = frame_buff,
+	.frame_notify = display_frame_notify,
 };
 
 #define ROW(x) VERTICAL_REV(x)
 DECLARE_FONT(font);
 
+// Text layer over the display buffer, only changed characters get rendered
+struct ssd130x_text_layer text = {
+	.gddram = gddram,
+	.font = font,
+};
+
 // Displays a char, mostly useless by itself, but can be used
 void display_char(uint8_t line, uint8_t col, uint8_t c)
 {
-	uint8_t tile = (c > FIRST_FONT_CHAR) ? (c - FIRST_FONT_CHAR) : 0;
-	uint8_t* tile_data = (uint8_t*)(&font[tile]);
-	ssd130x_buffer_set_tile(gddram, col, line, tile_data);
+	ssd130x_text_putc(&text, line, col, c);
 }
 
 // Function we'll use to display a line on the Adafruit screen, most od the time
-int display_line(uint8_t line, uint8_t col, char* text)
+int display_line(uint8_t line, uint8_t col, char* data)
 {
-	int len = strlen((char*)text);
-	int i = 0;
-
-	for (i = 0; i < len; i++) {
-		uint8_t tile = (text[i] > FIRST_FONT_CHAR) ? (text[i] - FIRST_FONT_CHAR) : 0;
-		uint8_t* tile_data = (uint8_t*)(&font[tile]);
-		ssd130x_buffer_set_tile(gddram, col++, line, tile_data);
-		if (col >= (SSD130x_NB_COL / 8)) {
-			col = 0;
-			line++;
-			if (line >= SSD130x_NB_PAGES) {
-				return i;
-			}
-		}
-	}
-	return len;
+	return ssd130x_text_puts(&text, line, col, data);
 }
 
-/***************************************************************************** */
-void periodic_display(uint32_t tick)
+// Reset the screen error line
+void clear_error_line(void)
 {
-	update_display = 1;
+	ssd130x_text_clear(&text, 7, 0, (SSD130x_NB_COL / 8));
 }
 
+
 /***************************************************************************** */
 /* Luminosity */
 
@@ -225,52 +253,11 @@ struct tsl256x_sensor_config tsl256x_sensor = {
 	.gain = TSL256x_LOW_GAIN,
 	.integration_time = TSL256x_INTEGRATION_100ms,
 	.package = TSL256x_PACKAGE_T,
+	.one_shot = 1,
+	.auto_range = 1,
+	.range = 1,
 };
 
-// Luminosity sensor setup
-void lux_config(int uart_num)
-{
-	int ret = 0;
-	ret = tsl256x_configure(&tsl256x_sensor);
-	if (ret != 0) {
-		// If the sensor couldn't be initialized, we warn the user
-		// by displaying a message and lighting the red led up
-		char data[20];
-		snprintf(data, 20, "ERROR: %d - %d", ERROR_TSL265X_CONFIG, ret);
-		display_line(7, 0, data);
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
-	}
-}
-
-// Reading the luminosity sensor
-void lux_display(int uart_num, uint16_t* ir, uint32_t* lux)
-{
-	uint16_t comb = 0;
-	int ret = 0;
-
-	ret = tsl256x_sensor_read(&tsl256x_sensor, &comb, ir, lux);
-	if (ret != 0)
-	{
-		// Error display again
-		char data[20];
-		snprintf(data, 20, "ERROR: %d - %d", ERROR_TSL256X_READ, ret);
-		display_line(7, 0, data);
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
-	}
-	else
-	{
-		// If now everything works fine (e.g. we fix the problem)
-		gpio_clear(status_led_red);
-		gpio_set(status_led_green);
-		// Reset the screen error line
-		char data[20];
-		snprintf(data, 20, "				");
-		display_line(7, 0, data);
-	}
-}
-
 /***************************************************************************** */
 /* BME280 Sensor */
 
@@ -283,85 +270,30 @@ struct bme280_sensor_config bme280_sensor =
 	.humidity_oversampling = BME280_OS_x16,
 	.temp_oversampling = BME280_OS_x16,
 	.pressure_oversampling = BME280_OS_x16,
-	.mode = BME280_NORMAL,
+	.mode = BME280_FORCED,
 	.standby_len = BME280_SB_62ms,
 	.filter_coeff = BME280_FILT_OFF,
 };
 
-// Humidity and temperature sensors setup
-void bme_config(int uart_num)
-{
-	int ret = 0;
-	ret = bme280_configure(&bme280_sensor);
-	if (ret != 0)
-	{
-		// Error display
-		char data[20];
-		snprintf(data, 20, "ERROR: %d - %d", ERROR_BME280_CONFIG, ret);
-		display_line(7, 0, data);
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
-	}
-	else
-	{
-		// If everything works fine
-		gpio_clear(status_led_red);
-		gpio_set(status_led_green);
-		// Reset the screen error line
-		char data[20];
-		snprintf(data, 20, "				");
-		display_line(7, 0, data);
-	}
-}
-
-/* BME will obtain temperature, pressure and humidity values */
-// Pressure isn't used in our application, but it might be in the future.
-void bme_display(int uart_num, uint32_t* pressure, uint32_t* temp, uint16_t* humidity)
-{
-	int ret = 0;
-	ret = bme280_sensor_read(&bme280_sensor, pressure, temp, humidity);
-	if(ret != 0)
-	{
-		// Error display
-		char data[20];
-		snprintf(data, 20, "ERROR: %d - %d", ERROR_BME280_READ, ret);
-		display_line(7, 0, data);
-		gpio_clear(status_led_green);
-		gpio_set(status_led_red);
-	}
-	else
-	{
-		// Values compensation
-		int comp_temp = 0;
-		uint32_t comp_pressure = 0;
-		uint32_t comp_humidity = 0;
-		comp_temp = bme280_compensate_temperature(&bme280_sensor, *temp)/10;
-		comp_pressure = bme280_compensate_pressure(&bme280_sensor, *pressure)/100;
-		comp_humidity = bme280_compensate_humidity(&bme280_sensor, *humidity)/10;
-		*temp = comp_temp;
-		*pressure = comp_pressure;
-		*humidity = comp_humidity;
+/***************************************************************************** */
+/* VEML6070 UV Sensor */
 
-		// If now everything works fine (e.g. we fix the problem)
-		gpio_clear(status_led_red);
-		gpio_set(status_led_green);
-		// Reset the screen error line
-		char data[20];
-		snprintf(data, 20, "				");
-		display_line(7, 0, data);
-	}
-}
+/* Note : 8bits address */
+#define VEML6070_ADDR 0x70
+struct veml6070_sensor_config veml6070_sensor = {
+	.bus_num = I2C0,
+	.addr = VEML6070_ADDR,
+};
 
 
 /******************************************************************************/
 /* RF Communication */
 #define RF_BUFF_LEN	64
 
-// Flag set when we receive data from the rf we have to handle
-static volatile int check_rx = 0;
+// Wake up the radio task when we receive data from the rf we have to handle
 void rf_rx_calback(uint32_t gpio)
 {
-	check_rx = 1;
+	sched_post(rf_task_num, RF_EVT_RX);
 }
 
 static uint8_t rf_specific_settings[] = {
@@ -424,18 +356,73 @@ typedef struct opayload_t
 	char third;
 } opayload_t;
 
+/* Message types, in the two high bits of the second payload byte : the checksum byte
+ * for values (always 00 there) and the first letter for order requests ('H', 'L' and 'T'
+ * are all 01). Alarms are sent with the priority flag. The receptor acknowledges alarms,
+ * values and stored values with the same type and the ACK flag. */
+#define MSG_TYPE_MASK      (0x03 << 6)
+#define MSG_TYPE_VALUES    (0x00 << 6)
+#define MSG_TYPE_ORDER     (0x01 << 6)
+#define MSG_TYPE_ALARM     (0x02 << 6)
+#define MSG_TYPE_STORED    (0x03 << 6)
+#define MSG_FLAG_PRIORITY  (0x01 << 5)
+#define MSG_FLAG_ACK       (0x01 << 4)
+
+// Alarms raised on the sensors values, sent as soon as they are raised
+typedef struct apayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;      // Alarm number, echoed in the acknowledge
+	char channel;     // 'T', 'H' or 'L', as for the display order
+	uint8_t alarms;   // ALARM_* conditions raised
+	uint8_t boot;     // Tells the receptor that alarm numbers restarted
+	int32_t value;    // Value which raised the alarm
+} apayload_t;
+
+// Values which were not acknowledged, stored and sent again once the receptor answers
+typedef struct spayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;      // Record number, echoed in the acknowledge
+	uint8_t boot;     // Tells the receptor that record numbers restarted
+	uint32_t age;     // Seconds since the reading, STORED_AGE_UNKNOWN if not known
+	uint32_t tmp;
+	uint16_t hmd;
+	uint32_t lux;
+} spayload_t;
+#define STORED_AGE_UNKNOWN  0xFFFFFFFF
+
+// Acknowledges from the receptor
+typedef struct kpayload_t
+{
+	char source;
+	char type;
+	uint8_t seq;
+	char channel;
+} kpayload_t;
+
 // This will be used to store data from the sensors before sending it through rf
 static volatile vpayload_t cc_tx_vpayload;
 
-// Function called when data comes from the radio
-void handle_rf_rx_data(void)
+static void alarm_ack(const kpayload_t* ack);
+static void values_ack(void);
+static void stored_ack(const kpayload_t* ack);
+
+// Radio packets buffers, used for both RX and TX
+#define RF_NB_PKTS  2
+PKTPOOL_DECLARE(rf_pkts, RF_NB_PKTS, RF_BUFF_LEN);
+
+// Handle a packet coming from the radio, using "data" as buffer
+void handle_rf_rx_packet(uint8_t* data)
 {
-	uint8_t data[RF_BUFF_LEN];
 	int8_t ret = 0;
 	uint8_t status = 0;
 
 	/* Check for received packet (and get it if any) */
 	ret = cc1101_receive_packet(data, RF_BUFF_LEN, &status);
+	TRACE_EVT(TRACE_ID_RF_RX, (((ret & 0xFF) << 8) | data[2]));
 	if(ret < 0)
 	{
 		// Error display
@@ -455,6 +442,26 @@ void handle_rf_rx_data(void)
 	// Storing the order locally so we don't mess up with volatile variables
 	opayload_t rec_order_payload;
 
+	// Acknowledges (order requests are all type 01, whatever their ACK bit)
+	if ((ret > 0) && (data[1] == MODULE_ADDRESS) && (data[3] & MSG_FLAG_ACK) &&
+			((data[3] & MSG_TYPE_MASK) != MSG_TYPE_ORDER))
+	{
+		kpayload_t ack;
+		memcpy(&ack, &data[2], sizeof(kpayload_t));
+		switch (ack.type & MSG_TYPE_MASK) {
+			case MSG_TYPE_ALARM:
+				alarm_ack(&ack);
+				break;
+			case MSG_TYPE_VALUES:
+				values_ack();
+				break;
+			case MSG_TYPE_STORED:
+				stored_ack(&ack);
+				break;
+		}
+		return;
+	}
+
 	// Address verification
 	if(data[1] == MODULE_ADDRESS)
 	{
@@ -520,50 +527,97 @@ void handle_rf_rx_data(void)
 	}
 }
 
+// Function called when data comes from the radio
+void handle_rf_rx_data(void)
+{
+	struct pktbuf* pkt = pktpool_alloc(&rf_pkts);
+
+	if (pkt == NULL) {
+		/* No buffer available, drop the packet */
+		cc1101_flush_rx_fifo();
+		cc1101_enter_rx_mode();
+		return;
+	}
+	handle_rf_rx_packet(pkt->data);
+	pktpool_put(&rf_pkts, pkt);
+}
+
 
-/* Data sent on radio comes from the UART, put any data received from UART in
- * cc_tx_buff and send when either '\r' or '\n' is received.
- * This function is very simple and data received between cc_tx flag set and
- * cc_ptr rewind to 0 may be lost. */
-static volatile uint32_t cc_tx = 0;
-static volatile uint8_t cc_tx_buff[RF_BUFF_LEN];
-static volatile uint8_t cc_ptr = 0;
+/* Data sent on radio comes from the sensors, the UART data itself is not used. An end
+ * of line received on UART only triggers sending the last values. */
 static volatile unsigned char cc_checksum = 0;
 
 // Deprecated, since the microcontroller doesn't receive data from the UART anymore
 void handle_uart_cmd(uint8_t c)
 {
-	if (cc_ptr < RF_BUFF_LEN) {
-		cc_tx_buff[cc_ptr++] = c;
-	} else {
-		// Reset the pointer
-		cc_ptr = 0;
-	}
 	if ((c == '\n') || (c == '\r')) {
-		cc_ptr = 0;
-		cc_tx = 1;
+		sched_post(rf_task_num, RF_EVT_TX);
+	} else if (c == 'p') {
+		/* Dump and reset the profiling statistics (build with PROF_ENABLE=1) */
+		sched_post(sensors_task_num, SENSORS_EVT_PROF);
+	} else if (c == 't') {
+		/* Send the binary events trace (build with TRACE_ENABLE=1) */
+		sched_post(sensors_task_num, SENSORS_EVT_TRACE);
 	}
 }
 
-// Sending data on the radio
-void send_on_rf(void)
+/* The receptor acknowledges each reading. A reading still not acknowledged when the next
+ * one is sent got lost (receptor out of range or off), and is stored in the last two
+ * sectors of the internal flash, one every FLASHLOG_SAMPLE_PERIOD lost readings.
+ * Once the receptor acknowledges a reading again, at most FLASHLOG_DRAIN_BATCH stored
+ * readings are sent, each one after the acknowledge of the previous one, as "stored
+ * values" packets holding their age. A stored reading is removed from flash when it is
+ * acknowledged, and sent again with the same number after the next acknowledged
+ * reading otherwise, so the receptor can drop the copies it already got.
+ * Flash writes are limited to one every 5 minutes (about 11 readings per write), which
+ * gives close to 3 hours of readings. The log is not used if the program gets over the
+ * log sectors. Readings timestamps are in ms since boot, so the age is only known for
+ * the readings stored since the last reset. */
+#define FLASHLOG_START        (6 * LPC12XX_SECTOR_SIZE)
+#define FLASHLOG_NB_SECTORS   2
+#define FLASHLOG_MIN_INTERVAL (5 * 60 * 1000)
+#define FLASHLOG_SAMPLE_PERIOD  30
+#define FLASHLOG_DRAIN_BATCH    8
+static struct flashlog rf_log;
+static uint8_t flashlog_ok = 0;
+static uint32_t flashlog_boot_seq = 0;  /* First unit written since boot */
+static uint8_t drain_left = 0;
+static uint8_t sample = 0;
+/* Last reading sent, until acknowledged */
+static vpayload_t values_last;
+static uint32_t values_last_tick = 0;
+static uint8_t values_wait = 0;
+/* Stored reading sent, until acknowledged */
+static spayload_t stored_rec;
+static uint32_t stored_tick = 0;
+static uint8_t stored_wait = 0;
+static uint8_t stored_seq = 0;
+static uint8_t stored_boot = 0;
+static uint8_t stored_boot_set = 0;
+
+void flashlog_config(void)
 {
-	uint8_t cc_tx_data[RF_BUFF_LEN + 2];
-	uint8_t tx_len = sizeof(vpayload_t);
+	if (flashlog_init(&rf_log, FLASHLOG_START, FLASHLOG_NB_SECTORS, FLASHLOG_MIN_INTERVAL) == 0) {
+		flashlog_boot_seq = rf_log.head_seq;
+		flashlog_ok = 1;
+	}
+}
+
+// Sending a payload on the radio
+static int send_payload(const uint8_t* payload, uint8_t tx_len)
+{
+	struct pktbuf* pkt = NULL;
+	uint8_t* cc_tx_data = NULL;
 	int ret = 0;
 
-	/* Create a local copy */
-	vpayload_t vpayload;
-	vpayload.source = cc_tx_vpayload.source;
-	vpayload.checksum = cc_tx_vpayload.checksum;
-	vpayload.tmp = cc_tx_vpayload.tmp;
-	vpayload.lux = cc_tx_vpayload.lux;
-	vpayload.hmd = cc_tx_vpayload.hmd;
+	pkt = pktpool_alloc(&rf_pkts);
+	if (pkt == NULL) {
+		return -ENOMEM;
+	}
+	cc_tx_data = pkt->data;
 
 	// Copy our structure into the packet we're going to send
-	memcpy((char*)&(cc_tx_data[2]), &vpayload, sizeof(vpayload_t));
-	/* "Free" the rx buffer as soon as possible */
-	cc_ptr = 0;
+	memcpy((char*)&(cc_tx_data[2]), payload, tx_len);
 	/* Prepare buffer for sending */
 	// Length
 	cc_tx_data[0] = tx_len + 1;
@@ -575,7 +629,143 @@ void send_on_rf(void)
 		cc1101_flush_tx_fifo();
 	}
 
+	TRACE_EVT(TRACE_ID_RF_TX, ((cc_tx_data[0] << 8) | cc_tx_data[1]));
 	ret = cc1101_send_packet(cc_tx_data, (tx_len + 2));
+	pktpool_put(&rf_pkts, pkt);
+	return ret;
+}
+
+/* Drain callback : copy the oldest stored reading in stored_rec, and keep it in the log
+ * until it is acknowledged. */
+static int stored_peek(uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	vpayload_t values;
+
+	if (len != sizeof(vpayload_t)) {
+		return 0; /* Drop it */
+	}
+	memcpy(&values, data, sizeof(vpayload_t));
+	/* Record numbers restart from 0 after a reset, as for the alarms. The boot number is
+	 *   only taken once, as the first record may be sent again. */
+	if (stored_boot_set == 0) {
+		stored_boot = (uint8_t)systick_get_clock_cycles();
+		stored_boot_set = 1;
+	}
+	stored_rec.source = MODULE_ADDRESS;
+	stored_rec.type = MSG_TYPE_STORED;
+	stored_rec.seq = stored_seq;
+	stored_rec.boot = stored_boot;
+	/* Units from flashlog_boot_seq on (and the RAM buffer) have been written since boot */
+	if ((int32_t)(rf_log.tail_seq - flashlog_boot_seq) >= 0) {
+		stored_rec.age = ((systick_get_tick_count() - timestamp) / 1000);
+	} else {
+		stored_rec.age = STORED_AGE_UNKNOWN;
+	}
+	stored_rec.tmp = values.tmp;
+	stored_rec.hmd = values.hmd;
+	stored_rec.lux = values.lux;
+	stored_tick = timestamp;
+	stored_wait = 1;
+	return -EAGAIN;
+}
+
+/* Drain callback : remove the acknowledged reading, unless the log lost it meanwhile
+ * (its sector got erased) and the oldest reading is now another one. */
+static int stored_remove(uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	vpayload_t values;
+
+	if ((len != sizeof(vpayload_t)) || (timestamp != stored_tick)) {
+		return -EAGAIN;
+	}
+	memcpy(&values, data, sizeof(vpayload_t));
+	if ((values.tmp != stored_rec.tmp) || (values.hmd != stored_rec.hmd) ||
+			(values.lux != stored_rec.lux)) {
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+// Send the oldest stored reading, the next one is sent once it is acknowledged
+static void send_stored(void)
+{
+	int ret = 0;
+
+	flashlog_drain(&rf_log, 1, stored_peek);
+	if (stored_wait == 0) {
+		/* Invalid record dropped, or nothing left */
+		if (flashlog_pending(&rf_log)) {
+			sched_post(rf_task_num, RF_EVT_DRAIN);
+		}
+		return;
+	}
+	ret = send_payload((uint8_t*)&stored_rec, sizeof(spayload_t));
+	if (ret < 0) {
+		char data[20];
+		snprintf(data, 20, "ERROR: %d - %d", ERROR_CC1101_SEND, ret);
+		display_line(7, 0, data);
+	}
+#ifdef DEBUG
+	uprintf(UART0, "Stored %d sent: %d, age %u\n\r", stored_rec.seq, ret, stored_rec.age);
+#endif
+}
+
+// Called by the radio task when a stored reading acknowledge is received
+static void stored_ack(const kpayload_t* ack)
+{
+	if ((stored_wait == 0) || (ack->seq != stored_rec.seq)) {
+		return; /* Acknowledge of a reading already acknowledged */
+	}
+	stored_wait = 0;
+	stored_seq++;
+	flashlog_drain(&rf_log, 1, stored_remove);
+	if (drain_left != 0) {
+		drain_left--;
+	}
+	if ((drain_left != 0) && flashlog_pending(&rf_log)) {
+		sched_post(rf_task_num, RF_EVT_DRAIN);
+	}
+}
+
+// Called by the radio task when a reading acknowledge is received
+static void values_ack(void)
+{
+	values_wait = 0;
+	sample = 0;
+	if (flashlog_ok && flashlog_pending(&rf_log)) {
+		/* The receptor answers again, send some stored values. A stored reading still
+		 *   waiting lost its acknowledge, and is sent again. */
+		drain_left = FLASHLOG_DRAIN_BATCH;
+		stored_wait = 0;
+		sched_post(rf_task_num, RF_EVT_DRAIN);
+	}
+}
+
+// Sending the last sensors values on the radio
+void send_on_rf(void)
+{
+	int ret = 0;
+
+	if (values_wait) {
+		// The last values were not acknowledged, keep some of them for later
+		if (flashlog_ok && (sample++ == 0)) {
+			flashlog_append(&rf_log, values_last_tick, (uint8_t*)&values_last, sizeof(vpayload_t));
+		}
+		if (sample >= FLASHLOG_SAMPLE_PERIOD) {
+			sample = 0;
+		}
+	}
+
+	/* Create a local copy */
+	values_last.source = cc_tx_vpayload.source;
+	values_last.checksum = cc_tx_vpayload.checksum;
+	values_last.tmp = cc_tx_vpayload.tmp;
+	values_last.lux = cc_tx_vpayload.lux;
+	values_last.hmd = cc_tx_vpayload.hmd;
+	values_last_tick = systick_get_tick_count();
+	values_wait = 1;
+
+	ret = send_payload((uint8_t*)&values_last, sizeof(vpayload_t));
 	if(ret < 0)
 	{
 		// Error display
@@ -587,231 +777,475 @@ void send_on_rf(void)
 	}
 
 #ifdef DEBUG
-	uprintf(UART0, "Tx ret: %d\n\r", ret);
+	uprintf(UART0, "Tx ret: %d, RF packets: %d/%d used\n\r", ret, rf_pkts.high_water, RF_NB_PKTS);
 #endif
 }
 
-/**************************************************************************** */
-int main(void)
+/* Alarms : sent as soon as they are raised, before any values waiting to be sent, and
+ * sent again until the receptor acknowledges them. The retry delay doubles on each
+ * retry, from ALARM_RETRY_MIN up to ALARM_RETRY_MAX ms, to leave some room on the radio
+ * for other nodes when the receptor is not there. Alarms are sent in order, and new
+ * alarms are lost (and counted) when ALARM_QUEUE_LEN alarms are already waiting. */
+#define ALARM_QUEUE_LEN   4  /* Power of two */
+#define ALARM_RETRY_MIN   100
+#define ALARM_RETRY_MAX   3200
+static apayload_t alarm_queue[ALARM_QUEUE_LEN];
+static uint8_t alarm_head = 0;
+static uint8_t alarm_nb = 0;
+static uint8_t alarm_seq = 0;
+static uint8_t alarm_boot = 0;
+static uint16_t alarm_retry = ALARM_RETRY_MIN;
+static uint32_t alarms_lost = 0;
+
+static void alarm_raise(char channel, uint8_t alarms, int32_t value)
 {
-	int ret = 0;
-	system_init();
-	uart_on(UART0, 115200, handle_uart_cmd);
-	i2c_on(I2C0, I2C_CLK_100KHz, I2C_MASTER);
-	ssp_master_on(0, LPC_SSP_FRAME_SPI, 8, 4*1000*1000); /* bus_num, frame_type, data_width, rate */
-
-	/* Sensors config */
-	bme_config(UART0);
-	lux_config(UART0);
+	apayload_t* alarm = NULL;
 
-	/* Radio */
-	rf_config();
+	if (alarm_nb >= ALARM_QUEUE_LEN) {
+		alarms_lost++;
+		return;
+	}
+	/* Alarm numbers restart from 0 after a reset : change the boot number along, so that
+	 *   the receptor does not take the new alarms for ones it already got. It is taken
+	 *   from the cycles counter when the first alarm is raised, which does not depend on
+	 *   the start-up sequence (changing it again when the numbers wrap does no harm). */
+	if (alarm_seq == 0) {
+		alarm_boot = (uint8_t)systick_get_clock_cycles();
+	}
+	alarm = &alarm_queue[(alarm_head + alarm_nb) & (ALARM_QUEUE_LEN - 1)];
+	alarm->source = MODULE_ADDRESS;
+	alarm->type = (MSG_TYPE_ALARM | MSG_FLAG_PRIORITY);
+	alarm->seq = alarm_seq++;
+	alarm->channel = channel;
+	alarm->alarms = alarms;
+	alarm->boot = alarm_boot;
+	alarm->value = value;
+	if (alarm_nb++ == 0) {
+		alarm_retry = ALARM_RETRY_MIN;
+		sched_post(rf_task_num, RF_EVT_ALARM);
+	}
+}
 
-	/* Configure and start display */
-	ret = ssd130x_display_on(&display);
-	/* Clear screen */
-	ssd130x_buffer_set(gddram, 0x00);
-	ret = ssd130x_display_full_screen(&display);
+// Called by the radio task when an acknowledge is received
+static void alarm_ack(const kpayload_t* ack)
+{
+	if ((alarm_nb == 0) || (ack->seq != alarm_queue[alarm_head].seq)) {
+		return; /* Acknowledge of an alarm already acknowledged */
+	}
+	alarm_head = (alarm_head + 1) & (ALARM_QUEUE_LEN - 1);
+	alarm_nb--;
+	alarm_retry = ALARM_RETRY_MIN;
+	if (alarm_nb != 0) {
+		sched_post(rf_task_num, RF_EVT_ALARM);
+	} else {
+		sched_cancel_timer(rf_task_num);
+	}
+}
 
+// Send the oldest alarm and plan its retry
+static void send_alarm(void)
+{
+	int ret = 0;
 
-	/* Flag to set to 1 when we go above 1000 lx */
-	int biglux = 0;
+	ret = send_payload((uint8_t*)&alarm_queue[alarm_head], sizeof(apayload_t));
+	if (ret < 0) {
+		char data[20];
+		snprintf(data, 20, "ERROR: %d - %d", ERROR_CC1101_SEND, ret);
+		display_line(7, 0, data);
+	}
+	sched_set_timer(rf_task_num, alarm_retry, 0);
+	if (alarm_retry < ALARM_RETRY_MAX) {
+		alarm_retry <<= 1;
+	}
+#ifdef DEBUG
+	uprintf(UART0, "Alarm %d sent: %d, %d waiting, %d lost\n\r", alarm_queue[alarm_head].seq,
+			ret, alarm_nb, alarms_lost);
+#endif
+}
 
-	/* Add periodic handler */
-	add_systick_callback(periodic_display, 250);
+/**************************************************************************** */
+/* Radio task : handles received packets, sends the alarms and the sensors values and
+ * keeps the radio in RX state. */
+void rf_task(uint32_t events)
+{
+	uint8_t status = 0;
 
-	// When everything is up and running, we use the green LED
-	gpio_set(status_led_green);
+	if (events & RF_EVT_RX) {
+		handle_rf_rx_data();
+	}
+	if ((events & (RF_EVT_ALARM | SCHED_EVT_TIMER)) && (alarm_nb != 0)) {
+		/* Alarms go first, values are sent on the next run, once the alarm is gone */
+		send_alarm();
+		if (events & (RF_EVT_TX | RF_EVT_DRAIN)) {
+			sched_post(rf_task_num, (events & (RF_EVT_TX | RF_EVT_DRAIN)));
+		}
+	} else if (events & RF_EVT_TX) {
+		send_on_rf();
+	} else if ((events & RF_EVT_DRAIN) && (drain_left != 0) && (stored_wait == 0)) {
+		/* One stored reading at a time, the next one once it is acknowledged */
+		send_stored();
+	}
 
-	while (1)
+	/* Do not leave radio in an unknown or unwated state */
+	do
 	{
-		uint8_t status = 0;
-
-		/* Read the sensors */
-		bme_display(UART0, &pressure, &temp, &humidity);
-		lux_display(UART0, &ir, &lux);
+		status = (cc1101_read_status() & CC1101_STATE_MASK);
+	} while (status == CC1101_STATE_TX);
 
-		/* Display */
-		if (update_display == 1)
+	if (status != CC1101_STATE_RX) {
+		static uint8_t loop = 0;
+		loop++;
+		if (loop > 10)
 		{
-			char data[20];
-
-			/* Update display */
-			// If the luminosity is too big, we display it using kilolux
-			if(lux > 1000)
-				biglux = 1;
-			else
-				biglux = 0;
-
-			// Preparing what we want to display
-			snprintf(data, 20, "TMP: %d.%d	dC", temp/10, temp%10);
-			// ... and displaying it.
-			display_line(tmppos, 0, data);
-			if(biglux)
-				snprintf(data, 20, "LUX: %d.0 klx", (lux/1000)/*, (lux/1000)%10*/);
-			else
-				snprintf(data, 20, "LUX: %d.0 lx	 ", lux/*, lux%10*/);
-			display_line(luxpos, 0, data);
-			snprintf(data, 20, "HMD: %d.%d	rH", humidity/10, humidity%10);
-			display_line(hmdpos, 0, data);
-
-			// Send to screen 
-			ret = ssd130x_display_full_screen(&display);
-			if(ret < 0)
-			{
-				// In case the screen fails, we display it on... the screen.
-				// That aside, we also set the red led, so it's not totally stupid.
-				char data[20];
-				snprintf(data, 20, "ERROR: %d - %d", ERROR_DISPLAY_FAILURE, ret);
-				display_line(7, 0, data);
-				gpio_clear(status_led_green);
-				gpio_set(status_led_red);
-			}
-			else
+			if (cc1101_rx_fifo_state() != 0)
 			{
-				// If now everything works fine (e.g. we fix the problem)
-				gpio_clear(status_led_red);
-				gpio_set(status_led_green);
-				// Reset the screen error line
-				char data[20];
-				snprintf(data, 20, "				");
-				display_line(7, 0, data);
+				cc1101_flush_rx_fifo();
 			}
-			update_display = 0;
+			cc1101_enter_rx_mode();
+			loop = 0;
 		}
+	}
+}
 
-		// We forge the 4th byte of our header here as it is easier to handle
-		// than in handle_uart_cmd
-		//
-		// The first 2 bits are for the type of message: 00 for values, 01 for 
-		// format change request, 10 and 11 for keys exchange (not available)
-		// Since the sensors will only send values, it is always 00.
-		char checksumByte[8];
-		checksumByte[0] = '0';
-		checksumByte[1] = '0';
-
-		// For parity bit and division checksum calculation
-		// This is super long, ugly and there's probably an easier way to do it,
-		// but I don't really have the time by now, unfortunately
-		//
-		// Temperature
-		if((temp/10)%2 == 0)
-		{
-			checksumByte[2] = '0';
-			checksumByte[3] = '1';
-		}
-		else if((temp/10)%3 == 0)
-		{
-			checksumByte[2] = '1';
-			checksumByte[3] = '0';
-		}
-		else if((temp/10)%5 == 0)
-		{
-			checksumByte[2] = '1';
-			checksumByte[3] = '1';
-		}
-		else
-		{
-			checksumByte[2] = '0';
-			checksumByte[3] = '0';
-		}
+/* Display task : renders the values every 250ms and moves the display frames forward */
+void display_task(uint32_t events)
+{
+	int ret = 0;
 
-		// Lux
-		if(lux%2 == 0)
-		{
-			checksumByte[4] = '0';
-			checksumByte[5] = '1';
-		}
-		else if(lux%3 == 0)
-		{
-			checksumByte[4] = '1';
-			checksumByte[5] = '0';
-		}
-		else if(lux%5 == 0)
-		{
-			checksumByte[4] = '1';
-			checksumByte[5] = '1';
-		}
-		else
-		{
-			checksumByte[4] = '0';
-			checksumByte[5] = '0';
-		}
+	if (events & DISPLAY_EVT_FRAME) {
+		ret = ssd130x_frame_poll(&display);
+	}
 
-		// Humidity
-		if((humidity/10)%2 == 0)
-		{
-			checksumByte[6] = '0';
-			checksumByte[7] = '1';
-		}
-		else if((humidity/10)%3 == 0)
-		{
-			checksumByte[6] = '1';
-			checksumByte[7] = '0';
-		}
-		else if((humidity/10)%5 == 0)
-		{
-			checksumByte[6] = '1';
-			checksumByte[7] = '1';
-		}
+	if (events & SCHED_EVT_TIMER)
+	{
+		/* Flag to set to 1 when we go above 1000 lx */
+		int biglux = 0;
+
+		/* Update display */
+		// If the luminosity is too big, we display it using kilolux
+		if(lux > 1000)
+			biglux = 1;
 		else
-		{
-			checksumByte[6] = '0';
-			checksumByte[7] = '0';
+			biglux = 0;
+
+		// Only the values fields get updated, labels and units do not
+		// change unless the lines order changed.
+		display_line(tmppos, 0, "TMP:");
+		ssd130x_text_fixed(&text, tmppos, 4, 6, (int32_t)temp, 1);
+		display_line(tmppos, 10, " dC   ");
+		display_line(luxpos, 0, "LUX:");
+		if(biglux) {
+			ssd130x_text_fixed(&text, luxpos, 4, 6, (lux / 100), 1);
+			display_line(luxpos, 10, " klx  ");
+		} else {
+			ssd130x_text_fixed(&text, luxpos, 4, 6, lux, 0);
+			display_line(luxpos, 10, " lx   ");
 		}
+		display_line(hmdpos, 0, "HMD:");
+		ssd130x_text_fixed(&text, hmdpos, 4, 6, humidity, 1);
+		display_line(hmdpos, 10, " rH   ");
+
+		// Send modified parts to screen. The frame goes on while we do
+		// other things, and if the previous one is not done yet the
+		// changes will simply be part of the next one.
+		ret = ssd130x_frame_start(&display);
+	}
 
-		// Good, now we have our char containing our byte in string form.
-		// Let's convert it to a proper 8 bit unsigned char.
-
-		// BIT OPERATIONS MAGIC
-		cc_checksum = 0;
-		for (int i = 0; i < 8; ++i )
-			cc_checksum |= (checksumByte[i] == '1') << (7 - i);
+	// A frame still being sent is not an error
+	if ((ret == -EAGAIN) || (ret == -EBUSY))
+		ret = 0;
+	if(ret < 0)
+	{
+		// In case the screen fails, we display it on... the screen.
+		// That aside, we also set the red led, so it's not totally stupid.
+		char data[20];
+		snprintf(data, 20, "ERROR: %d - %d", ERROR_DISPLAY_FAILURE, ret);
+		display_line(7, 0, data);
+		gpio_clear(status_led_green);
+		gpio_set(status_led_red);
+	}
+	else if (events & SCHED_EVT_TIMER)
+	{
+		// If now everything works fine (e.g. we fix the problem)
+		gpio_clear(status_led_red);
+		gpio_set(status_led_green);
+		// Reset the screen error line
+		clear_error_line();
+	}
+}
 
-		/* RF */
-		cc_tx_vpayload.source = MODULE_ADDRESS;
-		cc_tx_vpayload.checksum = cc_checksum;
-		cc_tx_vpayload.tmp = temp;
-		cc_tx_vpayload.lux = lux;
-		cc_tx_vpayload.hmd = humidity;
+/* Sensors values conditioning : each sensor is read every second, and the filtered
+ * values are sent only when one of them changed by more than its deadband, or after
+ * SENSORS_MAX_SILENCE seconds without sending. Spikes are removed by a median of 3 and the
+ * noise by an average over about 4 values, restarted on fast changes ("step").
+ * Temperature and humidity are in tenths of degree and percent, luminosity in lux. */
+#define SENSORS_MAX_SILENCE  60
+/*                                  oversample, median, ewma, step, deadband, silence */
+static struct filter_channel temp_filter = FILTER_CHANNEL(0, 3, 2, 10, 2, SENSORS_MAX_SILENCE);
+static struct filter_channel hmd_filter = FILTER_CHANNEL(0, 3, 2, 30, 5, SENSORS_MAX_SILENCE);
+static struct filter_channel lux_filter = FILTER_CHANNEL(0, 3, 2, 100, 10, SENSORS_MAX_SILENCE);
+static int sensors_report = 0;
+
+/* Alarms on the filtered values : temperature above 40.0 or below 0.0 degrees, or rising
+ * by more than 2.0 degrees in a minute, and humidity above 90.0 % or rising by more than
+ * 10.0 % in a minute. */
+#define ALARM_RATE_PERIOD  (60 * 1000)
+/*                                 conditions, low, high, hysteresis, rate, period */
+static struct alarm_channel temp_alarm = ALARM_CHANNEL((ALARM_HIGH | ALARM_LOW | ALARM_RISE),
+											0, 400, 10, 20, ALARM_RATE_PERIOD);
+static struct alarm_channel hmd_alarm = ALARM_CHANNEL((ALARM_HIGH | ALARM_RISE),
+											0, 900, 20, 100, ALARM_RATE_PERIOD);
+
+static void check_alarm(struct alarm_channel* al, char channel, int32_t value)
+{
+	uint8_t alarms = alarm_check(al, value, systick_get_tick_count());
+	if (alarms != 0) {
+		alarm_raise(channel, alarms, value);
+	}
+}
 
-		// We set the "please send me" flag
-		cc_tx = 1;
+/* Called by sensors_poll() with the new values of a sensor */
+static void handle_sensor_values(struct sensor* sensor, const struct sensor_values* values)
+{
+	int i = 0;
 
-		if (cc_tx == 1) 
-		{
-			send_on_rf();
-			cc_tx = 0;
+	for (i = 0; i < values->nb; i++) {
+		int32_t val = values->value[i];
+		switch (values->quantity[i]) {
+			case SENSOR_TEMPERATURE:
+				sensors_report |= filter_push(&temp_filter, val);
+				temp = filter_value(&temp_filter);
+				check_alarm(&temp_alarm, 'T', temp);
+				break;
+			case SENSOR_HUMIDITY:
+				sensors_report |= filter_push(&hmd_filter, val);
+				humidity = filter_value(&hmd_filter);
+				check_alarm(&hmd_alarm, 'H', humidity);
+				break;
+			case SENSOR_LIGHT:
+				sensors_report |= filter_push(&lux_filter, val);
+				lux = filter_value(&lux_filter);
+				break;
+			case SENSOR_PRESSURE:
+				pressure = val;
+				break;
+			case SENSOR_INFRARED:
+				ir = val;
+				break;
+			case SENSOR_UV:
+				uv = val;
+				break;
 		}
+	}
+}
 
-		/* Do not leave radio in an unknown or unwated state */
-		do
-		{
-			status = (cc1101_read_status() & CC1101_STATE_MASK);
-		} while (status == CC1101_STATE_TX);
+/* The sensors of the node. Sensors which are not found are probed again from time to
+ * time, so the same image works with any of these sensors.
+ * The BME280 (FORCED mode) and TSL256x (one shot) conversions are started together for
+ * each read, and the sensors sleep between two reads. */
+#define SENSORS_PERIOD  1000
+static struct sensor node_sensors[] = {
+	SENSOR(&bme280_sensor_ops, &bme280_sensor, SENSORS_PERIOD, handle_sensor_values),
+	SENSOR(&tsl256x_sensor_ops, &tsl256x_sensor, SENSORS_PERIOD, handle_sensor_values),
+	SENSOR(&veml6070_sensor_ops, &veml6070_sensor, SENSORS_PERIOD, handle_sensor_values),
+};
+static const uint8_t node_sensors_errors[] = {
+	ERROR_BME280_READ,
+	ERROR_TSL256X_READ,
+	ERROR_VEML6070_READ,
+};
+#define NB_NODE_SENSORS  (sizeof(node_sensors) / sizeof(node_sensors[0]))
 
-		if (status != CC1101_STATE_RX) {
-			static uint8_t loop = 0;
-			loop++;
-			if (loop > 10)
-			{
-				if (cc1101_rx_fifo_state() != 0)
-				{
-					cc1101_flush_rx_fifo();
-				}
-				cc1101_enter_rx_mode();
-				loop = 0;
-			}
-		}
+void sensors_config(void)
+{
+	unsigned int i = 0;
+	for (i = 0; i < NB_NODE_SENSORS; i++) {
+		sensor_register(&node_sensors[i]);
+	}
+}
 
-		if (check_rx == 1)
-		{
-			handle_rf_rx_data();
-			check_rx = 0;
+/* Display the error of the first failing sensor, if any */
+static void sensors_errors_display(void)
+{
+	unsigned int i = 0;
+
+	for (i = 0; i < NB_NODE_SENSORS; i++) {
+		if (node_sensors[i].last_error != 0) {
+			char data[20];
+			snprintf(data, 20, "ERROR: %d - %d", node_sensors_errors[i], node_sensors[i].last_error);
+			display_line(7, 0, data);
+			gpio_clear(status_led_green);
+			gpio_set(status_led_red);
+			return;
 		}
-		
-		// We add a delay not to flood the frequency and also the receptors
-		msleep(1000);
 	}
+	// If now everything works fine (e.g. we fix the problem)
+	gpio_clear(status_led_red);
+	gpio_set(status_led_green);
+	// Reset the screen error line
+	clear_error_line();
+}
+
+/* Sensors task : polls the sensors and sends the values on the radio when needed */
+void sensors_task(uint32_t events)
+{
+	if (events & SENSORS_EVT_PROF) {
+		prof_dump(UART0);
+		prof_reset();
+	}
+	if (events & SENSORS_EVT_TRACE) {
+		trace_drain(UART0);
+	}
+	if (!(events & SCHED_EVT_TIMER)) {
+		return;
+	}
+	PROF_ENTER(sensors_task);
+
+	/* Read and filter the sensors values */
+	sensors_report = 0;
+	sched_set_timer(sensors_task_num, sensors_poll(), 0);
+	sensors_errors_display();
+	if (!(sensors_report & FILTER_REPORT)) {
+		PROF_EXIT(sensors_task);
+		return;
+	}
+
+	// We forge the 4th byte of our header here as it is easier to handle
+	// than in handle_uart_cmd
+	//
+	// The first 2 bits are for the type of message: 00 for values, 01 for 
+	// format change request, 10 for alarms and 11 for stored values.
+	// Since these are live values, it is always 00.
+	char checksumByte[8];
+	checksumByte[0] = '0';
+	checksumByte[1] = '0';
+
+	// For parity bit and division checksum calculation
+	// This is super long, ugly and there's probably an easier way to do it,
+	// but I don't really have the time by now, unfortunately
+	//
+	// Temperature
+	if((temp/10)%2 == 0)
+	{
+		checksumByte[2] = '0';
+		checksumByte[3] = '1';
+	}
+	else if((temp/10)%3 == 0)
+	{
+		checksumByte[2] = '1';
+		checksumByte[3] = '0';
+	}
+	else if((temp/10)%5 == 0)
+	{
+		checksumByte[2] = '1';
+		checksumByte[3] = '1';
+	}
+	else
+	{
+		checksumByte[2] = '0';
+		checksumByte[3] = '0';
+	}
+
+	// Lux
+	if(lux%2 == 0)
+	{
+		checksumByte[4] = '0';
+		checksumByte[5] = '1';
+	}
+	else if(lux%3 == 0)
+	{
+		checksumByte[4] = '1';
+		checksumByte[5] = '0';
+	}
+	else if(lux%5 == 0)
+	{
+		checksumByte[4] = '1';
+		checksumByte[5] = '1';
+	}
+	else
+	{
+		checksumByte[4] = '0';
+		checksumByte[5] = '0';
+	}
+
+	// Humidity
+	if((humidity/10)%2 == 0)
+	{
+		checksumByte[6] = '0';
+		checksumByte[7] = '1';
+	}
+	else if((humidity/10)%3 == 0)
+	{
+		checksumByte[6] = '1';
+		checksumByte[7] = '0';
+	}
+	else if((humidity/10)%5 == 0)
+	{
+		checksumByte[6] = '1';
+		checksumByte[7] = '1';
+	}
+	else
+	{
+		checksumByte[6] = '0';
+		checksumByte[7] = '0';
+	}
+
+	// Good, now we have our char containing our byte in string form.
+	// Let's convert it to a proper 8 bit unsigned char.
+
+	// BIT OPERATIONS MAGIC
+	cc_checksum = 0;
+	for (int i = 0; i < 8; ++i )
+		cc_checksum |= (checksumByte[i] == '1') << (7 - i);
+
+	/* RF */
+	cc_tx_vpayload.source = MODULE_ADDRESS;
+	cc_tx_vpayload.checksum = cc_checksum;
+	cc_tx_vpayload.tmp = temp;
+	cc_tx_vpayload.lux = lux;
+	cc_tx_vpayload.hmd = humidity;
+
+	// We ask the radio task to send the values
+	sched_post(rf_task_num, RF_EVT_TX);
+	PROF_EXIT(sensors_task);
+
+#ifdef DEBUG
+	uprintf(UART0, "Wakeups: %d/s\n\r", systick_get_wakeups_per_second());
+#endif
+}
+
+/**************************************************************************** */
+int main(void)
+{
+	system_init();
+	uart_on(UART0, 115200, handle_uart_cmd);
+	i2c_on(I2C0, I2C_CLK_100KHz, I2C_MASTER);
+	ssp_master_on(0, LPC_SSP_FRAME_SPI, 8, 4*1000*1000); /* bus_num, frame_type, data_width, rate */
+
+	/* Tasks, must be registered before enabling the interrupts which post events */
+	rf_task_num = sched_add_task(rf_task, RF_TASK_PRIO);
+	display_task_num = sched_add_task(display_task, DISPLAY_TASK_PRIO);
+	sensors_task_num = sched_add_task(sensors_task, SENSORS_TASK_PRIO);
+	sched_set_timer(sensors_task_num, 0, 0);
+	sched_set_timer(display_task_num, 250, 250);
+
+	/* Sensors, configured on the first poll */
+	sensors_config();
+
+	/* Radio */
+	rf_config();
+	flashlog_config();
+
+	/* Configure and start display */
+	ssd130x_display_on(&display);
+	/* Clear screen */
+	ssd130x_buffer_set(gddram, 0x00);
+	ssd130x_text_invalidate(&text);
+	ssd130x_display_full_screen(&display);
+
+	// When everything is up and running, we use the green LED
+	gpio_set(status_led_green);
+
+	sched_run();
 	return 0;
-}
\ No newline at end of file
+}
@@ -29,6 +29,8 @@
  *****************************************************************************/
 
 
+#include "core/system.h"
+
 extern unsigned int _end_stack;
 extern unsigned int _end_text;
 extern unsigned int _start_data;
@@ -148,6 +150,11 @@ void Reset_Handler(void) {
 	while (dst < &_end_bss)
 		*dst++ = 0;
 
+	/* Paint the stack area (below our own stack frame) for get_stack_min_free() */
+	src = (unsigned int*)(get_main_stack_pointer() - STACK_PAINT_MARGIN);
+	while (dst < src)
+		*dst++ = STACK_PAINT_VALUE;
+
 	/* Initialize rom based division helpers */
 	rom_helpers_init();
 	/* Start main programm */
@@ -28,6 +28,8 @@
 
 
 #include "lib/stdint.h"
+#include "core/system.h"
+#include "core/lpc_core.h"
 #include "core/crc_engine.h"
 
 
@@ -39,6 +41,7 @@ void crc_config(uint8_t poly, uint32_t seed, uint8_t data_mode, uint8_t sum_mode
 {
 	struct lpc_crc_engine* crc_ctrl = LPC_CRC_ENGINE;
 
+	subsystem_power(LPC_SYS_ABH_CLK_CTRL_CRC, 1);
 	crc_ctrl->mode = ((poly & 0x03) | (data_mode & 0x0C) | (sum_mode & 0x30));
 	crc_ctrl->seed = seed;
 	crc_seed = seed;
@@ -64,5 +67,26 @@ void crc_add(uint32_t value)
 	crc_ctrl->sum = value;
 }
 
-
-
+/* Bytes are written one at a time up to the first word boundary and for the tail, and
+ * words in between. The engine handles the most significant byte of a written word first,
+ * so words are byte swapped to keep the bytes order. */
+void crc_add_buffer(const uint8_t* buf, uint32_t len)
+{
+	struct lpc_crc_engine* crc_ctrl = LPC_CRC_ENGINE;
+	volatile uint8_t* data8 = (volatile uint8_t*)&(crc_ctrl->data);
+	const uint32_t* buf32 = NULL;
+
+	while ((len != 0) && ((uint32_t)buf & 0x03)) {
+		*data8 = *buf++;
+		len--;
+	}
+	buf32 = (const uint32_t*)buf;
+	while (len >= 4) {
+		crc_ctrl->data = byte_swap_32(*buf32++);
+		len -= 4;
+	}
+	buf = (const uint8_t*)buf32;
+	while (len--) {
+		*data8 = *buf++;
+	}
+}
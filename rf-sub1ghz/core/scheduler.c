@@ -0,0 +1,216 @@
+/****************************************************************************
+ *  core/scheduler.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+
+/***************************************************************************** */
+/*               Tasks scheduler                                               */
+/***************************************************************************** */
+
+/* Cooperative run-to-completion tasks scheduler.
+ * A task is in the ready queue of its priority level if and only if it has pending events.
+ */
+
+#include "core/system.h"
+#include "core/systick.h"
+#include "core/scheduler.h"
+#include "lib/errno.h"
+
+
+struct sched_task {
+	void (*handler)(uint32_t);
+	volatile uint32_t events;
+	uint32_t deadline;
+	uint32_t period;
+	uint8_t prio;
+	uint8_t timer_on;
+};
+
+/* One FIFO per priority level. Each task can be queued only once. */
+struct sched_queue {
+	uint8_t tasks[SCHED_MAX_TASKS];
+	uint8_t head;
+	uint8_t nb;
+};
+
+static struct sched_task tasks[SCHED_MAX_TASKS];
+static uint8_t nb_tasks = 0;
+static struct sched_queue ready[SCHED_NB_PRIORITIES];
+/* One bit per non-empty ready queue */
+static volatile uint32_t ready_mask = 0;
+
+/* No deadline : keep the wakeup tick far enough to remain valid for signed comparisons */
+#define SCHED_NO_DEADLINE  0x7FFFFFFF
+
+
+/* Must be called with interrupts disabled */
+static void sched_enqueue(uint8_t task_num)
+{
+	uint8_t prio = tasks[task_num].prio;
+	struct sched_queue* q = &(ready[prio]);
+	uint8_t idx = q->head + q->nb;
+
+	if (idx >= SCHED_MAX_TASKS) {
+		idx -= SCHED_MAX_TASKS;
+	}
+	q->tasks[idx] = task_num;
+	q->nb++;
+	ready_mask |= (0x01 << prio);
+}
+
+/* Must be called with interrupts disabled, and with at least one task ready */
+static uint8_t sched_dequeue(void)
+{
+	struct sched_queue* q = NULL;
+	uint8_t prio = 0;
+	uint8_t task_num = 0;
+
+	while ((ready_mask & (0x01 << prio)) == 0) {
+		prio++;
+	}
+	q = &(ready[prio]);
+	task_num = q->tasks[q->head];
+	q->head++;
+	if (q->head >= SCHED_MAX_TASKS) {
+		q->head = 0;
+	}
+	q->nb--;
+	if (q->nb == 0) {
+		ready_mask &= ~(0x01 << prio);
+	}
+	return task_num;
+}
+
+
+int sched_add_task(void (*handler)(uint32_t), uint8_t prio)
+{
+	struct sched_task* task = NULL;
+
+	if ((handler == NULL) || (prio >= SCHED_NB_PRIORITIES)) {
+		return -EINVAL;
+	}
+	if (nb_tasks >= SCHED_MAX_TASKS) {
+		return -ENOMEM;
+	}
+	task = &(tasks[nb_tasks]);
+	task->handler = handler;
+	task->prio = prio;
+	task->events = 0;
+	task->timer_on = 0;
+	return nb_tasks++;
+}
+
+int sched_post(int task, uint32_t events)
+{
+	if ((task < 0) || (task >= nb_tasks) || (events == 0)) {
+		return -EINVAL;
+	}
+	lpc_disable_irq();
+	if (tasks[task].events == 0) {
+		sched_enqueue(task);
+	}
+	tasks[task].events |= events;
+	lpc_enable_irq();
+	return 0;
+}
+
+int sched_set_timer(int task, uint32_t ms, uint32_t period)
+{
+	uint32_t tick_ms = systick_get_tick_ms_period();
+
+	if ((task < 0) || (task >= nb_tasks)) {
+		return -EINVAL;
+	}
+	if (tick_ms > 1) {
+		ms = ms / tick_ms;
+		period = period / tick_ms;
+	}
+	if ((ms >= SCHED_NO_DEADLINE) || (period >= SCHED_NO_DEADLINE)) {
+		return -EINVAL;
+	}
+	tasks[task].deadline = systick_get_tick_count() + ms;
+	tasks[task].period = period;
+	tasks[task].timer_on = 1;
+	return 0;
+}
+
+int sched_cancel_timer(int task)
+{
+	if ((task < 0) || (task >= nb_tasks)) {
+		return -EINVAL;
+	}
+	tasks[task].timer_on = 0;
+	return 0;
+}
+
+
+/* Post SCHED_EVT_TIMER to the tasks which reached their deadline, and return the nearest
+ * deadline. Timers are only handled from the scheduler loop, so no locking is needed. */
+static uint32_t sched_check_timers(void)
+{
+	uint32_t now = systick_get_tick_count();
+	uint32_t next = now + SCHED_NO_DEADLINE;
+	int i = 0;
+
+	for (i = 0; i < nb_tasks; i++) {
+		struct sched_task* task = &(tasks[i]);
+		if (task->timer_on == 0) {
+			continue;
+		}
+		if ((int32_t)(now - task->deadline) >= 0) {
+			sched_post(i, SCHED_EVT_TIMER);
+			if (task->period == 0) {
+				task->timer_on = 0;
+				continue;
+			}
+			task->deadline += task->period;
+			/* Do not try to catch up missed periods */
+			if ((int32_t)(now - task->deadline) >= 0) {
+				task->deadline = now + task->period;
+			}
+		}
+		if ((int32_t)(task->deadline - next) < 0) {
+			next = task->deadline;
+		}
+	}
+	return next;
+}
+
+void sched_run(void)
+{
+	uint32_t next = 0;
+	uint32_t events = 0;
+	uint8_t task_num = 0;
+
+	while (1) {
+		next = sched_check_timers();
+
+		lpc_disable_irq();
+		if (ready_mask == 0) {
+			/* Nothing to do, sleep until an interrupt or the nearest deadline */
+			systick_wait_for_interrupt(next);
+			lpc_enable_irq();
+			continue;
+		}
+		task_num = sched_dequeue();
+		events = tasks[task_num].events;
+		tasks[task_num].events = 0;
+		lpc_enable_irq();
+
+		tasks[task_num].handler(events);
+	}
+}
@@ -350,3 +350,31 @@ static inline void def_usleep(uint32_t us)
 void msleep(uint32_t ms) __attribute__ ((weak, alias ("def_msleep")));
 void usleep(uint32_t us) __attribute__ ((weak, alias ("def_usleep")));
 
+
+
+/***************************************************************************** */
+/*                    Memory usage                                             */
+/***************************************************************************** */
+extern unsigned int _end_stack;
+extern unsigned int _start_data;
+extern unsigned int _end_data;
+extern unsigned int _start_bss;
+extern unsigned int _end_bss;
+
+/* Look for the first overwritten word of the stack area, starting from the bottom. */
+uint32_t get_stack_min_free(void)
+{
+	unsigned int* ptr = &_end_bss;
+	while ((ptr < &_end_stack) && (*ptr == STACK_PAINT_VALUE)) {
+		ptr++;
+	}
+	return ((uint32_t)ptr - (uint32_t)&_end_bss);
+}
+
+void get_memory_usage(struct memory_usage* usage)
+{
+	usage->data_size = (uint32_t)&_end_data - (uint32_t)&_start_data;
+	usage->bss_size = (uint32_t)&_end_bss - (uint32_t)&_start_bss;
+	usage->stack_size = (uint32_t)&_end_stack - (uint32_t)&_end_bss;
+	usage->stack_min_free = get_stack_min_free();
+}
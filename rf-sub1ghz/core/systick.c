@@ -30,6 +30,9 @@
 #include "core/system.h"
 #include "core/systick.h"
 #include "lib/errno.h"
+#include "drivers/timers.h"
+#include "drivers/countertimers.h"
+#include "lib/trace.h"
 
 
 /* Static variables */
@@ -43,12 +46,28 @@ static uint32_t usleep_us_count = 0;
 static volatile uint32_t global_wrapping_system_ticks = 0;
 /* The systick cycles run at get_main_clock(), and would wrap more often! */
 static volatile uint32_t global_wrapping_system_clock_cycles = 0;
+/* Upper 32 bits of the clock cycles count, for systick_get_clock_cycles_64() */
+static volatile uint32_t global_clock_cycles_wraps = 0;
+
+
+/* Wakeups measurement */
+static volatile uint32_t wakeups = 0;
+static uint32_t wakeups_window_start = 0;
+static uint32_t wakeups_rate = 0;
+
+/* Tickless mode */
+static volatile uint32_t tickless = 0;
+static struct lpc_timer* tickless_timer = NULL;
+static uint8_t tickless_timer_num = 0;
+static volatile uint32_t tickless_sleeping = 0;
+static volatile uint32_t tickless_sleep_deadline = 0;
 
 
 struct systick_callback {
 	void (*callback) (uint32_t);
 	uint16_t period;
 	uint16_t countdown;
+	uint32_t deadline; /* Used in tickless mode only */
 };
 static volatile struct systick_callback cbs[MAX_SYSTICK_CALLBACKS] = {};
 
@@ -56,8 +75,18 @@ static volatile struct systick_callback cbs[MAX_SYSTICK_CALLBACKS] = {};
 void SysTick_Handler(void)
 {
 	int i = 0;
-	global_wrapping_system_ticks++;
+	TRACE_ENTER_ISR(TRACE_ID_SYSTICK);
+	wakeups++;
+	if ((global_wrapping_system_clock_cycles + tick_reload) < global_wrapping_system_clock_cycles) {
+		global_clock_cycles_wraps++;
+	}
 	global_wrapping_system_clock_cycles += tick_reload;
+	if (tickless == 1) {
+		/* Only used as clock cycles counter in tickless mode */
+		TRACE_EXIT_ISR(TRACE_ID_SYSTICK);
+		return;
+	}
+	global_wrapping_system_ticks++;
 	if (sleep_count != 0) {
 		sleep_count--;
 	}
@@ -70,9 +99,84 @@ void SysTick_Handler(void)
 			}
 		}
 	}
+	TRACE_EXIT_ISR(TRACE_ID_SYSTICK);
 }
 
 
+/***************************************************************************** */
+/* Tickless mode
+ * The system tick count is the counter of a 32 bits counter timer running at 1KHz, and
+ *   the match channel 0 of this timer is programmed for the next deadline only (nearest
+ *   callback or end of msleep()), so the CPU is not woken up every ms for nothing.
+ * The system tick timer itself is only used to count clock cycles (for usleep() and
+ *   systick_get_clock_cycles()) and interrupts only when wrapping, which is less than
+ *   twice per second.
+ */
+
+/* No deadline : keep the match far enough to remain valid for signed comparisons */
+#define TICKLESS_NO_DEADLINE  0x7FFFFFFF
+
+/* Program the match register for the nearest deadline.
+ * Must be called with interrupts disabled (or from the timer interrupt).
+ */
+static void tickless_program_next(void)
+{
+	uint32_t now = tickless_timer->timer_counter;
+	uint32_t next = now + TICKLESS_NO_DEADLINE;
+	int i = 0;
+
+	for (i = 0; i < MAX_SYSTICK_CALLBACKS; i++) {
+		if ((cbs[i].callback != NULL) && ((int32_t)(cbs[i].deadline - next) < 0)) {
+			next = cbs[i].deadline;
+		}
+	}
+	if ((tickless_sleeping == 1) && ((int32_t)(tickless_sleep_deadline - next) < 0)) {
+		next = tickless_sleep_deadline;
+	}
+	tickless_timer->match_reg[0] = next;
+	/* The deadline may have been reached while we were computing it, in which case the
+	 * match would only occur after the counter wrapped. One tick is far longer than
+	 * these few instructions, so the next tick is safe. */
+	now = tickless_timer->timer_counter;
+	if ((int32_t)(next - now) <= 0) {
+		tickless_timer->match_reg[0] = now + 1;
+	}
+}
+
+/* Tickless timer match interrupt : call the callbacks which reached their deadline */
+static void tickless_handler(uint32_t flags)
+{
+	uint32_t now = tickless_timer->timer_counter;
+	int i = 0;
+
+	wakeups++;
+	for (i = 0; i < MAX_SYSTICK_CALLBACKS; i++) {
+		if ((cbs[i].callback != NULL) && ((int32_t)(now - cbs[i].deadline) >= 0)) {
+			cbs[i].deadline += cbs[i].period;
+			/* Do not try to catch up missed periods */
+			if ((int32_t)(now - cbs[i].deadline) >= 0) {
+				cbs[i].deadline = now + cbs[i].period;
+			}
+			cbs[i].callback(now);
+		}
+	}
+	tickless_program_next();
+}
+
+/* Restart the tickless timer counter from 0, moving the callbacks deadlines accordingly */
+static void tickless_restart(void)
+{
+	int i = 0;
+
+	lpc_disable_irq();
+	timer_restart(tickless_timer_num);
+	for (i = 0; i < MAX_SYSTICK_CALLBACKS; i++) {
+		cbs[i].deadline = cbs[i].period;
+	}
+	tickless_program_next();
+	lpc_enable_irq();
+}
+
 /* Register a callback to be called every 'period' system ticks.
  * returns the callback number if registration was OK.
  * returns negative value on error.
@@ -87,9 +191,17 @@ int add_systick_callback(void (*callback) (uint32_t), uint16_t period)
 	}
 	for (i = 0; i < MAX_SYSTICK_CALLBACKS; i++) {
 		if (cbs[i].callback == NULL) {
-			cbs[i].callback = callback;
 			cbs[i].period = period;
 			cbs[i].countdown = period;
+			if (tickless == 1) {
+				lpc_disable_irq();
+				cbs[i].deadline = tickless_timer->timer_counter + period;
+				cbs[i].callback = callback;
+				tickless_program_next();
+				lpc_enable_irq();
+			} else {
+				cbs[i].callback = callback;
+			}
 			return i;
 		}
 	}
@@ -124,7 +236,13 @@ void systick_start(void)
 	systick_running = 1;
 	global_wrapping_system_ticks = 0;
 	global_wrapping_system_clock_cycles = tick_reload;
+	global_clock_cycles_wraps = 0;
+	wakeups = 0;
+	wakeups_window_start = 0;
 	systick->control |= LPC_SYSTICK_CTRL_ENABLE;
+	if (tickless == 1) {
+		tickless_restart();
+	}
 }
 /* Stop the system tick timer */
 void systick_stop(void)
@@ -133,6 +251,9 @@ void systick_stop(void)
 	systick->control &= ~(LPC_SYSTICK_CTRL_ENABLE);
 	systick_running = 0;
 	systick->value = 0;
+	if (tickless == 1) {
+		timer_pause(tickless_timer_num);
+	}
 }
 /* Reset the system tick timer, making it count down from the reload value again
  * Reseting the systick timer also resets the internal tick counters.
@@ -146,6 +267,10 @@ void systick_reset(void)
 	systick->value = 0;
 	global_wrapping_system_ticks = 0;
 	global_wrapping_system_clock_cycles = tick_reload;
+	global_clock_cycles_wraps = 0;
+	if ((tickless == 1) && (systick_running == 1)) {
+		tickless_restart();
+	}
 }
 
 /* Get system tick timer current value (counts at get_main_clock() !)
@@ -195,16 +320,90 @@ static uint32_t systick_counted_to_zero(void)
  * is about 50 days with a 1ms system tick. */
 uint32_t systick_get_tick_count(void)
 {
+	if (tickless == 1) {
+		return tickless_timer->timer_counter;
+	}
 	return global_wrapping_system_ticks;
 }
 
-/* Get the number of clock cycles ... since last wrapping of the counter. */
+/* Get the number of clock cycles ... since last wrapping of the counter.
+ * The counter may have reloaded without the system tick interrupt having run yet (when
+ *   called with interrupts disabled or from an interrupt handler), in which case the
+ *   reload is added here. The read is done again if the system tick interrupt occured
+ *   in-between. */
 uint32_t systick_get_clock_cycles(void)
 {
 	struct lpc_system_tick* systick = LPC_SYSTICK;
+	struct syst_ctrl_block_regs* scb = LPC_SCB;
+	uint32_t cycles = 0, value = 0, reload = 0;
+
+	do {
+		cycles = global_wrapping_system_clock_cycles;
+		value = systick->value;
+		reload = 0;
+		if (scb->icsr & SCB_ICSR_PENDSTSET) {
+			/* Read the value again, it must be the one after the reload */
+			value = systick->value;
+			reload = tick_reload;
+		}
+	} while (cycles != global_wrapping_system_clock_cycles);
 	/* global_wrapping_system_clock_cycles has been initialised to reload value, thus there is
 	 * no need to add it here, making the call quicker */
-	return global_wrapping_system_clock_cycles - systick->value;
+	return cycles + reload - value;
+}
+
+/* Get the rate of the clock cycles counter, in Hz.
+ * For the LPC122x the system tick clock is fixed to half the frequency of the system clock */
+uint32_t systick_get_clock_cycles_rate(void)
+{
+	return (get_main_clock() >> 1);
+}
+
+/* Get the number of clock cycles since the system tick timer start, on 64 bits.
+ * The wraps count is read together with the cycles count, and the read is done again if
+ *   the system tick interrupt occured in-between. A reload not counted yet by the system
+ *   tick interrupt is added, as for systick_get_clock_cycles(). */
+uint64_t systick_get_clock_cycles_64(void)
+{
+	struct lpc_system_tick* systick = LPC_SYSTICK;
+	struct syst_ctrl_block_regs* scb = LPC_SCB;
+	uint32_t cycles = 0, wraps = 0, value = 0, reload = 0;
+
+	do {
+		cycles = global_wrapping_system_clock_cycles;
+		wraps = global_clock_cycles_wraps;
+		value = systick->value;
+		reload = 0;
+		if (scb->icsr & SCB_ICSR_PENDSTSET) {
+			/* Read the value again, it must be the one after the reload */
+			value = systick->value;
+			reload = tick_reload;
+		}
+	} while (cycles != global_wrapping_system_clock_cycles);
+	/* Same as for systick_get_clock_cycles(), cycles already includes the reload value */
+	return ((((uint64_t)wraps << 32) | cycles) + reload - value);
+}
+
+/* Get the number of wakeups (system tick timer or tickless timer interrupts) per second.
+ * The value is measured over a window of at least one second, which begins on the first
+ *   call following the end of the previous window.
+ */
+uint32_t systick_get_wakeups_per_second(void)
+{
+	uint32_t elapsed = (systick_get_tick_count() - wakeups_window_start) * tick_ms;
+	uint32_t count = wakeups;
+
+	if (elapsed >= 1000) {
+		/* Avoid overflow of count * 1000 on long windows */
+		if (count < (0xFFFFFFFF / 1000)) {
+			wakeups_rate = (count * 1000) / elapsed;
+		} else {
+			wakeups_rate = count / (elapsed / 1000);
+		}
+		wakeups -= count;
+		wakeups_window_start += (elapsed / tick_ms);
+	}
+	return wakeups_rate;
 }
 
 /***************************************************************************** */
@@ -234,6 +433,7 @@ void systick_timer_on(uint32_t ms)
 	systick->value = reload;
 	/* Consider we already counted one cycle, making further reading of this count easier */
 	global_wrapping_system_clock_cycles = tick_reload;
+	global_clock_cycles_wraps = 0;
 
 	/* And enable counter interrupt */
 	systick->control = LPC_SYSTICK_CTRL_TICKINT;
@@ -248,10 +448,63 @@ void systick_timer_on(uint32_t ms)
 	NVIC_SetPriority(SYSTICK_IRQ, ((1 << LPC_NVIC_PRIO_BITS) - 1));
 }
 
+/* Power up the system tick timer in tickless mode.
+ * timer_num is the 32 bits counter timer used to count the system ticks and to wake up
+ *   the CPU on the next deadline only (LPC_TIMER_32B0 or LPC_TIMER_32B1). This timer must
+ *   not be used for anything else.
+ * The system tick period is 1ms.
+ * Return 0 on success or a negative value on error.
+ */
+int systick_tickless_on(uint8_t timer_num)
+{
+	struct lpc_system_tick* systick = LPC_SYSTICK;
+	struct lpc_tc_config conf = {
+		.mode = (LPC_TIMER_MODE_TIMER | LPC_TIMER_MODE_MATCH),
+		.match_control = { LPC_TIMER_INTERRUPT_ON_MATCH, 0, 0, 0, },
+		.match = { TICKLESS_NO_DEADLINE, 0, 0, 0, },
+	};
+	int ret = 0;
+
+	if ((timer_num != LPC_TIMER_32B0) && (timer_num != LPC_TIMER_32B1)) {
+		return -EINVAL;
+	}
+	ret = timer_on(timer_num, 1000, tickless_handler);
+	if (ret != 0) {
+		return ret;
+	}
+	/* Callbacks run from the timer interrupt, keep them at the same lowest priority as
+	 * with the system tick timer */
+	NVIC_SetPriority(((timer_num == LPC_TIMER_32B0) ? TIMER2_IRQ : TIMER3_IRQ),
+						((1 << LPC_NVIC_PRIO_BITS) - 1));
+	ret = timer_counter_config(timer_num, &conf);
+	if (ret != 0) {
+		timer_off(timer_num);
+		return ret;
+	}
+	tickless_timer = LPC_TIMER_REGS(timer_num);
+	tickless_timer_num = timer_num;
+
+	/* Same configuration as the 1ms system tick for the usleep() function, then use the
+	 * maximum reload value in order to wrap as few times as possible */
+	systick_timer_on(1);
+	systick->reload_val = LPC_SYSTICK_LOAD_RELOAD;
+	systick->value = 0;
+	tick_reload = systick->reload_val;
+	global_wrapping_system_clock_cycles = tick_reload;
+	global_clock_cycles_wraps = 0;
+	tickless = 1;
+
+	return 0;
+}
+
 /* Removes the main clock from the selected timer block */
 void systick_timer_off(void)
 {
 	struct lpc_system_tick* systick = LPC_SYSTICK;
+	if (tickless == 1) {
+		tickless = 0;
+		timer_off(tickless_timer_num);
+	}
 	systick->control = 0;
 	systick->reload_val = 0;
 	tick_ms = 0;
@@ -287,12 +540,56 @@ static uint32_t sleep(void)
 	return 0;
 }
 
+/* Wait for an interrupt, or for the system tick count to reach 'tick'.
+ * Must be called with interrupts disabled, and returns with interrupts still disabled, so
+ *   that the caller can check its wakeup condition and call this function without missing
+ *   the interrupt which should end the wait : a pending interrupt ends the wfi even when
+ *   masked, and is handled as soon as interrupts are enabled again.
+ * In tickless mode the timer is programmed to wake up the CPU on 'tick' if this is the
+ *   nearest deadline. Use a tick far in the future (up to 2^31 ticks) when there is no
+ *   deadline. Without tickless mode the system tick interrupt ends the wait on each tick.
+ */
+void systick_wait_for_interrupt(uint32_t tick)
+{
+	if (tickless == 1) {
+		tickless_sleep_deadline = tick;
+		tickless_sleeping = 1;
+		tickless_program_next();
+	}
+	wfi();
+	tickless_sleeping = 0;
+}
+
+/* Tickless version of msleep : program the end of the sleep as next deadline and wait for
+ * interrupts instead of spinning.
+ */
+static void tickless_msleep(uint32_t ms)
+{
+	uint32_t deadline = 0;
+
+	if (systick_running == 0) {
+		systick_start();
+	}
+	lpc_disable_irq();
+	deadline = tickless_timer->timer_counter + ms;
+	while ((int32_t)(deadline - tickless_timer->timer_counter) > 0) {
+		systick_wait_for_interrupt(deadline);
+		lpc_enable_irq();
+		lpc_disable_irq();
+	}
+	lpc_enable_irq();
+}
+
 /* This msleep sleeps less than the required amount of time as it forgets about
  * the already elapsed time of the systick timer since last tick. */
 void msleep(uint32_t ms)
 {
 	uint32_t ticks = 0;
 
+	if (tickless == 1) {
+		tickless_msleep(ms);
+		return;
+	}
 	if (tick_ms == 0) {
 		systick_timer_on(1);
 		ticks = ms;
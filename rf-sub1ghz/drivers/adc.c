@@ -30,6 +30,7 @@
 
 #include "core/system.h"
 #include "lib/errno.h"
+#include "lib/trace.h"
 #include "drivers/adc.h"
 
 /* Should be as near to 9MHz as possible */
@@ -45,9 +46,11 @@ void ADC_Handler(void)
 	volatile struct lpc_adc* adc = LPC_ADC_REGS;
 	uint32_t status = adc->status;
 
+	TRACE_ENTER_ISR(TRACE_ID_ADC);
 	if (adc_int_callback != NULL) {
 		adc_int_callback(status);
 	}
+	TRACE_EXIT_ISR(TRACE_ID_ADC);
 }
 
 /* Read the conversion from the given channel (0 to 7)
@@ -135,6 +138,9 @@ void adc_start_burst_conversion(uint16_t channels, uint8_t seq_num)
 
 void adc_stop_burst_conversion(uint8_t seq_num)
 {
+	struct lpc_adc* adc = LPC_ADC_REGS;
+
+	adc->ctrl &= ~(LPC_ADC_BURST | LPC_ADC_START_CONV_MASK);
 }
 
 
@@ -179,18 +185,250 @@ void adc_trigger_sequence_conversion(uint8_t seq_num)
 }
 
 
+/***************************************************************************** */
+/*                ADC acquisition engine                                       */
+/***************************************************************************** */
+
+static void adc_set_clk_rate(uint32_t clk_rate);
+
+static struct adc_acq_channel* acq_channels[NB_ADC_CHANNELS];
+static uint8_t acq_nb = 0;
+static uint8_t acq_current = 0;  /* Channel being converted in event mode */
+static uint8_t acq_running = 0;
+static uint16_t acq_mask = 0;    /* ADC_MCH() bits of all acquisition channels */
+static uint8_t acq_last = 0;     /* Highest channel number, last one of a burst scan */
+static void (*acq_saved_callback)(uint32_t) = NULL;
+
+/* Average and store one conversion result. Called from the interrupt handler. */
+static void adc_acq_push(struct adc_acq_channel* ch, uint32_t data)
+{
+	uint32_t head = 0, val = 0;
+
+	ch->acc += ((data >> LPC_ADC_RESULT_SHIFT) & LPC_ADC_RESULT_MASK);
+	ch->nb_acc++;
+	if (ch->nb_acc < (1 << ch->avg_shift)) {
+		return;
+	}
+	val = ch->acc;
+	if (ch->avg_shift != 0) {
+		val = (val + (1 << (ch->avg_shift - 1))) >> ch->avg_shift;
+	}
+	ch->acc = 0;
+	ch->nb_acc = 0;
+
+	head = ch->head;
+	if ((head - ch->tail) > ch->mask) {
+		ch->dropped++;
+		return;
+	}
+	ch->buf[head & ch->mask] = val;
+	/* Sample must be in the buffer before the reader gets to see it */
+	dmb();
+	ch->head = head + 1;
+}
+
+static void adc_acq_int_handler(uint32_t status)
+{
+	struct lpc_adc* adc = LPC_ADC_REGS;
+	struct adc_acq_channel* ch = NULL;
+	uint32_t data = 0;
+	int i = 0;
+
+	if (adc->ctrl & LPC_ADC_BURST) {
+		/* One interrupt for each scan, get all the channels results */
+		for (i = 0; i < acq_nb; i++) {
+			ch = acq_channels[i];
+			data = adc->data[ch->channel];
+			if (data & LPC_ADC_CONV_DONE) {
+				adc_acq_push(ch, data);
+			}
+		}
+		return;
+	}
+
+	/* Event mode : get the result and select the next channel */
+	ch = acq_channels[acq_current];
+	data = adc->data[ch->channel];
+	if (data & LPC_ADC_CONV_DONE) {
+		adc_acq_push(ch, data);
+	}
+	if (acq_nb > 1) {
+		acq_current++;
+		if (acq_current >= acq_nb) {
+			acq_current = 0;
+		}
+		ch = acq_channels[acq_current];
+		adc->ctrl = ((adc->ctrl & ~ADC_MCH_MASK) | ADC_MCH(ch->channel)) & LPC_ADC_CTRL_MASK;
+	}
+}
+
+int adc_acq_setup(struct adc_acq_channel* channels[], uint8_t nb)
+{
+	uint16_t mask = 0;
+	int i = 0;
+
+	if ((channels == NULL) || (nb == 0) || (nb > NB_ADC_CHANNELS)) {
+		return -EINVAL;
+	}
+	for (i = 0; i < nb; i++) {
+		struct adc_acq_channel* ch = channels[i];
+		if ((ch == NULL) || (ch->buf == NULL) || (ch->channel >= NB_ADC_CHANNELS) ||
+				(mask & ADC_MCH(ch->channel)) || (ch->mask & (ch->mask + 1)) ||
+				(ch->avg_shift > 6)) {
+			return -EINVAL;
+		}
+		mask |= ADC_MCH(ch->channel);
+	}
+	adc_acq_stop();
+
+	acq_last = 0;
+	for (i = 0; i < nb; i++) {
+		struct adc_acq_channel* ch = channels[i];
+		ch->head = 0;
+		ch->tail = 0;
+		ch->dropped = 0;
+		ch->acc = 0;
+		ch->nb_acc = 0;
+		acq_channels[i] = ch;
+		if (ch->channel > acq_last) {
+			acq_last = ch->channel;
+		}
+	}
+	acq_nb = nb;
+	acq_mask = mask;
+	acq_current = 0;
+	return 0;
+}
+
+static void adc_acq_set_handler(void)
+{
+	if (acq_running == 0) {
+		acq_saved_callback = adc_int_callback;
+		adc_int_callback = adc_acq_int_handler;
+		acq_running = 1;
+	}
+}
+
+void adc_acq_start_burst(uint32_t rate)
+{
+	struct lpc_adc* adc = LPC_ADC_REGS;
+
+	if (acq_nb == 0) {
+		return;
+	}
+	adc_acq_set_handler();
+	adc_set_clk_rate((rate != 0) ? (rate * LPC_ADC_CONV_CLOCKS) : adc_clk_Val);
+	adc_start_burst_conversion(acq_mask, 0);
+	/* The last channel of the scan signals the end of the scan */
+	adc->int_en = ADC_MCH(acq_last);
+}
+
+void adc_acq_start_on_event(uint8_t event, uint32_t edge)
+{
+	struct lpc_adc* adc = LPC_ADC_REGS;
+
+	if (acq_nb == 0) {
+		return;
+	}
+	adc_acq_set_handler();
+	adc_set_clk_rate(adc_clk_Val);
+	acq_current = 0;
+	adc_prepare_conversion_on_event(ADC_MCH(acq_channels[0]->channel), 0, event, 0, edge);
+	adc->int_en = acq_mask;
+}
+
+void adc_acq_stop(void)
+{
+	struct lpc_adc* adc = LPC_ADC_REGS;
+
+	if (acq_running == 0) {
+		return;
+	}
+	adc_stop_burst_conversion(0);
+	adc->int_en = 0;
+	adc_int_callback = acq_saved_callback;
+	acq_running = 0;
+}
+
+uint32_t adc_acq_read(struct adc_acq_channel* ch, uint16_t* samples, uint32_t max)
+{
+	uint32_t tail = ch->tail, head = ch->head;
+	uint32_t nb = 0;
+
+	while ((tail != head) && (nb < max)) {
+		samples[nb++] = ch->buf[tail & ch->mask];
+		tail++;
+	}
+	/* Samples must have been read before the interrupt can overwrite them */
+	dmb();
+	ch->tail = tail;
+	return nb;
+}
+
+int adc_acq_summary(struct adc_acq_channel* ch, struct adc_acq_summary* summary)
+{
+	uint32_t tail = ch->tail, head = ch->head;
+	uint32_t total = 0;
+	uint16_t min = 0xFFFF, max = 0;
+
+	summary->nb = (head - tail);
+	summary->dropped = ch->dropped;
+	if (summary->nb == 0) {
+		return -ENODATA;
+	}
+	while (tail != head) {
+		uint16_t val = ch->buf[tail & ch->mask];
+		if (val < min) {
+			min = val;
+		}
+		if (val > max) {
+			max = val;
+		}
+		total += val;
+		tail++;
+	}
+	dmb();
+	ch->tail = tail;
+	summary->min = min;
+	summary->max = max;
+	summary->mean = ((total + (summary->nb >> 1)) / summary->nb);
+	return summary->nb;
+}
+
+
 /***************************************************************************** */
 /*   ADC Setup : private part : Clocks, Power and Mode   */
 
+/* Requested ADC clock, kept for main clock changes */
+static uint32_t adc_clk_rate = adc_clk_Val;
+
 void adc_clk_update(void)
 {
 	struct lpc_adc* adc = LPC_ADC_REGS;
 	uint32_t main_clock = get_main_clock();
-	uint32_t clkdiv = 0;
+	uint32_t clkdiv = 0, min_div = 0, reg_val = 0;
+
+	/* Configure ADC clock to get the requested sample clock, at most 9MHz */
+	clkdiv = (main_clock / adc_clk_rate);
+	min_div = (main_clock / adc_clk_Val);
+	if (clkdiv < min_div) {
+		clkdiv = min_div;
+	}
+	if (clkdiv > 0xFF) {
+		clkdiv = 0xFF;
+	}
+	reg_val = adc->ctrl & ~LPC_ADC_CLKDIV_MASK;
+	/* Do not start a new software conversion */
+	if ((reg_val & LPC_ADC_START_CONV_MASK) == LPC_ADC_START_CONV_NOW) {
+		reg_val &= ~LPC_ADC_START_CONV_MASK;
+	}
+	adc->ctrl = (reg_val | (clkdiv << LPC_ADC_CLKDIV_SHIFT)) & LPC_ADC_CTRL_MASK;
+}
 
-	/* Configure ADC clock to get the 9MHz sample clock */
-	clkdiv = (main_clock / adc_clk_Val);
-	adc->ctrl |= ((clkdiv & 0xFF) << 8);
+static void adc_set_clk_rate(uint32_t clk_rate)
+{
+	adc_clk_rate = clk_rate;
+	adc_clk_update();
 }
 
 
@@ -32,6 +32,7 @@
 #include "core/system.h"
 #include "lib/errno.h"
 #include "drivers/timers.h"
+#include "lib/trace.h"
 #include "drivers/countertimers.h"
 
 
@@ -90,19 +91,27 @@ void TIMER_Handler(struct countertimer_device* timer)
 }
 void TIMER_0_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_TIMER_0);
 	TIMER_Handler(&countertimers[0]);
+	TRACE_EXIT_ISR(TRACE_ID_TIMER_0);
 }
 void TIMER_1_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_TIMER_1);
 	TIMER_Handler(&countertimers[1]);
+	TRACE_EXIT_ISR(TRACE_ID_TIMER_1);
 }
 void TIMER_2_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_TIMER_2);
 	TIMER_Handler(&countertimers[2]);
+	TRACE_EXIT_ISR(TRACE_ID_TIMER_2);
 }
 void TIMER_3_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_TIMER_3);
 	TIMER_Handler(&countertimers[3]);
+	TRACE_EXIT_ISR(TRACE_ID_TIMER_3);
 }
 
 
@@ -30,6 +30,7 @@
 #include "core/system.h"
 #include "lib/errno.h"
 #include "core/pio.h"
+#include "lib/trace.h"
 #include "drivers/gpio.h"
 
 
@@ -198,6 +199,7 @@ void PIO_0_Handler(void)
 	uint32_t status = gpio0->masked_int_status;
 	uint32_t i = 0;
 
+	TRACE_ENTER_ISR(TRACE_ID_PIO_0);
 	/* Call interrupt handlers */
 	while (status) {
 		if (status & 1) {
@@ -211,6 +213,7 @@ void PIO_0_Handler(void)
 		status >>= 1;
 		i++;
 	}
+	TRACE_EXIT_ISR(TRACE_ID_PIO_0);
 }
 void PIO_1_Handler(void)
 {
@@ -218,6 +221,7 @@ void PIO_1_Handler(void)
 	uint32_t status = gpio1->masked_int_status;
 	uint32_t i = 0;
 
+	TRACE_ENTER_ISR(TRACE_ID_PIO_1);
 	/* Call interrupt handlers */
 	while (status) {
 		if (status & 1) {
@@ -231,6 +235,7 @@ void PIO_1_Handler(void)
 		status >>= 1;
 		i++;
 	}
+	TRACE_EXIT_ISR(TRACE_ID_PIO_1);
 }
 void PIO_2_Handler(void)
 {
@@ -238,6 +243,7 @@ void PIO_2_Handler(void)
 	uint32_t status = gpio2->masked_int_status;
 	uint32_t i = 0;
 
+	TRACE_ENTER_ISR(TRACE_ID_PIO_2);
 	/* Call interrupt handlers */
 	while (status) {
 		if (status & 1) {
@@ -251,6 +257,7 @@ void PIO_2_Handler(void)
 		status >>= 1;
 		i++;
 	}
+	TRACE_EXIT_ISR(TRACE_ID_PIO_2);
 }
 
 
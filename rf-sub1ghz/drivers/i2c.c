@@ -32,6 +32,7 @@
 #include "core/system.h"
 #include "lib/string.h"
 #include "lib/errno.h"
+#include "lib/trace.h"
 #include "drivers/i2c.h"
 
 
@@ -70,6 +71,10 @@ struct i2c_bus {
 	volatile char* in_buff;
 	volatile uint32_t read_length;
 	volatile uint32_t read_index;
+
+	volatile uint32_t async_pending;
+	void (*async_done)(uint32_t);      /* Called at the end of the current async transfer */
+	void (*async_callback)(uint32_t);  /* Default one, for i2c_write_async() */
 };
 
 static struct i2c_bus i2c_buses[NB_I2C_BUSSES] = {
@@ -95,6 +100,7 @@ void I2C_0_Handler(void)
 	uint8_t status;
 	struct i2c_bus* i2c = &(i2c_buses[0]);
 
+	TRACE_ENTER_ISR(TRACE_ID_I2C_0);
 	i2c->timeout = 0;
 
 	/* this handler deals with master read and master write only */
@@ -270,6 +276,15 @@ void I2C_0_Handler(void)
 
 	/* Clear interrupt flag. This has to be done last. */
 	i2c->regs->ctrl_clear = I2C_INTR_FLAG;
+
+	/* Signal the end of an asynchronous write */
+	if ((i2c->async_pending == 1) && (i2c->state != I2C_BUSY)) {
+		i2c->async_pending = 0;
+		if (i2c->async_done != NULL) {
+			i2c->async_done(i2c->state);
+		}
+	}
+	TRACE_EXIT_ISR(TRACE_ID_I2C_0);
 	return;
 }
 
@@ -310,6 +325,24 @@ static int i2c_state(struct i2c_bus* i2c)
 }
 
 
+/* Wait for the end of a pending asynchronous write.
+ * The transfer ends in the I2C interrupt, so when called from an interrupt handler (which
+ *   may have the same or a higher priority) or with interrupts disabled, do not wait and
+ *   return -EAGAIN if the bus is busy.
+ */
+static int i2c_wait_idle(struct i2c_bus* i2c)
+{
+	if (i2c->state != I2C_BUSY) {
+		return 0;
+	}
+	if ((IPSR != 0) || (get_priority_mask() != 0)) {
+		return -EAGAIN;
+	}
+	do {} while (i2c->state == I2C_BUSY);
+	return 0;
+}
+
+
 /* Release Bus
  * Some devices do not release the Bus at the end of a transaction if they don't receive
  *   a start condition immediately followed by a stop condition.
@@ -317,6 +350,9 @@ static int i2c_state(struct i2c_bus* i2c)
 void i2c_release_bus(uint8_t bus_num)
 {
 	struct i2c_bus* i2c = &(i2c_buses[0]);
+	if (i2c_wait_idle(i2c) != 0) {
+		return;
+	}
 	/* Force device to release the bus :
 	 *    send a START followed by a STOP (initiate transmission with nul write_length) */
 	i2c->state = I2C_BUSY;
@@ -352,7 +388,8 @@ int i2c_read(uint8_t bus_num, const void *cmd_buf, size_t cmd_size, const void*
 	if ((inbuff == NULL) && (count > 0))
 		return -EINVAL;
 
-	if (i2c->state == I2C_BUSY) {
+	/* Let a pending asynchronous write complete */
+	if (i2c_wait_idle(i2c) != 0) {
 		return -EAGAIN;
 	}
 	if (i2c->state != I2C_OK) {
@@ -376,6 +413,7 @@ int i2c_read(uint8_t bus_num, const void *cmd_buf, size_t cmd_size, const void*
 	i2c->read_index = 0;
 
 	/* Start the process */
+	TRACE_EVT(TRACE_ID_I2C_XFER, ((count << 8) | ((const uint8_t*)cmd_buf)[0]));
 	i2c->regs->ctrl_set = I2C_START_FLAG;
 	/* Wait for process completion */
 	do {} while (i2c->state == I2C_BUSY);
@@ -399,11 +437,12 @@ int i2c_read(uint8_t bus_num, const void *cmd_buf, size_t cmd_size, const void*
  * RETURN VALUE
  *   Upon successfull transmition start, returns 0. On error, returns a negative
  *   integer equivalent to errors from glibc.
+ * Only transfers started with notify set end with a call to "done" (if not NULL), so that
+ *   blocking writes are not signaled.
  */
-int i2c_write_async(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf)
+static int i2c_start_write(struct i2c_bus* i2c, const void *buf, size_t count, const void* ctrl_buf,
+							uint32_t notify, void (*done)(uint32_t))
 {
-	struct i2c_bus* i2c = &(i2c_buses[0]);
-
 	/* Checks */
 	if (i2c->regs != LPC_I2C0)
 		return -EBADFD;
@@ -430,12 +469,50 @@ int i2c_write_async(uint8_t bus_num, const void *buf, size_t count, const void*
 	i2c->restart_after_addr = I2C_CONT;
 	i2c->repeated_start_restart = ctrl_buf;
 	i2c->restart_after_data = 0;
+	i2c->async_done = done;
+	i2c->async_pending = notify;
 
 	/* Start the process */
+	TRACE_EVT(TRACE_ID_I2C_XFER, ((count << 8) | ((const uint8_t*)buf)[0]));
 	i2c->regs->ctrl_set = I2C_START_FLAG;
 
 	return 0;
 }
+int i2c_write_async(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf)
+{
+	struct i2c_bus* i2c = &(i2c_buses[0]);
+	return i2c_start_write(i2c, buf, count, ctrl_buf, 1, i2c->async_callback);
+}
+int i2c_write_async_done(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf,
+							void (*done)(uint32_t))
+{
+	struct i2c_bus* i2c = &(i2c_buses[0]);
+	return i2c_start_write(i2c, buf, count, ctrl_buf, 1, done);
+}
+
+
+/* Asynchronous transfer status
+ * Returns -EAGAIN while the transfer started by i2c_write_async() is in progress, 0 if
+ *   it completed successfully, or the error code of the transfer.
+ */
+int i2c_async_status(uint8_t bus_num)
+{
+	struct i2c_bus* i2c = &(i2c_buses[0]);
+	return i2c_state(i2c);
+}
+
+/* Register a callback to be called (from interrupt context) at the end of each transfer
+ *   started by i2c_write_async() (not by i2c_write_async_done()). The callback gets the internal bus state as argument.
+ * Use NULL to remove the callback.
+ */
+int i2c_set_async_callback(uint8_t bus_num, void (*callback)(uint32_t))
+{
+	struct i2c_bus* i2c = &(i2c_buses[0]);
+	if (i2c->regs != LPC_I2C0)
+		return -EBADFD;
+	i2c->async_callback = callback;
+	return 0;
+}
 
 
 /* Write
@@ -455,7 +532,12 @@ int i2c_write(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_b
 	struct i2c_bus* i2c = &(i2c_buses[0]);
 	int ret;
 
-	ret = i2c_write_async(bus_num, buf, count, ctrl_buf);
+	/* Let a pending asynchronous write complete */
+	if (i2c_wait_idle(i2c) != 0) {
+		return -EAGAIN;
+	}
+
+	ret = i2c_start_write(i2c, buf, count, ctrl_buf, 0, NULL);
 	
 	if (ret != 0) {
 		return ret;
@@ -34,6 +34,7 @@
 #include "lib/string.h"
 #include "lib/utils.h"
 #include "lib/errno.h"
+#include "lib/trace.h"
 #include "drivers/serial.h"
 
 struct uart_device
@@ -127,11 +128,15 @@ static void UART_Handler(struct uart_device* uart)
 /* Handlers */
 void UART_0_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_UART_0);
 	UART_Handler(&uarts[0]);
+	TRACE_EXIT_ISR(TRACE_ID_UART_0);
 }
 void UART_1_Handler(void)
 {
+	TRACE_ENTER_ISR(TRACE_ID_UART_1);
 	UART_Handler(&uarts[1]);
+	TRACE_EXIT_ISR(TRACE_ID_UART_1);
 }
 
 
@@ -32,6 +32,7 @@
 #include "core/pio.h"
 #include "lib/errno.h"
 #include "lib/string.h"
+#include "lib/trace.h"
 #include "drivers/ssp.h"
 
 
@@ -72,6 +73,7 @@ void SSP_0_Handler(void)
 	struct lpc_ssp* ssp = LPC_SSP0;
 	uint32_t intr_flags = ssp->masked_int_status;
 
+	TRACE_ENTER_ISR(TRACE_ID_SSP_0);
 	/* Clear the interrupts. Other bits are cleared by fifo access */
 	ssp->int_clear = (intr_flags & (LPC_SSP_INTR_RX_OVERRUN | LPC_SSP_INTR_RX_TIMEOUT));
 	if (intr_flags & LPC_SSP_INTR_RX_OVERRUN) {
@@ -80,6 +82,7 @@ void SSP_0_Handler(void)
 	if (intr_flags & LPC_SSP_INTR_RX_TIMEOUT) {
 		ssps[0].int_rx_timeout_stats += 1;
 	}
+	TRACE_EXIT_ISR(TRACE_ID_SSP_0);
 }
 
 
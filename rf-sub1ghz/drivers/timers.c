@@ -197,7 +197,7 @@ int timer_on(uint8_t timer_num, uint32_t clkrate, void (*callback)(uint32_t))
 	if (timer_num >= NUM_TIMERS)
 		return -EINVAL;
 	if (timers[timer_num].init_ops && timers[timer_num].init_ops->timer_on) {
-		timers[timer_num].init_ops->timer_on(timer_num, clkrate, callback);
+		return timers[timer_num].init_ops->timer_on(timer_num, clkrate, callback);
 	}
 	return -ENODEV;
 }
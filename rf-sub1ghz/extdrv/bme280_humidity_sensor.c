@@ -26,6 +26,7 @@
 #include "core/system.h"
 #include "lib/errno.h"
 #include "drivers/i2c.h"
+#include "lib/prof.h"
 
 #include "extdrv/bme280_humidity_sensor.h"
 
@@ -205,6 +206,80 @@ int bme280_sensor_read(struct bme280_sensor_config* conf, uint32_t* pressure, ui
 
 
 
+/* Start a measurement in FORCED mode
+ * Writing the measurement control register with the FORCED mode starts a single
+ *   measurement, the sensor goes back to sleep mode once done.
+ * Return value:
+ *   Upon successfull completion, returns 0. On error, returns a negative integer
+ *   equivalent to errors from glibc.
+ */
+#define START_BUF_SIZE  3
+int bme280_start_conversion(struct bme280_sensor_config* conf)
+{
+	int ret = 0;
+	char cmd_buf[START_BUF_SIZE] = {
+			conf->addr,
+			BME280_REGS(ctrl_measure),
+				BME280_CTRL_MEA(conf->pressure_oversampling, conf->temp_oversampling, BME280_FORCED),
+		};
+
+	if (conf->probe_ok != 1) {
+		return -ENODEV;
+	}
+	ret = i2c_write(conf->bus_num, cmd_buf, START_BUF_SIZE, NULL);
+	if (ret != START_BUF_SIZE) {
+		conf->probe_ok = 0;
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Check the end of a measurement using the "measuring" bit of the status register. */
+#define STATUS_CMD_SIZE  3
+int bme280_conversion_done(struct bme280_sensor_config* conf)
+{
+	int ret = 0;
+	char cmd_buf[STATUS_CMD_SIZE] = { conf->addr, BME280_REGS(status), (conf->addr | I2C_READ_BIT), };
+	char ctrl_buf[STATUS_CMD_SIZE] = { I2C_CONT, I2C_DO_REPEATED_START, I2C_CONT, };
+	uint8_t status = 0;
+
+	if (conf->probe_ok != 1) {
+		return -ENODEV;
+	}
+	ret = i2c_read(conf->bus_num, cmd_buf, STATUS_CMD_SIZE, ctrl_buf, &status, 1);
+	if (ret != 1) {
+		conf->probe_ok = 0;
+		return ret;
+	}
+	return (status & BME280_STATUS_MEASURING) ? 0 : 1;
+}
+
+/* Maximum measurement time, in ms (rounded up) :
+ *   1.25 + [2.3 * T_os] + [2.3 * P_os + 0.575] + [2.3 * H_os + 0.575] ms,
+ *   with skipped measurements removed.
+ */
+static uint32_t bme280_measure_us(struct bme280_sensor_config* conf)
+{
+	uint32_t us = 1250;
+	if (conf->temp_oversampling != BME280_SKIP) {
+		us += 2300 * (1 << (conf->temp_oversampling - 1));
+	}
+	if (conf->pressure_oversampling != BME280_SKIP) {
+		us += 2300 * (1 << (conf->pressure_oversampling - 1)) + 575;
+	}
+	if (conf->humidity_oversampling != BME280_SKIP) {
+		us += 2300 * (1 << (conf->humidity_oversampling - 1)) + 575;
+	}
+	return us;
+}
+
+uint32_t bme280_conversion_time(struct bme280_sensor_config* conf)
+{
+	return ((bme280_measure_us(conf) + 999) / 1000);
+}
+
+
+
 /* Compute actual temperature from uncompensated temperature
  * Param :
  *  - conf : bme280_sensor_configuration structure, with calibration data read from sensor
@@ -216,6 +291,7 @@ int bme280_compensate_temperature(struct bme280_sensor_config* conf, int utemp)
 {
 	int tmp1 = 0, tmp2 = 0;
 	int temperature = 0;
+	PROF_ENTER(bme280_temp);
 
 	/* Calculate tmp1 */
 	tmp1 = ((((utemp >> 3) - ((int)conf->cal.T1 << 1))) * conf->cal.T2) >> 11;
@@ -226,6 +302,7 @@ int bme280_compensate_temperature(struct bme280_sensor_config* conf, int utemp)
 	conf->fine_temp = tmp1 + tmp2;
 	/* Calculate temperature */
 	temperature = (conf->fine_temp * 5 + 128) >> 8;
+	PROF_EXIT(bme280_temp);
 	return temperature;
 }
 
@@ -237,6 +314,7 @@ uint32_t bme280_compensate_pressure(struct bme280_sensor_config* conf, int uncom
 {
 	int tmp1 = 0, tmp2 = 0, tmp3 = 0;
 	uint32_t pressure = 0;
+	PROF_ENTER(bme280_press);
 
 	/* Calculate tmp1 */
 	tmp1 = (conf->fine_temp >> 1) - 64000;
@@ -253,6 +331,7 @@ uint32_t bme280_compensate_pressure(struct bme280_sensor_config* conf, int uncom
 
 	/* Avoid exception caused by division by zero */
 	if (tmp1 == 0) {
+		PROF_EXIT(bme280_press);
 		return 0;
 	}
 	if (pressure < 0x80000000) {
@@ -265,18 +344,15 @@ uint32_t bme280_compensate_pressure(struct bme280_sensor_config* conf, int uncom
 	tmp2 = (((int)(pressure >> 2)) * conf->cal.P8) >> 13;
 	pressure = (uint32_t)((int)pressure + ((tmp1 + tmp2 + conf->cal.P7) >> 4));
 
+	PROF_EXIT(bme280_press);
 	return pressure;
 }
 
 
-/* Compute actual humidity from uncompensated humidity
- * Returns the value in 0.01 %rH
- * Output value of "4132" equals 41.32 %rH.
- */
-uint32_t bme280_compensate_humidity(struct bme280_sensor_config* conf, int uncomp_humidity)
+/* Humidity in Q22.10 format (22 integer 10 fractional bits) %rH */
+static uint32_t bme280_humidity_q10(struct bme280_sensor_config* conf, int uncomp_humidity)
 {
 	int tmp1 = 0, tmp2 = 0, tmp3 = 0;
-	uint32_t humidity = 0;
 
 	/* Calculate tmp1 */
 	tmp1 = conf->fine_temp - 76800;
@@ -293,15 +369,116 @@ uint32_t bme280_compensate_humidity(struct bme280_sensor_config* conf, int uncom
 	if (tmp1 > 419430400) {
 		tmp1 = 419430400;
 	}
-	humidity = (uint32_t)(tmp1 >> 12);
-	/* Convert from 32bit integer in Q22.10 format (22 integer 10 fractional bits) to a value
-	 *   in 0.01 %rH :
+	return (uint32_t)(tmp1 >> 12);
+}
+
+/* Compute actual humidity from uncompensated humidity
+ * Returns the value in 0.01 %rH
+ * Output value of "4132" equals 41.32 %rH.
+ */
+uint32_t bme280_compensate_humidity(struct bme280_sensor_config* conf, int uncomp_humidity)
+{
+	uint32_t humidity = 0;
+	PROF_ENTER(bme280_hum);
+
+	humidity = bme280_humidity_q10(conf, uncomp_humidity);
+	/* Convert from Q22.10 to a value in 0.01 %rH :
 	 * A value of 42313 represents 42313 / 1024 = 41.321 %rH, convert it to 4132, which is 41.32 %rH.
 	 */
-	humidity = ((humidity >> 10) * 100) + ((((humidity & 0x3FF) * 1000) >> 10) / 10);
+	humidity = ((humidity >> 10) * 100) + (((humidity & 0x3FF) * 100) >> 10);
+	PROF_EXIT(bme280_hum);
 	return humidity;
+}
 
+
+/* Batch conversion of raw samples */
+void bme280_compensate_samples(struct bme280_sensor_config* conf,
+				const struct bme280_raw_sample* raw, struct bme280_sample* out, unsigned int nb)
+{
+	unsigned int i = 0;
+
+	for (i = 0; i < nb; i++) {
+		out[i].temperature = bme280_compensate_temperature(conf, raw[i].temperature);
+		out[i].pressure = bme280_compensate_pressure(conf, raw[i].pressure);
+		out[i].humidity = bme280_compensate_humidity(conf, raw[i].humidity);
+	}
 }
 
 
 
+/***************************************************************************** */
+/* Generic sensor interface */
+
+static int bme280_ops_probe(void* conf)
+{
+	return bme280_probe_sensor(conf);
+}
+
+static int bme280_ops_configure(void* conf)
+{
+	return bme280_configure(conf);
+}
+
+static int bme280_ops_start_conversion(void* data)
+{
+	struct bme280_sensor_config* conf = data;
+
+	if (conf->mode != BME280_FORCED) {
+		return 0;
+	}
+	return bme280_start_conversion(conf);
+}
+
+static int bme280_ops_read_raw(void* conf, struct sensor_raw* raw)
+{
+	uint16_t hum = 0;
+	int ret = 0;
+
+	ret = bme280_sensor_read(conf, &(raw->data[1]), &(raw->data[0]), &hum);
+	raw->data[2] = hum;
+	return ret;
+}
+
+/* Values in 0.1 degree Centigrade, Pa and 0.1 %rH, converted using shifts :
+ * 0.01 degree is (fine_temp * 5) >> 8, so 0.1 degree is fine_temp >> 9 (rounded), and
+ * 0.1 %rH is (Q22.10 humidity * 10) >> 10. */
+static int bme280_ops_compensate(void* data, const struct sensor_raw* raw, struct sensor_values* values)
+{
+	struct bme280_sensor_config* conf = data;
+
+	/* Temperature first, it updates fine_temp used by the other ones */
+	bme280_compensate_temperature(conf, raw->data[0]);
+	values->quantity[0] = SENSOR_TEMPERATURE;
+	values->value[0] = ((conf->fine_temp + 256) >> 9);
+	values->quantity[1] = SENSOR_PRESSURE;
+	values->value[1] = bme280_compensate_pressure(conf, raw->data[1]);
+	values->quantity[2] = SENSOR_HUMIDITY;
+	values->value[2] = ((bme280_humidity_q10(conf, raw->data[2]) * 10) >> 10);
+	values->nb = 3;
+	return 0;
+}
+
+/* Standby durations in us, indexed by standby_len */
+static const uint32_t bme280_standby_us[8] = {
+	500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000,
+};
+
+static uint32_t bme280_ops_min_period(void* data)
+{
+	struct bme280_sensor_config* conf = data;
+	uint32_t us = bme280_measure_us(conf);
+
+	if (conf->mode == BME280_NORMAL) {
+		us += bme280_standby_us[conf->standby_len & 0x07];
+	}
+	return ((us + 999) / 1000);
+}
+
+const struct sensor_operations bme280_sensor_ops = {
+	.probe = bme280_ops_probe,
+	.configure = bme280_ops_configure,
+	.start_conversion = bme280_ops_start_conversion,
+	.read_raw = bme280_ops_read_raw,
+	.compensate = bme280_ops_compensate,
+	.min_period = bme280_ops_min_period,
+};
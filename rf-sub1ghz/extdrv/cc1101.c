@@ -24,6 +24,8 @@
 #include "lib/string.h"
 #include "drivers/ssp.h"
 #include "drivers/gpio.h"
+#include "lib/prof.h"
+#include "lib/trace.h"
 #include "extdrv/cc1101.h"
 
 /* Driver for the CC1101 Sub-1GHz RF transceiver from Texas Instrument.
@@ -102,6 +104,10 @@ static uint8_t cc1101_write_burst_reg(uint8_t start_addr, uint8_t* buffer, uint8
 /* Send command and return global status byte */
 static uint8_t cc1101_send_cmd(uint8_t addr)
 {
+	/* Status reads are not traced, the radio task polls the status */
+	if (addr < CC1101_CMD(no_op)) {
+		TRACE_EVT(TRACE_ID_RADIO_CMD, addr);
+	}
 	return cc1101_spi_transfer((addr | CC1101_WRITE_OFFSET), NULL, NULL, 0);
 }
 
@@ -309,6 +315,7 @@ int cc1101_receive_packet(uint8_t* buffer, uint8_t size, uint8_t* status)
 	uint8_t read_size = 0, pkt_length = 0;
 	int ret = 0;
 	uint8_t st_buff[2];
+	PROF_ENTER(cc1101_rx);
 
 	/* Get fifo state */
 	rx_status = cc1101_read_reg(CC1101_STATUS(rx_bytes));
@@ -318,6 +325,7 @@ int cc1101_receive_packet(uint8_t* buffer, uint8_t size, uint8_t* status)
 
 	/* Empty fifo ? */
 	if (rx_status == 0) {
+		PROF_EXIT(cc1101_rx);
 		return 0;
 	}
 	/* Receive one packet at most */
@@ -352,13 +360,16 @@ int cc1101_receive_packet(uint8_t* buffer, uint8_t size, uint8_t* status)
 	/* CRC error */
 	if (!(cc1101.link_quality & CC1101_CRC_OK)) {
 		cc1101_flush_rx_fifo();
+		PROF_EXIT(cc1101_rx);
 		return -CC1101_ERR_CRC;
 	}
 	/* Overflow ? */
 	if (rx_status & CC1101_RX_FIFO_OVERFLOW) {
 		cc1101_flush_rx_fifo();
+		PROF_EXIT(cc1101_rx);
 		return -CC1101_ERR_OVERFLOW;
 	}
+	PROF_EXIT(cc1101_rx);
 	return ret;
 }
 
@@ -52,7 +52,8 @@ int chirp_probe_sensor(struct chirp_sensor_config* conf)
 
 	/* Did we already probe the sensor ? */
 	if (conf->probe_ok != 1) {
-		conf->probe_ok = i2c_read(conf->bus_num, &cmd_buf, 1, NULL, NULL, 0);
+		/* Nothing to read : success is 0 bytes read */
+		conf->probe_ok = (i2c_read(conf->bus_num, &cmd_buf, 1, NULL, NULL, 0) == 0) ? 1 : 0;
 	}
 	return conf->probe_ok;
 }
@@ -157,3 +158,69 @@ int chirp_reset(struct chirp_sensor_config* conf)
 }
 
 
+
+
+/***************************************************************************** */
+/* Generic sensor interface */
+
+static int chirp_ops_probe(void* conf)
+{
+	return chirp_probe_sensor(conf);
+}
+
+static int chirp_ops_start_conversion(void* conf)
+{
+	int ret = chirp_sensor_start_light_conversion(conf);
+	return (ret == 2) ? 0 : -EIO;
+}
+
+static int chirp_ops_read_raw(void* conf, struct sensor_raw* raw)
+{
+	int ret = 0;
+
+	ret = chirp_sensor_cap_read(conf);
+	if (ret < 0) {
+		return ret;
+	}
+	raw->data[0] = ret;
+	ret = chirp_sensor_temp_read(conf);
+	if (ret < 0) {
+		return ret;
+	}
+	raw->data[1] = ret;
+	ret = chirp_sensor_light_read(conf);
+	if (ret < 0) {
+		return ret;
+	}
+	raw->data[2] = ret;
+	return 0;
+}
+
+static int chirp_ops_compensate(void* conf, const struct sensor_raw* raw, struct sensor_values* values)
+{
+	values->quantity[0] = SENSOR_MOISTURE;
+	values->value[0] = raw->data[0];
+	values->quantity[1] = SENSOR_TEMPERATURE;
+	values->value[1] = (int16_t)raw->data[1];
+	values->quantity[2] = SENSOR_LIGHT_COUNTS;
+	values->value[2] = raw->data[2];
+	values->nb = 3;
+	return 0;
+}
+
+/* The light measurement lasts up to a few seconds in the dark, the previous one is read
+ * if it is not over. */
+#define CHIRP_LIGHT_CONVERSION_MS  3000
+static uint32_t chirp_ops_min_period(void* conf)
+{
+	return CHIRP_LIGHT_CONVERSION_MS;
+}
+
+const struct sensor_operations chirp_sensor_ops = {
+	.probe = chirp_ops_probe,
+	.configure = NULL,
+	.start_conversion = chirp_ops_start_conversion,
+	.read_raw = chirp_ops_read_raw,
+	.compensate = chirp_ops_compensate,
+	.min_period = chirp_ops_min_period,
+};
@@ -90,22 +90,272 @@ int eeprom_detect(uint8_t eeprom_addr)
 	return ret; /* Error or module size */
 }
 
+/* The type is detected only once, unless the detection failed because of a bus error.
+ * Returns -ENODEV when there is no eeprom. */
 int get_eeprom_type(uint8_t eeprom_addr)
 {
 	static int eeprom_type = -1;
+	int ret = 0;
 
-	if (eeprom_type >= 0) {
-		return eeprom_type; /* No need to check again */
+	if (eeprom_type < 0) {
+		ret = eeprom_detect(eeprom_addr);
+		if (ret < 0) {
+			return ret;
+		}
+		eeprom_type = ret;
 	}
-
-	eeprom_type = eeprom_detect(eeprom_addr);
-	if (eeprom_type <= 0) {
-		return -1;
+	if (eeprom_type == EEPROM_TYPE_NONE) {
+		return -ENODEV;
 	}
 	return eeprom_type;
 }
 
 
+#define CMD_SIZE_SMALL 2
+#define CMD_SIZE_BIG 3
+#define MAX_CMD_SIZE CMD_SIZE_BIG
+#define EEPROM_ID_MAX_PAGE_SIZE EEPROM_ID_BIG_PAGE_SIZE
+
+/* Get the address command size and page size for the eeprom type */
+static int eeprom_geometry(int eeprom_type, uint8_t* cmd_size, uint8_t* page_size)
+{
+	switch (eeprom_type) {
+		case EEPROM_TYPE_SMALL:
+			*cmd_size = CMD_SIZE_SMALL;
+			*page_size = EEPROM_ID_SMALL_PAGE_SIZE;
+			return 0;
+		case EEPROM_TYPE_BIG:
+			*cmd_size = CMD_SIZE_BIG;
+			*page_size = EEPROM_ID_BIG_PAGE_SIZE;
+			return 0;
+		default:
+			return -ENODEV;
+	}
+}
+
+/* Fill the chip address and data offset bytes */
+static void eeprom_set_cmd(int eeprom_type, uint8_t eeprom_addr, uint32_t offset, char* cmd)
+{
+	if (eeprom_type == EEPROM_TYPE_SMALL) {
+		cmd[0] = EEPROM_ID_SMALL_ADDR_1 | ((offset & 0x700) >> 7);
+		cmd[1] = offset & 0xFF;
+	} else {
+		cmd[0] = eeprom_addr;
+		cmd[1] = ((offset & 0xFF00) >> 8);
+		cmd[2] = offset & 0xFF;
+	}
+}
+
+
+/***************************************************************************** */
+/* Write-back page cache
+ * A single page is cached, with the range of bytes modified since it was last written.
+ * The page is written (asynchronously) when a write goes to another page or on
+ *   eeprom_cache_flush(). The cache buffer keeps room for the address bytes before the
+ *   page data, so that the modified range is sent without copy.
+ * After a page write the eeprom does not answer until the page is programmed (up to 5ms).
+ *   This is checked when the eeprom is accessed again, or by eeprom_cache_poll().
+ * The end of the page data transfer is signaled by our own I2C completion callback, so
+ *   that other asynchronous transfers on the bus (display) are not mistaken for ours.
+ */
+#define EEPROM_CACHE_NO_PAGE  0xFFFFFFFF
+enum eeprom_cache_states {
+	EEPROM_CACHE_IDLE = 0,
+	EEPROM_CACHE_PROGRAMMING, /* Page data sent, the eeprom may be busy */
+	EEPROM_CACHE_SENDING,     /* Page data being sent from the cache buffer */
+};
+static struct eeprom_cache {
+	uint32_t page;        /* Offset of the cached page, or EEPROM_CACHE_NO_PAGE */
+	uint8_t eeprom_addr;
+	uint8_t dirty_start;
+	uint8_t dirty_end;    /* Modified range in the page, empty when dirty_end is 0 */
+	volatile uint8_t busy;  /* One of eeprom_cache_states */
+	char buf[MAX_CMD_SIZE + EEPROM_ID_MAX_PAGE_SIZE];
+} eeprom_cache = {
+	.page = EEPROM_CACHE_NO_PAGE,
+};
+#define EEPROM_CACHE_DATA  (eeprom_cache.buf + MAX_CMD_SIZE)
+
+static struct eeprom_stats eeprom_stats;
+
+const struct eeprom_stats* eeprom_get_stats(void)
+{
+	return &eeprom_stats;
+}
+
+int eeprom_cache_poll(void)
+{
+	int eeprom_type = 0, ret = 0;
+	char cmd[MAX_CMD_SIZE];
+
+	if (eeprom_cache.busy == EEPROM_CACHE_IDLE) {
+		return 0;
+	}
+	/* Page data still being sent ? */
+	if (eeprom_cache.busy == EEPROM_CACHE_SENDING) {
+		return -EAGAIN;
+	}
+	/* The device does not acknowledge anything during page write */
+	eeprom_type = get_eeprom_type(eeprom_cache.eeprom_addr);
+	eeprom_set_cmd(eeprom_type, eeprom_cache.eeprom_addr, 0, cmd);
+	eeprom_stats.busy_polls++;
+	ret = i2c_write(0, cmd, 1, NULL);
+	if (ret != 1) {
+		return -EAGAIN;
+	}
+	eeprom_cache.busy = EEPROM_CACHE_IDLE;
+	return 0;
+}
+
+/* End of the page data transfer, called from the I2C interrupt */
+static void eeprom_cache_sent(uint32_t state)
+{
+	eeprom_cache.busy = EEPROM_CACHE_PROGRAMMING;
+}
+
+void eeprom_cache_wait(void)
+{
+	while (eeprom_cache_poll() == -EAGAIN);
+}
+
+int eeprom_cache_flush(void)
+{
+	uint8_t cmd_size = 0, page_size = 0;
+	int eeprom_type = 0, ret = 0;
+	char* start = NULL;
+
+	if (eeprom_cache.dirty_end == 0) {
+		return 0;
+	}
+	eeprom_type = get_eeprom_type(eeprom_cache.eeprom_addr);
+	ret = eeprom_geometry(eeprom_type, &cmd_size, &page_size);
+	if (ret != 0) {
+		return ret;
+	}
+	/* Wait for the end of the previous page write */
+	eeprom_cache_wait();
+
+	/* Address bytes just before the modified range */
+	start = EEPROM_CACHE_DATA + eeprom_cache.dirty_start - cmd_size;
+	eeprom_set_cmd(eeprom_type, eeprom_cache.eeprom_addr,
+					(eeprom_cache.page + eeprom_cache.dirty_start), start);
+	/* Set before the start, the transfer may end before i2c_write_async_done() returns */
+	eeprom_cache.busy = EEPROM_CACHE_SENDING;
+	ret = i2c_write_async_done(0, start,
+					(cmd_size + eeprom_cache.dirty_end - eeprom_cache.dirty_start), NULL,
+					eeprom_cache_sent);
+	if (ret != 0) {
+		eeprom_cache.busy = EEPROM_CACHE_IDLE;
+		return ret;
+	}
+	eeprom_stats.page_writes++;
+	eeprom_stats.bytes_written += (eeprom_cache.dirty_end - eeprom_cache.dirty_start);
+	/* The address bytes overwrote some data : the page is not cached anymore */
+	eeprom_cache.dirty_start = 0;
+	eeprom_cache.dirty_end = 0;
+	eeprom_cache.page = EEPROM_CACHE_NO_PAGE;
+	return 0;
+}
+
+int eeprom_cache_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t count)
+{
+	uint8_t cmd_size = 0, page_size = 0;
+	int eeprom_type = 0, ret = 0;
+	size_t done = 0;
+
+	eeprom_type = get_eeprom_type(eeprom_addr);
+	ret = eeprom_geometry(eeprom_type, &cmd_size, &page_size);
+	if (ret != 0) {
+		return ret;
+	}
+	eeprom_stats.write_requests++;
+	eeprom_stats.bytes_requested += count;
+
+	while (done < count) {
+		uint32_t page = (offset & ~(page_size - 1));
+		uint8_t start = (offset - page);
+		uint8_t end = page_size;
+		if ((end - start) > (count - done)) {
+			end = start + (count - done);
+		}
+
+		/* Another page : write the cached one first */
+		if ((eeprom_cache.dirty_end != 0) &&
+				((eeprom_cache.page != page) || (eeprom_cache.eeprom_addr != eeprom_addr))) {
+			ret = eeprom_cache_flush();
+			if (ret != 0) {
+				break;
+			}
+		}
+		/* Do not modify the buffer while a page is being sent from it */
+		while (eeprom_cache.busy == EEPROM_CACHE_SENDING);
+
+		if (eeprom_cache.dirty_end == 0) {
+			eeprom_cache.page = page;
+			eeprom_cache.eeprom_addr = eeprom_addr;
+			eeprom_cache.dirty_start = start;
+			eeprom_cache.dirty_end = end;
+		} else {
+			/* Merge with the modified range, reading the bytes in between if any */
+			if (end < eeprom_cache.dirty_start) {
+				ret = eeprom_read(eeprom_addr, (page + end), (EEPROM_CACHE_DATA + end),
+									(eeprom_cache.dirty_start - end));
+				if (ret < 0) {
+					break;
+				}
+			} else if (start > eeprom_cache.dirty_end) {
+				ret = eeprom_read(eeprom_addr, (page + eeprom_cache.dirty_end),
+									(EEPROM_CACHE_DATA + eeprom_cache.dirty_end),
+									(start - eeprom_cache.dirty_end));
+				if (ret < 0) {
+					break;
+				}
+			}
+			if (start < eeprom_cache.dirty_start) {
+				eeprom_cache.dirty_start = start;
+			}
+			if (end > eeprom_cache.dirty_end) {
+				eeprom_cache.dirty_end = end;
+			}
+			eeprom_stats.merged_writes++;
+		}
+		memcpy((EEPROM_CACHE_DATA + start), ((const char*)buf + done), (end - start));
+		done += (end - start);
+		offset += (end - start);
+	}
+
+	if (done == 0) {
+		return ret;
+	}
+	return done;
+}
+
+int eeprom_cache_read(uint8_t eeprom_addr, uint32_t offset, void *buf, size_t count)
+{
+	uint32_t start = 0, end = 0;
+	int ret = 0;
+
+	ret = eeprom_read(eeprom_addr, offset, buf, count);
+	if ((ret <= 0) || (eeprom_cache.dirty_end == 0) || (eeprom_cache.eeprom_addr != eeprom_addr)) {
+		return ret;
+	}
+	/* Get the modified bytes from the cache */
+	start = eeprom_cache.page + eeprom_cache.dirty_start;
+	end = eeprom_cache.page + eeprom_cache.dirty_end;
+	if (start < offset) {
+		start = offset;
+	}
+	if (end > (offset + ret)) {
+		end = offset + ret;
+	}
+	if (start < end) {
+		memcpy(((char*)buf + (start - offset)), (EEPROM_CACHE_DATA + (start - eeprom_cache.page)),
+				(end - start));
+	}
+	return ret;
+}
+
+
 /* EEPROM Read
  * Performs a non-blocking read on the eeprom.
  *   address : data offset in eeprom.
@@ -123,6 +373,9 @@ int eeprom_read(uint8_t eeprom_addr, uint32_t offset, void *buf, size_t count)
 
 	eeprom_type = get_eeprom_type(eeprom_addr);
 
+	/* The eeprom does not answer while writing a page */
+	eeprom_cache_wait();
+
 	/* Read the requested data */
 	switch (eeprom_type) {
 		case EEPROM_TYPE_SMALL:
@@ -154,10 +407,6 @@ int eeprom_read(uint8_t eeprom_addr, uint32_t offset, void *buf, size_t count)
  *   Upon successfull completion, returns the number of bytes written. On error, returns a negative
  *   integer equivalent to errors from glibc.
  */
-#define CMD_SIZE_SMALL 2
-#define CMD_SIZE_BIG 3
-#define MAX_CMD_SIZE CMD_SIZE_BIG
-#define EEPROM_ID_MAX_PAGE_SIZE EEPROM_ID_BIG_PAGE_SIZE
 int eeprom_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t count)
 {
 	int ret = 0;
@@ -184,6 +433,14 @@ int eeprom_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t c
 			write_count = count + 1; /* skip the while loop, but return error */
 			break;
 	}
+	/* Write the cached page first, the data written here may overlap it */
+	if (eeprom_type > 0) {
+		ret = eeprom_cache_flush();
+		if (ret != 0) {
+			return ret;
+		}
+		eeprom_cache_wait();
+	}
 	while (write_count < count) {
 		switch (eeprom_type) {
 			case EEPROM_TYPE_SMALL:
@@ -216,8 +473,11 @@ int eeprom_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t c
 		 * page write, perform page writes with no data, until it returns 1 */
 		do {
 			ret = i2c_write(0, full_buff, 1, NULL);
+			eeprom_stats.busy_polls++;
 		} while (ret != 1);
 
+		eeprom_stats.page_writes++;
+		eeprom_stats.bytes_written += size;
 		write_count += size;
 	}
 
@@ -30,6 +30,8 @@
 #include "core/systick.h"
 #include "core/pio.h"
 #include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/errno.h"
 #include "drivers/gpio.h"
 #include "drivers/timers.h"
 #include "drivers/ssp.h"
@@ -45,9 +47,16 @@ struct epaper_definition* epd = NULL;
  * Configure all gpio used for e-paper display handling
  * Also calls timer_setup()
  * Keeps a pointer to the epaper_definition structure, which MUST stay available.
+ * Displays bigger than the line buffer are refused.
  */
-void epaper_config(struct epaper_definition* ep_def)
+int epaper_config(struct epaper_definition* ep_def)
 {
+	if ((ep_def == NULL) || (ep_def->lines > EPAPER_MAX_LINES) ||
+			(ep_def->bytes_per_line > EPAPER_MAX_BYTES_PER_LINE) ||
+			(ep_def->bytes_per_scan > (EPAPER_MAX_LINES / 4))) {
+		epd = NULL;
+		return -EINVAL;
+	}
 	/* Get a pointer to the epaper definition structure */
 	epd = ep_def;
 
@@ -66,6 +75,7 @@ void epaper_config(struct epaper_definition* ep_def)
 
 	/* PWM Timer configuration */
 	timer_pwm_config(epd->pwm_timer_num, &(epd->pwm_timer_conf));
+	return 0;
 }
 
 
@@ -74,15 +84,6 @@ void epaper_config(struct epaper_definition* ep_def)
 /*
  * internal functions for SPI communication with COG driver
  */
-static void epaper_spi_transfer_single_byte_wait(uint16_t data)
-{
-	struct lpc_gpio* gpio = LPC_GPIO_REGS(epd->pin_busy.port);
-
-	do {} while (gpio->in & (1 << epd->pin_busy.pin));
-
-	data = spi_transfer_single_frame(epd->spi_num, data);
-}
-
 static void epaper_spi_transfer(uint8_t* out, uint8_t* in, uint8_t size)
 {
 	/* Set CS Low */
@@ -206,137 +207,177 @@ static void epaper_cog_initialize()
  */
 void epaper_on()
 {
+	if (epd == NULL) {
+		return;
+	}
 	epaper_cog_power_on();
 	epaper_cog_initialize();
 }
 
 
+/*******************************************************************************/
+/*
+ * Per stage pixels transformations.
+ * Each pair of bits (one pixel) of the output only depends on the corresponding pair
+ *  of the input, so the transformations are stored as nibble tables, and each data
+ *  byte is converted using two lookups.
+ * Odd pixels are sent in reverse order, which is included in the odd pixels tables.
+ */
+/* Even pixels : B -> W, W -> B / B -> N, W -> W / B -> N, W -> B / B -> B, W -> W */
+#define EVEN_COMPENSATE(x)  (0xAA | ((((x) & 0xAA) ^ 0xAA) >> 1))
+#define EVEN_WHITE(x)       (0x55 + ((((x) & 0xAA) ^ 0xAA) >> 1))
+#define EVEN_INVERSE(x)     (0x55 | (((x) & 0xAA) ^ 0xAA))
+#define EVEN_NORMAL(x)      (0xAA | (((x) & 0xAA) >> 1))
+/* Odd pixels, same transformations */
+#define ODD_COMPENSATE(x)   (0xAA | (((x) & 0x55) ^ 0x55))
+#define ODD_WHITE(x)        (0x55 + (((x) & 0x55) ^ 0x55))
+#define ODD_INVERSE(x)      (0x55 | ((((x) & 0x55) ^ 0x55) << 1))
+#define ODD_NORMAL(x)       (0xAA | ((x) & 0x55))
+
+#define PAIR_SWAP(x)        ((((x) & 0x03) << 2) | (((x) & 0x0C) >> 2))
+#define EVEN_NIBBLE(f, n)   (f(n) & 0x0F)
+#define ODD_NIBBLE(f, n)    PAIR_SWAP(f(n) & 0x0F)
+#define LUT16(m, f) { \
+	m(f, 0),  m(f, 1),  m(f, 2),  m(f, 3),  m(f, 4),  m(f, 5),  m(f, 6),  m(f, 7), \
+	m(f, 8),  m(f, 9),  m(f, 10), m(f, 11), m(f, 12), m(f, 13), m(f, 14), m(f, 15), }
+
+/* Indexed by epaper_stages */
+static const uint8_t even_lut[4][16] = {
+	LUT16(EVEN_NIBBLE, EVEN_COMPENSATE),
+	LUT16(EVEN_NIBBLE, EVEN_WHITE),
+	LUT16(EVEN_NIBBLE, EVEN_INVERSE),
+	LUT16(EVEN_NIBBLE, EVEN_NORMAL),
+};
+static const uint8_t odd_lut[4][16] = {
+	LUT16(ODD_NIBBLE, ODD_COMPENSATE),
+	LUT16(ODD_NIBBLE, ODD_WHITE),
+	LUT16(ODD_NIBBLE, ODD_INVERSE),
+	LUT16(ODD_NIBBLE, ODD_NORMAL),
+};
+
+
 /*******************************************************************************/
 /*
  * internal function used to send a line to the display.
  * Line must be long enougth for the display
  * Line numbering starts at 0
+ * The whole line (data command, even pixels, scan line, odd pixels and termination)
+ *  is built in a buffer and sent in a single SPI transfer using the SSP fifo.
  */
+static uint8_t line_buff[EPAPER_LINE_BUFF_SIZE];
+
 static void epaper_send_data_line(const uint8_t line, uint8_t* line_data,
 								  uint8_t fixed_data, uint8_t stage)
 {
+	struct lpc_gpio* gpio = NULL;
+	const uint8_t* even = even_lut[stage & 0x03];
+	const uint8_t* odd = odd_lut[stage & 0x03];
+	uint8_t* buf = line_buff;
 	int i = 0;
-	uint8_t pixels = 0;
 
+	/* No display, or not configured : epaper_config() checked the line size */
+	if (epd == NULL) {
+		return;
+	}
+	gpio = LPC_GPIO_REGS(epd->pin_busy.port);
 	/* Set chargepump voltage level to reduce voltage shift */
 	epaper_spi_send(0x04, NULL, epd->gate_source_level, 1);
-	
+
 	/* Start with data index register */
-	/* Set CS Low */
-	gpio_clear(epd->pin_spi_cs);
-	epaper_spi_transfer_single_byte_wait(0x70);
-	epaper_spi_transfer_single_byte_wait(0x0A);
-	/* Release CS */
-	gpio_set(epd->pin_spi_cs);
+	buf[0] = 0x70;
+	buf[1] = 0x0A;
+	do {} while (gpio->in & (1 << epd->pin_busy.pin));
+	epaper_spi_transfer(buf, NULL, 2);
 	usleep(10);
 
-	/* Set CS Low */
-	gpio_clear(epd->pin_spi_cs);
-	epaper_spi_transfer_single_byte_wait(0x72);
+	*buf++ = 0x72;
 	/* Put even data bits first */
 	if (line_data != NULL) {
 		for (i = epd->bytes_per_line; i > 0; i--) {
-			pixels = line_data[i - 1] & 0xAA;
-			switch (stage) {
-				case epaper_compensate:  /* B -> W, W -> B (Current Image) */
-					pixels = 0xAA | ((pixels ^ 0xAA) >> 1);
-					break;
-				case epaper_white:       /* B -> N, W -> W (Current Image) */
-					pixels = 0x55 + ((pixels ^ 0xAA) >> 1);
-					break;
-				case epaper_inverse:     /* B -> N, W -> B (New Image) */
-					pixels = 0x55 | (pixels ^ 0xAA);
-					break;
-				case epaper_normal:      /* B -> B, W -> W (New Image) */
-					pixels = 0xAA | (pixels >> 1);
-					break;
-			}
-			pixels = pixels & 0xFF;
-			epaper_spi_transfer_single_byte_wait(pixels);
+			uint8_t pixels = line_data[i - 1];
+			*buf++ = (even[pixels >> 4] << 4) | even[pixels & 0x0F];
 		}
 	} else {
-		for (i = epd->bytes_per_line; i > 0; i--) {
-			epaper_spi_transfer_single_byte_wait(fixed_data);
-		}
+		memset(buf, fixed_data, epd->bytes_per_line);
+		buf += epd->bytes_per_line;
 	}
 
 	/* Send scan line ... All set to 0 but one */
-	for (i = 0; i < epd->bytes_per_scan; i++) {
-		if (i == (line >> 2)) {
-			epaper_spi_transfer_single_byte_wait((0xC0 >> ((line & 0x03) * 2)));
-		} else {
-			epaper_spi_transfer_single_byte_wait(0x00);
-		}
+	memset(buf, 0, epd->bytes_per_scan);
+	if ((line >> 2) < epd->bytes_per_scan) {
+		buf[(line >> 2)] = (0xC0 >> ((line & 0x03) * 2));
 	}
+	buf += epd->bytes_per_scan;
 
 	/* And then put odd data bits */
 	if (line_data != NULL) {
 		for (i = 0; i < epd->bytes_per_line; i++) {
-			uint16_t tmp = 0;
-			pixels = line_data[i] & 0x55;
-			switch(stage) {
-				case epaper_compensate:  /* B -> W, W -> B (Current Image) */
-					tmp = 0xaa | (pixels ^ 0x55);
-					break;
-				case epaper_white:       /* B -> N, W -> W (Current Image) */
-					tmp = 0x55 + (pixels ^ 0x55);
-					break;
-				case epaper_inverse:     /* B -> N, W -> B (New Image) */
-					tmp = 0x55 | ((pixels ^ 0x55) << 1);
-					break;
-				case epaper_normal:      /* B -> B, W -> W (New Image) */
-					tmp = 0xaa | pixels;
-					break;
-			}
-			/* Revert order */
-			pixels = (((tmp & 0x03) << 6) | ((tmp & 0x0C) << 2) | ((tmp & 0x30) >> 2) | ((tmp & 0xC0) >> 6));
-			epaper_spi_transfer_single_byte_wait(pixels);
+			uint8_t pixels = line_data[i];
+			*buf++ = (odd[pixels & 0x0F] << 4) | odd[pixels >> 4];
 		}
 	} else {
-		for (i = 0; i < epd->bytes_per_line; i++) {
-			epaper_spi_transfer_single_byte_wait(fixed_data);
-		}
+		memset(buf, fixed_data, epd->bytes_per_line);
+		buf += epd->bytes_per_line;
 	}
 
 	/* Line termination */
 	if (epd->line_termination_required) {
-		epaper_spi_transfer_single_byte_wait(0x00);
+		*buf++ = 0x00;
 	}
 
-	/* Done with the frame, release chip select */
-	gpio_set(epd->pin_spi_cs);
+	do {} while (gpio->in & (1 << epd->pin_busy.pin));
+	epaper_spi_transfer(line_buff, NULL, (buf - line_buff));
 
 	/* Turn on output enable to send data from CoG driver to panel */
 	epaper_spi_send(0x02, NULL, 0x2F, 1);
 }
 
-
-
-/*******************************************************************************/
-/* Epaper display functions */
-
 /*
- * Send whole image, performing only one stage.
- * Only "epaper_normal" has been tested yet.
+ * internal function used to perform one stage on the whole display or on the lines
+ *  set in the "lines" bitmap (if not NULL).
  */
-void epaper_send_frame(uint8_t* image, uint8_t stage)
+static void epaper_send_stage(uint8_t* image, const uint8_t* lines, uint8_t stage)
 {
 	uint32_t start_tick = systick_get_tick_count();
 	int i = 0;
 
+	if (epd == NULL) {
+		return;
+	}
 	do {
 		for (i = 0; i < epd->lines; i++) {
+			if ((lines != NULL) && !(lines[(i >> 3)] & (0x01 << (i & 0x07)))) {
+				continue;
+			}
 			epaper_send_data_line(i, (image + (i * epd->bytes_per_line)), 0, stage);
 		}
-	/* FIXME : start_tick will wrapp after 50 days */
 	} while ((systick_get_tick_count() - start_tick) < epd->stage_time);
 }
 
+/* Perform all stages on the whole display or on the lines set in the "lines" bitmap */
+static void epaper_send_all_stages(uint8_t* old_image_data, uint8_t* new_image_data,
+									const uint8_t* lines)
+{
+	epaper_send_stage(old_image_data, lines, epaper_compensate);
+	epaper_send_stage(old_image_data, lines, epaper_white);
+	epaper_send_stage(new_image_data, lines, epaper_inverse);
+	epaper_send_stage(new_image_data, lines, epaper_normal);
+}
+
+
+
+/*******************************************************************************/
+/* Epaper display functions */
+
+/*
+ * Send whole image, performing only one stage.
+ * Only "epaper_normal" has been tested yet.
+ */
+void epaper_send_frame(uint8_t* image, uint8_t stage)
+{
+	epaper_send_stage(image, NULL, stage);
+}
+
 /*
  * Update a few lines of the display.
  * Lines numbering starts at 0.
@@ -348,6 +389,9 @@ void epaper_send_partial_frame(uint8_t* image, uint8_t start_line, uint8_t nb_li
 	uint32_t start_tick = systick_get_tick_count();
 	int i = 0;
 
+	if (epd == NULL) {
+		return;
+	}
 	do {
 		for (i = 0; i < nb_lines; i++) {
 			epaper_send_data_line((start_line + i), (image + (i * epd->bytes_per_line)), 0, stage);
@@ -362,12 +406,42 @@ void epaper_send_partial_frame(uint8_t* image, uint8_t start_line, uint8_t nb_li
  *   - White,
  *   - Inversed new image,
  *   - New image.
- *
- * Note : unsupported yet.
  */
 void epaper_display(uint8_t* old_image_data, uint8_t* new_image_data)
 {
-	/* FIXME: perform all stages: Compensate old image, white, inversed new image, new image */
+	epaper_send_all_stages(old_image_data, new_image_data, NULL);
+}
+
+/*
+ * Update the display from old image to new image, performing all stages only on the
+ *   lines which changed.
+ */
+static uint8_t changed_lines[(EPAPER_MAX_LINES + 7) / 8];
+
+int epaper_update(uint8_t* old_image_data, uint8_t* new_image_data)
+{
+	int nb_changed = 0;
+	int line = 0, i = 0;
+
+	if (epd == NULL) {
+		return -EINVAL;
+	}
+	memset(changed_lines, 0, sizeof(changed_lines));
+	for (line = 0; line < epd->lines; line++) {
+		uint8_t* old = old_image_data + (line * epd->bytes_per_line);
+		uint8_t* new = new_image_data + (line * epd->bytes_per_line);
+		for (i = 0; i < epd->bytes_per_line; i++) {
+			if (old[i] != new[i]) {
+				changed_lines[(line >> 3)] |= (0x01 << (line & 0x07));
+				nb_changed++;
+				break;
+			}
+		}
+	}
+	if (nb_changed != 0) {
+		epaper_send_all_stages(old_image_data, new_image_data, changed_lines);
+	}
+	return nb_changed;
 }
 
 /*
@@ -381,6 +455,9 @@ void epaper_uniform_display(uint8_t value)
 	uint32_t start_tick = systick_get_tick_count();
 	int i = 0;
 
+	if (epd == NULL) {
+		return;
+	}
 	do {
 		for (i = 0; i < epd->lines; i++) {
 			epaper_send_data_line(i, NULL, value, 0);
@@ -397,6 +474,9 @@ void epaper_off()
 {
 	int i = 0;
 
+	if (epd == NULL) {
+		return;
+	}
 	/* Write a Nothing frame */
 	for (i = 0; i < epd->lines; i++) {
 		epaper_send_data_line(i, NULL, 0x55, 0); /* Will send all 'N' */
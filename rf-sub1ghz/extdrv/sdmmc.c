@@ -24,7 +24,7 @@
 #include "core/system.h"
 #include "lib/string.h"
 #include "lib/errno.h"
-#include "lib/crc_ccitt.h"
+#include "lib/crc.h"
 #include "lib/utils.h"
 #include "drivers/gpio.h"
 #include "drivers/ssp.h"
@@ -121,6 +121,10 @@ static int sdmmc_send_command(const struct sdmmc_card* mmc, uint8_t index, uint3
 
 	/* Send command */
 	spi_transfer_multiple_frames(mmc->ssp_bus_num, mmc_command, NULL, MMC_CMD_SIZE, 8);
+	/* The byte following CMD12 is a stuff byte, which may be read data and must be dropped */
+	if (index == MMC_STOP_TRANSMISSION) {
+		spi_transfer_single_frame(mmc->ssp_bus_num, 0xFF);
+	}
 
 	/* Get R1 */
 	for (i = 0; i < 8; i++) {
@@ -289,51 +293,31 @@ end_init_release_bus:
 }
 
 
-/* Read one block of data.
- * Returns -EINVAL on arguments error, -ENODEV on command error,
- *         -EBUSY on timeout, -EIO on CRC error,
- *         or 0 on success
+/* Receive one data block (start token, data and CRC) from the card, once the read
+ *   command has been sent.
+ * Returns -EBUSY on timeout, -EIO on CRC error, or 0 on success.
+ * Note : The SPI Bus mutex must be held by the calling function.
  */
 #define TMPBUF_SIZE 64
-int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t* buffer)
+static int sdmmc_receive_data_block(const struct sdmmc_card* mmc, uint8_t* buffer)
 {
 	uint16_t crc = 0x0000;
 	uint16_t sd_crc = 0xFFFF;
 	int ret = 0;
 
-	if ((buffer == NULL) || (mmc->card_type == MMC_CARDTYPE_UNKNOWN)) {
-		return -EINVAL;
-	}
-
 	/* Garbage for the SPI out data */
 	memset(buffer, 0xFF, mmc->block_size);
 
-	/* Non SDHC cards use address and not block number */
-	if (mmc->card_type != MMC_CARDTYPE_SDV2_HC) {
-		block_number = (block_number << mmc->block_shift);
-	}
-
-	/* Get SPI Bus */
-	spi_get_mutex(mmc->ssp_bus_num);
-	sdmmc_cs_activate(mmc);
-
-	ret = sdmmc_send_command(mmc, MMC_READ_SINGLE_BLOCK, block_number, NULL, 0);
-	if (ret != MMC_R1_NO_ERROR) {
-		ret = -ENODEV;
-		goto read_release;
-	}
-
 	/* Wait for start of Data */
 	ret = sdmmc_wait_for_ready(mmc, MMC_START_DATA_BLOCK_TOCKEN);
 	if (ret != MMC_START_DATA_BLOCK_TOCKEN) {
-		ret = -EBUSY;
-		goto read_release;
+		return -EBUSY;
 	}
 
 	/* Read data, interresting part */
 	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, NULL, buffer, mmc->block_size, 8);
 	/* Compute CRC of this part */
-	crc = crc_ccitt(0x0000, buffer, mmc->block_size);
+	crc = crc_compute(CRC_TYPE_CCITT, 0x0000, buffer, mmc->block_size);
 	/* Read data, remaining part */
 	if ((mmc->card_type == MMC_CARDTYPE_SDV2_HC) && (mmc->block_size != MMC_MAX_SECTOR_SIZE)) {
 		char tmpbuf[TMPBUF_SIZE];
@@ -347,7 +331,7 @@ int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_
 			/* Read data - remaining part ... and drop it (null input but non null output buffer) */
 			ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, NULL, tmpbuf, tmp_size, 8);
 			/* Update CRC with this part */
-			crc = crc_ccitt(crc, (uint8_t*)tmpbuf, tmp_size);
+			crc = crc_compute(CRC_TYPE_CCITT, crc, (uint8_t*)tmpbuf, tmp_size);
 			size -= tmp_size;
 		} while (size > 0);
 	}
@@ -355,7 +339,100 @@ int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_
 	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, NULL, (uint8_t*)(&sd_crc), 2, 8);
 	sd_crc = (uint16_t)ntohs(sd_crc);
 	if (crc != sd_crc) {
-		ret = -EIO;
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Send one data block (start token, data and CRC) to the card, once the write command
+ *   has been sent, and wait for the end of programming.
+ * Returns -ECOMM on response error, -EIO on CRC error, -EPERM on write error,
+ *   -EBUSY on timeout, or 0 on success.
+ * Note : The SPI Bus mutex must be held by the calling function.
+ */
+static int sdmmc_send_data_block(const struct sdmmc_card* mmc, uint8_t token, uint8_t* buffer)
+{
+	uint16_t crc = 0xFFFF;
+	int ret = 0;
+
+	/* Send start of Data token */
+	ret = (uint8_t)spi_transfer_single_frame(mmc->ssp_bus_num, token);
+
+	/* Send interresting data */
+	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, buffer, NULL, mmc->block_size, 8);
+	/* Compute CRC of this part */
+	crc = crc_compute(CRC_TYPE_CCITT, 0x0000, buffer, mmc->block_size);
+	/* Send data, remaining part */
+	if ((mmc->card_type == MMC_CARDTYPE_SDV2_HC) && (mmc->block_size != MMC_MAX_SECTOR_SIZE)) {
+		int size = (MMC_MAX_SECTOR_SIZE - mmc->block_size);
+		do {
+			int tmp_size = mmc->block_size;
+			if (tmp_size > size) {
+				tmp_size = size;
+			}
+			/* Send data - remaining part ... using the same data again */
+			ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, buffer, NULL, tmp_size, 8);
+			/* Update CRC with this part */
+			crc = crc_compute(CRC_TYPE_CCITT, crc, buffer, tmp_size);
+			size -= tmp_size;
+		} while (size > 0);
+	}
+	/* Send CRC (in network endianness) */
+	crc = (uint16_t)ntohs(crc);
+	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, (uint8_t*)(&crc), NULL, 2, 8);
+
+	/* Get Data response tocken */
+	ret = (uint8_t)spi_transfer_single_frame(mmc->ssp_bus_num, 0xFF);
+	if (!MMC_IS_WRITE_RESPONSE_TOKEN(ret)) {
+		return -ECOMM;
+	}
+	ret = MMC_WRITE_RESPONSE_TOKEN(ret);
+	if (ret != MMC_WRITE_RESPONSE_OK) {
+		if (ret == MMC_WRITE_RESPONSE_CRC_ERR) {
+			return -EIO;
+		}
+		return -EPERM;
+	}
+
+	/* Wait for card ready */
+	ret = sdmmc_wait_for_ready(mmc, 0xFF);
+	if (ret != 0xFF) {
+		return -EBUSY;
+	}
+	return 0;
+}
+
+
+/* Read one block of data.
+ * Returns -EINVAL on arguments error, -ENODEV on command error,
+ *         -EBUSY on timeout, -EIO on CRC error,
+ *         or 0 on success
+ */
+int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t* buffer)
+{
+	int ret = 0;
+
+	if ((buffer == NULL) || (mmc->card_type == MMC_CARDTYPE_UNKNOWN)) {
+		return -EINVAL;
+	}
+
+	/* Non SDHC cards use address and not block number */
+	if (mmc->card_type != MMC_CARDTYPE_SDV2_HC) {
+		block_number = (block_number << mmc->block_shift);
+	}
+
+	/* Get SPI Bus */
+	spi_get_mutex(mmc->ssp_bus_num);
+	sdmmc_cs_activate(mmc);
+
+	ret = sdmmc_send_command(mmc, MMC_READ_SINGLE_BLOCK, block_number, NULL, 0);
+	if (ret != MMC_R1_NO_ERROR) {
+		ret = -ENODEV;
+		goto read_release;
+	}
+
+	ret = sdmmc_receive_data_block(mmc, buffer);
+	if (ret != 0) {
 		goto read_release;
 	}
 
@@ -375,6 +452,64 @@ read_release:
 	return ret;
 }
 
+/* Read nb_blocks consecutive blocks of data using a single read command (CMD18), which
+ *   saves the command and card access time for all blocks but the first one.
+ * The transfer is ended with CMD12 (STOP_TRANSMISSION), even on error.
+ * Returns -EINVAL on arguments error, -ENODEV on command error,
+ *         -EBUSY on timeout, -EIO on CRC error,
+ *         or 0 on success
+ */
+int sdmmc_read_blocks(const struct sdmmc_card* mmc, uint32_t block_number,
+						uint32_t nb_blocks, uint8_t* buffer)
+{
+	int ret = 0, r1 = 0;
+
+	if ((buffer == NULL) || (mmc->card_type == MMC_CARDTYPE_UNKNOWN)) {
+		return -EINVAL;
+	}
+	if (nb_blocks <= 1) {
+		if (nb_blocks == 0) {
+			return 0;
+		}
+		return sdmmc_read_block(mmc, block_number, buffer);
+	}
+
+	/* Non SDHC cards use address and not block number */
+	if (mmc->card_type != MMC_CARDTYPE_SDV2_HC) {
+		block_number = (block_number << mmc->block_shift);
+	}
+
+	/* Get SPI Bus */
+	spi_get_mutex(mmc->ssp_bus_num);
+	sdmmc_cs_activate(mmc);
+
+	ret = sdmmc_send_command(mmc, MMC_READ_MULTIPLE_BLOCK, block_number, NULL, 0);
+	if (ret != MMC_R1_NO_ERROR) {
+		ret = -ENODEV;
+		goto read_multi_release;
+	}
+
+	while (nb_blocks-- > 0) {
+		ret = sdmmc_receive_data_block(mmc, buffer);
+		if (ret != 0) {
+			break;
+		}
+		buffer += mmc->block_size;
+	}
+
+	/* Stop the transfer. The card may have started sending the next block. */
+	r1 = sdmmc_send_command(mmc, MMC_STOP_TRANSMISSION, 0, NULL, -1);
+	if ((ret == 0) && (r1 != MMC_R1_NO_ERROR)) {
+		ret = -EBUSY;
+	}
+
+read_multi_release:
+	/* Release SPI Bus */
+	sdmmc_cs_release(mmc);
+	spi_release_mutex(mmc->ssp_bus_num);
+	return ret;
+}
+
 
 
 /* Write one block of data.
@@ -386,7 +521,6 @@ read_release:
  */
 int sdmmc_write_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t* buffer)
 {
-	uint16_t crc = 0xFFFF;
 	int ret = 0;
 
 	if ((buffer == NULL) || (mmc->card_type == MMC_CARDTYPE_UNKNOWN)) {
@@ -407,63 +541,84 @@ int sdmmc_write_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8
 		goto write_release;
 	}
 
-	/* Send start of Data token */
-	ret = (uint8_t)spi_transfer_single_frame(mmc->ssp_bus_num, MMC_START_DATA_BLOCK_TOCKEN);
+	ret = sdmmc_send_data_block(mmc, MMC_START_DATA_BLOCK_TOCKEN, buffer);
 
-	/* Send interresting data */
-	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, buffer, NULL, mmc->block_size, 8);
-	/* Compute CRC of this part */
-	crc = crc_ccitt(0x0000, buffer, mmc->block_size);
-	/* Send data, remaining part */
-	if ((mmc->card_type == MMC_CARDTYPE_SDV2_HC) && (mmc->block_size != MMC_MAX_SECTOR_SIZE)) {
-		int size = (MMC_MAX_SECTOR_SIZE - mmc->block_size);
-		do {
-			int tmp_size = mmc->block_size;
-			if (tmp_size > size) {
-				tmp_size = size;
-			}
-			/* Send data - remaining part ... using the same data again */
-			ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, buffer, NULL, tmp_size, 8);
-			/* Update CRC with this part */
-			crc = crc_ccitt(crc, buffer, tmp_size);
-			size -= tmp_size;
-		} while (size > 0);
+write_release:
+	/* Release SPI Bus */
+	sdmmc_cs_release(mmc);
+	spi_release_mutex(mmc->ssp_bus_num);
+	return ret;
+}
+
+/* Write nb_blocks consecutive blocks of data using a single write command (CMD25).
+ * SD cards are first told the number of blocks to be written (ACMD23), so that they can
+ *   pre-erase them and program the data faster. Failure of this step is not an error.
+ * The transfer is ended with the "Stop Tran" token, even on error. The card keeps the
+ *   blocks written before the error.
+ * Returns -EINVAL on arguments error, -ENODEV on command error,
+ *         -ECOMM on response error, -EIO on CRC error, -EPERM on write error,
+ *         -EBUSY on timeout, or 0 on success
+ */
+int sdmmc_write_blocks(const struct sdmmc_card* mmc, uint32_t block_number,
+						uint32_t nb_blocks, uint8_t* buffer)
+{
+	int ret = 0, val = 0;
+
+	if ((buffer == NULL) || (mmc->card_type == MMC_CARDTYPE_UNKNOWN)) {
+		return -EINVAL;
+	}
+	if (nb_blocks <= 1) {
+		if (nb_blocks == 0) {
+			return 0;
+		}
+		return sdmmc_write_block(mmc, block_number, buffer);
 	}
-	/* Send CRC (in network endianness) */
-	crc = (uint16_t)ntohs(crc);
-	ret = spi_transfer_multiple_frames(mmc->ssp_bus_num, (uint8_t*)(&crc), NULL, 2, 8);
 
-	/* Get Data response tocken */
-	ret = (uint8_t)spi_transfer_single_frame(mmc->ssp_bus_num, 0xFF);
-	if (!MMC_IS_WRITE_RESPONSE_TOKEN(ret)) {
-		ret = -ECOMM;
-		goto write_release;
+	if (mmc->card_type != MMC_CARDTYPE_SDV2_HC) {
+		block_number = (block_number << mmc->block_shift);
 	}
-	ret = MMC_WRITE_RESPONSE_TOKEN(ret);
-	if (ret != MMC_WRITE_RESPONSE_OK) {
-		if (ret == MMC_WRITE_RESPONSE_CRC_ERR) {
-			ret = -EIO;
-		} else {
-			ret = -EPERM;
+
+	/* Get SPI Bus */
+	spi_get_mutex(mmc->ssp_bus_num);
+	sdmmc_cs_activate(mmc);
+
+	/* Pre-erase (SD cards only, the count is limited to 23 bits) */
+	if (mmc->card_type != MMC_CARDTYPE_MMC) {
+		sdmmc_send_app_command(mmc, MMC_SD_SET_WR_BLK_ERASE_COUNT, (nb_blocks & 0x007FFFFF));
+	}
+
+	ret = sdmmc_send_command(mmc, MMC_WRITE_MULTIPLE_BLOCK, block_number, NULL, 0);
+	if (ret != MMC_R1_NO_ERROR) {
+		ret = -ENODEV;
+		goto write_multi_release;
+	}
+
+	while (nb_blocks-- > 0) {
+		ret = sdmmc_send_data_block(mmc, MMC_START_MULTI_WRITE_TOCKEN, buffer);
+		if (ret != 0) {
+			break;
 		}
-		goto write_release;
+		buffer += mmc->block_size;
 	}
 
-	/* Wait for card ready */
-	ret = sdmmc_wait_for_ready(mmc, 0xFF);
-	if (ret != 0xFF) {
+	/* The card ignores the "Stop Tran" token while busy, which is still the case after a
+	 *   busy timeout : wait again before sending it. */
+	val = sdmmc_wait_for_ready(mmc, 0xFF);
+	if (val != 0xFF) {
+		ret = -EBUSY;
+		goto write_multi_release;
+	}
+	/* Send "Stop Tran" token, skip one byte, and wait for the end of programming */
+	spi_transfer_single_frame(mmc->ssp_bus_num, MMC_STOP_MULTI_WRITE_TOCKEN);
+	spi_transfer_single_frame(mmc->ssp_bus_num, 0xFF);
+	val = sdmmc_wait_for_ready(mmc, 0xFF);
+	if ((ret == 0) && (val != 0xFF)) {
 		ret = -EBUSY;
-		goto write_release;
 	}
 
-	ret = 0;
-
-write_release:
+write_multi_release:
 	/* Release SPI Bus */
 	sdmmc_cs_release(mmc);
 	spi_release_mutex(mmc->ssp_bus_num);
 	return ret;
 }
-
-
-
@@ -0,0 +1,192 @@
+/****************************************************************************
+ *  extdrv/sensor.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/errno.h"
+#include "core/systick.h"
+#include "extdrv/sensor.h"
+
+
+/***************************************************************************** */
+/* Generic sensors interface and polling                                       */
+/***************************************************************************** */
+
+static struct sensor* sensors[SENSORS_MAX_NB];
+static uint8_t nb_sensors = 0;
+
+/* Longest delay returned by sensors_poll() */
+#define SENSORS_MAX_DELAY  SENSOR_RETRY_PERIOD
+
+static inline uint32_t sensors_now(void)
+{
+	return (systick_get_tick_count() * systick_get_tick_ms_period());
+}
+
+/* Is "time" reached ? Works across counter wrapping. */
+static inline int sensor_due(uint32_t time, uint32_t now)
+{
+	return ((int32_t)(now - time) >= 0);
+}
+
+int sensor_register(struct sensor* sensor)
+{
+	if ((sensor == NULL) || (sensor->ops == NULL) || (sensor->ops->read_raw == NULL)) {
+		return -EINVAL;
+	}
+	if (nb_sensors >= SENSORS_MAX_NB) {
+		return -ENOMEM;
+	}
+	sensor->state = SENSOR_ABSENT;
+	sensor->last_error = 0;
+	sensor->next = sensors_now();
+	sensors[nb_sensors++] = sensor;
+	return 0;
+}
+
+static void sensor_failed(struct sensor* sensor, int error, uint32_t now)
+{
+	sensor->state = SENSOR_ABSENT;
+	sensor->last_error = error;
+	sensor->next = now + SENSOR_RETRY_PERIOD;
+}
+
+/* Probe and configure an absent sensor */
+static void sensor_setup(struct sensor* sensor, uint32_t now)
+{
+	const struct sensor_operations* ops = sensor->ops;
+	uint32_t min_period = 0;
+	int ret = 0;
+
+	if ((ops->probe != NULL) && (ops->probe(sensor->conf) != 1)) {
+		sensor_failed(sensor, -ENODEV, now);
+		return;
+	}
+	if (ops->configure != NULL) {
+		ret = ops->configure(sensor->conf);
+		if (ret != 0) {
+			sensor_failed(sensor, ret, now);
+			return;
+		}
+	}
+	if (ops->min_period != NULL) {
+		min_period = ops->min_period(sensor->conf);
+	}
+	if (sensor->period < min_period) {
+		sensor->period = min_period;
+	}
+	sensor->state = SENSOR_IDLE;
+	sensor->last_error = 0;
+	/* Free running sensors need a first conversion after configuration */
+	if (ops->start_conversion == NULL) {
+		sensor->next = now + min_period;
+	} else {
+		sensor->next = now;
+	}
+	sensor->start = sensor->next;
+}
+
+static void sensor_start(struct sensor* sensor, uint32_t now)
+{
+	const struct sensor_operations* ops = sensor->ops;
+	int ret = 0;
+
+	sensor->start = now;
+	if (ops->start_conversion == NULL) {
+		/* Free running : the last measurement can be read right away */
+		sensor->state = SENSOR_CONVERTING;
+		return;
+	}
+	ret = ops->start_conversion(sensor->conf);
+	if (ret != 0) {
+		sensor_failed(sensor, ret, now);
+		return;
+	}
+	sensor->state = SENSOR_CONVERTING;
+	sensor->next = now + ((ops->min_period != NULL) ? ops->min_period(sensor->conf) : 0);
+}
+
+static void sensor_read(struct sensor* sensor, uint32_t now)
+{
+	const struct sensor_operations* ops = sensor->ops;
+	struct sensor_raw raw;
+	struct sensor_values values;
+	int ret = 0;
+
+	ret = ops->read_raw(sensor->conf, &raw);
+	if (ret != 0) {
+		sensor_failed(sensor, ret, now);
+		return;
+	}
+	values.nb = 0;
+	if (ops->compensate != NULL) {
+		ret = ops->compensate(sensor->conf, &raw, &values);
+	}
+	sensor->state = SENSOR_IDLE;
+	if ((ret == 0) && (ops->compensate != NULL) && (values.nb == 0)) {
+		/* No valid values for this conversion, which is neither an error nor a sample :
+		 * start a new one right away */
+		sensor->next = now;
+		return;
+	}
+	if ((ret == 0) && (sensor->callback != NULL)) {
+		sensor->callback(sensor, &values);
+	}
+	sensor->last_error = ret;
+	/* Keep the period, unless we are late */
+	sensor->next = sensor->start + sensor->period;
+	if (sensor_due(sensor->next, now)) {
+		sensor->next = now;
+	}
+}
+
+uint32_t sensors_poll(void)
+{
+	uint32_t now = sensors_now();
+	uint32_t delay = SENSORS_MAX_DELAY;
+	int i = 0;
+
+	/* Setup the new or failed sensors, and start all the conversions due */
+	for (i = 0; i < nb_sensors; i++) {
+		struct sensor* sensor = sensors[i];
+		if (!sensor_due(sensor->next, now)) {
+			continue;
+		}
+		if (sensor->state == SENSOR_ABSENT) {
+			sensor_setup(sensor, now);
+		}
+		if ((sensor->state == SENSOR_IDLE) && sensor_due(sensor->next, now)) {
+			sensor_start(sensor, now);
+		}
+	}
+
+	/* Then read the sensors which are ready, and get the nearest deadline */
+	now = sensors_now();
+	for (i = 0; i < nb_sensors; i++) {
+		struct sensor* sensor = sensors[i];
+		if ((sensor->state == SENSOR_CONVERTING) && sensor_due(sensor->next, now)) {
+			sensor_read(sensor, now);
+		}
+		if (sensor_due(sensor->next, now)) {
+			delay = 0;
+		} else if ((sensor->next - now) < delay) {
+			delay = sensor->next - now;
+		}
+	}
+	return delay;
+}
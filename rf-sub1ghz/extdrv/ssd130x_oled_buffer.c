@@ -22,13 +22,25 @@
  *************************************************************************** */
 
 #include "lib/string.h"
+#include "lib/errno.h"
+#include "lib/utils.h"
+#include "lib/font.h"
 
 #include "extdrv/ssd130x_oled_driver.h"
+#include "extdrv/ssd130x_oled_buffer.h"
+
+/* Mark a single tile as modified */
+static inline void ssd130x_buffer_mark_tile(uint8_t* gddram, uint8_t x0, uint8_t y0)
+{
+	uint8_t* map = SSD130x_DIRTY_MAP(gddram);
+	map[(y0 * 2) + (x0 >> 3)] |= (0x01 << (x0 & 0x07));
+}
 
 /* Set whole display to given value */
 int ssd130x_buffer_set(uint8_t *gddram, uint8_t val)
 {
 	memset(gddram + 4, val, GDDRAM_SIZE);
+	memset(SSD130x_DIRTY_MAP(gddram), 0xFF, SSD130x_DIRTY_MAP_SIZE);
 	return 0;
 }
 
@@ -36,22 +48,157 @@ int ssd130x_buffer_set(uint8_t *gddram, uint8_t val)
 int ssd130x_buffer_set_pixel(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t state)
 {
 	uint8_t* addr = gddram + 4 + ((y0 / 8) * 128) + x0;
+	uint8_t old = *addr;
 	if (state != 0) {
 		*addr |=  (0x01 << (y0 % 8));
 	} else {
 		*addr &= ~(0x01 << (y0 % 8));
 	}
+	if (*addr != old) {
+		ssd130x_buffer_mark_tile(gddram, (x0 / 8), (y0 / 8));
+	}
 	return 0;
 }
 
 /* Change a "tile" in the bitmap memory.
  * A tile is a 8x8 pixels region, aligned on a 8x8 grid representation of the display.
  *  x0 and y0 are in number of tiles.
+ * The tile is marked as modified only if it's content changed.
  */
 int ssd130x_buffer_set_tile(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t* tile)
 {
 	uint8_t* addr = gddram + 4 + (y0 * 128) + (x0 * 8);
-	memcpy(addr, tile, 8);
+	uint8_t diff = 0;
+	int i = 0;
+
+	for (i = 0; i < 8; i++) {
+		diff |= (addr[i] ^ tile[i]);
+		addr[i] = tile[i];
+	}
+	if (diff != 0) {
+		ssd130x_buffer_mark_tile(gddram, x0, y0);
+	}
+	return 0;
+}
+
+/* Mark a region of tiles as modified, for use after direct changes to the buffer. */
+int ssd130x_buffer_mark_region(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+	uint8_t x = 0;
+
+	if ((x1 >= SSD130x_TILES_PER_PAGE) || (y1 >= SSD130x_NB_PAGES) || (x0 > x1) || (y0 > y1)) {
+		return -EINVAL;
+	}
+	for (; y0 <= y1; y0++) {
+		for (x = x0; x <= x1; x++) {
+			ssd130x_buffer_mark_tile(gddram, x, y0);
+		}
+	}
+	return 0;
+}
+
+
+/***************************************************************************** */
+/* Text layer */
+
+#define TEXT_NO_GLYPH  0xFF
+
+void ssd130x_text_init(struct ssd130x_text_layer* text, uint8_t* gddram, const uint64_t* font)
+{
+	text->gddram = gddram;
+	text->font = font;
+	ssd130x_text_invalidate(text);
+}
+
+void ssd130x_text_invalidate(struct ssd130x_text_layer* text)
+{
+	memset(text->cells, TEXT_NO_GLYPH, sizeof(text->cells));
+}
+
+int ssd130x_text_putc(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, char c)
+{
+	uint8_t glyph = 0;
+
+	if ((line >= SSD130x_NB_PAGES) || (col >= SSD130x_TILES_PER_PAGE)) {
+		return -EINVAL;
+	}
+	if (((uint8_t)c > FIRST_FONT_CHAR) && ((uint8_t)c < (FIRST_FONT_CHAR + NB_FONT_TILES))) {
+		glyph = c - FIRST_FONT_CHAR;
+	}
+	if (text->cells[line][col] != glyph) {
+		text->cells[line][col] = glyph;
+		ssd130x_buffer_set_tile(text->gddram, col, line, (uint8_t*)(&text->font[glyph]));
+	}
+	return 0;
+}
+
+int ssd130x_text_puts(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, const char* str)
+{
+	int i = 0;
+
+	while ((str[i] != '\0') && (line < SSD130x_NB_PAGES)) {
+		ssd130x_text_putc(text, line, col++, str[i++]);
+		if (col >= SSD130x_TILES_PER_PAGE) {
+			col = 0;
+			line++;
+		}
+	}
+	return i;
+}
+
+int ssd130x_text_clear(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, uint8_t len)
+{
+	int i = 0;
+
+	for (i = 0; (i < len) && (line < SSD130x_NB_PAGES); i++) {
+		ssd130x_text_putc(text, line, col++, ' ');
+		if (col >= SSD130x_TILES_PER_PAGE) {
+			col = 0;
+			line++;
+		}
+	}
+	return i;
+}
+
+int ssd130x_text_fixed(struct ssd130x_text_layer* text, uint8_t line, uint8_t col,
+						uint8_t width, int32_t value, uint8_t decimals)
+{
+	char field[SSD130x_TILES_PER_PAGE];
+	uint32_t val = (value < 0) ? -value : value;
+	uint8_t nb_digits = 0;
+	int i = width;
+
+	if ((width == 0) || ((col + width) > SSD130x_TILES_PER_PAGE)) {
+		return -EINVAL;
+	}
+	/* Fill the field from the right, with at least one digit before the decimal point */
+	do {
+		uint32_t quot = udiv10(val);
+		if ((decimals != 0) && (nb_digits == decimals) && (i > 0)) {
+			field[--i] = '.';
+		}
+		if (i == 0) {
+			break;
+		}
+		field[--i] = '0' + (val - (quot * 10));
+		val = quot;
+		nb_digits++;
+	} while ((val != 0) || (nb_digits <= decimals));
+	if ((value < 0) && (i > 0)) {
+		field[--i] = '-';
+		value = 0;
+	}
+	if ((val != 0) || (nb_digits <= decimals) || (value < 0)) {
+		/* Does not fit */
+		memset(field, '#', width);
+		i = 0;
+	}
+	while (i > 0) {
+		field[--i] = ' ';
+	}
+	for (i = 0; i < width; i++) {
+		ssd130x_text_putc(text, line, (col + i), field[i]);
+	}
 	return 0;
 }
 
@@ -32,6 +32,7 @@
 #include "drivers/gpio.h"
 #include "drivers/i2c.h"
 #include "drivers/ssp.h"
+#include "lib/prof.h"
 #include "extdrv/ssd130x_oled_driver.h"
 
 
@@ -365,8 +366,6 @@ int ssd130x_send_data(struct oled_display* conf, uint8_t* start, uint16_t len)
 			return ret;
 		}
 	} else if (conf->bus_type == SSD130x_BUS_I2C) {
-		int (*write)(uint8_t, const void *, size_t, const void*);
-
 		/* Check that start and satrt + len are within buffer */
 
 		/* Copy previous two bytes to storage area (gddram[0] and gddram[1]) */
@@ -377,10 +376,10 @@ int ssd130x_send_data(struct oled_display* conf, uint8_t* start, uint16_t len)
 		*(start - 2) = conf->address;
 		*(start - 1) = SSD130x_DATA_ONLY;
 
-		/* Send data on I2C bus */
-		write = conf->async ? i2c_write_async : i2c_write;
+		/* Send data on I2C bus.
+		 * This must be a synchronous write as we restore data right after. */
 		do {
-			ret = write(conf->bus_num, (start - 2), (2 + len), NULL);
+			ret = i2c_write(conf->bus_num, (start - 2), (2 + len), NULL);
 		} while (ret == -EAGAIN);
 
 		/* Restore gddram data */
@@ -400,14 +399,17 @@ int ssd130x_send_data(struct oled_display* conf, uint8_t* start, uint16_t len)
 int ssd130x_display_full_screen(struct oled_display* conf)
 {
 	int ret;
+	PROF_ENTER(ssd130x_full);
 
 	if (!conf->fullscreen) {
 		ret = ssd130x_set_column_address(conf, 0, 127);
 		if (ret != 0) {
+			PROF_EXIT(ssd130x_full);
 			return ret;
 		}
 		ret = ssd130x_set_page_address(conf, 0, 7);
 		if (ret != 0) {
+			PROF_EXIT(ssd130x_full);
 			return ret;
 		}
 		conf->fullscreen = 1;
@@ -427,11 +429,26 @@ int ssd130x_display_full_screen(struct oled_display* conf)
 			ret = write(conf->bus_num, conf->gddram + 2, 2 + GDDRAM_SIZE, NULL);
 		} while (ret == -EAGAIN);
 	} else {
+		PROF_EXIT(ssd130x_full);
 		return -EPROTO;
 	}
+	if (ret >= 0) {
+		memset(SSD130x_DIRTY_MAP(conf->gddram), 0, SSD130x_DIRTY_MAP_SIZE);
+	}
+	PROF_EXIT(ssd130x_full);
 	return ret;
 }
 
+/* Clear the modified flag of a region of tiles, x1 and y1 included */
+static void ssd130x_clear_modified(uint8_t* map, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+	uint16_t mask = ((0x01 << (x1 + 1)) - (0x01 << x0));
+	for (; y0 <= y1; y0++) {
+		map[(y0 * 2)] &= ~(mask & 0xFF);
+		map[(y0 * 2) + 1] &= ~(mask >> 8);
+	}
+}
+
 /* Change a "tile" in the GDDRAM memory.
  * A tile is a 8x8 pixels region, aligned on a 8x8 grid representation of the display.
  *  x0 and y0 are in number of tiles.
@@ -455,11 +472,332 @@ int ssd130x_update_tile(struct oled_display* conf, uint8_t x0, uint8_t y0)
 	if (ret != 0) {
 		return ret;
 	}
+	ssd130x_clear_modified(SSD130x_DIRTY_MAP(conf->gddram), x0, y0, x0, y0);
 	return 0;
 }
 
+/* Send a rectangular region of tiles to the display.
+ * x0, y0, x1 and y1 are in number of tiles, x1 and y1 included.
+ * The display window is set once for the whole region. The column address pointer
+ *  wraps to the next page at the end of the window, so each page part of the region
+ *  can be sent in it's own transfer, or all at once if the region is as wide as the
+ *  display (data is then contiguous in our buffer).
+ */
+int ssd130x_update_region(struct oled_display* conf,
+							uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+	uint16_t len = ((x1 - x0 + 1) * 8);
+	uint8_t page = y0;
+	int ret = 0;
+
+	if ((x1 >= SSD130x_TILES_PER_PAGE) || (y1 >= SSD130x_NB_PAGES) || (x0 > x1) || (y0 > y1)) {
+		return -EINVAL;
+	}
+
+	conf->fullscreen = 0;
+
+	ret = ssd130x_set_column_address(conf, (x0 * 8), (((x1 + 1) * 8) - 1));
+	if (ret != 0) {
+		return ret;
+	}
+	ret = ssd130x_set_page_address(conf, y0, y1);
+	if (ret != 0) {
+		return ret;
+	}
+	if (len == SSD130x_NB_COL) {
+		ret = ssd130x_send_data(conf, (conf->gddram + 4 + (y0 * 128)), (len * (y1 - y0 + 1)));
+		if (ret != 0) {
+			return ret;
+		}
+	} else {
+		for (page = y0; page <= y1; page++) {
+			ret = ssd130x_send_data(conf, (conf->gddram + 4 + (page * 128) + (x0 * 8)), len);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+	}
+	ssd130x_clear_modified(SSD130x_DIRTY_MAP(conf->gddram), x0, y0, x1, y1);
+	return 0;
+}
+
+/* Find the next span of modified tiles in a page, starting at tile "from".
+ * Modified tiles separated by at most SSD130x_MERGE_GAP unmodified tiles are part
+ *  of the same span.
+ * Returns 1 if a span has been found, 0 if there are no more modified tiles.
+ */
+static int ssd130x_next_span(uint16_t mask, uint8_t from, uint8_t* start, uint8_t* end)
+{
+	uint8_t x = from, gap = 0;
+
+	while ((x < SSD130x_TILES_PER_PAGE) && !(mask & (0x01 << x))) {
+		x++;
+	}
+	if (x >= SSD130x_TILES_PER_PAGE) {
+		return 0;
+	}
+	*start = x;
+	*end = x;
+	for (x++; x < SSD130x_TILES_PER_PAGE; x++) {
+		if (mask & (0x01 << x)) {
+			*end = x;
+			gap = 0;
+		} else if (++gap > SSD130x_MERGE_GAP) {
+			break;
+		}
+	}
+	return 1;
+}
+
+/* Get the modified tiles of the page as a bitmask, and check whether they all fit
+ *  in a single span. Returns 1 if so (start and end are then valid), 0 otherwise.
+ */
+static int ssd130x_single_span(uint8_t* map, uint8_t page, uint16_t* mask, uint8_t* start, uint8_t* end)
+{
+	uint8_t dummy = 0;
+
+	*mask = map[(page * 2)] | (map[(page * 2) + 1] << 8);
+	if (ssd130x_next_span(*mask, 0, start, end) == 0) {
+		return 0;
+	}
+	return (ssd130x_next_span(*mask, (*end + 1), &dummy, &dummy) == 0);
+}
+
+/* Find the next window of modified tiles in the map.
+ * Pages which modified tiles all fit in a single span are grouped with the following
+ *  pages having the same span. Otherwise the first span of the page is used.
+ * Returns 1 if a window has been found, 0 if there are no more modified tiles.
+ */
+static int ssd130x_next_window(uint8_t* map, uint8_t* x0, uint8_t* y0, uint8_t* x1, uint8_t* y1)
+{
+	uint8_t page = 0, start = 0, end = 0;
+	uint16_t mask = 0;
+
+	for (page = 0; page < SSD130x_NB_PAGES; page++) {
+		if (ssd130x_single_span(map, page, &mask, &start, &end) == 1) {
+			*y0 = page;
+			/* Extend the window to the following pages which have the same single span */
+			while (page < (SSD130x_NB_PAGES - 1)) {
+				uint8_t next_start = 0, next_end = 0;
+				uint16_t next_mask = 0;
+				if ((ssd130x_single_span(map, (page + 1), &next_mask, &next_start, &next_end) == 0) ||
+						(next_start != start) || (next_end != end)) {
+					break;
+				}
+				page++;
+			}
+			break;
+		}
+		if (ssd130x_next_span(mask, 0, &start, &end) == 1) {
+			*y0 = page;
+			break;
+		}
+	}
+	if (page >= SSD130x_NB_PAGES) {
+		return 0;
+	}
+	*x0 = start;
+	*x1 = end;
+	*y1 = page;
+	return 1;
+}
+
 int ssd130x_update_modified(struct oled_display* conf)
 {
+	uint8_t* map = SSD130x_DIRTY_MAP(conf->gddram);
+	uint8_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	int ret = 0;
+
+	while (ssd130x_next_window(map, &x0, &y0, &x1, &y1) == 1) {
+		/* ssd130x_update_region() clears the modified flag of sent tiles */
+		ret = ssd130x_update_region(conf, x0, y0, x1, y1);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+
+
+/***************************************************************************** */
+/* Frame pipeline */
+
+/* Display of the asynchronous page transfer in progress (one transfer at a time on the
+ *   bus), and end of the transfer, called from the I2C interrupt.
+ */
+static struct oled_display* ssd130x_async_conf = NULL;
+static void ssd130x_page_sent(uint32_t state)
+{
+	struct oled_display* conf = ssd130x_async_conf;
+
+	if (conf == NULL) {
+		return;
+	}
+	conf->frame.xfer_state = state;
+	conf->frame.xfer_pending = 0;
+	if (conf->frame_notify != NULL) {
+		conf->frame_notify();
+	}
+}
+
+/* Translate the I2C state at the end of a page transfer to 0 or an error code */
+static int ssd130x_xfer_error(uint32_t state)
+{
+	switch (state) {
+		case I2C_OK:
+		case I2C_NO_DATA:
+			return 0;
+		case I2C_NACK:
+			return -EREMOTEIO;
+		case I2C_ARBITRATION_LOST:
+			return -EBUSY;
+		default:
+			return -EIO;
+	}
+}
+
+/* Copy one page of the current window to the transfer buffer and send it.
+ * Returns 0 when the transfer is done (synchronous transfers), -EAGAIN when an
+ *   asynchronous transfer has been started, or a negative error code.
+ */
+static int ssd130x_frame_send_page(struct oled_display* conf)
+{
+	struct ssd130x_frame* frame = &(conf->frame);
+	uint16_t len = ((frame->x1 - frame->x0 + 1) * 8);
+	uint8_t* buf = conf->frame_buff;
+	int ret = 0;
+
+	memcpy((buf + 2), (conf->gddram + 4 + (frame->page * 128) + (frame->x0 * 8)), len);
+	frame->page++;
+
+	if (conf->bus_type == SSD130x_BUS_SPI) {
+		gpio_set(conf->gpio_dc);
+		gpio_clear(conf->gpio_cs);
+		ret = spi_transfer_multiple_frames(conf->bus_num, (buf + 2), NULL, len, 8);
+		gpio_set(conf->gpio_cs);
+		return ((ret == len) ? 0 : -EIO);
+	} else if (conf->bus_type == SSD130x_BUS_I2C) {
+		buf[0] = conf->address;
+		buf[1] = SSD130x_DATA_ONLY;
+		if (conf->async) {
+			ssd130x_async_conf = conf;
+			frame->xfer_pending = 1;
+			ret = i2c_write_async_done(conf->bus_num, buf, (2 + len), NULL, ssd130x_page_sent);
+			if (ret == -EAGAIN) {
+				/* Bus used by another transfer : send the page again on next poll */
+				frame->xfer_pending = 0;
+				frame->page--;
+				return -EAGAIN;
+			}
+			if (ret != 0) {
+				frame->xfer_pending = 0;
+				return ret;
+			}
+			return -EAGAIN;
+		}
+		ret = i2c_write(conf->bus_num, buf, (2 + len), NULL);
+		return ((ret == (2 + len)) ? 0 : ret);
+	}
+	return -EPROTO;
+}
+
+/* End of frame, with or without error */
+static int ssd130x_frame_end(struct oled_display* conf, int error)
+{
+	struct ssd130x_frame* frame = &(conf->frame);
+	uint32_t now = systick_get_tick_count();
+	uint32_t tick_ms = systick_get_tick_ms_period();
+
+	frame->busy = 0;
+	if (error != 0) {
+		/* We do not know what the display got, send everything next time */
+		memset(SSD130x_DIRTY_MAP(conf->gddram), 0xFF, SSD130x_DIRTY_MAP_SIZE);
+		frame->nb_errors++;
+		return error;
+	}
+	frame->nb_frames++;
+	frame->frame_time = (now - frame->start_tick) * tick_ms;
+	if (frame->frame_time > frame->max_frame_time) {
+		frame->max_frame_time = frame->frame_time;
+	}
+	frame->fps_count++;
+	if (((now - frame->fps_start_tick) * tick_ms) >= 1000) {
+		frame->fps = frame->fps_count;
+		frame->fps_count = 0;
+		frame->fps_start_tick = now;
+	}
 	return 0;
 }
 
+int ssd130x_frame_poll(struct oled_display* conf)
+{
+	struct ssd130x_frame* frame = &(conf->frame);
+	int ret = 0;
+
+	if (frame->busy == 0) {
+		return 0;
+	}
+	/* Check for the end of our asynchronous page transfer */
+	if ((conf->bus_type == SSD130x_BUS_I2C) && conf->async) {
+		if (frame->xfer_pending) {
+			return -EAGAIN;
+		}
+		ret = ssd130x_xfer_error(frame->xfer_state);
+		frame->xfer_state = I2C_OK;
+		if (ret != 0) {
+			return ssd130x_frame_end(conf, ret);
+		}
+	}
+
+	do {
+		/* Move to next window ? */
+		if (frame->page > frame->y1) {
+			if (ssd130x_next_window(frame->map, &frame->x0, &frame->y0, &frame->x1, &frame->y1) == 0) {
+				return ssd130x_frame_end(conf, 0);
+			}
+			ssd130x_clear_modified(frame->map, frame->x0, frame->y0, frame->x1, frame->y1);
+			conf->fullscreen = 0;
+			ret = ssd130x_set_column_address(conf, (frame->x0 * 8), (((frame->x1 + 1) * 8) - 1));
+			if (ret == 0) {
+				ret = ssd130x_set_page_address(conf, frame->y0, frame->y1);
+			}
+			if (ret != 0) {
+				return ssd130x_frame_end(conf, ret);
+			}
+			frame->page = frame->y0;
+		}
+		ret = ssd130x_frame_send_page(conf);
+	} while (ret == 0);
+
+	if (ret != -EAGAIN) {
+		return ssd130x_frame_end(conf, ret);
+	}
+	return -EAGAIN;
+}
+
+int ssd130x_frame_start(struct oled_display* conf)
+{
+	struct ssd130x_frame* frame = &(conf->frame);
+	uint8_t* map = SSD130x_DIRTY_MAP(conf->gddram);
+
+	if (conf->frame_buff == NULL) {
+		return ssd130x_update_modified(conf);
+	}
+	if (frame->busy != 0) {
+		/* Give the previous frame a chance to end */
+		if (ssd130x_frame_poll(conf) == -EAGAIN) {
+			return -EBUSY;
+		}
+	}
+	/* Take the modified tiles for this frame, tiles modified from now on go to the next one */
+	memcpy(frame->map, map, SSD130x_DIRTY_MAP_SIZE);
+	memset(map, 0, SSD130x_DIRTY_MAP_SIZE);
+	frame->busy = 1;
+	frame->xfer_state = I2C_OK;
+	frame->start_tick = systick_get_tick_count();
+	/* Force selection of the first window */
+	frame->page = 1;
+	frame->y1 = 0;
+	return ssd130x_frame_poll(conf);
+}
@@ -67,7 +67,8 @@ int tmp101_probe_sensor(struct tmp101_sensor_config* conf)
 
 	/* Did we already probe the sensor ? */
 	if (conf->probe_ok != 1) {
-		conf->probe_ok = i2c_read(conf->bus_num, &cmd_buf, 1, NULL, NULL, 0);
+		/* Nothing to read : success is 0 bytes read */
+		conf->probe_ok = (i2c_read(conf->bus_num, &cmd_buf, 1, NULL, NULL, 0) == 0) ? 1 : 0;
 	}
 	return conf->probe_ok;
 }
@@ -179,3 +180,57 @@ int tmp101_sensor_start_conversion(struct tmp101_sensor_config* conf)
 }
 
 
+
+
+/***************************************************************************** */
+/* Generic sensor interface */
+
+static int tmp101_ops_probe(void* conf)
+{
+	return tmp101_probe_sensor(conf);
+}
+
+static int tmp101_ops_configure(void* conf)
+{
+	return tmp101_sensor_config(conf);
+}
+
+static int tmp101_ops_start_conversion(void* conf)
+{
+	return tmp101_sensor_start_conversion(conf);
+}
+
+static int tmp101_ops_read_raw(void* conf, struct sensor_raw* raw)
+{
+	uint16_t temp = 0;
+	int ret = 0;
+
+	ret = tmp101_sensor_read(conf, &temp, NULL);
+	raw->data[0] = temp;
+	return ret;
+}
+
+static int tmp101_ops_compensate(void* conf, const struct sensor_raw* raw, struct sensor_values* values)
+{
+	values->quantity[0] = SENSOR_TEMPERATURE;
+	values->value[0] = tmp101_convert_to_deci_degrees(raw->data[0]);
+	values->nb = 1;
+	return 0;
+}
+
+/* Conversion time depends on the resolution : 40ms for 9 bits, doubled for each bit */
+static uint32_t tmp101_ops_min_period(void* data)
+{
+	struct tmp101_sensor_config* conf = data;
+
+	return (40 << ((conf->resolution >> 5) & 0x03));
+}
+
+const struct sensor_operations tmp101_sensor_ops = {
+	.probe = tmp101_ops_probe,
+	.configure = tmp101_ops_configure,
+	.start_conversion = tmp101_ops_start_conversion,
+	.read_raw = tmp101_ops_read_raw,
+	.compensate = tmp101_ops_compensate,
+	.min_period = tmp101_ops_min_period,
+};
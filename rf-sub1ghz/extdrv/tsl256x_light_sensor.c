@@ -90,6 +90,126 @@ int tsl256x_read_id(struct tsl256x_sensor_config* conf)
 }
 
 
+/* Power the sensor up or down by writing the control register */
+#define POWER_BUF_SIZE  3
+static int tsl256x_set_power(struct tsl256x_sensor_config* conf, uint8_t power)
+{
+	int ret = 0;
+	char cmd_buf[POWER_BUF_SIZE] = { conf->addr, TSL256x_CMD(control), power, };
+
+	ret = i2c_write(conf->bus_num, cmd_buf, POWER_BUF_SIZE, NULL);
+	if (ret != POWER_BUF_SIZE) {
+		conf->probe_ok = 0;
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Start a conversion : a new integration cycle starts when the sensor gets powered up. */
+int tsl256x_start_conversion(struct tsl256x_sensor_config* conf)
+{
+	if (conf->probe_ok != 1) {
+		return -ENODEV;
+	}
+	return tsl256x_set_power(conf, TSL256x_POWER_ON);
+}
+
+/* Nominal integration times are 13.7ms, 101ms and 402ms */
+uint32_t tsl256x_conversion_time(struct tsl256x_sensor_config* conf)
+{
+	switch (conf->integration_time) {
+		case TSL256x_INTEGRATION_13ms:
+			return 15;
+		case TSL256x_INTEGRATION_100ms:
+			return 106;
+		case TSL256x_INTEGRATION_400ms:
+		default:
+			return 420;
+	}
+}
+
+
+/* Auto-ranging
+ * Ranges from the least to the most sensitive. The gain is raised before the integration
+ *   time, so that the integration time remains as short as possible.
+ * max_count is the ADC count reached at saturation for the integration time.
+ * A more sensitive range is selected when channel 0 count is below "up" (the count would
+ *   stay below half of the next range maximum), and a less sensitive one when it is above
+ *   "down" (three quarters of the range maximum) or saturated.
+ */
+struct tsl256x_range {
+	uint8_t gain;
+	uint8_t integration_time;
+	uint16_t max_count;
+	uint16_t up;
+	uint16_t down;
+};
+
+#define TSL256x_NB_RANGES  4
+static const struct tsl256x_range tsl256x_ranges[TSL256x_NB_RANGES] = {
+	{ TSL256x_LOW_GAIN, TSL256x_INTEGRATION_13ms, 5047, 157, 0xFFFF, },       /* x1 */
+	{ TSL256x_HIGH_GAIN_16X, TSL256x_INTEGRATION_13ms, 5047, 2522, 3785, },   /* x16 */
+	{ TSL256x_HIGH_GAIN_16X, TSL256x_INTEGRATION_100ms, 37177, 8233, 27882, }, /* x118 */
+	{ TSL256x_HIGH_GAIN_16X, TSL256x_INTEGRATION_400ms, 65535, 0, 49151, },   /* x470 */
+};
+
+static uint16_t tsl256x_max_count(uint8_t integration_time)
+{
+	switch (integration_time) {
+		case TSL256x_INTEGRATION_13ms:
+			return 5047;
+		case TSL256x_INTEGRATION_100ms:
+			return 37177;
+		default:
+			return 65535;
+	}
+}
+
+/* Write the gain and integration time from conf to the timing register */
+#define TIMING_BUF_SIZE  3
+static int tsl256x_set_timing(struct tsl256x_sensor_config* conf)
+{
+	int ret = 0;
+	char cmd_buf[TIMING_BUF_SIZE] = { conf->addr, TSL256x_CMD(timing), (conf->gain | conf->integration_time), };
+
+	ret = i2c_write(conf->bus_num, cmd_buf, TIMING_BUF_SIZE, NULL);
+	if (ret != TIMING_BUF_SIZE) {
+		conf->probe_ok = 0;
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Select the range for the next conversion from the channel 0 count of the last one */
+static int tsl256x_auto_range(struct tsl256x_sensor_config* conf, uint16_t ch0)
+{
+	const struct tsl256x_range* range = &(tsl256x_ranges[conf->range]);
+	int ret = 0;
+
+	if (((conf->status & TSL256x_SATURATED) || (ch0 > range->down)) && (conf->range > 0)) {
+		conf->range--;
+	} else if ((ch0 < range->up) && (conf->range < (TSL256x_NB_RANGES - 1))) {
+		conf->range++;
+	} else {
+		return 0;
+	}
+	range = &(tsl256x_ranges[conf->range]);
+	conf->gain = range->gain;
+	conf->integration_time = range->integration_time;
+	conf->status |= TSL256x_RANGE_CHANGED;
+	ret = tsl256x_set_timing(conf);
+	if ((ret != 0) || conf->one_shot) {
+		return ret;
+	}
+	/* Continuous mode : restart the integration with the new settings */
+	ret = tsl256x_set_power(conf, TSL256x_POWER_OFF);
+	if (ret != 0) {
+		return ret;
+	}
+	return tsl256x_set_power(conf, TSL256x_POWER_ON);
+}
+
+
 /* Lux Read
  * Performs a non-blocking read of the luminosity from the sensor.
  * 'lux' 'ir' and 'comb': integer addresses for conversion result, may be NULL.
@@ -105,7 +225,7 @@ int tsl256x_sensor_read(struct tsl256x_sensor_config* conf, uint16_t* comb, uint
 	char cmd_buf[READ_BUF_SIZE] = { conf->addr, TSL256x_CMD(data), (conf->addr | I2C_READ_BIT), };
 	char ctrl_buf[READ_BUF_SIZE] = { I2C_CONT, I2C_DO_REPEATED_START, I2C_CONT, };
 	uint8_t data[4];
-	uint16_t comb_raw = 0, ir_raw = 0;
+	uint16_t comb_raw = 0, ir_raw = 0, max_count = 0;
 
 	ret = i2c_read(conf->bus_num, cmd_buf, READ_BUF_SIZE, ctrl_buf, data, 4);
 	if (ret != 4) {
@@ -124,13 +244,29 @@ int tsl256x_sensor_read(struct tsl256x_sensor_config* conf, uint16_t* comb, uint
 	if (lux != NULL) {
 		*lux = calculate_lux(conf, comb_raw, ir_raw);
 	}
+	conf->status = 0;
+	max_count = tsl256x_max_count(conf->integration_time);
+	if ((comb_raw >= max_count) || (ir_raw >= max_count)) {
+		conf->status |= TSL256x_SATURATED;
+	}
 
+	if (conf->one_shot) {
+		ret = tsl256x_set_power(conf, TSL256x_POWER_OFF);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	if (conf->auto_range) {
+		return tsl256x_auto_range(conf, comb_raw);
+	}
 	return 0;
 }
 
 
 /* Sensor config
  * Performs default configuration of the luminosity sensor.
+ * With auto_range set, gain and integration time are those of the starting range
+ *   (conf->range) instead of those of conf.
  * FIXME : Add more comments about the behavior and the resulting configuration.
  * Return value:
  *   Upon successfull completion, returns 0. On error, returns a negative integer
@@ -142,6 +278,15 @@ int tsl256x_configure(struct tsl256x_sensor_config* conf)
 	int ret = 0;
 	char cmd_buf[CONF_BUF_SIZE] = { conf->addr, TSL256x_CMD(timing), 0, };
 
+	/* Auto-ranging starts from "range" */
+	if (conf->auto_range) {
+		if (conf->range >= TSL256x_NB_RANGES) {
+			conf->range = TSL256x_NB_RANGES - 1;
+		}
+		conf->gain = tsl256x_ranges[conf->range].gain;
+		conf->integration_time = tsl256x_ranges[conf->range].integration_time;
+	}
+	conf->status = 0;
 	cmd_buf[2] = (conf->gain | conf->integration_time);
 
 	if (tsl256x_probe_sensor(conf) != 1) {
@@ -153,6 +298,10 @@ int tsl256x_configure(struct tsl256x_sensor_config* conf)
 		conf->probe_ok = 0;
 		return -EIO;
 	}
+	/* Wait for tsl256x_start_conversion() in one shot mode */
+	if (conf->one_shot) {
+		return tsl256x_set_power(conf, TSL256x_POWER_OFF);
+	}
 	return 0;
 }
 
@@ -165,6 +314,8 @@ int tsl256x_configure(struct tsl256x_sensor_config* conf)
  * Description:
  *   Calculate the approximate illuminance (lux) given the raw channel values of
  *   the TSL2560. The equation if implemented as a piece−wise linear approximation.
+ *   The segments are given by tables, one for each package type, and each segment is
+ *   used for ratio values up to "k".
  *
  * Arguments:
  * uint16_t ch0 − raw channel value from channel 0 of TSL2560
@@ -173,21 +324,39 @@ int tsl256x_configure(struct tsl256x_sensor_config* conf)
  * Return: uint32_t − the approximate illuminance (lux)
  *
  */
-uint32_t calculate_lux(struct tsl256x_sensor_config* conf, uint16_t ch0, uint16_t ch1)
+struct tsl256x_lux_segment {
+	uint16_t k;
+	uint16_t b;
+	uint16_t m;
+};
+
+#define TSL256x_NB_LUX_SEGMENTS  8
+static const struct tsl256x_lux_segment tsl256x_lux_t[TSL256x_NB_LUX_SEGMENTS] = {
+	{ K1T, B1T, M1T }, { K2T, B2T, M2T }, { K3T, B3T, M3T }, { K4T, B4T, M4T },
+	{ K5T, B5T, M5T }, { K6T, B6T, M6T }, { K7T, B7T, M7T }, { 0xFFFF, B8T, M8T },
+};
+static const struct tsl256x_lux_segment tsl256x_lux_cs[TSL256x_NB_LUX_SEGMENTS] = {
+	{ K1C, B1C, M1C }, { K2C, B2C, M2C }, { K3C, B3C, M3C }, { K4C, B4C, M4C },
+	{ K5C, B5C, M5C }, { K6C, B6C, M6C }, { K7C, B7C, M7C }, { 0xFFFF, B8C, M8C },
+};
+
+static uint32_t tsl256x_compute_lux(uint8_t package, uint8_t gain, uint8_t integration_time,
+									uint16_t ch0, uint16_t ch1)
 {
-	/* First, scale the channel values depending on the gain and integration time
-	 * 16X, 402mS is nominal.
-	 * Scale if integration time is NOT 402 msec */
+	const struct tsl256x_lux_segment* seg = tsl256x_lux_t;
 	uint32_t chScale = 0;
 	uint32_t channel1 = 0, channel0 = 0;
 	uint32_t ratio = 0, lux = 0;
-	uint32_t b = 0, m = 0;
+	int i = 0;
 
-	switch (conf->integration_time) {
-		 case TSL256x_INTEGRATION_13ms: /* 13.7 msec */
+	/* First, scale the channel values depending on the gain and integration time
+	 * 16X, 402mS is nominal.
+	 * Scale if integration time is NOT 402 msec */
+	switch (integration_time) {
+		case TSL256x_INTEGRATION_13ms: /* 13.7 msec */
 			chScale = CHSCALE_TINT0;
 			break;
-		 case TSL256x_INTEGRATION_100ms: /* 101 msec */
+		case TSL256x_INTEGRATION_100ms: /* 101 msec */
 			chScale = CHSCALE_TINT1;
 			break;
 		case TSL256x_INTEGRATION_400ms: /* 402 msec */
@@ -195,13 +364,11 @@ uint32_t calculate_lux(struct tsl256x_sensor_config* conf, uint16_t ch0, uint16_
 			chScale = (1 << CH_SCALE);
 			break;
 	}
-
 	/* Scale if gain is NOT 16X */
-	if (conf->gain == TSL256x_LOW_GAIN) {
+	if (gain == TSL256x_LOW_GAIN) {
 		chScale = chScale << 4; /* Scale 1X to 16X */
 	}
-
-	// Scale the channel values */
+	/* Scale the channel values */
 	channel0 = (ch0 * chScale) >> CH_SCALE;
 	channel1 = (ch1 * chScale) >> CH_SCALE;
 
@@ -213,53 +380,22 @@ uint32_t calculate_lux(struct tsl256x_sensor_config* conf, uint16_t ch0, uint16_
 	/* Round the ratio value */
 	ratio = (ratio + 1) >> 1;
 
-	/* Is ratio <= eachBreak ? */
-	switch (conf->package) {
-		case TSL256x_PACKAGE_T:
-		case TSL256x_PACKAGE_FN:
-		case TSL256x_PACKAGE_CL:
-			if ((ratio >= 0) && (ratio <= K1T)) {
-				b = B1T; m = M1T;
-			} else if (ratio <=  K2T) {
-				b = B2T; m = M2T;
-			} else if (ratio <=  K3T) {
-				b = B3T; m = M3T;
-			} else if (ratio <=  K4T) {
-				b = B4T; m = M4T;
-			} else if (ratio <=  K5T) {
-				b = B5T; m = M5T;
-			} else if (ratio <=  K6T) {
-				b = B6T; m = M6T;
-			} else if (ratio <=  K7T) {
-				b = B7T; m = M7T;
-			} else if (ratio > K8T) {
-				b = B8T; m = M8T;
-			} break;
-		case TSL256x_PACKAGE_CS:    /* CS package */
-			if ((ratio >=  0) && (ratio <=  K1C)) {
-				b = B1C; m = M1C;
-			} else if (ratio <=  K2C) {
-				b = B2C; m = M2C;
-			} else if (ratio <=  K3C) {
-				b = B3C; m = M3C;
-			} else if (ratio <=  K4C) {
-				b = B4C; m = M4C;
-			} else if (ratio <=  K5C) {
-				b = B5C; m = M5C;
-			} else if (ratio <=  K6C) {
-				b = B6C; m = M6C;
-			} else if (ratio <=  K7C) {
-				b = B7C; m = M7C;
-			}else if (ratio > K8C) {
-				b = B8C; m = M8C;
-			} break;
+	/* Find the segment for this ratio */
+	if (package == TSL256x_PACKAGE_CS) {
+		seg = tsl256x_lux_cs;
 	}
-	lux = ((channel0 * b) - (channel1 * m));
+	for (i = 0; i < (TSL256x_NB_LUX_SEGMENTS - 1); i++) {
+		if (ratio <= seg[i].k) {
+			break;
+		}
+	}
+	seg += i;
 
 	/* Do not allow negative lux value */
-	if (lux < 0) {
-		lux = 0;
+	if ((channel1 * seg->m) >= (channel0 * seg->b)) {
+		return 0;
 	}
+	lux = ((channel0 * seg->b) - (channel1 * seg->m));
 	/* Round lsb (2^(LUX_SCALE−1)) */
 	lux += (1 << (LUX_SCALE - 1));
 	/* Strip off fractional portion */
@@ -268,3 +404,78 @@ uint32_t calculate_lux(struct tsl256x_sensor_config* conf, uint16_t ch0, uint16_
 	return lux;
 }
 
+uint32_t calculate_lux(struct tsl256x_sensor_config* conf, uint16_t ch0, uint16_t ch1)
+{
+	return tsl256x_compute_lux(conf->package, conf->gain, conf->integration_time, ch0, ch1);
+}
+
+
+/***************************************************************************** */
+/* Generic sensor interface */
+
+static int tsl256x_ops_probe(void* conf)
+{
+	return tsl256x_probe_sensor(conf);
+}
+
+static int tsl256x_ops_configure(void* conf)
+{
+	return tsl256x_configure(conf);
+}
+
+/* The lux value is computed by the read, with the gain and integration time used for this
+ * conversion, as auto-ranging may change them for the next one. */
+static int tsl256x_ops_read_raw(void* conf, struct sensor_raw* raw)
+{
+	uint16_t comb = 0, ir = 0;
+	uint32_t lux = 0;
+	int ret = 0;
+
+	ret = tsl256x_sensor_read(conf, &comb, &ir, &lux);
+	raw->data[0] = comb;
+	raw->data[1] = ir;
+	raw->data[2] = lux;
+	return ret;
+}
+
+/* A saturated conversion is dropped (no values) when a less sensitive range has been
+ * selected for the next one. It is kept (as a lower bound) in the least sensitive range. */
+static int tsl256x_ops_compensate(void* data, const struct sensor_raw* raw, struct sensor_values* values)
+{
+	struct tsl256x_sensor_config* conf = data;
+
+	if ((conf->status & TSL256x_SATURATED) && (conf->status & TSL256x_RANGE_CHANGED)) {
+		values->nb = 0;
+		return 0;
+	}
+	values->quantity[0] = SENSOR_LIGHT;
+	values->value[0] = raw->data[2];
+	values->quantity[1] = SENSOR_INFRARED;
+	values->value[1] = raw->data[1];
+	values->nb = 2;
+	return 0;
+}
+
+static int tsl256x_ops_start_conversion(void* data)
+{
+	struct tsl256x_sensor_config* conf = data;
+
+	if (!conf->one_shot) {
+		return 0;
+	}
+	return tsl256x_start_conversion(conf);
+}
+
+static uint32_t tsl256x_ops_min_period(void* conf)
+{
+	return tsl256x_conversion_time(conf);
+}
+
+const struct sensor_operations tsl256x_sensor_ops = {
+	.probe = tsl256x_ops_probe,
+	.configure = tsl256x_ops_configure,
+	.start_conversion = tsl256x_ops_start_conversion,
+	.read_raw = tsl256x_ops_read_raw,
+	.compensate = tsl256x_ops_compensate,
+	.min_period = tsl256x_ops_min_period,
+};
@@ -115,3 +115,51 @@ int veml6070_configure(struct veml6070_sensor_config* conf)
 
 
 
+
+
+/***************************************************************************** */
+/* Generic sensor interface */
+
+static int veml6070_ops_probe(void* conf)
+{
+	return veml6070_probe_sensor(conf);
+}
+
+static int veml6070_ops_configure(void* conf)
+{
+	return veml6070_configure(conf);
+}
+
+static int veml6070_ops_read_raw(void* conf, struct sensor_raw* raw)
+{
+	uint16_t uv = 0;
+	int ret = 0;
+
+	ret = veml6070_sensor_read(conf, &uv);
+	raw->data[0] = uv;
+	return ret;
+}
+
+static int veml6070_ops_compensate(void* conf, const struct sensor_raw* raw, struct sensor_values* values)
+{
+	values->quantity[0] = SENSOR_UV;
+	values->value[0] = raw->data[0];
+	values->nb = 1;
+	return 0;
+}
+
+/* Integration time set by veml6070_configure() (1T), with the 270kOhm Rset resistor
+ * of the reference design */
+static uint32_t veml6070_ops_min_period(void* conf)
+{
+	return 125;
+}
+
+const struct sensor_operations veml6070_sensor_ops = {
+	.probe = veml6070_ops_probe,
+	.configure = veml6070_ops_configure,
+	.start_conversion = NULL,
+	.read_raw = veml6070_ops_read_raw,
+	.compensate = veml6070_ops_compensate,
+	.min_period = veml6070_ops_min_period,
+};
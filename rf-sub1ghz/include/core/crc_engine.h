@@ -37,7 +37,11 @@
 
 
 /***************************************************************************** */
-/* Configure the CRC engine. */
+/* Configure the CRC engine. Also turns on the CRC engine clock.
+ * poly is one of LPC_CRC_POLY_*, data_mode a combination of LPC_CRC_REVERSE_DATA_BIT_ORDER
+ *   and LPC_CRC_DATA_COMPLEMENT, and sum_mode a combination of LPC_CRC_REVERSE_SUM_BIT_ORDER
+ *   and LPC_CRC_SUM_COMPLEMENT.
+ */
 void crc_config(uint8_t poly, uint32_t seed, uint8_t data_mode, uint8_t sum_mode);
 
 
@@ -47,6 +51,10 @@ uint32_t crc_get_sum(void);
 
 void crc_add(uint32_t value);
 
+/* Add "len" bytes from "buf" to the CRC computation, in order, using word writes when
+ * possible. See lib/crc.h for a higher level interface. */
+void crc_add_buffer(const uint8_t* buf, uint32_t len);
+
 
 
 
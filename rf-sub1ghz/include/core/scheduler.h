@@ -0,0 +1,76 @@
+/****************************************************************************
+ *   core/scheduler.h
+ *
+ * Cooperative run-to-completion tasks scheduler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef CORE_SCHEDULER_H
+#define CORE_SCHEDULER_H
+
+#include "lib/stdint.h"
+
+/***************************************************************************** */
+/*               Tasks scheduler                                               */
+/***************************************************************************** */
+
+/* Tasks are handlers which get called with the set of events posted to them since their
+ *   last run. They run to completion and are never preempted by another task, only by
+ *   interrupts.
+ * Events are posted using sched_post(), which may be called from interrupt handlers, or
+ *   generated by the task timer (SCHED_EVT_TIMER).
+ * The ready task with the highest priority (lowest value) runs first, and ready tasks of
+ *   same priority run in the order they became ready.
+ * When no task is ready, the CPU waits for interrupts until the nearest task deadline
+ *   (see systick_wait_for_interrupt()). The system tick timer must have been started.
+ * The time needed for a task to react to an event is thus bounded by the run time of
+ *   the longest task handler, whatever its priority.
+ */
+
+#define SCHED_MAX_TASKS      8
+#define SCHED_NB_PRIORITIES  4  /* 0 is the highest priority */
+
+/* Event set when the task deadline is reached. Other bits are free for use by tasks. */
+#define SCHED_EVT_TIMER   (0x01UL << 31)
+
+
+/* Register a task.
+ * handler gets called with the events posted to the task as argument.
+ * Returns the task number (to be used with other sched_*() functions) or a negative
+ *   value on error.
+ */
+int sched_add_task(void (*handler)(uint32_t), uint8_t prio);
+
+/* Post events to a task. May be called from interrupt handlers.
+ * events is a mask of events, which are merged with events already pending for this task.
+ */
+int sched_post(int task, uint32_t events);
+
+/* Set the task deadline 'ms' milliseconds from now, and then every 'period' milliseconds
+ *   if period is not 0. SCHED_EVT_TIMER is posted to the task each time the deadline is
+ *   reached. Setting a new deadline replaces the previous one.
+ * Must not be called from interrupt handlers.
+ */
+int sched_set_timer(int task, uint32_t ms, uint32_t period);
+
+/* Cancel the task deadline. Must not be called from interrupt handlers. */
+int sched_cancel_timer(int task);
+
+/* Run the scheduler. Never returns. */
+void sched_run(void);
+
+
+#endif /* CORE_SCHEDULER_H */
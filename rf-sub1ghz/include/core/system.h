@@ -115,6 +115,30 @@ void msleep(uint32_t ms);
 void usleep(uint32_t us);
 
 
+/***************************************************************************** */
+/* Memory usage
+ * The stack area goes from the end of the .bss section up to _end_stack, and is painted
+ *   with STACK_PAINT_VALUE by the Reset_Handler, so that the maximum stack usage since
+ *   reset can be found by looking for the first overwritten word.
+ * All sizes are in bytes.
+ */
+#define STACK_PAINT_VALUE   0xC5ACCE55
+#define STACK_PAINT_MARGIN  32 /* Not painted, used by the Reset_Handler itself */
+struct memory_usage {
+	uint16_t data_size;
+	uint16_t bss_size;
+	uint16_t stack_size;
+	uint16_t stack_min_free; /* Never used stack since reset */
+};
+
+/* Get .data and .bss sections sizes, the stack area size, and the minimum free
+ * stack since reset. */
+void get_memory_usage(struct memory_usage* usage);
+
+/* Get only the minimum free stack since reset */
+uint32_t get_stack_min_free(void);
+
+
 
 
 /***************************************************************************** */
@@ -55,7 +55,7 @@ void systick_stop(void);
  */
 void systick_reset(void);
 
-/* Get system tick timer current value (counts at get_main_clock() !)
+/* Get system tick timer current value (counts at systick_get_clock_cycles_rate() !)
  * systick_get_timer_val returns a value between 0 and systick_get_timer_reload_val()
  */
 uint32_t systick_get_timer_val(void);
@@ -80,12 +80,39 @@ uint32_t systick_get_tick_count(void);
 /* Get the number of clock cycles ... since last wrapping of the counter. */
 uint32_t systick_get_clock_cycles(void);
 
+/* Get the number of clock cycles since the system tick timer start, on 64 bits, which
+ * does not wrap (more than 24000 years at 48MHz). */
+uint64_t systick_get_clock_cycles_64(void);
+
+/* Get the rate of the clock cycles counter (systick_get_clock_cycles() and
+ * systick_get_clock_cycles_64()), in Hz, which is half the main clock. */
+uint32_t systick_get_clock_cycles_rate(void);
+
+/* Get the number of wakeups (system tick timer or tickless timer interrupts) per second.
+ * The value is measured over a window of at least one second, which begins on the first
+ *   call following the end of the previous window.
+ */
+uint32_t systick_get_wakeups_per_second(void);
+
 /* Power up the system tick timer.
  * ms is the interval between system tick timer interrupts. If set to 0, the default
  *     value is used, which should provide a 1ms period.
  */
 void systick_timer_on(uint32_t ms);
 
+/* Power up the system tick timer in tickless mode.
+ * timer_num is the 32 bits counter timer used to count the system ticks and to wake up
+ *   the CPU on the next deadline only (LPC_TIMER_32B0 or LPC_TIMER_32B1). This timer must
+ *   not be used for anything else.
+ * The system tick period is 1ms, and the system tick timer is then only used to count
+ *   clock cycles for usleep() and systick_get_clock_cycles().
+ * Callbacks, msleep() and usleep() keep the same behavior, msleep() waiting for
+ *   interrupts instead of spinning.
+ * Use systick_start() to start counting.
+ * Return 0 on success or a negative value on error.
+ */
+int systick_tickless_on(uint8_t timer_num);
+
 /* Removes the main clock from the selected timer block */
 void systick_timer_off(void);
 
@@ -102,6 +129,17 @@ int remove_systick_callback(void (*callback) (uint32_t));
 
 
 
+/* Wait for an interrupt, or for the system tick count to reach 'tick'.
+ * Must be called with interrupts disabled, and returns with interrupts still disabled, so
+ *   that the caller can check its wakeup condition and call this function without missing
+ *   the interrupt which should end the wait. The interrupt gets handled as soon as
+ *   interrupts are enabled again.
+ * In tickless mode the CPU is woken up on 'tick' at the latest. Use a tick far in the
+ *   future (up to 2^31 ticks) when there is no deadline.
+ * Without tickless mode the system tick interrupt ends the wait on each tick.
+ */
+void systick_wait_for_interrupt(uint32_t tick);
+
 /* This function can be used when you are absolutly certain that systick timer is running, and when
  * you need to sleep less than 1000us (1ms)
  */
@@ -82,6 +82,106 @@ void adc_prepare_conversion_on_event(uint16_t channels, uint8_t seq_num, uint8_t
 void adc_trigger_sequence_conversion(uint8_t seq_num);
 
 
+/***************************************************************************** */
+/*                ADC acquisition engine                                       */
+/***************************************************************************** */
+
+/* Continuous sampling of up to NB_ADC_CHANNELS channels into per channel sample buffers,
+ *   filled from the ADC interrupt, so that the main loop only reads the samples or their
+ *   summary (min, max and mean).
+ *
+ * Conversions are either burst conversions, at a rate set by the ADC clock, or
+ *   conversions started on a timer match (or capture) event :
+ *  - adc_acq_start_burst() : all channels are converted one after the other, at "rate"
+ *      conversions per second (shared by all channels), with one interrupt for each scan of
+ *      all channels. The lowest rate is about main_clock / (256 * 11).
+ *  - adc_acq_start_on_event() : one conversion on each event, on the next channel of the
+ *      list, so each channel gets the event rate divided by the number of channels. The
+ *      timer must be configured by the user to toggle the external match output
+ *      (LPC_TIMER_TOGGLE_ON_MATCH), in which case only one match out of two gives the
+ *      selected edge.
+ *
+ * Each channel averages (1 << avg_shift) conversions into one sample before storing it in
+ *   its buffer. Samples are 10 bits ADC values.
+ * The sample buffers are single producer (the interrupt) single consumer rings with free
+ *   running indexes, like lib/ringbuf. Samples which do not fit are dropped and counted.
+ * The ADC must be on (adc_on()), and the acquisition engine replaces the interrupt callback
+ *   given to adc_on() until adc_acq_stop().
+ */
+
+struct adc_acq_channel {
+	/* Configuration */
+	uint8_t channel;         /* ADC channel, 0 to 7 */
+	uint8_t avg_shift;       /* (1 << avg_shift) conversions averaged for each sample */
+	uint16_t mask;           /* Buffer size - 1, size is a power of two */
+	uint16_t* buf;
+	/* State */
+	volatile uint32_t head;  /* Written by the interrupt handler */
+	volatile uint32_t tail;  /* Written by the reader */
+	volatile uint32_t dropped;
+	uint32_t acc;            /* Averaging accumulator */
+	uint16_t nb_acc;
+};
+
+/* Declare and initialise an acquisition channel with its static storage of "size" samples.
+ * size must be a power of two. */
+#define ADC_ACQ_CHANNEL_DECLARE(name, chan, shift, size) \
+	static uint16_t name ## _buf[(size)]; \
+	struct adc_acq_channel name = { \
+		.channel = (chan), \
+		.avg_shift = (shift), \
+		.mask = ((size) - 1), \
+		.buf = name ## _buf, \
+		.head = 0, \
+		.tail = 0, \
+		.dropped = 0, \
+	}
+
+struct adc_acq_summary {
+	uint32_t nb;        /* Number of samples summarized */
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+	uint32_t dropped;   /* Samples dropped since adc_acq_setup() */
+};
+
+/* Select the channels used for the acquisition, in conversion order for event mode (for
+ *   burst mode the ADC always converts the channels in increasing order).
+ * Stops the acquisition if it was running, and empties the channels buffers.
+ * Returns 0, or -EINVAL if a channel is invalid, used twice, or its buffer is missing or not
+ *   a power of two.
+ */
+int adc_acq_setup(struct adc_acq_channel* channels[], uint8_t nb);
+
+/* Start burst conversions at approximately (at most) "rate" conversions per second. */
+void adc_acq_start_burst(uint32_t rate);
+
+/* Start conversions on the given event (one of lpc_adc_start_conv_events), on the
+ *   LPC_ADC_START_EDGE_RISING or LPC_ADC_START_EDGE_FALLING edge. */
+void adc_acq_start_on_event(uint8_t event, uint32_t edge);
+
+/* Stop the acquisition. Samples in the buffers are kept. */
+void adc_acq_stop(void);
+
+/* Number of samples available in the channel buffer */
+static inline uint32_t adc_acq_count(struct adc_acq_channel* ch)
+{
+	return (ch->head - ch->tail);
+}
+
+/* Get up to "max" samples from the channel buffer.
+ * Returns the number of samples read.
+ */
+uint32_t adc_acq_read(struct adc_acq_channel* ch, uint16_t* samples, uint32_t max);
+
+/* Get the minimum, maximum and mean of all the samples in the channel buffer, which are
+ *   removed from the buffer.
+ * Returns the number of samples summarized, or -ENODATA if the buffer was empty (only
+ *   "nb" and "dropped" are valid then).
+ */
+int adc_acq_summary(struct adc_acq_channel* ch, struct adc_acq_summary* summary);
+
+
 /***************************************************************************** */
 /*   ADC Setup : private part : Clocks, Pins, Power and Mode   */
 void adc_on(void (*adc_callback)(uint32_t));
@@ -106,6 +206,10 @@ struct lpc_adc
 
 /* ADC Control register bits */
 #define LPC_ADC_CTRL_MASK  0x0F01FFFF
+#define LPC_ADC_CLKDIV_SHIFT  8
+#define LPC_ADC_CLKDIV_MASK   (0xFF << LPC_ADC_CLKDIV_SHIFT)
+/* Number of ADC clock cycles for one conversion */
+#define LPC_ADC_CONV_CLOCKS   11
 /* ADC_MCH_* are also used for interrupt register */
 #define ADC_MCH_MASK    (0xFF << 0)
 #define ADC_MCH(x)      (0x01 << ((x) & 0x07))
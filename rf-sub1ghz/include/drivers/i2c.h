@@ -163,6 +163,37 @@ int i2c_write(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_b
  */
 int i2c_write_async(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf);
 
+/* I2C Asynchronous Write with its own completion callback
+ * Same as i2c_write_async(), but "done" (if not NULL) is called (from interrupt context)
+ *   at the end of this transfer instead of the callback registered with
+ *   i2c_set_async_callback(), so that drivers sharing the bus only get their own transfers.
+ */
+int i2c_write_async_done(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf,
+							void (*done)(uint32_t));
+
+/* I2C Asynchronous transfer status
+ * RETURN VALUE
+ *   -EAGAIN while the transfer started by i2c_write_async() is in progress, 0 if it
+ *   completed successfully, or one of the i2c_write() error codes.
+ *   This is the state of the last transfer on the bus, whoever started it : drivers
+ *   sharing the bus should rather use i2c_write_async_done().
+ * Note that i2c_read() and i2c_write() wait for the end of a pending asynchronous write
+ *   before starting their own transfer, unless called from an interrupt handler or with
+ *   interrupts disabled, in which case the transfer could never end and they return
+ *   -EAGAIN instead.
+ */
+int i2c_async_status(uint8_t bus_num);
+
+/* I2C Asynchronous transfer completion callback
+ * Register a callback to be called (from interrupt context) at the end of each transfer
+ *   started by i2c_write_async() (not by i2c_write_async_done()), with the internal bus
+ *   state as argument.
+ *   Use NULL to remove the callback.
+ * RETURN VALUE
+ *   0 on success, -EBADFD if the device is not initialized.
+ */
+int i2c_set_async_callback(uint8_t bus_num, void (*callback)(uint32_t));
+
 
 /* Release Bus
  * Some devices do not release the Bus at the end of a transaction if they don't receive
@@ -26,6 +26,7 @@
 
 #include "lib/stdint.h"
 #include "core/system.h"
+#include "extdrv/sensor.h"
 
 struct bme280_calibration_data {
 	/* Temperature */
@@ -126,6 +127,10 @@ struct bme280_internal_regs {
 #define BME280_FORCED   0x01
 #define BME280_NORMAL   0x03
 
+/* Status register */
+#define BME280_STATUS_MEASURING  (0x01 << 3)
+#define BME280_STATUS_IM_UPDATE  (0x01 << 0)
+
 /* Control registers helpers */
 #define BME280_CTRL_HUM(hum)    ((hum) & 0x07)
 #define BME280_CTRL_MEA(pres, temp, mode)  \
@@ -182,7 +187,32 @@ int bme280_configure(struct bme280_sensor_config* conf);
  *   provided integer(s). On error, returns a negative integer equivalent to errors from
  *   glibc.
  */
-int bme280_sensor_read(struct bme280_sensor_config* conf, uint32_t* temp, uint32_t* pressure, uint16_t* hum);
+int bme280_sensor_read(struct bme280_sensor_config* conf, uint32_t* pressure, uint32_t* temp, uint16_t* hum);
+
+
+/* Split-phase conversions in FORCED mode :
+ *   bme280_start_conversion() starts a single measurement, which lasts at most
+ *   bme280_conversion_time() ms, after which the sensor goes back to sleep mode and the
+ *   result is read using bme280_sensor_read(). bme280_conversion_done() tells whether the
+ *   measurement is over, for use when the caller cannot wait for the conversion time.
+ */
+
+/* Start a measurement when the sensor is configured in FORCED mode.
+ * Return value:
+ *   Upon successfull completion, returns 0. On error, returns a negative integer
+ *   equivalent to errors from glibc.
+ */
+int bme280_start_conversion(struct bme280_sensor_config* conf);
+
+/* Returns 1 if the measurement is over, 0 if it is still running, or a negative integer
+ *   equivalent to errors from glibc on error.
+ */
+int bme280_conversion_done(struct bme280_sensor_config* conf);
+
+/* Maximum measurement time in ms for the oversampling settings of conf, from the
+ *   BME280 documentation, section 9.1.
+ */
+uint32_t bme280_conversion_time(struct bme280_sensor_config* conf);
 
 
 /* Compute actual temperature from uncompensated temperature
@@ -209,6 +239,33 @@ uint32_t bme280_compensate_pressure(struct bme280_sensor_config* conf, int uncom
 uint32_t bme280_compensate_humidity(struct bme280_sensor_config* conf, int uncomp_humidity);
 
 
+/* Batch conversion of raw samples (for oversampling in software or replay of raw logs).
+ * Each sample is compensated in order, using the temperature of the sample for the
+ *   pressure and humidity, and gives the same results as the three functions above.
+ * Values are in 0.01 degree Centigrade, Pa and 0.01 %rH.
+ */
+struct bme280_raw_sample {
+	uint32_t pressure;
+	uint32_t temperature;
+	uint16_t humidity;
+};
+struct bme280_sample {
+	int temperature;
+	uint32_t pressure;
+	uint32_t humidity;
+};
+void bme280_compensate_samples(struct bme280_sensor_config* conf,
+				const struct bme280_raw_sample* raw, struct bme280_sample* out, unsigned int nb);
+
+
+/* Generic sensor interface (see extdrv/sensor.h), with a struct bme280_sensor_config as
+ *   configuration. In FORCED mode a measurement is started for each read, in NORMAL mode
+ *   the read period is at least the measurement time plus the standby time. Values are
+ *   temperature, pressure and humidity.
+ */
+extern const struct sensor_operations bme280_sensor_ops;
+
+
 #endif /* EXTDRV_BME280_H */
 
 
@@ -24,6 +24,7 @@
 #define EXTDRV_CHIRP_H
 
 #include "lib/stdint.h"
+#include "extdrv/sensor.h"
 
 
 /***************************************************************************** */
@@ -83,5 +84,12 @@ int chirp_sensor_light_read(struct chirp_sensor_config* conf);
 int chirp_reset(struct chirp_sensor_config* conf);
 
 
+/* Generic sensor interface (see extdrv/sensor.h), with a struct chirp_sensor_config as
+ *   configuration. Values are moisture (capacitance), temperature and light, with a
+ *   light conversion started before each read.
+ */
+extern const struct sensor_operations chirp_sensor_ops;
+
+
 #endif /* EXTDRV_TEMP_H */
 
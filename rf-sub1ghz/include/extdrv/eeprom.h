@@ -52,6 +52,64 @@ int eeprom_read(uint8_t eeprom_addr, uint32_t offset, void *buf, size_t count);
 int eeprom_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t count);
 
 
+/***************************************************************************** */
+/*          Cached writes                                                      */
+/***************************************************************************** */
+/* Frequent small writes (configuration, counters) should use the cached versions : the
+ *   data is kept in a single page RAM cache, and successive writes to the same page are
+ *   merged in a single page write, which is sent when a write goes to another page or on
+ *   eeprom_cache_flush().
+ * Page writes are sent asynchronously, and the end of the page programming is checked
+ *   on the next eeprom access, or with eeprom_cache_poll().
+ * Call eeprom_cache_flush() before any reset or power down, the cached data is lost
+ *   otherwise.
+ */
+
+/* EEPROM Cached Write
+ * Same as eeprom_write(), but data is written to the cache. Bytes of the page which are not
+ *   written but lie between two modified parts of a page are read from the eeprom.
+ * RETURN VALUE
+ *   Upon successfull completion, returns the number of bytes written. On error, returns a
+ *   negative integer equivalent to errors from glibc (-EAGAIN if a page needed to be sent
+ *   while the I2C bus was used by another asynchronous transfer).
+ */
+int eeprom_cache_write(uint8_t eeprom_addr, uint32_t offset, const void *buf, size_t count);
+
+/* EEPROM Cached Read
+ * Same as eeprom_read(), but returns the data from the cache when it has been modified.
+ */
+int eeprom_cache_read(uint8_t eeprom_addr, uint32_t offset, void *buf, size_t count);
+
+/* Start writing the modified part of the cached page to the eeprom.
+ * Returns 0 on success, or a negative value on error (-EAGAIN if the I2C bus is used by
+ *   another asynchronous transfer).
+ */
+int eeprom_cache_flush(void);
+
+/* Check the end of the last page write.
+ * Returns 0 when the eeprom is ready, -EAGAIN while the page is being sent or programmed.
+ */
+int eeprom_cache_poll(void);
+
+/* Wait for the end of the last page write. */
+void eeprom_cache_wait(void);
+
+
+/* Writes statistics, for wear estimation.
+ * The eeprom endurance is given as a number of writes of each page.
+ */
+struct eeprom_stats {
+	uint32_t write_requests;   /* Calls to eeprom_cache_write() */
+	uint32_t bytes_requested;  /* Bytes given to eeprom_cache_write() */
+	uint32_t merged_writes;    /* Writes merged with previous ones in the cache */
+	uint32_t page_writes;      /* Page writes sent to the eeprom */
+	uint32_t bytes_written;    /* Bytes sent to the eeprom */
+	uint32_t busy_polls;       /* Polls of the eeprom during page programming */
+};
+
+const struct eeprom_stats* eeprom_get_stats(void);
+
+
 
 
 #endif /* EXTDRV_EEPROM_H */
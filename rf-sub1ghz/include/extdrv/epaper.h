@@ -37,6 +37,15 @@
 
 /***************************************************************************** */
 /* E-Paper */
+
+/* Biggest display supported (2.7") : 176 lines of 264 pixels.
+ * Each line is sent in a single SPI transfer, with the data command byte, even pixels,
+ *  scan line bytes, odd pixels and line termination.
+ */
+#define EPAPER_MAX_LINES  176
+#define EPAPER_MAX_BYTES_PER_LINE  33
+#define EPAPER_LINE_BUFF_SIZE  (1 + (2 * EPAPER_MAX_BYTES_PER_LINE) + (EPAPER_MAX_LINES / 4) + 1)
+
 struct epaper_definition
 {
 	uint16_t pixels_per_line;
@@ -73,8 +82,11 @@ enum epaper_stages {  /* mage pixel -> Display pixel */
  * Configure all gpio used for e-paper display handling
  * Also calls timer_pwm_config()
  * Keeps a pointer to the epaper_definition structure, which MUST stay available.
+ * Returns 0, or -EINVAL if the display is bigger than EPAPER_MAX_LINES lines,
+ *   EPAPER_MAX_BYTES_PER_LINE bytes per line or (EPAPER_MAX_LINES / 4) scan bytes, in
+ *   which case the display is not used.
  */
-void epaper_config(struct epaper_definition* epd);
+int epaper_config(struct epaper_definition* epd);
 
 
 /*
@@ -104,11 +116,18 @@ void epaper_uniform_display(uint8_t value);
  *   - White,
  *   - Inversed new image,
  *   - New image.
- *
- * Note : unsupported yet.
  */
 void epaper_display(uint8_t* old_image_data, uint8_t* new_image_data);
 
+/*
+ * Update the display from old image to new image.
+ * Same as epaper_display(), but the stages are performed only on the lines which differ
+ *   between both images.
+ * Returns the number of lines updated (0 if both images are identical, in which case
+ *   nothing is sent), or -EINVAL if the display has not been configured.
+ */
+int epaper_update(uint8_t* old_image_data, uint8_t* new_image_data);
+
 /*
  * Send whole image, performing only one stage.
  * Only "epaper_normal" has been tested yet.
@@ -48,6 +48,17 @@ int sdmmc_init_end(struct sdmmc_card* mmc);
 int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t *buffer);
 int sdmmc_write_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t *buffer);
 
+/* Read or write nb_blocks consecutive blocks using the multiple blocks commands (CMD18
+ *   and CMD25), which is much faster than one command per block for streaming data.
+ * The buffer must hold nb_blocks * block_size bytes.
+ * The SD cards are asked to pre-erase the blocks (ACMD23) before a multiple blocks write.
+ * Return the same errors as the single block versions, or 0 on success.
+ */
+int sdmmc_read_blocks(const struct sdmmc_card* mmc, uint32_t block_number,
+						uint32_t nb_blocks, uint8_t *buffer);
+int sdmmc_write_blocks(const struct sdmmc_card* mmc, uint32_t block_number,
+						uint32_t nb_blocks, uint8_t *buffer);
+
 
 /* Card states and Operation modes */
 /* Inactive operation mode */
@@ -146,6 +157,8 @@ int sdmmc_write_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8
 
 
 #define MMC_START_DATA_BLOCK_TOCKEN  0xFE
+#define MMC_START_MULTI_WRITE_TOCKEN 0xFC
+#define MMC_STOP_MULTI_WRITE_TOCKEN  0xFD
 
 #define MMC_IS_WRITE_RESPONSE_TOKEN(x)  (((x) & 0x11) == 0x01)
 #define MMC_WRITE_RESPONSE_TOKEN(x)     (((x) & 0x0E) >> 1)
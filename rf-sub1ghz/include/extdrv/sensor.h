@@ -0,0 +1,133 @@
+/****************************************************************************
+ *  extdrv/sensor.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef EXTDRV_SENSOR_H
+#define EXTDRV_SENSOR_H
+
+/***************************************************************************** */
+/* Generic sensors interface and polling                                       */
+/***************************************************************************** */
+
+/* Sensor drivers export a "struct sensor_operations" (see each driver header), which
+ *   gives access to the sensor through a common interface :
+ *  - probe() returns 1 if the sensor is present.
+ *  - configure() sends the sensor configuration, returns 0 or a negative error.
+ *  - start_conversion() triggers a new measurement, NULL for free running sensors.
+ *  - read_raw() gets the raw measurement, returns 0 or a negative error.
+ *  - compensate() converts the raw measurement to physical values. Returns 0 or a
+ *      negative error. A measurement which is not valid and must be dropped (not an
+ *      error) gives no values (nb set to 0), in which case a new conversion is started
+ *      right away and the callback is not called.
+ *  - min_period() returns the time needed for a measurement, in ms, which is both the
+ *      delay between start_conversion() and read_raw() and the shortest read period.
+ *
+ * Sensors are registered with sensor_register(), and sensors_poll() starts the
+ *   conversions and reads the values of all registered sensors, each at its own period.
+ *   All the conversions due are started before reading any sensor, so that conversions
+ *   of different sensors overlap.
+ * sensors_poll() returns the delay until it must be called again, for use with
+ *   sched_set_timer().
+ * A sensor which is not found or fails is probed again every SENSOR_RETRY_PERIOD ms.
+ *
+ * The poll runs in the calling task, and the sensors drivers use blocking I2C accesses.
+ */
+
+#include "lib/stdint.h"
+
+
+/* Physical values units */
+enum sensor_quantities {
+	SENSOR_TEMPERATURE = 0,  /* 0.1 degree Centigrade */
+	SENSOR_HUMIDITY,         /* 0.1 %rH */
+	SENSOR_PRESSURE,         /* Pa */
+	SENSOR_LIGHT,            /* lux */
+	SENSOR_INFRARED,         /* Sensor counts */
+	SENSOR_UV,               /* Sensor counts */
+	SENSOR_MOISTURE,         /* Sensor counts (capacitance) */
+	SENSOR_LIGHT_COUNTS,     /* Sensor counts, lower is brighter */
+};
+
+#define SENSOR_MAX_VALUES  3
+
+struct sensor_raw {
+	uint32_t data[SENSOR_MAX_VALUES];
+};
+
+struct sensor_values {
+	uint8_t nb;
+	uint8_t quantity[SENSOR_MAX_VALUES];
+	int32_t value[SENSOR_MAX_VALUES];
+};
+
+struct sensor_operations {
+	int (*probe)(void* conf);
+	int (*configure)(void* conf);
+	int (*start_conversion)(void* conf);
+	int (*read_raw)(void* conf, struct sensor_raw* raw);
+	int (*compensate)(void* conf, const struct sensor_raw* raw, struct sensor_values* values);
+	uint32_t (*min_period)(void* conf);
+};
+
+
+/***************************************************************************** */
+/* Sensors polling */
+
+#define SENSORS_MAX_NB  8
+#define SENSOR_RETRY_PERIOD  10000
+
+enum sensor_states {
+	SENSOR_ABSENT = 0,
+	SENSOR_IDLE,
+	SENSOR_CONVERTING,
+};
+
+struct sensor {
+	const struct sensor_operations* ops;
+	void* conf;           /* Driver configuration structure */
+	uint32_t period;      /* Read period in ms, raised to the sensor min_period() */
+	/* Called with the new values of the sensor */
+	void (*callback)(struct sensor* sensor, const struct sensor_values* values);
+	/* Polling state */
+	uint8_t state;
+	int last_error;
+	uint32_t start;       /* Time of the last conversion start, in ms */
+	uint32_t next;        /* Time of the next action, in ms */
+};
+
+#define SENSOR(sensor_ops, sensor_conf, read_period, values_callback) \
+	{ \
+		.ops = (sensor_ops), \
+		.conf = (sensor_conf), \
+		.period = (read_period), \
+		.callback = (values_callback), \
+		.state = SENSOR_ABSENT, \
+	}
+
+/* Add a sensor to the polled sensors. The sensor is probed and configured on the next
+ *   poll.
+ * Returns 0, -EINVAL on arguments error, or -ENOMEM if there are already SENSORS_MAX_NB
+ *   sensors.
+ */
+int sensor_register(struct sensor* sensor);
+
+/* Probe, start the conversions and read the values of the registered sensors which are due.
+ * Returns the delay until the next call, in ms.
+ */
+uint32_t sensors_poll(void);
+
+#endif /* EXTDRV_SENSOR_H */
@@ -25,14 +25,65 @@
 #define EXTDRV_SSD130X_OLED_BUFFER_H
 
 #include "lib/stdint.h"
+#include "extdrv/ssd130x_oled_driver.h"
 
 /* Set whole display to given value */
 int ssd130x_buffer_set(uint8_t* gddram, uint8_t val);
 
-/* Change our internal buffer, without actually displaying the changes */
+/* Change our internal buffer, without actually displaying the changes
+ * Tiles which content changed are marked as modified for ssd130x_update_modified().
+ */
 int ssd130x_buffer_set_pixel(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t state);
 int ssd130x_buffer_set_tile(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t* tile);
 
+/* Mark a region of tiles as modified, for use after direct changes to the buffer.
+ * x0, y0, x1 and y1 are in number of tiles, x1 and y1 included.
+ */
+int ssd130x_buffer_mark_region(uint8_t* gddram, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+
+
+/***************************************************************************** */
+/* Text layer
+ * The display is used as a 16 x 8 characters grid, one character per tile.
+ * A shadow copy of the displayed glyphs is kept so that only the cells which glyph
+ *  changed are rendered to the buffer (and marked as modified).
+ * All characters below FIRST_FONT_CHAR are displayed as spaces.
+ */
+struct ssd130x_text_layer {
+	uint8_t* gddram;
+	const uint64_t* font; /* NB_FONT_TILES glyphs, the first one being FIRST_FONT_CHAR */
+	uint8_t cells[SSD130x_NB_PAGES][SSD130x_TILES_PER_PAGE]; /* Displayed glyph indexes */
+};
+
+/* Attach the text layer to a display buffer and font.
+ * The shadow grid is invalidated, the first write to each cell renders it.
+ */
+void ssd130x_text_init(struct ssd130x_text_layer* text, uint8_t* gddram, const uint64_t* font);
+
+/* Invalidate the shadow grid, for use after direct changes to the buffer. */
+void ssd130x_text_invalidate(struct ssd130x_text_layer* text);
+
+/* Display a single character */
+int ssd130x_text_putc(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, char c);
+
+/* Display a string, starting at given line and column and wrapping to the next line.
+ * Returns the number of characters displayed.
+ */
+int ssd130x_text_puts(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, const char* str);
+
+/* Blank "len" cells (wrapping to next line), starting at given line and column */
+int ssd130x_text_clear(struct ssd130x_text_layer* text, uint8_t line, uint8_t col, uint8_t len);
+
+/* Display a fixed point number in a field of "width" cells, right aligned.
+ * The displayed value is "value / 10^decimals", with "decimals" digits after the
+ *  decimal point. The field is filled with '#' if the value does not fit.
+ * Only the field is updated, without formatting the rest of the line, and only the
+ *  digits which changed are rendered.
+ */
+int ssd130x_text_fixed(struct ssd130x_text_layer* text, uint8_t line, uint8_t col,
+						uint8_t width, int32_t value, uint8_t decimals);
+
+
 /* Simple RLE decompressor (two implementations, wip) */
 void uncompress_image(const uint8_t* compressed_data,
                       uint8_t* buffer);
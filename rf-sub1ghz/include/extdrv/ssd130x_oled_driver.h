@@ -28,6 +28,41 @@
 #include "drivers/gpio.h"
 
 
+#define SSD130x_NB_LINES   64
+#define SSD130x_NB_PAGES   8
+#define SSD130x_NB_COL     128
+
+/* The display is also seen as a grid of 16 x 8 "tiles" of 8x8 pixels, one page
+ *  high. Modified tiles are tracked in a bitmap (two bytes per page, one bit per
+ *  tile) stored right after the graphical data in the display buffer.
+ */
+#define SSD130x_TILES_PER_PAGE  (SSD130x_NB_COL / 8)
+#define SSD130x_DIRTY_MAP_SIZE  ((SSD130x_TILES_PER_PAGE / 8) * SSD130x_NB_PAGES)
+
+/* Size of the transfer buffer used by the frame pipeline : I2C header and one page */
+#define SSD130x_FRAME_BUFF_SIZE  (2 + SSD130x_NB_COL)
+
+
+/***************************************************************************** */
+/* Frame pipeline state and statistics */
+struct ssd130x_frame {
+	uint8_t  busy;
+	uint8_t  page; /* Next page of the current window */
+	uint8_t  x0, y0, x1, y1; /* Current window, in tiles */
+	uint8_t  map[SSD130x_DIRTY_MAP_SIZE]; /* Tiles of the frame not sent yet */
+	volatile uint8_t xfer_pending; /* Asynchronous page transfer in progress */
+	volatile uint8_t xfer_state;   /* I2C state at the end of the last page transfer */
+	/* Statistics */
+	uint32_t start_tick;
+	uint32_t frame_time; /* Duration of the last frame transfer, in ms */
+	uint32_t max_frame_time;
+	uint32_t nb_frames;
+	uint32_t nb_errors;
+	uint32_t fps_start_tick;
+	uint16_t fps_count;
+	uint16_t fps; /* Frames sent during the last second or more (updated at end of frames) */
+};
+
 /***************************************************************************** */
 /* Oled Display */
 struct oled_display {
@@ -43,19 +78,19 @@ struct oled_display {
 	uint8_t  display_offset_dir;
 	uint8_t  display_offset;
 	uint8_t* gddram;
-	uint8_t  async;
+	uint8_t  async; /* Use the frame pipeline with asynchronous transfers, requires frame_buff */
+	uint8_t* frame_buff; /* SSD130x_FRAME_BUFF_SIZE bytes, used by the frame pipeline */
+	void (*frame_notify)(void); /* Called (from interrupt) at the end of each asynchronous
+	                             *   page transfer, to get ssd130x_frame_poll() called. */
 	/* spi */
 	struct pio gpio_dc;
 	struct pio gpio_cs;
 	struct pio gpio_rst;
 	/* internal */
 	uint8_t  fullscreen;
+	struct ssd130x_frame frame;
 };
 
-#define SSD130x_NB_LINES   64
-#define SSD130x_NB_PAGES   8
-#define SSD130x_NB_COL     128
-
 enum ssd130x_defs {
 	SSD130x_DISP_OFF = 0,
 	SSD130x_DISP_ON,
@@ -329,12 +364,28 @@ int ssd130x_display_off(struct oled_display* conf);
 
 
 #define GDDRAM_SIZE   (128 * 8)
+
+/* Modified tiles bitmap location in the display buffer */
+#define SSD130x_DIRTY_MAP(gddram)  ((gddram) + 4 + GDDRAM_SIZE)
+
+/* Size of the buffer to be used as "gddram" in the oled_display structure */
+#define SSD130x_BUFFER_SIZE  (4 + GDDRAM_SIZE + SSD130x_DIRTY_MAP_SIZE)
+
+/* Modified tiles separated by at most this number of unmodified tiles are sent
+ *  in a single transfer : sending 8 more bytes is cheaper than setting up a new
+ *  window (two commands and a new I2C frame header).
+ */
+#define SSD130x_MERGE_GAP  1
+
 /***************************************************************************** */
 /* Data */
 
 /* Our internal buffer for the whole display.
  * Graphical data starts at byte 4. The first four bytes are here for temporary
  *  storage of display data during I2C frame transfer.
+ * The modified tiles bitmap follows the graphical data (see SSD130x_BUFFER_SIZE).
+ * Data is modified in place during the transfer, which is always synchronous :
+ *  use the frame pipeline for asynchronous updates.
  */
 int ssd130x_send_data(struct oled_display* conf, uint8_t* start, uint16_t len);
 
@@ -342,8 +393,46 @@ int ssd130x_send_data(struct oled_display* conf, uint8_t* start, uint16_t len);
 /* Update what is really displayed */
 int ssd130x_display_full_screen(struct oled_display* conf);
 int ssd130x_update_tile(struct oled_display* conf, uint8_t x0, uint8_t y0);
+
+/* Send a rectangular region of tiles to the display.
+ * x0, y0, x1 and y1 are in number of tiles, x1 and y1 included.
+ */
 int ssd130x_update_region(struct oled_display* conf,
 							uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+
+/* Send only the tiles marked as modified since last update.
+ * Modified tiles of a page are grouped in spans (see SSD130x_MERGE_GAP), and
+ *  identical spans on consecutive pages are sent using a single window.
+ */
 int ssd130x_update_modified(struct oled_display* conf);
 
+
+/***************************************************************************** */
+/* Frame pipeline
+ * The modified tiles are sent one page at a time from the frame_buff transfer buffer,
+ *  which acts as front buffer : the gddram buffer is never accessed by the bus and
+ *  rendering to it can go on while a frame is being sent. Tiles modified during the
+ *  transfer are marked as modified again and will be part of the next frame.
+ * With I2C and "async" set, each page is sent using an asynchronous write and
+ *  ssd130x_frame_poll() must be called regularly to move on to the next one, which is
+ *  best done when frame_notify is called. The end of the page transfers is tracked by
+ *  the driver, other transfers on the bus do not interfere. SPI transfers are always
+ *  synchronous.
+ */
+
+/* Start sending a new frame made of all tiles modified since last frame.
+ * Returns -EBUSY if the previous frame is still being sent (nothing done, try again
+ *   later), -EAGAIN if the frame has been started and is not complete yet, 0 if the
+ *   frame is complete (or if nothing changed), or a negative error code.
+ * Without frame_buff, this falls back to a synchronous ssd130x_update_modified().
+ */
+int ssd130x_frame_start(struct oled_display* conf);
+
+/* Move the current frame forward.
+ * Returns -EAGAIN while the frame is not complete, 0 when done (or if no frame is in
+ *   progress), or a negative error code, in which case the whole display will be sent
+ *   on next frame.
+ */
+int ssd130x_frame_poll(struct oled_display* conf);
+
 #endif /* EXTDRV_SSD130X_OLED_DRIVER_H */
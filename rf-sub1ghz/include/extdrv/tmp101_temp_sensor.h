@@ -24,6 +24,7 @@
 #define EXTDRV_TEMP_H
 
 #include "lib/stdint.h"
+#include "extdrv/sensor.h"
 
 
 /***************************************************************************** */
@@ -109,5 +110,11 @@ int tmp101_sensor_config(struct tmp101_sensor_config* conf);
 int tmp101_sensor_start_conversion(struct tmp101_sensor_config* conf);
 
 
+/* Generic sensor interface (see extdrv/sensor.h), with a struct tmp101_sensor_config as
+ *   configuration. The sensor is used in shutdown mode with one-shot conversions.
+ */
+extern const struct sensor_operations tmp101_sensor_ops;
+
+
 #endif /* EXTDRV_TEMP_H */
 
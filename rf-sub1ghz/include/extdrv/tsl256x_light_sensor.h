@@ -26,11 +26,17 @@
 #define EXTDRV_TSL256X_H
 
 #include "lib/stdint.h"
+#include "extdrv/sensor.h"
 
 
 /* TSL256x sensor instance data.
  * Use one of this for each sensor you want to access.
  * - addr is the sensor address on most significant bits (8bits address).
+ * - one_shot : when set, the sensor is powered down after each read, and each
+ *     conversion must be started using tsl256x_start_conversion().
+ * - auto_range : when set, gain and integration_time are selected by the driver (see
+ *     tsl256x_sensor_read()).
+ * - status : TSL256x_SATURATED and TSL256x_RANGE_CHANGED flags for the last read.
  */
 struct tsl256x_sensor_config {
 	uint8_t addr;
@@ -38,9 +44,17 @@ struct tsl256x_sensor_config {
 	uint8_t package;
 	uint8_t gain;
 	uint8_t integration_time;
+	uint8_t one_shot;
+	uint8_t auto_range;
+	uint8_t range;
+	uint8_t status;
 	uint8_t probe_ok;
 };
 
+/* Status flags */
+#define TSL256x_SATURATED      (0x01 << 0)  /* An ADC channel reached its maximum count */
+#define TSL256x_RANGE_CHANGED  (0x01 << 1)  /* Gain or integration time changed after the read */
+
 enum tsl256x_pkg_types {
 	TSL256x_PACKAGE_T = 0,
 	TSL256x_PACKAGE_FN,
@@ -72,6 +86,7 @@ struct tsl256x_internal_regs {
 
 /* Defines for control register */
 #define TSL256x_POWER_ON          (0x03)
+#define TSL256x_POWER_OFF         (0x00)
 
 /* Defines for timing register */
 /* See page 22 of tsl256x manual for information on how to calculate lux. */
@@ -116,6 +131,14 @@ int tsl256x_read_id(struct tsl256x_sensor_config* conf);
 /* Sensor read
  * Performs a non-blocking read of the luminosity from the sensor.
  * 'lux' 'ir' and 'comb': integer addresses for conversion result, may be NULL.
+ * The lux value is computed with the gain and integration time used for the conversion,
+ *   and is not valid when conf->status has the TSL256x_SATURATED flag set.
+ * With auto_range set, the gain and integration time are then changed if the counts are
+ *   out of the current range, with some hysteresis, for the next conversion. More
+ *   sensitivity is obtained by raising the gain first, so that the integration time
+ *   remains as short as possible. In continuous mode the sensor integration is restarted
+ *   on range change, and the next read must occur at least tsl256x_conversion_time() ms
+ *   later.
  * Return value(s):
  *   Upon successfull completion, returns 0 and the luminosity read is placed in the
  *   provided integer(s). On error, returns a negative integer equivalent to errors from
@@ -134,6 +157,33 @@ int tsl256x_sensor_read(struct tsl256x_sensor_config* conf, uint16_t* comb, uint
 int tsl256x_configure(struct tsl256x_sensor_config* conf);
 
 
+/* Split-phase conversions (one_shot set in conf) :
+ *   The sensor integrates continuously while powered, and a new integration cycle starts
+ *   on power up. tsl256x_start_conversion() powers the sensor up, and the result can be
+ *   read using tsl256x_sensor_read() tsl256x_conversion_time() ms later. The sensor is
+ *   powered down again by tsl256x_sensor_read().
+ *   The sensor has no "conversion done" flag, the conversion time must be waited for.
+ */
+
+/* Start a conversion by powering the sensor up.
+ * Return value:
+ *   Upon successfull completion, returns 0. On error, returns a negative integer
+ *   equivalent to errors from glibc.
+ */
+int tsl256x_start_conversion(struct tsl256x_sensor_config* conf);
+
+/* Integration time in ms for the configuration of conf, with some margin for the
+ *   internal oscillator tolerance. */
+uint32_t tsl256x_conversion_time(struct tsl256x_sensor_config* conf);
+
+
+/* Generic sensor interface (see extdrv/sensor.h), with a struct tsl256x_sensor_config as
+ *   configuration. A conversion is started for each read when one_shot is set. Values
+ *   are luminosity and infrared counts.
+ */
+extern const struct sensor_operations tsl256x_sensor_ops;
+
+
 
 
 /***************************************************************************** */
@@ -151,8 +201,8 @@ int tsl256x_configure(struct tsl256x_sensor_config* conf);
 
 /* Integration time scaling factors */
 #define CH_SCALE 10 /* scale channel values by 2^10 */
-#define CHSCALE_TINT0 ((322 / 11) * (2 << CH_SCALE)) /* = 0x7517 = 322/11 * 2^CH_SCALE */
-#define CHSCALE_TINT1 ((322 / 81) * (2 << CH_SCALE)) /* = 0x0fe7 = 322/81 * 2^CH_SCALE */
+#define CHSCALE_TINT0 0x7517 /* = 322/11 * 2^CH_SCALE */
+#define CHSCALE_TINT1 0x0fe7 /* = 322/81 * 2^CH_SCALE */
 
 
 /*
@@ -25,6 +25,7 @@
 #define EXTDRV_VEML6070_H
 
 #include "lib/stdint.h"
+#include "extdrv/sensor.h"
 
 
 
@@ -75,5 +76,11 @@ int veml6070_sensor_read(struct veml6070_sensor_config* conf, uint16_t* uv_raw);
 int veml6070_configure(struct veml6070_sensor_config* conf);
 
 
+/* Generic sensor interface (see extdrv/sensor.h), with a struct veml6070_sensor_config as
+ *   configuration. The value is the UV sensor count.
+ */
+extern const struct sensor_operations veml6070_sensor_ops;
+
+
 #endif /* EXTDRV_VEML6070_H */
 
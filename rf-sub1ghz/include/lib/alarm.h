@@ -0,0 +1,88 @@
+/****************************************************************************
+ *  lib/alarm.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_ALARM_H
+#define LIB_ALARM_H
+
+/***************************************************************************** */
+/* Sensor values alarms                                                        */
+/***************************************************************************** */
+
+/* Per channel alarm conditions on sensor values, checked on each new value :
+ *  - ALARM_HIGH / ALARM_LOW : the value is above "high" or below "low". The condition
+ *      ends once the value gets back by more than "hysteresis" on the other side of the
+ *      threshold.
+ *  - ALARM_RISE / ALARM_FALL : the value rose or fell by more than "rate" in less than
+ *      rate_period ms. Values are kept every (rate_period >> ALARM_RATE_SHIFT) ms for
+ *      this, so the change is measured over 3/4 to 4/4 of rate_period, and the first
+ *      rate alarm can only be raised 3/4 of rate_period after the first value.
+ *
+ * Only the conditions selected in "enabled" are checked. alarm_check() returns the
+ *   conditions which were raised by this value, each condition being raised once until
+ *   it ends.
+ * Values are in the sensor units, and times in ms.
+ */
+
+#include "lib/stdint.h"
+
+#define ALARM_HIGH  (0x01 << 0)
+#define ALARM_LOW   (0x01 << 1)
+#define ALARM_RISE  (0x01 << 2)
+#define ALARM_FALL  (0x01 << 3)
+
+#define ALARM_RATE_SHIFT  2
+#define ALARM_RATE_SLOTS  (1 << ALARM_RATE_SHIFT)
+
+struct alarm_channel {
+	/* Configuration */
+	uint8_t enabled;       /* ALARM_* conditions checked */
+	int32_t low;
+	int32_t high;
+	uint32_t hysteresis;
+	uint32_t rate;         /* Change raising ALARM_RISE or ALARM_FALL */
+	uint32_t rate_period;  /* In ms */
+	/* State */
+	uint8_t active;        /* ALARM_* conditions in progress */
+	uint8_t nb_hist;       /* Values in the history */
+	uint8_t hist_pos;      /* Next (and oldest) slot of the history */
+	uint32_t hist_time;    /* Time of the last value kept in the history */
+	int32_t hist[ALARM_RATE_SLOTS];
+};
+
+/* Initialise a channel with its configuration */
+#define ALARM_CHANNEL(conditions, low_val, high_val, hyst, rate_val, period) \
+	{ \
+		.enabled = (conditions), \
+		.low = (low_val), \
+		.high = (high_val), \
+		.hysteresis = (hyst), \
+		.rate = (rate_val), \
+		.rate_period = (period), \
+		.active = 0, \
+		.nb_hist = 0, \
+	}
+
+/* Forget the conditions in progress and the values history, keeping the configuration */
+void alarm_reset(struct alarm_channel* al);
+
+/* Check a new value, received at time "now" (in ms).
+ * Returns the ALARM_* conditions raised by this value, 0 if none.
+ */
+uint8_t alarm_check(struct alarm_channel* al, int32_t value, uint32_t now);
+
+#endif /* LIB_ALARM_H */
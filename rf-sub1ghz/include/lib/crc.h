@@ -0,0 +1,59 @@
+/****************************************************************************
+ *  lib/crc.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_CRC_H
+#define LIB_CRC_H
+
+/***************************************************************************** */
+/* CRC computation                                                             */
+/***************************************************************************** */
+
+/* Single interface for the CRC computations, using the CRC engine (see
+ *   core/crc_engine.h) when possible, and lookup tables otherwise.
+ * The CRC engine is used for buffers of at least CRC_HW_MIN_LEN bytes, when it is not
+ *   already in use. Interrupts are not disabled while the engine runs, and an interrupt
+ *   handler which finds the engine in use by the interrupted context uses the tables.
+ *   Both give the same results.
+ *
+ * Data can be processed in successive chunks : provide the start value on first call,
+ *   and the value returned by the previous call for the following ones.
+ */
+
+#include "lib/stdint.h"
+
+/* CRC types */
+enum crc_types {
+	/* Polynomial 0x1021, most significant bit first, no final xor.
+	 * This is the SD cards data CRC and CRC-16/XMODEM when started with 0x0000. */
+	CRC_TYPE_CCITT = 0,
+	/* Polynomial 0x8005, reflected, no final xor. CRC-16/ARC when started with 0x0000. */
+	CRC_TYPE_CRC16,
+	/* Polynomial 0x04C11DB7, reflected, with initial and final complement.
+	 * This is the Ethernet / zlib CRC-32, start with 0. */
+	CRC_TYPE_CRC32,
+};
+
+/* Setting up the CRC engine costs more than computing a few bytes with the tables */
+#define CRC_HW_MIN_LEN  16
+
+/* Compute the CRC of "len" bytes from "buf", starting with "crc".
+ * Returns the updated CRC, or "crc" if the type is not supported or buf is NULL.
+ */
+uint32_t crc_compute(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#endif /* LIB_CRC_H */
@@ -32,6 +32,7 @@
 #define EBUSY       16 /* Device or ressource Busy */
 #define ENODEV      19 /* No such device */
 #define EINVAL      22 /* Invalid argument */
+#define ENOSPC      28  /* No space left on device */
 #define ENODATA     61  /* No data available */
 #define ECOMM       70  /* Communication error on send */
 #define EPROTO      71  /* Protocol error */
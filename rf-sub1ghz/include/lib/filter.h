@@ -0,0 +1,97 @@
+/****************************************************************************
+ *  lib/filter.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_FILTER_H
+#define LIB_FILTER_H
+
+/***************************************************************************** */
+/* Sensor values conditioning                                                  */
+/***************************************************************************** */
+
+/* Per channel pipeline for sensor values, in integer arithmetic only (shifts, no
+ *   division) :
+ *  - Oversampling : (1 << oversample_shift) raw samples are averaged into one sample.
+ *  - Spike filter : median of the last median_len samples (1, 3 or 5, 1 disables it).
+ *  - Smoothing : exponentially weighted moving average with a weight of
+ *      1 / (1 << ewma_shift) for the new sample (0 disables it). When the median output
+ *      moves away from the average by more than "step", the average is restarted from
+ *      it, so that fast changes are not delayed by the smoothing (0 disables this).
+ *  - Report by exception : a value must be reported when it moved by more than
+ *      "deadband" from the last reported value, or after max_silence values without
+ *      report (0 for no limit). The first value is always reported.
+ *
+ * Values are in the sensor units, up to +/- (2^31 >> (ewma_shift + oversample_shift)).
+ */
+
+#include "lib/stdint.h"
+
+#define FILTER_MEDIAN_MAX_LEN  5
+
+struct filter_channel {
+	/* Configuration */
+	uint8_t oversample_shift;
+	uint8_t median_len;
+	uint8_t ewma_shift;
+	uint32_t step;
+	uint32_t deadband;
+	uint16_t max_silence;
+	/* State */
+	uint8_t nb_acc;        /* Raw samples in the oversampling accumulator */
+	uint8_t nb_median;     /* Samples in the median buffer */
+	uint8_t median_pos;    /* Next slot of the median buffer */
+	uint8_t initialized;   /* A value has been computed (and reported) */
+	int32_t acc;           /* Oversampling accumulator */
+	int32_t median_buf[FILTER_MEDIAN_MAX_LEN];
+	int32_t ewma;          /* Average, scaled by (1 << ewma_shift) */
+	int32_t value;         /* Last filtered value */
+	int32_t reported;      /* Last reported value */
+	uint16_t silence;      /* Values since the last report */
+};
+
+/* Initialise a channel with its configuration */
+#define FILTER_CHANNEL(os_shift, med_len, ew_shift, step_val, db, silence_max) \
+	{ \
+		.oversample_shift = (os_shift), \
+		.median_len = (med_len), \
+		.ewma_shift = (ew_shift), \
+		.step = (step_val), \
+		.deadband = (db), \
+		.max_silence = (silence_max), \
+		.initialized = 0, \
+	}
+
+/* filter_push() return flags */
+#define FILTER_NEW_VALUE  (0x01 << 0)  /* A new filtered value is available */
+#define FILTER_REPORT     (0x01 << 1)  /* The new value must be reported */
+
+/* Restart the pipeline, keeping the configuration */
+void filter_reset(struct filter_channel* ch);
+
+/* Add a raw sample to the channel.
+ * Returns 0 if the sample has been accumulated (oversampling), or FILTER_NEW_VALUE with
+ *   FILTER_REPORT if the new value (see filter_value()) must be reported.
+ */
+int filter_push(struct filter_channel* ch, int32_t raw);
+
+/* Last filtered value */
+static inline int32_t filter_value(const struct filter_channel* ch)
+{
+	return ch->value;
+}
+
+#endif /* LIB_FILTER_H */
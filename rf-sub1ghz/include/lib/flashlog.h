@@ -0,0 +1,129 @@
+/****************************************************************************
+ *  lib/flashlog.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_FLASHLOG_H
+#define LIB_FLASHLOG_H
+
+/***************************************************************************** */
+/* Records log in internal flash                                               */
+/***************************************************************************** */
+
+/* Circular log of small timestamped records in unused sectors of the internal flash,
+ *   written using the IAP ROM routines (see core/iap.h), for nodes without SD card.
+ *
+ * Records are gathered in a RAM buffer and written by units of FLASHLOG_UNIT_SIZE bytes
+ *   when the buffer is full or on flashlog_flush(). Each unit holds a header with a
+ *   sequence number and the drain position, and ends with a CRC32 of the unit, so that a
+ *   unit partially written on power loss is detected and skipped. A unit is written only
+ *   once between two erases.
+ * The sectors are erased one at a time when the log gets to them, so the oldest records
+ *   get lost when the log is full.
+ * The flash has a limited number of erase cycles : units writes are rate limited by
+ *   "min_interval" (a write before this delay fails with -EAGAIN, and a record which does
+ *   not fit is then dropped and counted in "lost"). Each sector gets erased once every
+ *   (nb_sectors * units per sector) units writes.
+ *
+ * Records are read back, oldest first, with flashlog_drain(), including the records still
+ *   in the RAM buffer. The drain position is saved in each new unit header, so draining
+ *   resumes after a reset. It is saved by unit : the records of the unit being drained when
+ *   the last unit was written, and of the units drained since, are drained again.
+ * Between two resets each record is drained once, unless lost with its sector when the log
+ *   is full. A reset loses the records in the RAM buffer. See scripts/flashlog_check.c.
+ *
+ * Interrupts are disabled during flash erase and programming.
+ */
+
+#include "lib/stdint.h"
+
+
+/* Must be a multiple of 4, a divider of the flash sector size, and at most 512 */
+#ifndef FLASHLOG_UNIT_SIZE
+#define FLASHLOG_UNIT_SIZE  256
+#endif
+
+#define FLASHLOG_MAGIC  0xA5
+
+struct flashlog_unit_header {
+	uint32_t seq;
+	uint32_t tail_seq;   /* Oldest unit not drained when this unit was written */
+	uint16_t len;        /* Number of records bytes in this unit */
+	uint8_t nb_records;
+	uint8_t magic;
+};
+
+/* Records bytes in a unit : the unit ends with the CRC32 of the header and records */
+#define FLASHLOG_PAYLOAD_SIZE  (FLASHLOG_UNIT_SIZE - sizeof(struct flashlog_unit_header) - 4)
+/* Each record is its length (1 byte), its timestamp (4 bytes) and the record data */
+#define FLASHLOG_RECORD_HEADER_SIZE  5
+#define FLASHLOG_MAX_RECORD_SIZE  (FLASHLOG_PAYLOAD_SIZE - FLASHLOG_RECORD_HEADER_SIZE)
+
+struct flashlog {
+	uint32_t start;         /* Address of the first sector */
+	uint16_t nb_units;
+	uint16_t head_pos;      /* Unit for the next write */
+	uint32_t head_seq;      /* Sequence number of the next unit written */
+	uint32_t tail_seq;      /* Sequence number of the oldest unit not drained */
+	uint32_t tail_addr;     /* Address of this unit, 0 if not known yet */
+	uint16_t tail_offset;   /* Offset of the next record to drain in this unit */
+	uint16_t fill;          /* Records bytes in the RAM buffer */
+	uint8_t nb_records;
+	uint8_t written;        /* A unit has been written since init */
+	uint16_t lost;          /* Records dropped because of the rate limit or write errors */
+	uint32_t min_interval;  /* Minimum delay between units writes, in system ticks */
+	uint32_t last_write;    /* System tick count of the last unit write */
+	uint32_t buf[FLASHLOG_UNIT_SIZE / 4];
+};
+
+/* Setup the log on "nb_sectors" flash sectors starting at address "start", and find the
+ *   head and drain position of an existing log.
+ * start must be sector aligned and above the program image, and the region must be within
+ *   the 4kB sectors. At least two sectors are required.
+ * min_interval is the minimum delay between two units writes, in system ticks.
+ * Returns 0 on success, -EINVAL on arguments error, or -ENOSPC if the region overlaps the
+ *   program image.
+ */
+int flashlog_init(struct flashlog* log, uint32_t start, uint8_t nb_sectors, uint32_t min_interval);
+
+/* Add a record to the log. The RAM buffer is written to flash first if the record does not
+ *   fit.
+ * Returns 0 on success, -EINVAL on arguments error, or the error of the unit write (the
+ *   record is then dropped and counted as lost).
+ */
+int flashlog_append(struct flashlog* log, uint32_t timestamp, const uint8_t* data, uint8_t len);
+
+/* Write the records of the RAM buffer to flash.
+ * Returns 0 on success, -EAGAIN if the last write is too recent, or -EIO on flash error.
+ *   The records are kept in RAM on error.
+ */
+int flashlog_flush(struct flashlog* log);
+
+/* Call the callback for at most "max" records, oldest first. The callback returns a
+ *   negative value if the record could not be handled, which stops the drain, and the
+ *   record is then kept for the next drain.
+ * Returns the number of records drained.
+ */
+int flashlog_drain(struct flashlog* log, unsigned int max,
+				int (*callback)(uint32_t timestamp, const uint8_t* data, uint8_t len));
+
+/* Returns 1 if there are records to drain, 0 otherwise. */
+static inline int flashlog_pending(const struct flashlog* log)
+{
+	return ((log->tail_seq != log->head_seq) || (log->fill != 0));
+}
+
+#endif /* LIB_FLASHLOG_H */
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *  lib/pktpool.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_PKTPOOL_H
+#define LIB_PKTPOOL_H
+
+/***************************************************************************** */
+/* Packet buffers pool                                                         */
+/***************************************************************************** */
+
+/* Static pool of fixed size packet buffers with reference counting.
+ *
+ * A packet buffer can be shared by several users (queues, UART forwarding, radio
+ *   retransmission, ...) without copies : each user takes a reference with
+ *   pktpool_get() and releases it with pktpool_put(). The buffer goes back to the pool
+ *   when the last reference is released.
+ * Allocation and release may be done from interrupt handlers.
+ * Buffers are identified by their index in the pool, which fits in a byte and can be
+ *   passed through a ring buffer (see lib/ringbuf.h).
+ * The pool keeps track of the number of buffers in use, its high water mark, and the
+ *   number of failed allocations, which should be used to size the pool.
+ */
+
+#include "lib/stdint.h"
+
+#define PKTPOOL_MAX_BUFS  32
+
+struct pktbuf {
+	volatile uint8_t refcount;
+	uint8_t idx;   /* Index in the pool */
+	uint8_t len;   /* Number of valid bytes in data, for use by the buffer users */
+	uint8_t flags; /* Free for use by the buffer users */
+	uint8_t data[];
+};
+
+struct pktpool {
+	uint8_t* storage;
+	uint16_t stride;    /* Buffer header and data size, rounded up to a multiple of 4 */
+	uint8_t data_size;
+	uint8_t nb_bufs;
+	volatile uint32_t free_mask;  /* One bit per free buffer */
+	volatile uint8_t in_use;
+	volatile uint8_t high_water;
+	volatile uint16_t alloc_failures;
+};
+
+#define PKTPOOL_STRIDE(size)  ((sizeof(struct pktbuf) + (size) + 3) & ~3)
+
+/* Declare a pool of "nb" buffers of "size" data bytes each, with its static storage.
+ * nb must be between 1 and PKTPOOL_MAX_BUFS, size at most 255.
+ */
+#define PKTPOOL_DECLARE(name, nb, size) \
+	static uint32_t name ## _storage[((nb) * PKTPOOL_STRIDE(size)) / 4]; \
+	struct pktpool name = { \
+		.storage = (uint8_t*)name ## _storage, \
+		.stride = PKTPOOL_STRIDE(size), \
+		.data_size = (size), \
+		.nb_bufs = (nb), \
+		.free_mask = (0xFFFFFFFFUL >> (32 - (nb))), \
+		.in_use = 0, \
+		.high_water = 0, \
+		.alloc_failures = 0, \
+	}
+
+/* Get a free buffer from the pool, with a reference count of 1 and a length of 0.
+ * Returns NULL if no buffer is available.
+ */
+struct pktbuf* pktpool_alloc(struct pktpool* pool);
+
+/* Take one more reference on a buffer */
+void pktpool_get(struct pktbuf* pkt);
+
+/* Release one reference on a buffer, and give it back to the pool if it was the last one */
+void pktpool_put(struct pktpool* pool, struct pktbuf* pkt);
+
+/* Get a buffer from its index. Does not take a reference. */
+static inline struct pktbuf* pktpool_buf(struct pktpool* pool, uint8_t idx)
+{
+	return (struct pktbuf*)(pool->storage + (idx * pool->stride));
+}
+
+#endif /* LIB_PKTPOOL_H */
@@ -0,0 +1,98 @@
+/****************************************************************************
+ *  lib/prof.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_PROF_H
+#define LIB_PROF_H
+
+/***************************************************************************** */
+/* Profiling                                                                   */
+/***************************************************************************** */
+
+/* Named scoped timers, counting the clock cycles spent between PROF_ENTER() and
+ *   PROF_EXIT() using the system tick timer (see systick_get_clock_cycles()).
+ * Each scope keeps the number of runs and the min, max and total cycles count. The scopes
+ *   register themselves on first use and prof_dump() prints them all on an UART.
+ * The cycles count includes the time spent in interrupt handlers.
+ *
+ * Profiling is disabled by default and the macros then expand to nothing. Build with
+ *   "-DPROF_ENABLE=1" (add it to CFLAGS) to enable it.
+ * The system tick timer must be running.
+ *
+ * Usage :
+ *   int func(void)
+ *   {
+ *       int ret = 0;
+ *       PROF_ENTER(func);
+ *       ...
+ *       PROF_EXIT(func);
+ *       return ret;
+ *   }
+ * Each return path must go through PROF_EXIT(), and a scope name must be used only once
+ *   per function. The start cycles count is kept on the stack, so profiled functions may be
+ *   re-entered (from interrupts or recursively).
+ */
+
+#include "lib/stdint.h"
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 0
+#endif
+
+struct prof_scope {
+	const char* name;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	struct prof_scope* next;
+	uint8_t registered;
+};
+
+#if (PROF_ENABLE == 1)
+
+#define PROF_ENTER(scope) \
+	static struct prof_scope prof_scope_ ## scope = { .name = #scope, .min = 0xFFFFFFFF, }; \
+	uint32_t prof_start_ ## scope = prof_enter(&prof_scope_ ## scope)
+
+#define PROF_EXIT(scope) \
+	prof_exit(&prof_scope_ ## scope, prof_start_ ## scope)
+
+#else
+
+#define PROF_ENTER(scope)  do {} while (0)
+#define PROF_EXIT(scope)   do {} while (0)
+
+#endif
+
+
+/* Register the scope if not done yet and return the current clock cycles count.
+ * Use PROF_ENTER() instead. */
+uint32_t prof_enter(struct prof_scope* scope);
+
+/* Update the scope statistics. Use PROF_EXIT() instead. */
+void prof_exit(struct prof_scope* scope, uint32_t start);
+
+/* Print the statistics of all registered scopes on the given UART :
+ *  name, number of runs, min, average and max cycles count.
+ */
+void prof_dump(int uart_num);
+
+/* Reset the statistics of all registered scopes */
+void prof_reset(void);
+
+#endif /* LIB_PROF_H */
@@ -0,0 +1,162 @@
+/****************************************************************************
+ *  lib/ringbuf.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_RINGBUF_H
+#define LIB_RINGBUF_H
+
+/***************************************************************************** */
+/* Ring buffers                                                                */
+/***************************************************************************** */
+
+/* Byte ring buffers used to pass data between interrupt handlers and the main context.
+ *
+ * The size is a power of two, and head and tail are free running indexes masked on
+ *   access, so that all the buffer can be used and the number of bytes in the buffer is
+ *   always (head - tail).
+ * With a single producer and a single consumer (which may each be an interrupt handler
+ *   or the main context) no locking is needed : head is only written by the producer
+ *   and tail by the consumer, and 32 bits aligned accesses are atomic on the Cortex-M0.
+ * Use ringbuf_mp_write() when there is more than one producer (the main context and an
+ *   interrupt handler, or interrupts of different priorities). Multiple consumers are
+ *   not supported.
+ * Data pushed to a full buffer is dropped and counted in "dropped".
+ */
+
+#include "lib/stdint.h"
+#include "lib/errno.h"
+#include "core/lpc_core.h"
+
+struct ringbuf {
+	uint8_t* data;
+	uint32_t mask;  /* Size - 1 */
+	volatile uint32_t head;  /* Written by the producer */
+	volatile uint32_t tail;  /* Written by the consumer */
+	volatile uint32_t dropped;
+};
+
+/* Declare and initialise a ring buffer with its static storage. size must be a
+ * power of two. */
+#define RINGBUF_DECLARE(name, size) \
+	static uint8_t name ## _data[(size)]; \
+	struct ringbuf name = { \
+		.data = name ## _data, \
+		.mask = ((size) - 1), \
+		.head = 0, \
+		.tail = 0, \
+		.dropped = 0, \
+	}
+
+/* Initialise a ring buffer using the "size" bytes of "data" as storage.
+ * Returns 0, or -EINVAL if size is not a power of two.
+ */
+int ringbuf_init(struct ringbuf* rb, uint8_t* data, uint32_t size);
+
+/* Number of bytes in the buffer */
+static inline uint32_t ringbuf_count(struct ringbuf* rb)
+{
+	return (rb->head - rb->tail);
+}
+
+/* Number of free bytes in the buffer */
+static inline uint32_t ringbuf_space(struct ringbuf* rb)
+{
+	return (rb->mask + 1 - (rb->head - rb->tail));
+}
+
+
+/***************************************************************************** */
+/* Single byte access */
+
+/* Add one byte to the buffer.
+ * Returns 0, or -ENOBUFS if the buffer is full (the byte is dropped).
+ */
+static inline int ringbuf_push(struct ringbuf* rb, uint8_t c)
+{
+	uint32_t head = rb->head;
+	if ((head - rb->tail) > rb->mask) {
+		rb->dropped++;
+		return -ENOBUFS;
+	}
+	rb->data[head & rb->mask] = c;
+	/* Data must be in the buffer before the consumer gets to see it */
+	dmb();
+	rb->head = head + 1;
+	return 0;
+}
+
+/* Get one byte from the buffer.
+ * Returns 0, or -ENODATA if the buffer is empty.
+ */
+static inline int ringbuf_pop(struct ringbuf* rb, uint8_t* c)
+{
+	uint32_t tail = rb->tail;
+	if (rb->head == tail) {
+		return -ENODATA;
+	}
+	*c = rb->data[tail & rb->mask];
+	/* Data must have been read before the producer can overwrite it */
+	dmb();
+	rb->tail = tail + 1;
+	return 0;
+}
+
+
+/***************************************************************************** */
+/* Bulk access */
+
+/* Add up to "len" bytes from "buf" to the buffer.
+ * Returns the number of bytes actually added. Bytes which do not fit are dropped.
+ */
+uint32_t ringbuf_write(struct ringbuf* rb, const void* buf, uint32_t len);
+
+/* Add "len" bytes from "buf" to the buffer when there may be more than one producer.
+ * Data is only added if it fits in the buffer, so that data from different producers
+ *   never gets interleaved.
+ * Interrupts are disabled during the copy (and restored to their previous state), so
+ *   keep the writes short.
+ * Returns 0, or -ENOBUFS if there is not enough space (nothing added).
+ */
+int ringbuf_mp_write(struct ringbuf* rb, const void* buf, uint32_t len);
+
+/* Get up to "len" bytes from the buffer to "buf".
+ * Returns the number of bytes actually read.
+ */
+uint32_t ringbuf_read(struct ringbuf* rb, void* buf, uint32_t len);
+
+
+/***************************************************************************** */
+/* Zero copy access
+ * The reserve and peek functions return the number of contiguous bytes which can be
+ *   accessed at the returned address, which may be less than ringbuf_space() or
+ *   ringbuf_count() when the area wraps at the end of the buffer.
+ */
+
+/* Get the address and size of the contiguous free area at head.
+ * Fill (part of) it and call ringbuf_write_commit() with the number of bytes written.
+ */
+uint32_t ringbuf_write_reserve(struct ringbuf* rb, uint8_t** ptr);
+void ringbuf_write_commit(struct ringbuf* rb, uint32_t len);
+
+/* Get the address and size of the contiguous data area at tail.
+ * Use (part of) it and call ringbuf_read_release() with the number of bytes used.
+ */
+uint32_t ringbuf_read_peek(struct ringbuf* rb, const uint8_t** ptr);
+void ringbuf_read_release(struct ringbuf* rb, uint32_t len);
+
+
+#endif /* LIB_RINGBUF_H */
@@ -0,0 +1,120 @@
+/****************************************************************************
+ *  lib/sdlog.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_SDLOG_H
+#define LIB_SDLOG_H
+
+/***************************************************************************** */
+/* Append-only records log on SD card                                          */
+/***************************************************************************** */
+
+/* Store and forward log of small timestamped records, written directly to a range of
+ *   blocks of an SD card (no file system).
+ *
+ * Records are gathered in a RAM buffer and written one 512 bytes block at a time, when
+ *   the block is full or on sdlog_flush(). Each block is written only once, and holds a
+ *   header with a sequence number and a CRC32 of the whole block, so that a block
+ *   partially written on power loss is detected and ignored. When the ring is full, such
+ *   a write also destroys the oldest block, which sdlog_replay() then skips.
+ * The blocks range is used as a ring : the block for sequence number "seq" is
+ *   (seq % nb_blocks), and the oldest blocks get overwritten when the ring is full.
+ *   The sequence numbers being consecutive, the head of the log is found on init with a
+ *   binary search (about log2(nb_blocks) block reads).
+ * Records are replayed one block at a time, oldest first, with sdlog_replay(). Each block
+ *   header also holds the sequence number of the oldest block not replayed yet, so that
+ *   replay resumes after a reset. Blocks replayed since the last write may be replayed
+ *   again after a reset.
+ *
+ * The RAM buffer is used both to gather new records and to read the replayed blocks, so
+ *   sdlog_replay() fails with -EBUSY while records are waiting to be written.
+ * The log uses the single block commands : there is only one block in RAM at a time, and
+ *   the multiple blocks transfers (sdmmc_write_blocks()) only save time when several
+ *   blocks are sent with one command, which would need one more 512 bytes buffer for
+ *   each block on a 4KB RAM part.
+ */
+
+#include "lib/stdint.h"
+#include "extdrv/sdmmc.h"
+
+
+#define SDLOG_MAGIC  0x474C4453  /* "SDLG" */
+#define SDLOG_BLOCK_SIZE  MMC_MAX_SECTOR_SIZE
+
+struct sdlog_block_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t tail_seq;    /* Oldest block not replayed when this block was written */
+	uint16_t len;         /* Number of records bytes in this block */
+	uint16_t nb_records;
+};
+
+/* Records bytes in a block : the block ends with the CRC32 of the header and records */
+#define SDLOG_PAYLOAD_SIZE  (SDLOG_BLOCK_SIZE - sizeof(struct sdlog_block_header) - 4)
+/* Each record is its length (1 byte), its timestamp (4 bytes) and the record data */
+#define SDLOG_RECORD_HEADER_SIZE  5
+#define SDLOG_MAX_RECORD_SIZE  255
+
+struct sdlog {
+	const struct sdmmc_card* mmc;
+	uint32_t first_block;
+	uint32_t nb_blocks;
+	uint32_t head_seq;   /* Sequence number of the next block to be written */
+	uint32_t tail_seq;   /* Sequence number of the oldest block not replayed */
+	uint16_t fill;       /* Records bytes waiting in the buffer */
+	uint16_t nb_records;
+	uint8_t* buf;        /* SDLOG_BLOCK_SIZE bytes, 32 bits aligned */
+};
+
+/* Setup the log on the "nb_blocks" blocks of the card starting at "first_block", and find
+ *   the head and replay position of an existing log.
+ * The card must have been initialised with a block size of SDLOG_BLOCK_SIZE.
+ * buf must be SDLOG_BLOCK_SIZE bytes long and 32 bits aligned.
+ * Returns 0 on success, -EINVAL on arguments error, or the card read error.
+ */
+int sdlog_init(struct sdlog* log, const struct sdmmc_card* mmc,
+				uint32_t first_block, uint32_t nb_blocks, uint8_t* buf);
+
+/* Add a record to the log. The current block is written first if the record does not fit.
+ * len must be at most SDLOG_MAX_RECORD_SIZE.
+ * Returns 0 on success, -EINVAL on arguments error, or the card write error (the record
+ *   is then not added).
+ */
+int sdlog_append(struct sdlog* log, uint32_t timestamp, const uint8_t* data, uint8_t len);
+
+/* Write the records waiting in the buffer to the card, in a new block.
+ * Returns 0 on success or the card write error, in which case the records are kept.
+ */
+int sdlog_flush(struct sdlog* log);
+
+/* Number of blocks which have not been replayed yet (excluding the records waiting in
+ *   the buffer). */
+static inline uint32_t sdlog_pending(const struct sdlog* log)
+{
+	return (log->head_seq - log->tail_seq);
+}
+
+/* Replay the oldest block not replayed yet : the callback is called for each record
+ *   of the block, in order.
+ * Returns the number of records replayed, 0 if there is nothing to replay, -EBUSY if
+ *   records are waiting in the buffer (see sdlog_flush()), -EIO if the block is invalid
+ *   (it is then skipped), or the card read error.
+ */
+int sdlog_replay(struct sdlog* log,
+				void (*callback)(uint32_t timestamp, const uint8_t* data, uint8_t len));
+
+#endif /* LIB_SDLOG_H */
@@ -31,6 +31,12 @@ int vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
 
 int snprintf(char* buf, size_t size, const char *format, ...);
 
+/* Print a fixed point value with "decimals" digits after the decimal point, avoiding the
+ * separate divisions of "%d.%d" (1234 with 1 decimal gives "123.4", -5 gives "-0.5").
+ * Returns the number of chars written, not including the terminating null byte.
+ */
+int snprintf_fixed(char* buf, size_t size, int32_t value, uint8_t decimals);
+
 
 int uprintf(int uart_num, const char *format, ...);
 
@@ -0,0 +1,126 @@
+/****************************************************************************
+ *  lib/trace.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#ifndef LIB_TRACE_H
+#define LIB_TRACE_H
+
+/***************************************************************************** */
+/* Events trace                                                                */
+/***************************************************************************** */
+
+/* In RAM ring of timestamped event records, used to check the timings between interrupt
+ *   handlers and tasks.
+ * Each record holds the clock cycles count (see systick_get_clock_cycles()), an event
+ *   id, a record type (enter, exit or single event) and a 16 bits argument. When the ring
+ *   is full the oldest records are overwritten.
+ * The interrupt handlers of the drivers record their entry and exit, and some drivers
+ *   record events (radio commands, I2C transfers start). Applications may use their own
+ *   ids from TRACE_ID_APP.
+ *
+ * Tracing is disabled by default and the macros then expand to nothing. Build with
+ *   "-DTRACE_ENABLE=1" (add it to CFLAGS) to enable it.
+ * The system tick timer must be running for the timestamps to be meaningful.
+ *
+ * The trace is sent on an UART as binary data using trace_drain() and converted on the
+ *   host to the Chrome "trace_event" JSON format by scripts/trace2chrome.py. The ids below
+ *   must be kept in sync with this script.
+ */
+
+#include "lib/stdint.h"
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+
+/* Number of records, must be a power of two. Each record uses 8 bytes of RAM. */
+#ifndef TRACE_NB_RECORDS
+#define TRACE_NB_RECORDS 32
+#endif
+
+/* Record types */
+#define TRACE_ENTER  0
+#define TRACE_EXIT   1
+#define TRACE_EVENT  2
+
+/* Events ids */
+enum trace_ids {
+	TRACE_ID_SYSTICK = 0,
+	TRACE_ID_PIO_0,
+	TRACE_ID_PIO_1,
+	TRACE_ID_PIO_2,
+	TRACE_ID_I2C_0,
+	TRACE_ID_UART_0,
+	TRACE_ID_UART_1,
+	TRACE_ID_TIMER_0,
+	TRACE_ID_TIMER_1,
+	TRACE_ID_TIMER_2,
+	TRACE_ID_TIMER_3,
+	TRACE_ID_SSP_0,
+	TRACE_ID_ADC,
+	/* Events */
+	TRACE_ID_RADIO_CMD = 16,  /* Argument is the command strobe */
+	TRACE_ID_I2C_XFER,        /* Argument is the slave address (low byte) and length */
+	TRACE_ID_RF_TX,           /* Argument is application defined (packet id) */
+	TRACE_ID_RF_RX,           /* Argument is application defined (packet id) */
+	/* First id free for applications */
+	TRACE_ID_APP = 32,
+};
+
+struct trace_record {
+	uint32_t cycles;
+	uint16_t arg;
+	uint8_t id;
+	uint8_t type;
+};
+
+
+#if (TRACE_ENABLE == 1)
+
+#define TRACE_ENTER_ISR(id)      trace_record((id), TRACE_ENTER, 0)
+#define TRACE_EXIT_ISR(id)       trace_record((id), TRACE_EXIT, 0)
+#define TRACE_EVT(id, arg)       trace_record((id), TRACE_EVENT, (arg))
+
+#else
+
+#define TRACE_ENTER_ISR(id)      do {} while (0)
+#define TRACE_EXIT_ISR(id)       do {} while (0)
+#define TRACE_EVT(id, arg)       do {} while (0)
+
+#endif
+
+
+/* Add a record to the trace. Use the TRACE_* macros instead.
+ * May be called from any context, including with interrupts disabled.
+ */
+void trace_record(uint8_t id, uint8_t type, uint16_t arg);
+
+/* Send the trace content on the given UART, oldest record first, and empty the trace.
+ * The binary format is :
+ *  - "TRC" and the format version (1),
+ *  - the clock cycles frequency (32 bits, see systick_get_clock_cycles_rate()),
+ *  - the number of records which follow and the number of records lost since last
+ *    drain (16 bits each),
+ *  - the records (8 bytes each, see struct trace_record).
+ * All values are little endian.
+ * Tracing is suspended while sending, events occuring meanwhile are counted as lost.
+ * Returns the number of records sent or a negative value on error (-ENODEV if tracing
+ *   is not enabled).
+ */
+int trace_drain(int uart_num);
+
+#endif /* LIB_TRACE_H */
@@ -65,6 +65,25 @@ static inline uint32_t ntohs(uint32_t val) __attribute__ ((alias ("byte_swap_16"
 static inline uint32_t htons(uint32_t val) __attribute__ ((alias ("byte_swap_16")));
 
 
+/* Division by 10
+ * The Cortex-M0 has no divider, and the multiplication only provides the low 32 bits of
+ * the result, so the usual multiplication by the reciprocal is done with shifts and adds
+ * (from "Hacker's Delight"). This is exact for all 32 bits values and much quicker than
+ * the division routines.
+ */
+static inline uint32_t udiv10(uint32_t n)
+{
+	uint32_t q = (n >> 1) + (n >> 2);
+	uint32_t r = 0;
+	q += (q >> 4);
+	q += (q >> 8);
+	q += (q >> 16);
+	q = (q >> 3);
+	r = n - (((q << 2) + q) << 1);
+	return q + (r > 9);
+}
+
+
 /* MIN and MAX */
 #define MIN(a, b)  (((a) < (b)) ? (a) : (b))
 #define MAX(a, b)  (((a) > (b)) ? (a) : (b))
@@ -0,0 +1,80 @@
+/****************************************************************************
+ *  lib/alarm.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/alarm.h"
+
+
+/***************************************************************************** */
+/* Sensor values alarms                                                        */
+/***************************************************************************** */
+
+void alarm_reset(struct alarm_channel* al)
+{
+	al->active = 0;
+	al->nb_hist = 0;
+	al->hist_pos = 0;
+	al->hist_time = 0;
+}
+
+uint8_t alarm_check(struct alarm_channel* al, int32_t value, uint32_t now)
+{
+	uint8_t cond = 0, raised = 0;
+
+	/* Thresholds, with hysteresis on the way back */
+	if (al->enabled & ALARM_HIGH) {
+		if ((value > al->high) ||
+				((al->active & ALARM_HIGH) && (value >= (al->high - (int32_t)al->hysteresis)))) {
+			cond |= ALARM_HIGH;
+		}
+	}
+	if (al->enabled & ALARM_LOW) {
+		if ((value < al->low) ||
+				((al->active & ALARM_LOW) && (value <= (al->low + (int32_t)al->hysteresis)))) {
+			cond |= ALARM_LOW;
+		}
+	}
+
+	/* Rate of change, from the oldest value of the history */
+	if (al->enabled & (ALARM_RISE | ALARM_FALL)) {
+		if (al->nb_hist == ALARM_RATE_SLOTS) {
+			int32_t delta = value - al->hist[al->hist_pos];
+			if ((al->enabled & ALARM_RISE) && (delta > (int32_t)al->rate)) {
+				cond |= ALARM_RISE;
+			}
+			if ((al->enabled & ALARM_FALL) && (-delta > (int32_t)al->rate)) {
+				cond |= ALARM_FALL;
+			}
+		}
+		if ((al->nb_hist == 0) ||
+				((now - al->hist_time) >= (al->rate_period >> ALARM_RATE_SHIFT))) {
+			al->hist[al->hist_pos++] = value;
+			if (al->hist_pos >= ALARM_RATE_SLOTS) {
+				al->hist_pos = 0;
+			}
+			if (al->nb_hist < ALARM_RATE_SLOTS) {
+				al->nb_hist++;
+			}
+			al->hist_time = now;
+		}
+	}
+
+	raised = (cond & ~al->active);
+	al->active = cond;
+	return raised;
+}
@@ -0,0 +1,141 @@
+/****************************************************************************
+ *  lib/crc.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/crc.h"
+#include "lib/crc_ccitt.h"
+#include "core/lpc_core.h"
+#include "core/crc_engine.h"
+
+
+/***************************************************************************** */
+/* Tables versions
+ * The reflected CRCs use 16 entries tables (one nibble at a time) to save flash. The CCITT
+ * one uses the 256 entries table from lib/crc_ccitt.c
+ */
+static const uint16_t crc16_nibble_table[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400,
+};
+static const uint32_t crc32_nibble_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t crc16_table(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	while (len--) {
+		crc ^= *buf++;
+		crc = (crc >> 4) ^ crc16_nibble_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc16_nibble_table[crc & 0x0F];
+	}
+	return crc;
+}
+
+static uint32_t crc32_table(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+
+/***************************************************************************** */
+/* CRC engine version
+ * The engine shifts the data most significant bit first. For the reflected CRCs the data
+ *   bits order is reversed on input and the sum bits order on output, so the seed must be
+ *   given in the engine (reversed) bit order.
+ */
+static volatile uint32_t crc_hw_lock = 0;
+
+/* Take the engine lock in a short critical section, so that interrupts stay enabled while
+ * the engine runs. Interrupts are left in the state they were in. Returns 1 if the lock
+ * was taken, 0 if the engine is in use. */
+static int crc_hw_try_lock(void)
+{
+	uint32_t primask = get_priority_mask();
+	int taken = 0;
+
+	lpc_disable_irq();
+	if (crc_hw_lock == 0) {
+		crc_hw_lock = 1;
+		taken = 1;
+	}
+	set_priority_mask(primask);
+	return taken;
+}
+
+static uint32_t bit_reverse_32(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+	return byte_swap_32(x);
+}
+
+static uint32_t crc_hw(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	switch (type) {
+		case CRC_TYPE_CCITT:
+			crc_config(LPC_CRC_POLY_CRCCITT, (crc & 0xFFFF), 0, 0);
+			break;
+		case CRC_TYPE_CRC16:
+			crc_config(LPC_CRC_POLY_CRC16, (bit_reverse_32(crc) >> 16),
+						LPC_CRC_REVERSE_DATA_BIT_ORDER, LPC_CRC_REVERSE_SUM_BIT_ORDER);
+			break;
+		case CRC_TYPE_CRC32:
+			crc_config(LPC_CRC_POLY_CRC32, bit_reverse_32(~crc), LPC_CRC_REVERSE_DATA_BIT_ORDER,
+						(LPC_CRC_REVERSE_SUM_BIT_ORDER | LPC_CRC_SUM_COMPLEMENT));
+			break;
+	}
+	crc_add_buffer(buf, len);
+	crc = crc_get_sum();
+	if (type != CRC_TYPE_CRC32) {
+		crc &= 0xFFFF;
+	}
+	return crc;
+}
+
+
+/***************************************************************************** */
+uint32_t crc_compute(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	if ((buf == NULL) || (type > CRC_TYPE_CRC32)) {
+		return crc;
+	}
+	/* Use the CRC engine if it's worth it and not in use by an interrupted context */
+	if ((len >= CRC_HW_MIN_LEN) && crc_hw_try_lock()) {
+		crc = crc_hw(type, crc, buf, len);
+		sync_lock_release(&crc_hw_lock);
+		return crc;
+	}
+	switch (type) {
+		case CRC_TYPE_CCITT:
+			return crc_ccitt((crc & 0xFFFF), (uint8_t*)buf, len);
+		case CRC_TYPE_CRC16:
+			return crc16_table((crc & 0xFFFF), buf, len);
+		case CRC_TYPE_CRC32:
+		default:
+			return crc32_table(crc, buf, len);
+	}
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *  lib/filter.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/filter.h"
+
+
+/***************************************************************************** */
+/* Sensor values conditioning                                                  */
+/***************************************************************************** */
+
+void filter_reset(struct filter_channel* ch)
+{
+	ch->nb_acc = 0;
+	ch->nb_median = 0;
+	ch->median_pos = 0;
+	ch->initialized = 0;
+	ch->acc = 0;
+	ch->ewma = 0;
+	ch->value = 0;
+	ch->reported = 0;
+	ch->silence = 0;
+}
+
+/* Median of the samples in the median buffer (insertion sort of a copy, at most
+ * FILTER_MEDIAN_MAX_LEN samples). Until the buffer is full, this is the median of the
+ * samples received so far (upper one for an even number). */
+static int32_t filter_median(struct filter_channel* ch)
+{
+	int32_t sorted[FILTER_MEDIAN_MAX_LEN];
+	int i = 0, j = 0;
+
+	for (i = 0; i < ch->nb_median; i++) {
+		int32_t val = ch->median_buf[i];
+		for (j = i; (j > 0) && (sorted[j - 1] > val); j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = val;
+	}
+	return sorted[ch->nb_median >> 1];
+}
+
+static inline uint32_t filter_distance(int32_t a, int32_t b)
+{
+	return (a > b) ? (uint32_t)(a - b) : (uint32_t)(b - a);
+}
+
+int filter_push(struct filter_channel* ch, int32_t raw)
+{
+	int32_t sample = raw;
+	int ret = FILTER_NEW_VALUE;
+
+	/* Oversampling */
+	if (ch->oversample_shift != 0) {
+		ch->acc += raw;
+		ch->nb_acc++;
+		if (ch->nb_acc < (1 << ch->oversample_shift)) {
+			return 0;
+		}
+		/* Rounded average */
+		sample = (ch->acc + (1 << (ch->oversample_shift - 1))) >> ch->oversample_shift;
+		ch->acc = 0;
+		ch->nb_acc = 0;
+	}
+
+	/* Spike filter */
+	if (ch->median_len > 1) {
+		uint8_t len = ch->median_len;
+		if (len > FILTER_MEDIAN_MAX_LEN) {
+			len = FILTER_MEDIAN_MAX_LEN;
+		}
+		ch->median_buf[ch->median_pos++] = sample;
+		if (ch->median_pos >= len) {
+			ch->median_pos = 0;
+		}
+		if (ch->nb_median < len) {
+			ch->nb_median++;
+		}
+		sample = filter_median(ch);
+	}
+
+	/* Smoothing */
+	if (ch->ewma_shift != 0) {
+		if ((ch->initialized == 0) ||
+				((ch->step != 0) && (filter_distance(sample, ch->value) > ch->step))) {
+			ch->ewma = sample << ch->ewma_shift;
+		} else {
+			ch->ewma += sample - (ch->ewma >> ch->ewma_shift);
+		}
+		sample = (ch->ewma + (1 << (ch->ewma_shift - 1))) >> ch->ewma_shift;
+	}
+	ch->value = sample;
+
+	/* Report by exception */
+	if (ch->silence < 0xFFFF) {
+		ch->silence++;
+	}
+	if ((ch->initialized == 0) || (filter_distance(sample, ch->reported) > ch->deadband) ||
+			((ch->max_silence != 0) && (ch->silence >= ch->max_silence))) {
+		ch->reported = sample;
+		ch->silence = 0;
+		ret |= FILTER_REPORT;
+	}
+	ch->initialized = 1;
+	return ret;
+}
@@ -0,0 +1,331 @@
+/****************************************************************************
+ *  lib/flashlog.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/errno.h"
+#include "lib/string.h"
+#include "lib/crc.h"
+#include "lib/flashlog.h"
+#include "core/iap.h"
+#include "core/systick.h"
+
+
+/***************************************************************************** */
+/* Records log in internal flash                                               */
+/***************************************************************************** */
+
+extern unsigned int _end_text;
+extern unsigned int _start_data;
+extern unsigned int _end_data;
+
+#define FLASHLOG_UNITS_PER_SECTOR  (LPC12XX_SECTOR_SIZE / FLASHLOG_UNIT_SIZE)
+#define FLASHLOG_CRC_OFFSET  (FLASHLOG_UNIT_SIZE - 4)
+#define FLASHLOG_RECORDS(hdr)  ((uint8_t*)(hdr) + sizeof(struct flashlog_unit_header))
+/* Flash sectors above this address are 32kB sectors */
+#define FLASHLOG_SMALL_SECTORS_END  0x10000
+/* The flash is read directly. The host check (scripts/flashlog_check.c) defines this to
+ * map the flash addresses to its simulated flash. */
+#ifndef FLASHLOG_FLASH_PTR
+#define FLASHLOG_FLASH_PTR(addr)  ((void*)(addr))
+#endif
+
+static inline uint32_t flashlog_unit_addr(struct flashlog* log, uint32_t pos)
+{
+	return (log->start + (pos * FLASHLOG_UNIT_SIZE));
+}
+
+/* Returns the unit header if the unit at "addr" is valid, NULL otherwise. */
+static struct flashlog_unit_header* flashlog_check_unit(uint32_t addr)
+{
+	struct flashlog_unit_header* hdr = FLASHLOG_FLASH_PTR(addr);
+	uint32_t crc = 0;
+
+	if ((hdr->magic != FLASHLOG_MAGIC) || (hdr->len > FLASHLOG_PAYLOAD_SIZE)) {
+		return NULL;
+	}
+	crc = crc_compute(CRC_TYPE_CRC32, 0, (uint8_t*)hdr, FLASHLOG_CRC_OFFSET);
+	if (crc != *(uint32_t*)FLASHLOG_FLASH_PTR(addr + FLASHLOG_CRC_OFFSET)) {
+		return NULL;
+	}
+	return hdr;
+}
+
+static int flashlog_unit_is_blank(uint32_t addr)
+{
+	uint32_t* word = FLASHLOG_FLASH_PTR(addr);
+	int i = 0;
+
+	for (i = 0; i < (FLASHLOG_UNIT_SIZE / 4); i++) {
+		if (word[i] != 0xFFFFFFFF) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Find the valid unit with the lowest sequence number starting from "seq" (and before the
+ * head). Returns its address, or 0 if there is none. */
+static uint32_t flashlog_find_unit(struct flashlog* log, uint32_t seq, uint32_t* found_seq)
+{
+	struct flashlog_unit_header* hdr = NULL;
+	uint32_t pos = 0, addr = 0, best = 0;
+
+	for (pos = 0; pos < log->nb_units; pos++) {
+		hdr = flashlog_check_unit(flashlog_unit_addr(log, pos));
+		if (hdr == NULL) {
+			continue;
+		}
+		/* Sequence numbers may wrap, compare the distances from seq */
+		if ((hdr->seq - seq) >= (log->head_seq - seq)) {
+			continue;
+		}
+		if ((addr == 0) || ((hdr->seq - seq) < (best - seq))) {
+			addr = flashlog_unit_addr(log, pos);
+			best = hdr->seq;
+		}
+	}
+	*found_seq = best;
+	return addr;
+}
+
+
+/***************************************************************************** */
+int flashlog_init(struct flashlog* log, uint32_t start, uint8_t nb_sectors, uint32_t min_interval)
+{
+	struct flashlog_unit_header* hdr = NULL;
+	struct flashlog_unit_header* last = NULL;
+	uint32_t image_end = 0, pos = 0, last_pos = 0;
+
+	if ((log == NULL) || (nb_sectors < 2) || (start & (LPC12XX_SECTOR_SIZE - 1))) {
+		return -EINVAL;
+	}
+	if ((start + (nb_sectors * LPC12XX_SECTOR_SIZE)) > FLASHLOG_SMALL_SECTORS_END) {
+		return -EINVAL;
+	}
+	image_end = (uint32_t)(uintptr_t)&_end_text +
+			((uint32_t)(uintptr_t)&_end_data - (uint32_t)(uintptr_t)&_start_data);
+	if (start < image_end) {
+		return -ENOSPC;
+	}
+	log->start = start;
+	log->nb_units = nb_sectors * FLASHLOG_UNITS_PER_SECTOR;
+	log->head_pos = 0;
+	log->head_seq = 0;
+	log->tail_seq = 0;
+	log->tail_addr = 0;
+	log->tail_offset = 0;
+	log->fill = 0;
+	log->nb_records = 0;
+	log->written = 0;
+	log->lost = 0;
+	log->min_interval = min_interval;
+	log->last_write = 0;
+
+	/* The last unit written is the valid one with the highest sequence number */
+	for (pos = 0; pos < log->nb_units; pos++) {
+		hdr = flashlog_check_unit(flashlog_unit_addr(log, pos));
+		if (hdr == NULL) {
+			continue;
+		}
+		if ((last == NULL) || ((int32_t)(hdr->seq - last->seq) > 0)) {
+			last = hdr;
+			last_pos = pos;
+		}
+	}
+	if (last != NULL) {
+		log->head_pos = last_pos + 1;
+		if (log->head_pos >= log->nb_units) {
+			log->head_pos = 0;
+		}
+		log->head_seq = last->seq + 1;
+		log->tail_seq = last->tail_seq;
+	}
+	return 0;
+}
+
+
+/***************************************************************************** */
+/* Write the RAM buffer to the next writable unit, erasing the sector first when the head
+ * gets to a new sector. Units which are not blank (interrupted write or erase) are skipped.
+ */
+static int flashlog_write_unit(struct flashlog* log)
+{
+	struct flashlog_unit_header* hdr = (struct flashlog_unit_header*)log->buf;
+	uint32_t pos = log->head_pos, addr = 0;
+	int tries = 0, ret = 0;
+
+	hdr->seq = log->head_seq;
+	hdr->tail_seq = log->tail_seq;
+	hdr->len = log->fill;
+	hdr->nb_records = log->nb_records;
+	hdr->magic = FLASHLOG_MAGIC;
+	memset((FLASHLOG_RECORDS(hdr) + log->fill), 0xFF, (FLASHLOG_PAYLOAD_SIZE - log->fill));
+	log->buf[FLASHLOG_CRC_OFFSET / 4] = crc_compute(CRC_TYPE_CRC32, 0, (uint8_t*)log->buf, FLASHLOG_CRC_OFFSET);
+
+	for (tries = 0; tries < log->nb_units; tries++) {
+		addr = flashlog_unit_addr(log, pos);
+		if ((pos & (FLASHLOG_UNITS_PER_SECTOR - 1)) == 0) {
+			/* The oldest units get erased, look for the drain unit again if it was there.
+			 *   The erase may fail and leave it, keep the offset for this case. */
+			if ((log->tail_addr >= addr) && (log->tail_addr < (addr + LPC12XX_SECTOR_SIZE))) {
+				log->tail_addr = 0;
+			}
+			ret = flash_erase_sector(addr);
+			if (ret != 0) {
+				/* Going on would erase the next sector, which holds the last units
+				 *   written : give up, the erase is tried again on the next write. */
+				break;
+			}
+		} else {
+			ret = (flashlog_unit_is_blank(addr) ? 0 : -1);
+		}
+		if (ret == 0) {
+			ret = flash_program_page(addr, FLASHLOG_UNIT_SIZE, (unsigned char*)log->buf);
+			if ((ret == 0) && (flashlog_check_unit(addr) != NULL)) {
+				break;
+			}
+		}
+		pos++;
+		if (pos >= log->nb_units) {
+			pos = 0;
+		}
+	}
+	log->written = 1;
+	log->last_write = systick_get_tick_count();
+	if ((ret != 0) || (tries == log->nb_units)) {
+		return -EIO;
+	}
+
+	log->head_pos = pos + 1;
+	if (log->head_pos >= log->nb_units) {
+		log->head_pos = 0;
+	}
+	log->head_seq++;
+	log->fill = 0;
+	log->nb_records = 0;
+	return 0;
+}
+
+int flashlog_flush(struct flashlog* log)
+{
+	if (log->fill == 0) {
+		return 0;
+	}
+	if (log->written && ((systick_get_tick_count() - log->last_write) < log->min_interval)) {
+		return -EAGAIN;
+	}
+	return flashlog_write_unit(log);
+}
+
+int flashlog_append(struct flashlog* log, uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	uint8_t* rec = NULL;
+	uint32_t size = FLASHLOG_RECORD_HEADER_SIZE + len;
+	int ret = 0;
+
+	if (((data == NULL) && (len != 0)) || (len > FLASHLOG_MAX_RECORD_SIZE)) {
+		return -EINVAL;
+	}
+	if ((log->fill + size) > FLASHLOG_PAYLOAD_SIZE) {
+		ret = flashlog_flush(log);
+		if (ret != 0) {
+			log->lost++;
+			return ret;
+		}
+	}
+	rec = FLASHLOG_RECORDS(log->buf) + log->fill;
+	rec[0] = len;
+	rec[1] = (timestamp & 0xFF);
+	rec[2] = ((timestamp >> 8) & 0xFF);
+	rec[3] = ((timestamp >> 16) & 0xFF);
+	rec[4] = ((timestamp >> 24) & 0xFF);
+	memcpy((rec + FLASHLOG_RECORD_HEADER_SIZE), data, len);
+	log->fill += size;
+	log->nb_records++;
+	return 0;
+}
+
+
+/***************************************************************************** */
+static inline uint32_t flashlog_rec_timestamp(const uint8_t* rec)
+{
+	return (rec[1] | (rec[2] << 8) | (rec[3] << 16) | (rec[4] << 24));
+}
+
+int flashlog_drain(struct flashlog* log, unsigned int max,
+				int (*callback)(uint32_t timestamp, const uint8_t* data, uint8_t len))
+{
+	struct flashlog_unit_header* hdr = NULL;
+	uint8_t* rec = NULL;
+	unsigned int nb = 0;
+	uint32_t size = 0, seq = 0;
+
+	while (nb < max) {
+		if (log->tail_seq != log->head_seq) {
+			/* Records from flash */
+			if (log->tail_addr == 0) {
+				log->tail_addr = flashlog_find_unit(log, log->tail_seq, &seq);
+				if (log->tail_addr == 0) {
+					/* Nothing left in flash (erased or invalid units) */
+					log->tail_seq = log->head_seq;
+					log->tail_offset = 0;
+					continue;
+				}
+				if (seq != log->tail_seq) {
+					log->tail_offset = 0;
+				}
+				log->tail_seq = seq;
+			}
+			hdr = FLASHLOG_FLASH_PTR(log->tail_addr);
+			if ((log->tail_offset + FLASHLOG_RECORD_HEADER_SIZE) > hdr->len) {
+				/* End of this unit */
+				log->tail_seq++;
+				log->tail_addr = 0;
+				log->tail_offset = 0;
+				continue;
+			}
+			rec = FLASHLOG_RECORDS(hdr) + log->tail_offset;
+			size = FLASHLOG_RECORD_HEADER_SIZE + rec[0];
+			if ((callback != NULL) &&
+					(callback(flashlog_rec_timestamp(rec), (rec + FLASHLOG_RECORD_HEADER_SIZE), rec[0]) < 0)) {
+				break;
+			}
+			log->tail_offset += size;
+		} else if (log->fill != 0) {
+			/* Records from the RAM buffer, removed once handled */
+			uint8_t* dst = FLASHLOG_RECORDS(log->buf);
+			uint32_t i = 0;
+			rec = dst;
+			size = FLASHLOG_RECORD_HEADER_SIZE + rec[0];
+			if ((callback != NULL) &&
+					(callback(flashlog_rec_timestamp(rec), (rec + FLASHLOG_RECORD_HEADER_SIZE), rec[0]) < 0)) {
+				break;
+			}
+			log->fill -= size;
+			log->nb_records--;
+			for (i = 0; i < log->fill; i++) {
+				dst[i] = dst[i + size];
+			}
+		} else {
+			break;
+		}
+		nb++;
+	}
+	return nb;
+}
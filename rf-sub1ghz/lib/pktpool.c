@@ -0,0 +1,78 @@
+/****************************************************************************
+ *  lib/pktpool.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/utils.h"
+#include "lib/pktpool.h"
+#include "core/lpc_core.h"
+
+
+/***************************************************************************** */
+/* Packet buffers pool                                                         */
+/***************************************************************************** */
+
+/* The free mask, counters and reference counts are only modified with interrupts
+ * disabled, as there is no atomic read-modify-write instruction on the Cortex-M0. */
+
+struct pktbuf* pktpool_alloc(struct pktpool* pool)
+{
+	struct pktbuf* pkt = NULL;
+	uint8_t idx = 0;
+
+	lpc_disable_irq();
+	if (pool->free_mask == 0) {
+		pool->alloc_failures++;
+		lpc_enable_irq();
+		return NULL;
+	}
+	idx = ctz(pool->free_mask);
+	pool->free_mask &= ~(0x01UL << idx);
+	pool->in_use++;
+	if (pool->in_use > pool->high_water) {
+		pool->high_water = pool->in_use;
+	}
+	lpc_enable_irq();
+
+	pkt = pktpool_buf(pool, idx);
+	pkt->refcount = 1;
+	pkt->idx = idx;
+	pkt->len = 0;
+	pkt->flags = 0;
+	return pkt;
+}
+
+void pktpool_get(struct pktbuf* pkt)
+{
+	lpc_disable_irq();
+	pkt->refcount++;
+	lpc_enable_irq();
+}
+
+void pktpool_put(struct pktpool* pool, struct pktbuf* pkt)
+{
+	lpc_disable_irq();
+	if (pkt->refcount != 0) {
+		pkt->refcount--;
+		if (pkt->refcount == 0) {
+			pool->free_mask |= (0x01UL << pkt->idx);
+			pool->in_use--;
+		}
+	}
+	lpc_enable_irq();
+}
@@ -0,0 +1,140 @@
+/****************************************************************************
+ *  lib/prof.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/stdio.h"
+#include "lib/prof.h"
+#include "core/lpc_core.h"
+#include "core/systick.h"
+
+
+/***************************************************************************** */
+/* Profiling                                                                   */
+/***************************************************************************** */
+
+static struct prof_scope* prof_scopes = NULL;
+/* Start of the statistics period, to get the share of time spent in each scope */
+static uint64_t prof_period_start = 0;
+
+uint32_t prof_enter(struct prof_scope* scope)
+{
+	if (scope->registered == 0) {
+		lpc_disable_irq();
+		if (scope->registered == 0) {
+			scope->next = prof_scopes;
+			prof_scopes = scope;
+			scope->registered = 1;
+		}
+		lpc_enable_irq();
+	}
+	return systick_get_clock_cycles();
+}
+
+/* The statistics are updated with interrupts disabled, as profiled functions may be
+ * called from interrupt handlers. */
+void prof_exit(struct prof_scope* scope, uint32_t start)
+{
+	uint32_t cycles = systick_get_clock_cycles() - start;
+
+	lpc_disable_irq();
+	scope->count++;
+	scope->total += cycles;
+	if (cycles < scope->min) {
+		scope->min = cycles;
+	}
+	if (cycles > scope->max) {
+		scope->max = cycles;
+	}
+	lpc_enable_irq();
+}
+
+/* 64 bits by 32 bits division, with a 32 bits result. The ROM division helpers only
+ * handle 32 bits values, and there is no libgcc for the 64 bits shifts and multiplication
+ * helpers, so the 64 bits value is handled as two 32 bits words.
+ * Only used for the dump, speed does not matter. */
+static uint32_t prof_div64(uint64_t num, uint32_t den)
+{
+	uint32_t hi = (uint32_t)(num >> 32), lo = (uint32_t)num;
+	uint32_t quot = 0, rem = 0, carry = 0;
+	int i = 0;
+
+	if (den == 0) {
+		return 0;
+	}
+	for (i = 0; i < 64; i++) {
+		carry = (rem >> 31);
+		rem = (rem << 1) | (hi >> 31);
+		hi = (hi << 1) | (lo >> 31);
+		lo = (lo << 1);
+		quot = (quot << 1);
+		if (carry || (rem >= den)) {
+			rem -= den;
+			quot |= 0x01;
+		}
+	}
+	return quot;
+}
+
+void prof_dump(int uart_num)
+{
+	struct prof_scope* scope = prof_scopes;
+	uint64_t period = systick_get_clock_cycles_64() - prof_period_start;
+	/* Share of the period in 0.1%, valid for periods up to 2^32 thousand cycles (about
+	 * 49 hours at 48MHz, the cycles counter runs at half the main clock) */
+	uint32_t share_div = prof_div64(period, 1000);
+
+	/* Lines are kept short enough for the UART output buffer */
+	uprintf(uart_num, "Prof: %u Kcycles at %u kHz\n\r", prof_div64(period, 1024),
+				(systick_get_clock_cycles_rate() / 1000));
+	uprintf(uart_num, "name: count min/avg/max share(0.1%%)\n\r");
+	while (scope != NULL) {
+		struct prof_scope snap;
+		uint32_t avg = 0, share = 0;
+
+		/* Take a consistent copy, the scope may be updated while we print */
+		lpc_disable_irq();
+		snap = *scope;
+		lpc_enable_irq();
+		if (snap.count != 0) {
+			avg = prof_div64(snap.total, snap.count);
+			share = prof_div64(snap.total, share_div);
+		} else {
+			snap.min = 0;
+		}
+		uprintf(uart_num, "%s: %u %u/%u/%u %u\n\r", snap.name, snap.count,
+					snap.min, avg, snap.max, share);
+		scope = snap.next;
+	}
+}
+
+void prof_reset(void)
+{
+	struct prof_scope* scope = prof_scopes;
+
+	lpc_disable_irq();
+	while (scope != NULL) {
+		scope->count = 0;
+		scope->min = 0xFFFFFFFF;
+		scope->max = 0;
+		scope->total = 0;
+		scope = scope->next;
+	}
+	lpc_enable_irq();
+	prof_period_start = systick_get_clock_cycles_64();
+}
@@ -442,6 +442,35 @@ static int dtplug_protocol_common_handles(struct dtplug_protocol_handle* handle,
 			/* Software reset of the board. No way out. */
 			NVIC_SystemReset();
 			break;
+		case PKT_TYPE_GET_BOARD_INFO:
+			/* Version and serial number (32 bits each), then .data and .bss sizes, stack
+			 * size and minimum free stack since reset (16 bits each), all big endian,
+			 * followed by the board name. */
+			{
+				struct user_info* info = get_user_info();
+				struct memory_usage mem;
+				uint16_t mem_buff[4];
+				uint8_t info_buff[PACKET_DATA_SIZE] __attribute__ ((__aligned__(4)));
+				uint32_t* info_buff_32 = (uint32_t*)info_buff;
+				uint8_t size = 16;
+
+				get_memory_usage(&mem);
+				info_buff_32[0] = byte_swap_32(info->version);
+				info_buff_32[1] = byte_swap_32(info->serial_number);
+				mem_buff[0] = byte_swap_16(mem.data_size);
+				mem_buff[1] = byte_swap_16(mem.bss_size);
+				mem_buff[2] = byte_swap_16(mem.stack_size);
+				mem_buff[3] = byte_swap_16(mem.stack_min_free);
+				memcpy(&(info_buff[8]), mem_buff, 8);
+				while ((size < PACKET_DATA_SIZE) && ((size - 16) < sizeof(info->name)) && (info->name[size - 16] != '\0')) {
+					info_buff[size] = info->name[size - 16];
+					size++;
+				}
+				question->info.seq_num |= PACKET_NEEDS_REPLY; /* Make sure the reply will be sent */
+				dtplug_protocol_send_reply(handle, question, NO_ERROR, size, info_buff);
+			}
+			dtplug_protocol_release_old_packet(handle);
+			break;
 		case PKT_TYPE_GET_NUM_PACKETS:
 			question->info.seq_num |= PACKET_NEEDS_REPLY; /* Make sure the reply will be sent */
 			tmp_val_swap = byte_swap_32(handle->packet_count);
@@ -0,0 +1,166 @@
+/****************************************************************************
+ *  lib/ringbuf.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/errno.h"
+#include "lib/string.h"
+#include "lib/ringbuf.h"
+
+
+/***************************************************************************** */
+/* Ring buffers                                                                */
+/***************************************************************************** */
+
+int ringbuf_init(struct ringbuf* rb, uint8_t* data, uint32_t size)
+{
+	if ((size == 0) || ((size & (size - 1)) != 0)) {
+		return -EINVAL;
+	}
+	rb->data = data;
+	rb->mask = size - 1;
+	rb->head = 0;
+	rb->tail = 0;
+	rb->dropped = 0;
+	return 0;
+}
+
+/* Copy len bytes to the buffer at head, in at most two parts. Does not move head. */
+static void ringbuf_copy_in(struct ringbuf* rb, uint32_t head, const uint8_t* src, uint32_t len)
+{
+	uint32_t idx = head & rb->mask;
+	uint32_t first = rb->mask + 1 - idx;
+
+	if (first > len) {
+		first = len;
+	}
+	memcpy(rb->data + idx, src, first);
+	if (len > first) {
+		memcpy(rb->data, src + first, (len - first));
+	}
+}
+
+uint32_t ringbuf_write(struct ringbuf* rb, const void* buf, uint32_t len)
+{
+	uint32_t head = rb->head;
+	uint32_t space = rb->mask + 1 - (head - rb->tail);
+
+	if (len > space) {
+		rb->dropped += (len - space);
+		len = space;
+	}
+	if (len == 0) {
+		return 0;
+	}
+	ringbuf_copy_in(rb, head, buf, len);
+	dmb();
+	rb->head = head + len;
+	return len;
+}
+
+/* The space check, copy and head update are done with interrupts disabled, so that no
+ * other producer can run in between. The previous interrupt state is restored, so this
+ * can be used from within a critical section. */
+int ringbuf_mp_write(struct ringbuf* rb, const void* buf, uint32_t len)
+{
+	uint32_t primask = get_priority_mask();
+	uint32_t head = 0;
+	int ret = 0;
+
+	lpc_disable_irq();
+	head = rb->head;
+	if (len > (rb->mask + 1 - (head - rb->tail))) {
+		rb->dropped += len;
+		ret = -ENOBUFS;
+	} else {
+		ringbuf_copy_in(rb, head, buf, len);
+		dmb();
+		rb->head = head + len;
+	}
+	set_priority_mask(primask);
+	return ret;
+}
+
+uint32_t ringbuf_read(struct ringbuf* rb, void* buf, uint32_t len)
+{
+	uint32_t tail = rb->tail;
+	uint32_t count = rb->head - tail;
+	uint32_t idx = tail & rb->mask;
+	uint32_t first = rb->mask + 1 - idx;
+	uint8_t* dst = buf;
+
+	if (len > count) {
+		len = count;
+	}
+	if (len == 0) {
+		return 0;
+	}
+	if (first > len) {
+		first = len;
+	}
+	memcpy(dst, rb->data + idx, first);
+	if (len > first) {
+		memcpy(dst + first, rb->data, (len - first));
+	}
+	dmb();
+	rb->tail = tail + len;
+	return len;
+}
+
+
+/***************************************************************************** */
+/* Zero copy access */
+
+uint32_t ringbuf_write_reserve(struct ringbuf* rb, uint8_t** ptr)
+{
+	uint32_t head = rb->head;
+	uint32_t space = rb->mask + 1 - (head - rb->tail);
+	uint32_t idx = head & rb->mask;
+	uint32_t contiguous = rb->mask + 1 - idx;
+
+	*ptr = rb->data + idx;
+	if (contiguous > space) {
+		contiguous = space;
+	}
+	return contiguous;
+}
+
+void ringbuf_write_commit(struct ringbuf* rb, uint32_t len)
+{
+	dmb();
+	rb->head += len;
+}
+
+uint32_t ringbuf_read_peek(struct ringbuf* rb, const uint8_t** ptr)
+{
+	uint32_t tail = rb->tail;
+	uint32_t count = rb->head - tail;
+	uint32_t idx = tail & rb->mask;
+	uint32_t contiguous = rb->mask + 1 - idx;
+
+	*ptr = rb->data + idx;
+	if (contiguous > count) {
+		contiguous = count;
+	}
+	return contiguous;
+}
+
+void ringbuf_read_release(struct ringbuf* rb, uint32_t len)
+{
+	dmb();
+	rb->tail += len;
+}
@@ -0,0 +1,248 @@
+/****************************************************************************
+ *  lib/sdlog.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/stddef.h"
+#include "lib/errno.h"
+#include "lib/string.h"
+#include "lib/crc.h"
+#include "lib/sdlog.h"
+#include "extdrv/sdmmc.h"
+
+
+/***************************************************************************** */
+/* Append-only records log on SD card                                          */
+/***************************************************************************** */
+
+#define SDLOG_CRC_OFFSET  (SDLOG_BLOCK_SIZE - 4)
+#define SDLOG_RECORDS(log)  ((log)->buf + sizeof(struct sdlog_block_header))
+
+/* Read the block used for sequence number "seq" and check it.
+ * Returns 0 if the block is valid and holds this sequence number, 1 if it is not valid or
+ *   holds another sequence number, or the card read error.
+ */
+static int sdlog_read_check(struct sdlog* log, uint32_t seq)
+{
+	struct sdlog_block_header* hdr = (struct sdlog_block_header*)log->buf;
+	uint32_t crc = 0;
+	int ret = 0;
+
+	ret = sdmmc_read_block(log->mmc, (log->first_block + (seq % log->nb_blocks)), log->buf);
+	if (ret != 0) {
+		return ret;
+	}
+	if ((hdr->magic != SDLOG_MAGIC) || (hdr->len > SDLOG_PAYLOAD_SIZE)) {
+		return 1;
+	}
+	crc = crc_compute(CRC_TYPE_CRC32, 0, log->buf, SDLOG_CRC_OFFSET);
+	if (crc != *(uint32_t*)(log->buf + SDLOG_CRC_OFFSET)) {
+		return 1;
+	}
+	return (hdr->seq == seq) ? 0 : 1;
+}
+
+/* Setup the log and find its head.
+ * Block 0 holds a multiple of nb_blocks as sequence number "seq0" when the log is not
+ *   empty, and the blocks written after it hold (seq0 + 1), (seq0 + 2), ... up to the head.
+ *   The following ones are from the previous ring turn, never written, or corrupted
+ *   (interrupted write), so the head is the first block which does not hold
+ *   (seq0 + block index).
+ * If block 0 is not valid, either the log is empty or the write of block 0 has been
+ *   interrupted, in which case the last block is the last one written.
+ */
+int sdlog_init(struct sdlog* log, const struct sdmmc_card* mmc,
+				uint32_t first_block, uint32_t nb_blocks, uint8_t* buf)
+{
+	struct sdlog_block_header* hdr = NULL;
+	uint32_t seq0 = 0, low = 1, high = nb_blocks;
+	int ret = 0;
+
+	if ((log == NULL) || (mmc == NULL) || (buf == NULL) || (nb_blocks < 2)) {
+		return -EINVAL;
+	}
+	if (((uintptr_t)buf & 0x03) || (mmc->block_size != SDLOG_BLOCK_SIZE)) {
+		return -EINVAL;
+	}
+	log->mmc = mmc;
+	log->first_block = first_block;
+	log->nb_blocks = nb_blocks;
+	log->head_seq = 0;
+	log->tail_seq = 0;
+	log->fill = 0;
+	log->nb_records = 0;
+	log->buf = buf;
+	hdr = (struct sdlog_block_header*)buf;
+
+	/* Get the sequence number in block 0. Read the sequence number from the block itself
+	 * as we do not know it yet. */
+	ret = sdmmc_read_block(mmc, first_block, buf);
+	if (ret != 0) {
+		return ret;
+	}
+	seq0 = hdr->seq;
+	ret = 1;
+	if ((seq0 % nb_blocks) == 0) {
+		ret = sdlog_read_check(log, seq0);
+	}
+	if (ret == 0) {
+		/* Binary search of the head */
+		while (low < high) {
+			uint32_t mid = low + ((high - low) >> 1);
+			ret = sdlog_read_check(log, (seq0 + mid));
+			if (ret < 0) {
+				return ret;
+			}
+			if (ret == 0) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		log->head_seq = seq0 + low;
+	} else if (ret >= 0) {
+		/* Block 0 not valid : check the last block */
+		ret = sdmmc_read_block(mmc, (first_block + nb_blocks - 1), buf);
+		if (ret != 0) {
+			return ret;
+		}
+		if ((((hdr->seq + 1) % nb_blocks) != 0) || (sdlog_read_check(log, hdr->seq) != 0)) {
+			/* Empty log */
+			return 0;
+		}
+		log->head_seq = hdr->seq + 1;
+	} else {
+		return ret;
+	}
+
+	/* Get the replay position from the last block written */
+	ret = sdlog_read_check(log, (log->head_seq - 1));
+	if (ret < 0) {
+		return ret;
+	}
+	if (ret == 0) {
+		log->tail_seq = hdr->tail_seq;
+	}
+	if ((log->head_seq - log->tail_seq) > nb_blocks) {
+		log->tail_seq = log->head_seq - nb_blocks;
+	}
+	return 0;
+}
+
+
+/***************************************************************************** */
+int sdlog_flush(struct sdlog* log)
+{
+	struct sdlog_block_header* hdr = (struct sdlog_block_header*)log->buf;
+	uint32_t seq = log->head_seq;
+	uint32_t tail = log->tail_seq;
+	int ret = 0;
+
+	if (log->fill == 0) {
+		return 0;
+	}
+	/* Writing this block overwrites the block (seq - nb_blocks) */
+	if (((seq + 1) - tail) > log->nb_blocks) {
+		tail = (seq + 1) - log->nb_blocks;
+	}
+	hdr->magic = SDLOG_MAGIC;
+	hdr->seq = seq;
+	hdr->tail_seq = tail;
+	hdr->len = log->fill;
+	hdr->nb_records = log->nb_records;
+	memset((SDLOG_RECORDS(log) + log->fill), 0xFF, (SDLOG_PAYLOAD_SIZE - log->fill));
+	*(uint32_t*)(log->buf + SDLOG_CRC_OFFSET) = crc_compute(CRC_TYPE_CRC32, 0, log->buf, SDLOG_CRC_OFFSET);
+
+	ret = sdmmc_write_block(log->mmc, (log->first_block + (seq % log->nb_blocks)), log->buf);
+	if (ret != 0) {
+		return ret;
+	}
+	log->head_seq = seq + 1;
+	log->tail_seq = tail;
+	log->fill = 0;
+	log->nb_records = 0;
+	return 0;
+}
+
+int sdlog_append(struct sdlog* log, uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	uint8_t* rec = NULL;
+	uint32_t size = SDLOG_RECORD_HEADER_SIZE + len;
+	int ret = 0;
+
+	if ((data == NULL) && (len != 0)) {
+		return -EINVAL;
+	}
+	if ((log->fill + size) > SDLOG_PAYLOAD_SIZE) {
+		ret = sdlog_flush(log);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	rec = SDLOG_RECORDS(log) + log->fill;
+	rec[0] = len;
+	rec[1] = (timestamp & 0xFF);
+	rec[2] = ((timestamp >> 8) & 0xFF);
+	rec[3] = ((timestamp >> 16) & 0xFF);
+	rec[4] = ((timestamp >> 24) & 0xFF);
+	memcpy((rec + SDLOG_RECORD_HEADER_SIZE), data, len);
+	log->fill += size;
+	log->nb_records++;
+	return 0;
+}
+
+
+/***************************************************************************** */
+int sdlog_replay(struct sdlog* log,
+				void (*callback)(uint32_t timestamp, const uint8_t* data, uint8_t len))
+{
+	struct sdlog_block_header* hdr = (struct sdlog_block_header*)log->buf;
+	uint8_t* rec = NULL;
+	uint32_t offset = 0;
+	int ret = 0, nb = 0;
+
+	if (log->fill != 0) {
+		return -EBUSY;
+	}
+	if (log->tail_seq == log->head_seq) {
+		return 0;
+	}
+	ret = sdlog_read_check(log, log->tail_seq);
+	if (ret < 0) {
+		return ret;
+	}
+	log->tail_seq++;
+	if (ret != 0) {
+		return -EIO;
+	}
+
+	rec = SDLOG_RECORDS(log);
+	while ((offset + SDLOG_RECORD_HEADER_SIZE) <= hdr->len) {
+		uint8_t len = rec[offset];
+		uint32_t timestamp = rec[offset + 1] | (rec[offset + 2] << 8) |
+							(rec[offset + 3] << 16) | (rec[offset + 4] << 24);
+		if ((offset + SDLOG_RECORD_HEADER_SIZE + len) > hdr->len) {
+			break;
+		}
+		if (callback != NULL) {
+			callback(timestamp, (rec + offset + SDLOG_RECORD_HEADER_SIZE), len);
+		}
+		offset += SDLOG_RECORD_HEADER_SIZE + len;
+		nb++;
+	}
+	return nb;
+}
@@ -18,6 +18,20 @@
 #include "lib/stddef.h"
 #include "lib/stdint.h"
 
+/* memcpy and memset for the Cortex-M0 :
+ *  - Short areas are handled one byte at a time, the setup would cost more than it saves.
+ *  - The destination is aligned first, using byte accesses.
+ *  - The aligned core moves 16 bytes per loop with a single LDM / STM pair (the M0
+ *    needs one cycle per word plus one for these, against two cycles per LDR or STR).
+ *  - When source and destination are mutually misaligned, aligned words are read from
+ *    the source and merged two by two with shifts to build the destination words.
+ *    Whole words are read, so this may read up to three bytes before the start and up
+ *    to three bytes past the end of the source area, but always within an aligned word
+ *    holding source bytes : it never touches another word, so it cannot fault.
+ *  - The LDM / STM blocks have a C equivalent for host builds (scripts/string_check.c).
+ */
+#define MEM_SMALL_SIZE  8
+
 /**
  * memcpy - Copy one area of memory to another
  * @dest: Where to copy to
@@ -26,22 +40,63 @@
  */
 void* memcpy(void* dest, const void* src, size_t count)
 {
-	unsigned long* dl = (unsigned long*)dest, *sl = (unsigned long*)src;
-	char *d8, *s8;
+	uint8_t* d8 = (uint8_t*)dest;
+	const uint8_t* s8 = (const uint8_t*)src;
 
 	if (src == dest)
 		return dest;
 
-	/* while all data is aligned (common case), copy a word at a time */
-	if ( (((uint32_t)dest | (uint32_t)src) & (sizeof(*dl) - 1)) == 0) {
-		while (count >= sizeof(*dl)) {
-			*dl++ = *sl++;
-			count -= sizeof(*dl);
+	if (count >= MEM_SMALL_SIZE) {
+		uint32_t* dl = NULL;
+		const uint32_t* sl = NULL;
+		uint32_t shift = 0;
+
+		/* Align destination */
+		while ((uintptr_t)d8 & 0x03) {
+			*d8++ = *s8++;
+			count--;
+		}
+		dl = (uint32_t*)d8;
+		shift = ((uintptr_t)s8 & 0x03) * 8;
+		if (shift == 0) {
+			/* Both aligned (common case) */
+			sl = (const uint32_t*)s8;
+			while (count >= 16) {
+#ifdef __ARM_ARCH
+				__asm volatile ("ldmia %1!, {r3, r4, r5, r6}\n\t"
+								"stmia %0!, {r3, r4, r5, r6}"
+								: "+l" (dl), "+l" (sl) : : "r3", "r4", "r5", "r6", "memory");
+#else
+				dl[0] = sl[0];
+				dl[1] = sl[1];
+				dl[2] = sl[2];
+				dl[3] = sl[3];
+				dl += 4;
+				sl += 4;
+#endif
+				count -= 16;
+			}
+			while (count >= 4) {
+				*dl++ = *sl++;
+				count -= 4;
+			}
+			s8 = (const uint8_t*)sl;
+		} else {
+			/* Mutually misaligned : shift and merge aligned source words */
+			uint32_t prev = 0, next = 0;
+			sl = (const uint32_t*)((uintptr_t)s8 & ~0x03);
+			prev = *sl++;
+			while (count >= 4) {
+				next = *sl++;
+				*dl++ = (prev >> shift) | (next << (32 - shift));
+				prev = next;
+				count -= 4;
+			}
+			s8 = (const uint8_t*)sl - 4 + (shift >> 3);
 		}
+		d8 = (uint8_t*)dl;
 	}
-	/* copy the rest one byte at a time */
-	d8 = (char *)dl;
-	s8 = (char *)sl;
+	/* Copy the rest one byte at a time */
 	while (count--) {
 		*d8++ = *s8++;
 	}
@@ -56,24 +111,49 @@ void* memcpy(void* dest, const void* src, size_t count)
  */
 void* memset(void* s, int c, size_t count)
 {
-	unsigned long* sl = (unsigned long*) s;
-	unsigned long cl = 0;
-	char* s8;
-	size_t i;
-
-	/* do it one word at a time (32 bits or 64 bits) while possible */
-	if ( ((uint32_t)s & (sizeof(*sl) - 1)) == 0) {
-		for (i = 0; i < sizeof(*sl); i++) {
-			cl <<= 8;
-			cl |= c & 0xff;
+	uint8_t* s8 = (uint8_t*)s;
+
+	if (count >= MEM_SMALL_SIZE) {
+		uint32_t* sl = NULL;
+		uint32_t cl = (c & 0xFF);
+
+		/* Align destination */
+		while ((uintptr_t)s8 & 0x03) {
+			*s8++ = c;
+			count--;
+		}
+		sl = (uint32_t*)s8;
+		cl |= (cl << 8);
+		cl |= (cl << 16);
+		if (count >= 16) {
+#ifdef __ARM_ARCH
+			register uint32_t v0 __asm("r3") = cl;
+			register uint32_t v1 __asm("r4") = cl;
+			register uint32_t v2 __asm("r5") = cl;
+			register uint32_t v3 __asm("r6") = cl;
+			do {
+				__asm volatile ("stmia %0!, {r3, r4, r5, r6}"
+								: "+l" (sl) : "r" (v0), "r" (v1), "r" (v2), "r" (v3) : "memory");
+				count -= 16;
+			} while (count >= 16);
+#else
+			do {
+				sl[0] = cl;
+				sl[1] = cl;
+				sl[2] = cl;
+				sl[3] = cl;
+				sl += 4;
+				count -= 16;
+			} while (count >= 16);
+#endif
 		}
-		while (count >= sizeof(*sl)) {
+		while (count >= 4) {
 			*sl++ = cl;
-			count -= sizeof(*sl);
+			count -= 4;
 		}
+		s8 = (uint8_t*)sl;
 	}
-	/* fill 8 bits at a time */
-	s8 = (char*)sl;
+	/* Fill the rest one byte at a time */
 	while (count--) {
 		*s8++ = c;
 	}
@@ -0,0 +1,138 @@
+/****************************************************************************
+ *  lib/trace.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+#include "lib/stdint.h"
+#include "lib/errno.h"
+#include "lib/trace.h"
+#include "core/lpc_core.h"
+#include "core/system.h"
+#include "core/systick.h"
+#include "drivers/serial.h"
+
+
+/***************************************************************************** */
+/* Events trace                                                                */
+/***************************************************************************** */
+
+#if (TRACE_ENABLE == 1)
+
+#define TRACE_FORMAT_VERSION  1
+#define TRACE_DRAIN_CHUNK  (SERIAL_OUT_BUFF_SIZE & ~(sizeof(struct trace_record) - 1))
+
+static struct trace_record trace_buf[TRACE_NB_RECORDS];
+static volatile uint32_t trace_head = 0;
+static volatile uint32_t trace_count = 0;
+static volatile uint32_t trace_lost = 0;
+static volatile uint32_t trace_suspended = 0;
+
+/* The primask is restored instead of enabling interrupts, so that this can be used
+ * within critical sections. */
+void trace_record(uint8_t id, uint8_t type, uint16_t arg)
+{
+	struct trace_record* rec = NULL;
+	uint32_t primask = get_priority_mask();
+
+	lpc_disable_irq();
+	if (trace_suspended != 0) {
+		trace_lost++;
+	} else {
+		rec = &(trace_buf[trace_head & (TRACE_NB_RECORDS - 1)]);
+		rec->cycles = systick_get_clock_cycles();
+		rec->arg = arg;
+		rec->id = id;
+		rec->type = type;
+		trace_head++;
+		if (trace_count < TRACE_NB_RECORDS) {
+			trace_count++;
+		} else {
+			trace_lost++;
+		}
+	}
+	set_priority_mask(primask);
+}
+
+int trace_drain(int uart_num)
+{
+	uint8_t header[12];
+	uint32_t clock = systick_get_clock_cycles_rate();
+	uint32_t first = 0, count = 0, lost = 0, i = 0;
+	int ret = 0;
+
+	lpc_disable_irq();
+	trace_suspended = 1;
+	count = trace_count;
+	lost = trace_lost;
+	first = trace_head - count;
+	lpc_enable_irq();
+
+	header[0] = 'T';
+	header[1] = 'R';
+	header[2] = 'C';
+	header[3] = TRACE_FORMAT_VERSION;
+	for (i = 0; i < 4; i++) {
+		header[4 + i] = (clock >> (8 * i)) & 0xFF;
+	}
+	header[8] = (count & 0xFF);
+	header[9] = (count >> 8) & 0xFF;
+	header[10] = (lost & 0xFF);
+	header[11] = (lost >> 8) & 0xFF;
+	ret = serial_write(uart_num, (char*)header, sizeof(header));
+	if (ret < 0) {
+		goto out;
+	}
+
+	/* Records are sent by contiguous chunks fitting in the UART output buffer */
+	i = 0;
+	while (i < count) {
+		uint32_t idx = (first + i) & (TRACE_NB_RECORDS - 1);
+		uint32_t len = (count - i) * sizeof(struct trace_record);
+		if (len > ((TRACE_NB_RECORDS - idx) * sizeof(struct trace_record))) {
+			len = (TRACE_NB_RECORDS - idx) * sizeof(struct trace_record);
+		}
+		if (len > TRACE_DRAIN_CHUNK) {
+			len = TRACE_DRAIN_CHUNK;
+		}
+		ret = serial_write(uart_num, (char*)&(trace_buf[idx]), len);
+		if (ret < 0) {
+			goto out;
+		}
+		i += (len / sizeof(struct trace_record));
+	}
+	ret = count;
+
+out:
+	lpc_disable_irq();
+	trace_count = 0;
+	trace_lost -= lost;
+	trace_suspended = 0;
+	lpc_enable_irq();
+	return ret;
+}
+
+#else /* TRACE_ENABLE */
+
+void trace_record(uint8_t id, uint8_t type, uint16_t arg)
+{
+}
+
+int trace_drain(int uart_num)
+{
+	return -ENODEV;
+}
+
+#endif /* TRACE_ENABLE */
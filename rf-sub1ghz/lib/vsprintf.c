@@ -23,6 +23,8 @@
 #include <stdarg.h>
 #include "lib/stdint.h"
 #include "lib/string.h"
+#include "lib/utils.h"
+#include "lib/prof.h"
 
 #define ZEROPAD   (1 <<  0)  /* pad with zero */
 #define SIGNED    (1 <<  1)  /* unsigned/signed long */
@@ -70,8 +72,9 @@ static int convert(char* buf, char* end, uint32_t flags, uint32_t width, uint32_
 		} while (num);
 	} else {
 		while (num) {
-			tmp[i++] = (num % 10) + '0';
-			num = num / 10;
+			uint32_t quot = udiv10(num);
+			tmp[i++] = (num - (quot * 10)) + '0';
+			num = quot;
 		}
 	}
 
@@ -111,6 +114,7 @@ int vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
 {
     char* start = buf;
     char* end = buf + size - 1; /* leave one char for terminating null byte */
+	PROF_ENTER(vsnprintf);
 
 	/* Parse format string */
 	while ((buf < end) && *fmt) {
@@ -199,6 +203,7 @@ int vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
 		}
 	}
 	*buf = '\0';
+	PROF_EXIT(vsnprintf);
 	return (buf - start);
 }
 
@@ -216,3 +221,39 @@ int snprintf(char* buf, size_t size, const char *format, ...)
 }
 
 
+/* Fixed point values : print "value" as a decimal number with "decimals" digits after
+ * the decimal point, so that 1234 with 1 decimal gives "123.4" and -5 gives "-0.5".
+ * Returns the number of chars written, not including the terminating null byte.
+ */
+int snprintf_fixed(char* buf, size_t size, int32_t value, uint8_t decimals)
+{
+	char tmp[TMP_NUM_BUF_SIZE];
+	uint32_t num = (value < 0) ? -value : value;
+	int i = 0, length = 0, nb_digits = 0;
+
+	if (size == 0) {
+		return 0;
+	}
+	if (decimals > (TMP_NUM_BUF_SIZE - 12)) {
+		decimals = TMP_NUM_BUF_SIZE - 12;
+	}
+	/* Generate the string in reverse order, with at least one digit before the point */
+	do {
+		uint32_t quot = udiv10(num);
+		tmp[i++] = (num - (quot * 10)) + '0';
+		num = quot;
+		nb_digits++;
+		if ((nb_digits == decimals) && (decimals != 0)) {
+			tmp[i++] = '.';
+		}
+	} while ((num != 0) || (nb_digits <= decimals));
+	if (value < 0) {
+		tmp[i++] = '-';
+	}
+	/* And reverse it */
+	while (i && (length < (size - 1))) {
+		buf[length++] = tmp[--i];
+	}
+	buf[length] = '\0';
+	return length;
+}
@@ -0,0 +1,344 @@
+/****************************************************************************
+ *   scripts/bme280_check.c
+ *
+ * Host check of the BME280 compensation against the reference formulas
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -fwrapv -DLIB_STDINT_H -include stdint.h -Iinclude -o /tmp/bme280_check \
+ *       scripts/bme280_check.c extdrv/bme280_humidity_sensor.c
+ *   /tmp/bme280_check [nb_samples] [seed]
+ *
+ * The driver is built as is, with the I2C accesses replaced by a fake register image
+ *   holding the calibration data, so that the calibration parsing is used too (H4 and H5
+ *   are kept positive, the driver reads them as unsigned 12 bits values).
+ * For each calibration set (the datasheet example, then random ones), the temperature,
+ *   pressure and humidity computed by bme280_compensate_samples() and by the three
+ *   single value functions are compared with the integer formulas of the BME280
+ *   datasheet (section 4.2.3), on edge values and random raw samples.
+ * -fwrapv gives the wrapping behavior of the target on integer overflows, which random
+ *   calibration data may produce in both versions.
+ * The benchmark gives the host time per sample of both versions : only the ratio is
+ *   meaningful, use the PROF_* counters (lib/prof.h) for the cycles on the target.
+ * Returns 0 if all values match, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extdrv/bme280_humidity_sensor.h"
+
+
+/***************************************************************************** */
+/* Fake sensor : registers image holding the calibration data read by bme280_configure() */
+static uint8_t regs[256];
+
+int i2c_read(uint8_t bus_num, const void *cmd_buf, size_t cmd_size, const void* ctrl_buf, void* inbuff, size_t count)
+{
+	uint8_t reg = ((const uint8_t*)cmd_buf)[1];
+
+	memcpy(inbuff, &regs[reg], count);
+	return count;
+}
+
+int i2c_write(uint8_t bus_num, const void *buf, size_t count, const void* ctrl_buf)
+{
+	return count;
+}
+
+void msleep(uint32_t ms)
+{
+}
+
+static void set_reg16(uint8_t reg, int val)
+{
+	regs[reg] = (val & 0xFF);
+	regs[reg + 1] = ((val >> 8) & 0xFF);
+}
+
+static void set_calibration(const struct bme280_calibration_data* cal)
+{
+	memset(regs, 0, sizeof(regs));
+	regs[0xD0] = BME280_ID;
+	set_reg16(0x88, cal->T1);
+	set_reg16(0x8A, cal->T2);
+	set_reg16(0x8C, cal->T3);
+	set_reg16(0x8E, cal->P1);
+	set_reg16(0x90, cal->P2);
+	set_reg16(0x92, cal->P3);
+	set_reg16(0x94, cal->P4);
+	set_reg16(0x96, cal->P5);
+	set_reg16(0x98, cal->P6);
+	set_reg16(0x9A, cal->P7);
+	set_reg16(0x9C, cal->P8);
+	set_reg16(0x9E, cal->P9);
+	regs[0xA1] = cal->H1;
+	set_reg16(0xE1, cal->H2);
+	regs[0xE3] = cal->H3;
+	regs[0xE4] = ((cal->H4 >> 4) & 0xFF);
+	regs[0xE5] = ((cal->H4 & 0x0F) | ((cal->H5 & 0x0F) << 4));
+	regs[0xE6] = ((cal->H5 >> 4) & 0xFF);
+	regs[0xE7] = (uint8_t)cal->H6;
+}
+
+
+/***************************************************************************** */
+/* Reference formulas, as given in the datasheet */
+static int ref_fine_temp;
+
+static int ref_temperature(const struct bme280_calibration_data* cal, int adc_T)
+{
+	int var1, var2;
+
+	var1 = ((((adc_T >> 3) - ((int)cal->T1 << 1))) * ((int)cal->T2)) >> 11;
+	var2 = (((((adc_T >> 4) - ((int)cal->T1)) * ((adc_T >> 4) - ((int)cal->T1))) >> 12) *
+			((int)cal->T3)) >> 14;
+	ref_fine_temp = var1 + var2;
+	return (ref_fine_temp * 5 + 128) >> 8;
+}
+
+static uint32_t ref_pressure(const struct bme280_calibration_data* cal, int adc_P)
+{
+	int var1, var2;
+	uint32_t p;
+
+	var1 = (((int)ref_fine_temp) >> 1) - (int)64000;
+	var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int)cal->P6);
+	var2 = var2 + ((var1 * ((int)cal->P5)) << 1);
+	var2 = (var2 >> 2) + (((int)cal->P4) << 16);
+	var1 = (((cal->P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int)cal->P2) * var1) >> 1)) >> 18;
+	var1 = ((((32768 + var1)) * ((int)cal->P1)) >> 15);
+	if (var1 == 0) {
+		return 0;
+	}
+	p = (((uint32_t)(((int)1048576) - adc_P) - (var2 >> 12))) * 3125;
+	if (p < 0x80000000) {
+		p = (p << 1) / ((uint32_t)var1);
+	} else {
+		p = (p / (uint32_t)var1) * 2;
+	}
+	var1 = (((int)cal->P9) * ((int)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+	var2 = (((int)(p >> 2)) * ((int)cal->P8)) >> 13;
+	p = (uint32_t)((int)p + ((var1 + var2 + cal->P7) >> 4));
+	return p;
+}
+
+/* In 0.01 %rH, converted from the Q22.10 result the same way as the driver always did */
+static uint32_t ref_humidity(const struct bme280_calibration_data* cal, int adc_H)
+{
+	int v_x1_u32r;
+	uint32_t h;
+
+	v_x1_u32r = (ref_fine_temp - ((int)76800));
+	v_x1_u32r = (((((adc_H << 14) - (((int)cal->H4) << 20) - (((int)cal->H5) * v_x1_u32r)) +
+			((int)16384)) >> 15) * (((((((v_x1_u32r * ((int)cal->H6)) >> 10) *
+			(((v_x1_u32r * ((int)cal->H3)) >> 11) + ((int)32768))) >> 10) +
+			((int)2097152)) * ((int)cal->H2) + 8192) >> 14));
+	v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int)cal->H1)) >> 4));
+	v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
+	v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
+	h = (uint32_t)(v_x1_u32r >> 12);
+	return ((h >> 10) * 100) + ((((h & 0x3FF) * 1000) >> 10) / 10);
+}
+
+
+/***************************************************************************** */
+/* Test data */
+static const struct bme280_calibration_data datasheet_cal = {
+	.T1 = 27504, .T2 = 26435, .T3 = -1000,
+	.P1 = 36477, .P2 = -10685, .P3 = 3024, .P4 = 2855, .P5 = 140, .P6 = -7,
+	.P7 = 15500, .P8 = -14600, .P9 = 6000,
+	.H1 = 75, .H2 = 362, .H3 = 0, .H4 = 313, .H5 = 50, .H6 = 30,
+};
+
+/* Random calibration around the datasheet values, over the whole register ranges for
+ *   some of the sets */
+static void random_calibration(struct bme280_calibration_data* cal, int full_range)
+{
+	*cal = datasheet_cal;
+	if (full_range) {
+		cal->T1 = rand(); cal->T2 = rand(); cal->T3 = rand();
+		cal->P1 = rand(); cal->P2 = rand(); cal->P3 = rand(); cal->P4 = rand();
+		cal->P5 = rand(); cal->P6 = rand(); cal->P7 = rand(); cal->P8 = rand();
+		cal->P9 = rand();
+		cal->H1 = rand(); cal->H2 = rand(); cal->H3 = rand(); cal->H6 = rand();
+	} else {
+		cal->T1 += (rand() % 4001) - 2000;
+		cal->T2 += (rand() % 4001) - 2000;
+		cal->T3 += (rand() % 201) - 100;
+		cal->P1 += (rand() % 4001) - 2000;
+		cal->P2 += (rand() % 2001) - 1000;
+		cal->P3 += (rand() % 1001) - 500;
+		cal->P4 += (rand() % 2001) - 1000;
+		cal->P5 += (rand() % 201) - 100;
+		cal->P6 += (rand() % 21) - 10;
+		cal->P7 += (rand() % 2001) - 1000;
+		cal->P8 += (rand() % 2001) - 1000;
+		cal->P9 += (rand() % 2001) - 1000;
+		cal->H1 += (rand() % 41) - 20;
+		cal->H2 += (rand() % 101) - 50;
+		cal->H3 = (rand() % 8);
+		cal->H6 += (rand() % 21) - 10;
+	}
+	/* 12 bits values, the driver does not extend their sign */
+	cal->H4 = (rand() % 4096);
+	cal->H5 = (rand() % 4096);
+}
+
+static const uint32_t edge_values[] = { 0, 1, 0x7FFFF, 0x80000, 0xFFFFE, 0xFFFFF, };
+#define NB_EDGE_VALUES  (sizeof(edge_values) / sizeof(edge_values[0]))
+
+static void fill_samples(struct bme280_raw_sample* raw, unsigned int nb)
+{
+	unsigned int i = 0, j = 0, k = 0, l = 0;
+
+	/* All combinations of the edge values first */
+	for (i = 0; (i < NB_EDGE_VALUES) && (l < nb); i++) {
+		for (j = 0; (j < NB_EDGE_VALUES) && (l < nb); j++) {
+			for (k = 0; (k < NB_EDGE_VALUES) && (l < nb); k++, l++) {
+				raw[l].temperature = edge_values[i];
+				raw[l].pressure = edge_values[j];
+				raw[l].humidity = (edge_values[k] >> 4);
+			}
+		}
+	}
+	/* Then runs of random samples with the same temperature */
+	while (l < nb) {
+		uint32_t temp = (rand() & 0xFFFFF);
+		unsigned int run = 1 + (rand() % 8);
+		for (i = 0; (i < run) && (l < nb); i++, l++) {
+			raw[l].temperature = temp;
+			raw[l].pressure = (rand() & 0xFFFFF);
+			raw[l].humidity = (rand() & 0xFFFF);
+		}
+	}
+}
+
+
+/***************************************************************************** */
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+#define NB_CAL_SETS  64
+
+int main(int argc, char* argv[])
+{
+	struct bme280_sensor_config conf;
+	struct bme280_calibration_data cal;
+	struct bme280_raw_sample* raw = NULL;
+	struct bme280_sample* out = NULL;
+	struct bme280_sample* ref = NULL;
+	unsigned int nb = 10000, seed = 1;
+	unsigned int set = 0, i = 0, errors = 0;
+	double t_ref = 0, t_new = 0, start = 0;
+	volatile uint32_t sink = 0;
+
+	if (argc > 1) {
+		nb = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		seed = strtoul(argv[2], NULL, 0);
+	}
+	srand(seed);
+	raw = malloc(nb * sizeof(*raw));
+	out = malloc(nb * sizeof(*out));
+	ref = malloc(nb * sizeof(*ref));
+	if ((raw == NULL) || (out == NULL) || (ref == NULL)) {
+		return 1;
+	}
+
+	for (set = 0; set < NB_CAL_SETS; set++) {
+		if (set == 0) {
+			cal = datasheet_cal;
+		} else {
+			random_calibration(&cal, (set >= (NB_CAL_SETS / 2)));
+		}
+		set_calibration(&cal);
+		memset(&conf, 0, sizeof(conf));
+		conf.addr = 0xEC;
+		if (bme280_configure(&conf) != 0) {
+			printf("Calibration data read failed\n");
+			return 1;
+		}
+		if (memcmp(&conf.cal, &cal, sizeof(cal)) != 0) {
+			printf("Set %u : calibration data parsing mismatch\n", set);
+			errors++;
+			continue;
+		}
+		fill_samples(raw, nb);
+
+		/* Reference */
+		start = now_us();
+		for (i = 0; i < nb; i++) {
+			ref[i].temperature = ref_temperature(&cal, raw[i].temperature);
+			ref[i].pressure = ref_pressure(&cal, raw[i].pressure);
+			ref[i].humidity = ref_humidity(&cal, raw[i].humidity);
+			sink += ref[i].pressure;
+		}
+		t_ref += now_us() - start;
+
+		/* Batch conversion */
+		start = now_us();
+		bme280_compensate_samples(&conf, raw, out, nb);
+		t_new += now_us() - start;
+		sink += out[nb - 1].pressure;
+
+		for (i = 0; i < nb; i++) {
+			if (memcmp(&out[i], &ref[i], sizeof(out[i])) != 0) {
+				if (errors++ < 10) {
+					printf("Set %u, batch sample %u (T %u, P %u, H %u) : "
+							"%d %u %u instead of %d %u %u\n",
+							set, i, raw[i].temperature, raw[i].pressure, raw[i].humidity,
+							out[i].temperature, out[i].pressure, out[i].humidity,
+							ref[i].temperature, ref[i].pressure, ref[i].humidity);
+				}
+			}
+		}
+		/* Single value functions, in the order used by the driver */
+		for (i = 0; i < nb; i++) {
+			struct bme280_sample val;
+			val.temperature = bme280_compensate_temperature(&conf, raw[i].temperature);
+			val.pressure = bme280_compensate_pressure(&conf, raw[i].pressure);
+			val.humidity = bme280_compensate_humidity(&conf, raw[i].humidity);
+			if (memcmp(&val, &ref[i], sizeof(val)) != 0) {
+				if (errors++ < 10) {
+					printf("Set %u, sample %u (T %u, P %u, H %u) : "
+							"%d %u %u instead of %d %u %u\n",
+							set, i, raw[i].temperature, raw[i].pressure, raw[i].humidity,
+							val.temperature, val.pressure, val.humidity,
+							ref[i].temperature, ref[i].pressure, ref[i].humidity);
+				}
+			}
+		}
+	}
+
+	printf("%u calibration sets, %u samples each : %u mismatch(es)\n", NB_CAL_SETS, nb, errors);
+	printf("Host time per sample : reference %.1f ns, driver %.1f ns (%.2fx)\n",
+			(t_ref * 1000) / (NB_CAL_SETS * nb), (t_new * 1000) / (NB_CAL_SETS * nb),
+			(t_new > 0) ? (t_ref / t_new) : 0);
+	free(raw);
+	free(out);
+	free(ref);
+	return (errors != 0);
+}
@@ -0,0 +1,434 @@
+/****************************************************************************
+ *   scripts/flashlog_check.c
+ *
+ * Host check of the internal flash log delivery after interrupted writes and resets
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -no-pie -DLIB_STDINT_H -DLIB_STDDEF_H -include stdint.h -include stddef.h \
+ *       -Iinclude -I. -Wl,--defsym,_end_text=0x4000 -Wl,--defsym,_start_data=0x10000000 \
+ *       -Wl,--defsym,_end_data=0x10000100 -o /tmp/flashlog_check scripts/flashlog_check.c
+ *   /tmp/flashlog_check [nb_operations] [seed]
+ *
+ * lib/flashlog.c is included in this file, on a simulated flash : a RAM image of the
+ *   log sectors, erased to 0xFF, on which programming can only clear bits. The linker
+ *   symbols place the program image end at 0x4100.
+ * Records are appended, flushed and drained at random while the time goes on (so that
+ *   some writes hit the rate limit), and the drain callback refuses some records. The
+ *   simulated flash fails some erases and writes (error returned, part of the sector or
+ *   unit changed) or resets the system in the middle of them : only part of the sector
+ *   is erased or part of the unit written, the log and its RAM buffer are lost, and
+ *   flashlog_init() is called again.
+ * The test keeps the records of each unit fully written, and checks :
+ *  - Units are only programmed when blank, within the log sectors.
+ *  - flashlog_init() finds the head after the last unit fully written, and the drain
+ *    position saved in that unit.
+ *  - Drained records are records which were appended, with their data, and are drained
+ *    in order and exactly once between two resets. A refused record is drained again.
+ *  - No record is skipped : when a record is drained, the older ones have all been
+ *    drained, except the ones lost in the RAM buffer on a reset and the ones of units
+ *    erased when the log got full.
+ *  - After a reset, the only records drained again are the ones of the units from the
+ *    saved drain position on (at least once delivery).
+ *  - At the end, every record accepted by flashlog_append() has been drained, with the
+ *    same exceptions.
+ * Each record holds a unique number as timestamp, and bytes depending on it.
+ * Returns 0 if all checks pass, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#define LIB_STRING_H
+
+/* Simulated flash, at SIM_START in the target address space */
+#define SIM_START       0x8000
+#define SIM_NB_SECTORS  8
+static uint8_t flash_mem[SIM_NB_SECTORS * 0x1000];
+#define FLASHLOG_FLASH_PTR(addr)  ((void*)&flash_mem[(addr) - SIM_START])
+
+#include "lib/flashlog.c"
+
+
+/***************************************************************************** */
+static unsigned int errors = 0;
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			if (errors++ < 20) { \
+				printf(__VA_ARGS__); \
+				printf("\n"); \
+			} \
+		} \
+	} while (0)
+
+
+/***************************************************************************** */
+/* Host CRC32 (reflected 0x04C11DB7, with complements) */
+uint32_t crc_compute(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	uint32_t i = 0, b = 0;
+
+	crc = ~crc;
+	for (i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (b = 0; b < 8; b++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t sim_tick = 0;
+uint32_t systick_get_tick_count(void)
+{
+	return sim_tick;
+}
+
+
+/***************************************************************************** */
+/* Test model */
+#define MAX_RECORDS  400000
+#define MAX_SEQ      60000
+#define MIN_INTERVAL 20
+
+static struct flashlog fl_log;
+static uint32_t log_nb_sectors = 0;
+static unsigned int fail_rate = 0;    /* Out of 1000 erases or writes */
+static unsigned int reset_rate = 0;   /* Out of 1000 erases or writes */
+static jmp_buf reset_jmp;
+
+static struct record_model {
+	uint8_t accepted;
+	uint8_t drained;
+	uint8_t again;      /* May be drained once more after a reset */
+	uint8_t lost_ram;   /* In the RAM buffer on a reset */
+	int32_t seq;        /* Unit holding the record, -1 if none */
+} records[MAX_RECORDS];
+static struct unit_model {
+	uint8_t erased;
+	uint32_t tail;      /* Drain position saved in the unit */
+} units[MAX_SEQ];
+static int32_t pos_seq[SIM_NB_SECTORS * FLASHLOG_UNITS_PER_SECTOR];
+static uint32_t pending[FLASHLOG_PAYLOAD_SIZE / FLASHLOG_RECORD_HEADER_SIZE];
+static unsigned int nb_pending = 0;
+static int32_t last_written = -1;
+static int64_t last_drained = -1;
+static uint32_t scan = 0;  /* Records before this one are drained or lost */
+static unsigned int nb_records = 0, nb_accepted = 0, nb_drained = 0, nb_again = 0;
+static unsigned int nb_resets = 0, nb_fails = 0, nb_erased_lost = 0;
+
+static int sim_fault(unsigned int* len, unsigned int size)
+{
+	if ((unsigned int)(rand() % 1000) < fail_rate) {
+		nb_fails++;
+		*len = rand() % size;
+		return -1;
+	}
+	if ((unsigned int)(rand() % 1000) < reset_rate) {
+		*len = rand() % size;
+		return 1;
+	}
+	*len = size;
+	return 0;
+}
+
+int flash_erase_sector(uint32_t addr)
+{
+	uint32_t pos = 0, first = 0;
+	unsigned int len = 0;
+	int fault = 0;
+
+	CHECK(((addr & (LPC12XX_SECTOR_SIZE - 1)) == 0) && (addr >= SIM_START) &&
+			(addr < (SIM_START + (log_nb_sectors * LPC12XX_SECTOR_SIZE))),
+			"Erase out of the log : 0x%x", addr);
+	fault = sim_fault(&len, LPC12XX_SECTOR_SIZE);
+	if (len != 0) {
+		first = ((addr - SIM_START) / FLASHLOG_UNIT_SIZE);
+		for (pos = first; pos < (first + FLASHLOG_UNITS_PER_SECTOR); pos++) {
+			if (pos_seq[pos] >= 0) {
+				units[pos_seq[pos]].erased = 1;
+			}
+			pos_seq[pos] = -1;
+		}
+		memset(FLASHLOG_FLASH_PTR(addr), 0xFF, len);
+	}
+	if (fault > 0) {
+		longjmp(reset_jmp, 1);
+	}
+	return fault;
+}
+
+/* Update the model with the records of a unit fully written */
+static void unit_written(uint32_t pos, const uint8_t* buf)
+{
+	const struct flashlog_unit_header* hdr = (const struct flashlog_unit_header*)buf;
+	const uint8_t* rec = FLASHLOG_RECORDS(buf);
+	unsigned int off = 0, nb = 0;
+
+	CHECK(hdr->seq == (uint32_t)(last_written + 1), "Unit %u written after %d", hdr->seq, last_written);
+	if (hdr->seq >= MAX_SEQ) {
+		return;
+	}
+	memset(&units[hdr->seq], 0, sizeof(struct unit_model));
+	units[hdr->seq].tail = hdr->tail_seq;
+	while ((off + FLASHLOG_RECORD_HEADER_SIZE) <= hdr->len) {
+		uint32_t id = flashlog_rec_timestamp(rec + off);
+		CHECK((nb < nb_pending) && (id == pending[nb]), "Unit %u : record %u is %u instead of %u",
+				hdr->seq, nb, id, ((nb < nb_pending) ? pending[nb] : 0));
+		if (id < MAX_RECORDS) {
+			records[id].seq = hdr->seq;
+		}
+		off += FLASHLOG_RECORD_HEADER_SIZE + rec[off];
+		nb++;
+	}
+	CHECK((nb == hdr->nb_records) && (nb == nb_pending), "Unit %u : %u records, %u in header, %u waiting",
+			hdr->seq, nb, hdr->nb_records, nb_pending);
+	nb_pending = 0;
+	pos_seq[pos] = hdr->seq;
+	last_written = hdr->seq;
+}
+
+int flash_program_page(uint32_t addr, uint32_t sz, unsigned char* buf)
+{
+	uint8_t* mem = FLASHLOG_FLASH_PTR(addr);
+	unsigned int len = 0, i = 0, blank = 1;
+	int fault = 0;
+
+	CHECK((sz == FLASHLOG_UNIT_SIZE) && ((addr & (FLASHLOG_UNIT_SIZE - 1)) == 0) &&
+			(addr >= SIM_START) &&
+			((addr + sz) <= (SIM_START + (log_nb_sectors * LPC12XX_SECTOR_SIZE))),
+			"Write out of the log : 0x%x, %u bytes", addr, sz);
+	for (i = 0; i < sz; i++) {
+		if (mem[i] != 0xFF) {
+			blank = 0;
+		}
+	}
+	CHECK(blank, "Unit at 0x%x programmed while not blank", addr);
+	fault = sim_fault(&len, sz);
+	/* Programming only clears bits */
+	for (i = 0; i < len; i++) {
+		mem[i] &= buf[i];
+	}
+	if ((fault == 0) && (memcmp(mem, buf, sz) == 0)) {
+		unit_written(((addr - SIM_START) / FLASHLOG_UNIT_SIZE), buf);
+	}
+	if (fault > 0) {
+		longjmp(reset_jmp, 1);
+	}
+	return fault;
+}
+
+
+/***************************************************************************** */
+static void record_data(uint32_t id, uint8_t* data, uint8_t len)
+{
+	unsigned int i = 0;
+	for (i = 0; i < len; i++) {
+		data[i] = ((id * 7) + i) & 0xFF;
+	}
+}
+
+static unsigned int refuse_rate = 0;  /* Out of 100 records */
+
+/* Check that the records before "id" have been drained, or lost */
+static void check_skipped(uint32_t id)
+{
+	for (; scan < id; scan++) {
+		struct record_model* rec = &records[scan];
+		if (!rec->accepted || rec->drained || rec->lost_ram) {
+			continue;
+		}
+		if ((rec->seq >= 0) && units[rec->seq].erased) {
+			nb_erased_lost++;
+			continue;
+		}
+		CHECK(0, "Record %u (unit %d) skipped", scan, rec->seq);
+	}
+}
+
+static int drain_callback(uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	uint8_t ref[FLASHLOG_MAX_RECORD_SIZE];
+	struct record_model* rec = NULL;
+
+	if ((timestamp >= nb_records) || !records[timestamp].accepted) {
+		CHECK(0, "Drained record %u was never accepted", timestamp);
+		return 0;
+	}
+	rec = &records[timestamp];
+	record_data(timestamp, ref, len);
+	CHECK(memcmp(data, ref, len) == 0, "Record %u : bad data", timestamp);
+	if ((unsigned int)(rand() % 100) < refuse_rate) {
+		return -1;
+	}
+	CHECK((int64_t)timestamp > last_drained, "Record %u drained after %lld", timestamp,
+			(long long)last_drained);
+	CHECK(!rec->drained || rec->again, "Record %u drained twice", timestamp);
+	if (rec->drained) {
+		nb_again++;
+	}
+	check_skipped(timestamp);
+	last_drained = timestamp;
+	rec->drained = 1;
+	rec->again = 0;
+	nb_drained++;
+	/* Drained from the RAM buffer */
+	if ((nb_pending != 0) && (pending[0] == timestamp)) {
+		nb_pending--;
+		memmove(&pending[0], &pending[1], (nb_pending * sizeof(uint32_t)));
+	}
+	return 0;
+}
+
+/* After a reset */
+static void check_init(void)
+{
+	uint32_t head = (uint32_t)(last_written + 1);
+	uint32_t tail = 0, id = 0;
+	unsigned int i = 0;
+	int ret = 0;
+
+	for (i = 0; i < nb_pending; i++) {
+		records[pending[i]].lost_ram = 1;
+	}
+	nb_pending = 0;
+	memset(&fl_log, 0x5A, sizeof(fl_log));
+	ret = flashlog_init(&fl_log, SIM_START, log_nb_sectors, MIN_INTERVAL);
+	CHECK(ret == 0, "flashlog_init() : %d", ret);
+	if (last_written >= 0) {
+		tail = units[last_written].tail;
+	}
+	CHECK((fl_log.head_seq == head) && (fl_log.tail_seq == tail),
+			"Init after %u resets : head %u tail %u instead of %u %u",
+			nb_resets, fl_log.head_seq, fl_log.tail_seq, head, tail);
+	/* Records of the units from the saved drain position on may be drained again */
+	for (id = 0; id < nb_records; id++) {
+		if (records[id].drained && (records[id].seq >= 0) && ((uint32_t)records[id].seq >= tail)) {
+			records[id].again = 1;
+		}
+	}
+	last_drained = -1;
+}
+
+static void run(uint32_t nb_sectors, unsigned int nb_ops, unsigned int f_rate, unsigned int rst_rate)
+{
+	volatile unsigned int op = 0;
+	uint32_t id = 0;
+	uint8_t data[FLASHLOG_MAX_RECORD_SIZE];
+
+	memset(flash_mem, 0xFF, sizeof(flash_mem));
+	/* Some garbage left from a previous use */
+	for (id = 0; id < 64; id++) {
+		flash_mem[rand() % (nb_sectors * LPC12XX_SECTOR_SIZE)] = rand();
+	}
+	memset(records, 0, sizeof(records));
+	memset(units, 0, sizeof(units));
+	memset(pos_seq, 0xFF, sizeof(pos_seq));
+	nb_pending = 0;
+	last_written = -1;
+	scan = 0;
+	nb_records = 0;
+	nb_accepted = 0;
+	nb_drained = 0;
+	nb_again = 0;
+	nb_resets = 0;
+	nb_fails = 0;
+	nb_erased_lost = 0;
+	log_nb_sectors = nb_sectors;
+	fail_rate = f_rate;
+	reset_rate = rst_rate;
+	refuse_rate = 10;
+
+	if (setjmp(reset_jmp) != 0) {
+		nb_resets++;
+	}
+	check_init();
+
+	for (; op < nb_ops; op++) {
+		int action = rand() % 100;
+		if ((last_written >= (MAX_SEQ - 2)) || (nb_records >= (MAX_RECORDS - 1))) {
+			break;
+		}
+		sim_tick += rand() % 4;
+		if (action < 60) {
+			/* Append, mostly small records */
+			uint8_t len = ((rand() % 10) == 0) ? (rand() % (FLASHLOG_MAX_RECORD_SIZE + 1)) : (rand() % 40);
+			uint16_t lost = fl_log.lost;
+			int ret = 0;
+			id = nb_records++;
+			records[id].seq = -1;
+			record_data(id, data, len);
+			ret = flashlog_append(&fl_log, id, data, len);
+			if (ret == 0) {
+				records[id].accepted = 1;
+				pending[nb_pending++] = id;
+				nb_accepted++;
+			} else {
+				CHECK(fl_log.lost == (uint16_t)(lost + 1), "Record %u refused (%d) and not counted", id, ret);
+			}
+		} else if (action < 63) {
+			flashlog_flush(&fl_log);
+		} else {
+			flashlog_drain(&fl_log, (rand() % 4), drain_callback);
+		}
+	}
+	/* Drain : everything still in the log gets drained */
+	fail_rate = 0;
+	reset_rate = 0;
+	refuse_rate = 0;
+	sim_tick += MIN_INTERVAL;
+	CHECK(flashlog_flush(&fl_log) == 0, "Final flush");
+	while (flashlog_pending(&fl_log)) {
+		flashlog_drain(&fl_log, 16, drain_callback);
+	}
+	check_skipped(nb_records);
+}
+
+
+/***************************************************************************** */
+int main(int argc, char* argv[])
+{
+	static const uint32_t sizes[] = { 2, 3, 8 };
+	unsigned int nb_ops = 200000, seed = 1, i = 0;
+
+	if (argc > 1) {
+		nb_ops = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		seed = strtoul(argv[2], NULL, 0);
+	}
+	srand(seed);
+
+	/* Arguments checks */
+	CHECK(flashlog_init(&fl_log, SIM_START, 1, 0) == -EINVAL, "Init on one sector");
+	CHECK(flashlog_init(&fl_log, (SIM_START + 0x100), 2, 0) == -EINVAL, "Init on unaligned start");
+	CHECK(flashlog_init(&fl_log, 0xF000, 2, 0) == -EINVAL, "Init over the 4kB sectors");
+	CHECK(flashlog_init(&fl_log, 0x4000, 2, 0) == -ENOSPC, "Init over the program image");
+
+	for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++) {
+		run(sizes[i], nb_ops, 10, 20);
+		printf("%u sectors : %u records, %u accepted, %u drained (%u again), %d units written,\n"
+				"    %u erase/write errors, %u resets, %u lost in erased units\n",
+				sizes[i], nb_records, nb_accepted, nb_drained, nb_again, (last_written + 1),
+				nb_fails, nb_resets, nb_erased_lost);
+	}
+	printf("Flash log checked : %u error(s)\n", errors);
+	return (errors == 0) ? 0 : 1;
+}
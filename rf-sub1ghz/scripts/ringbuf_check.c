@@ -0,0 +1,430 @@
+/****************************************************************************
+ *   scripts/ringbuf_check.c
+ *
+ * Host stress test and benchmark of the ring buffers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -pthread -DLIB_STDINT_H -DLPC_CORE_H -include stdint.h -Iinclude -I. \
+ *       -o /tmp/ringbuf_check scripts/ringbuf_check.c
+ *   /tmp/ringbuf_check [nb_records]
+ *
+ * lib/ringbuf.c is included in this file, with the core functions it uses replaced by
+ *   host versions : the contexts (main and interrupt handlers) are threads, and
+ *   "interrupts disabled" is a mutex shared by all of them, taken and released through
+ *   the PRIMASK functions, which keep a per thread PRIMASK value.
+ * Threads may run in parallel on the host, which is harder on the lock-free single
+ *   producer / single consumer accesses than preemption on the target, and the copies
+ *   done by lib/ringbuf.c yield to the other threads at random, like an interrupt.
+ * Checks :
+ *  - ringbuf_mp_write() from several producers : records are never interleaved or
+ *    corrupted, records which did not fit are reported and counted in "dropped", all
+ *    the others are received in order.
+ *  - ringbuf_mp_write() called with interrupts disabled keeps them disabled.
+ *  - Byte streams through ringbuf_write() / ringbuf_read(), ringbuf_push() /
+ *    ringbuf_pop() and the zero copy functions, with random chunk sizes.
+ * The benchmark gives the host time per byte or record : only useful to compare the
+ *   access methods, use the PROF_* counters (lib/prof.h) for the cycles on the target.
+ * Returns 0 if all checks pass, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+
+/***************************************************************************** */
+/* Host versions of the core functions used by lib/ringbuf.c */
+static pthread_mutex_t irq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint32_t primask = 0;
+
+static inline uint32_t get_priority_mask(void)
+{
+	return primask;
+}
+static inline void set_priority_mask(uint32_t mask)
+{
+	if (mask && !primask) {
+		pthread_mutex_lock(&irq_mutex);
+	} else if (!mask && primask) {
+		pthread_mutex_unlock(&irq_mutex);
+	}
+	primask = mask;
+}
+static inline void lpc_disable_irq(void)
+{
+	set_priority_mask(1);
+}
+#define dmb() __sync_synchronize()
+
+/* Copies done by lib/ringbuf.c let the other threads run from time to time, as an
+ *   interrupt would, to hit the windows between the space check and the index update. */
+static int preempt = 0;
+static __thread unsigned int preempt_seed = 1;
+static void* check_memcpy(void* dest, const void* src, size_t count)
+{
+	if (preempt && ((rand_r(&preempt_seed) & 0x03) == 0)) {
+		sched_yield();
+	}
+	return memcpy(dest, src, count);
+}
+#define memcpy check_memcpy
+
+#include "lib/ringbuf.c"
+
+#undef memcpy
+
+
+/***************************************************************************** */
+static unsigned int errors = 0;
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			if (__sync_fetch_and_add(&errors, 1) < 10) { \
+				printf(__VA_ARGS__); \
+				printf("\n"); \
+			} \
+		} \
+	} while (0)
+
+
+/***************************************************************************** */
+/* Multiple producers
+ * Records : total length (4 to REC_MAX_LEN), producer, 16 bits sequence number, then
+ *   bytes depending on all of them.
+ */
+#define NB_PRODUCERS  3
+#define REC_MAX_LEN   32
+RINGBUF_DECLARE(mp_rb, 256);
+
+static unsigned int nb_records = 50000;
+static volatile unsigned int producers_done = 0;
+static unsigned int rec_dropped[NB_PRODUCERS];
+static unsigned int rec_dropped_bytes[NB_PRODUCERS];
+static unsigned int rec_received[NB_PRODUCERS];
+
+static uint8_t rec_byte(unsigned int id, unsigned int seq, unsigned int i)
+{
+	return ((id * 31) + (seq * 7) + i);
+}
+
+static void* mp_producer(void* arg)
+{
+	unsigned int id = (unsigned int)(uintptr_t)arg;
+	unsigned int seed = id + 1;
+	uint8_t rec[REC_MAX_LEN];
+	unsigned int seq = 0, i = 0;
+
+	for (seq = 0; seq < nb_records; seq++) {
+		unsigned int len = 4 + (rand_r(&seed) % (REC_MAX_LEN - 3));
+		rec[0] = len;
+		rec[1] = id;
+		rec[2] = (seq & 0xFF);
+		rec[3] = ((seq >> 8) & 0xFF);
+		for (i = 4; i < len; i++) {
+			rec[i] = rec_byte(id, seq, i);
+		}
+		/* Some of the writes from within a critical section */
+		if ((seq & 0x0F) == 0) {
+			set_priority_mask(1);
+			if (ringbuf_mp_write(&mp_rb, rec, len) != 0) {
+				rec_dropped[id]++;
+				rec_dropped_bytes[id] += len;
+			}
+			CHECK(get_priority_mask() == 1, "Interrupts enabled by ringbuf_mp_write()");
+			set_priority_mask(0);
+		} else if (ringbuf_mp_write(&mp_rb, rec, len) != 0) {
+			rec_dropped[id]++;
+			rec_dropped_bytes[id] += len;
+			sched_yield();
+		}
+		CHECK(get_priority_mask() == 0, "Interrupts disabled by ringbuf_mp_write()");
+	}
+	__sync_fetch_and_add(&producers_done, 1);
+	return NULL;
+}
+
+static void* mp_consumer(void* arg)
+{
+	unsigned int next_seq[NB_PRODUCERS] = { 0 };
+	uint8_t rec[REC_MAX_LEN];
+	unsigned int have = 0, i = 0;
+	unsigned int seed = 42;
+
+	while (1) {
+		unsigned int done = producers_done;
+		unsigned int got = 0;
+		/* Read the record length, then the rest of the record, in random chunks */
+		if (have == 0) {
+			got = ringbuf_read(&mp_rb, rec, 1);
+		} else {
+			unsigned int chunk = 1 + (rand_r(&seed) % (rec[0] - have));
+			got = ringbuf_read(&mp_rb, (rec + have), chunk);
+		}
+		if (got == 0) {
+			if ((done == NB_PRODUCERS) && (ringbuf_count(&mp_rb) == 0)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		have += got;
+		if ((have == 1) && ((rec[0] < 4) || (rec[0] > REC_MAX_LEN))) {
+			CHECK(0, "Bad record length %u", rec[0]);
+			return NULL;
+		}
+		if ((have < 4) || (have < rec[0])) {
+			continue;
+		}
+		/* Complete record */
+		unsigned int id = rec[1];
+		unsigned int seq = (rec[2] | (rec[3] << 8));
+		if (id >= NB_PRODUCERS) {
+			CHECK(0, "Bad producer %u", id);
+			return NULL;
+		}
+		/* Records may be missing (dropped), but never out of order */
+		CHECK(((seq - next_seq[id]) & 0xFFFF) < 0x8000,
+				"Producer %u : record %u after %u", id, seq, (next_seq[id] - 1));
+		for (i = 4; i < rec[0]; i++) {
+			CHECK(rec[i] == (uint8_t)rec_byte(id, seq, i), "Producer %u : record %u corrupted", id, seq);
+		}
+		next_seq[id] = ((seq + 1) & 0xFFFF);
+		rec_received[id]++;
+		have = 0;
+	}
+	CHECK(have == 0, "Incomplete record at end");
+	return NULL;
+}
+
+static void mp_check(void)
+{
+	pthread_t prod[NB_PRODUCERS], cons;
+	unsigned int i = 0, dropped_bytes = 0;
+
+	pthread_create(&cons, NULL, mp_consumer, NULL);
+	for (i = 0; i < NB_PRODUCERS; i++) {
+		pthread_create(&prod[i], NULL, mp_producer, (void*)(uintptr_t)i);
+	}
+	for (i = 0; i < NB_PRODUCERS; i++) {
+		pthread_join(prod[i], NULL);
+	}
+	pthread_join(cons, NULL);
+	for (i = 0; i < NB_PRODUCERS; i++) {
+		CHECK((rec_received[i] + rec_dropped[i]) == nb_records,
+				"Producer %u : %u received + %u dropped, %u sent", i,
+				rec_received[i], rec_dropped[i], nb_records);
+		dropped_bytes += rec_dropped_bytes[i];
+		printf("Producer %u : %u records received, %u dropped (buffer full)\n", i,
+				rec_received[i], rec_dropped[i]);
+	}
+	CHECK(mp_rb.dropped == dropped_bytes, "%u bytes counted as dropped instead of %u",
+			mp_rb.dropped, dropped_bytes);
+}
+
+
+/***************************************************************************** */
+/* Single producer / single consumer byte streams, the byte value being the low byte
+ *   of its position in the stream.
+ */
+enum stream_modes {
+	STREAM_BULK = 0,
+	STREAM_BYTE,
+	STREAM_ZERO_COPY,
+};
+static const char* stream_names[] = { "write/read", "push/pop", "reserve/peek", };
+RINGBUF_DECLARE(sp_rb, 64);
+static unsigned int stream_len = 1000000;
+static int stream_mode = 0;
+
+static void* sp_producer(void* arg)
+{
+	unsigned int pos = 0, i = 0, seed = 7;
+	uint8_t buf[80];
+
+	while (pos < stream_len) {
+		unsigned int prev = pos;
+		unsigned int len = 1 + (rand_r(&seed) % sizeof(buf));
+		uint8_t* ptr = NULL;
+		if (len > (stream_len - pos)) {
+			len = stream_len - pos;
+		}
+		switch (stream_mode) {
+			case STREAM_BULK:
+				for (i = 0; i < len; i++) {
+					buf[i] = (pos + i);
+				}
+				/* Do not write more than the free space, the rest would be dropped */
+				if (len > ringbuf_space(&sp_rb)) {
+					len = ringbuf_space(&sp_rb);
+				}
+				pos += ringbuf_write(&sp_rb, buf, len);
+				break;
+			case STREAM_BYTE:
+				/* A push to a full buffer is counted as dropped */
+				if ((ringbuf_space(&sp_rb) != 0) && (ringbuf_push(&sp_rb, pos) == 0)) {
+					pos++;
+				}
+				break;
+			case STREAM_ZERO_COPY:
+				i = ringbuf_write_reserve(&sp_rb, &ptr);
+				if (len > i) {
+					len = i;
+				}
+				for (i = 0; i < len; i++) {
+					ptr[i] = (pos + i);
+				}
+				ringbuf_write_commit(&sp_rb, len);
+				pos += len;
+				break;
+		}
+		/* Let the other side run */
+		if (pos == prev) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void* sp_consumer(void* arg)
+{
+	unsigned int pos = 0, i = 0, seed = 11;
+	uint8_t buf[80];
+
+	while (pos < stream_len) {
+		unsigned int prev = pos;
+		unsigned int len = 1 + (rand_r(&seed) % sizeof(buf));
+		const uint8_t* ptr = NULL;
+		uint8_t c = 0;
+		switch (stream_mode) {
+			case STREAM_BULK:
+				len = ringbuf_read(&sp_rb, buf, len);
+				for (i = 0; i < len; i++) {
+					CHECK(buf[i] == (uint8_t)(pos + i), "%s : byte %u is %u",
+							stream_names[stream_mode], (pos + i), buf[i]);
+				}
+				pos += len;
+				break;
+			case STREAM_BYTE:
+				if (ringbuf_pop(&sp_rb, &c) == 0) {
+					CHECK(c == (uint8_t)pos, "%s : byte %u is %u", stream_names[stream_mode], pos, c);
+					pos++;
+				}
+				break;
+			case STREAM_ZERO_COPY:
+				i = ringbuf_read_peek(&sp_rb, &ptr);
+				if (len > i) {
+					len = i;
+				}
+				for (i = 0; i < len; i++) {
+					CHECK(ptr[i] == (uint8_t)(pos + i), "%s : byte %u is %u",
+							stream_names[stream_mode], (pos + i), ptr[i]);
+				}
+				ringbuf_read_release(&sp_rb, len);
+				pos += len;
+				break;
+		}
+		/* Let the other side run */
+		if (pos == prev) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void sp_check(int mode)
+{
+	pthread_t prod, cons;
+
+	stream_mode = mode;
+	ringbuf_init(&sp_rb, sp_rb_data, sizeof(sp_rb_data));
+	pthread_create(&cons, NULL, sp_consumer, NULL);
+	pthread_create(&prod, NULL, sp_producer, NULL);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	CHECK(sp_rb.dropped == 0, "%s : %u bytes dropped", stream_names[mode], sp_rb.dropped);
+	CHECK(ringbuf_count(&sp_rb) == 0, "%s : %u bytes left", stream_names[mode], ringbuf_count(&sp_rb));
+	printf("Stream %s : %u bytes\n", stream_names[mode], stream_len);
+}
+
+
+/***************************************************************************** */
+/* Benchmark, single thread : write then read back the same amount */
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+#define BENCH_BYTES  (16 * 1024 * 1024)
+static void bench(void)
+{
+	static const unsigned int chunks[] = { 1, 4, 16, 64, };
+	uint8_t buf[64] = { 0 };
+	unsigned int i = 0, j = 0;
+	double start = 0;
+	uint8_t c = 0;
+
+	ringbuf_init(&sp_rb, sp_rb_data, sizeof(sp_rb_data));
+	start = now_ns();
+	for (j = 0; j < BENCH_BYTES; j++) {
+		ringbuf_push(&sp_rb, j);
+		ringbuf_pop(&sp_rb, &c);
+	}
+	printf("Host time per byte : push/pop %.2f ns\n", (now_ns() - start) / BENCH_BYTES);
+	for (i = 0; i < (sizeof(chunks) / sizeof(chunks[0])); i++) {
+		start = now_ns();
+		for (j = 0; j < BENCH_BYTES; j += chunks[i]) {
+			ringbuf_write(&sp_rb, buf, chunks[i]);
+			ringbuf_read(&sp_rb, buf, chunks[i]);
+		}
+		printf("Host time per byte : write/read by %2u bytes %.2f ns", chunks[i],
+				(now_ns() - start) / BENCH_BYTES);
+		start = now_ns();
+		for (j = 0; j < BENCH_BYTES; j += chunks[i]) {
+			ringbuf_mp_write(&sp_rb, buf, chunks[i]);
+			ringbuf_read(&sp_rb, buf, chunks[i]);
+		}
+		printf(", mp_write/read %.2f ns\n", (now_ns() - start) / BENCH_BYTES);
+	}
+	(void)c;
+}
+
+
+/***************************************************************************** */
+int main(int argc, char* argv[])
+{
+	int mode = 0;
+
+	if (argc > 1) {
+		nb_records = strtoul(argv[1], NULL, 0);
+	}
+	preempt = 1;
+	mp_check();
+	for (mode = STREAM_BULK; mode <= STREAM_ZERO_COPY; mode++) {
+		sp_check(mode);
+	}
+	preempt = 0;
+	bench();
+	printf("%u error(s)\n", errors);
+	return (errors != 0);
+}
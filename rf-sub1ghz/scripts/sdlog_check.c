@@ -0,0 +1,339 @@
+/****************************************************************************
+ *   scripts/sdlog_check.c
+ *
+ * Host check of the SD card log recovery after interrupted writes and resets
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -DLIB_STDINT_H -DLIB_STDDEF_H -include stdint.h -include stddef.h \
+ *       -Iinclude -I. -o /tmp/sdlog_check scripts/sdlog_check.c
+ *   /tmp/sdlog_check [nb_operations] [seed]
+ *
+ * lib/sdlog.c is included in this file, on a simulated card : block reads and writes
+ *   on a RAM image. Records are appended, flushed and replayed at random, and the
+ *   simulated card fails some writes (error returned, nothing written) or resets the
+ *   system in the middle of a write : only the beginning of the block is written, the
+ *   log and its buffer are lost, and sdlog_init() is called again.
+ * The test keeps the content of each block fully written, and checks :
+ *  - sdlog_init() finds the head just after the last block fully written, and the replay
+ *    position saved in that block, including when the interrupted block is the first
+ *    one of the ring or when nothing has been written yet.
+ *  - Replayed blocks hold the records appended to them, in order. The only invalid
+ *    blocks are the ones partly overwritten by an interrupted write : when the ring is
+ *    full, this is the oldest block, lost like it would have been by the write.
+ *  - A block is replayed at most once, except after a reset for the blocks replayed
+ *    since the last write (at least once delivery), and all the blocks still in the
+ *    ring are replayed at the end.
+ * Each record holds a unique number as timestamp, and bytes depending on it.
+ * Returns 0 if all checks pass, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#define LIB_STRING_H
+
+#include "lib/sdlog.c"
+
+
+/***************************************************************************** */
+static unsigned int errors = 0;
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			if (errors++ < 20) { \
+				printf(__VA_ARGS__); \
+				printf("\n"); \
+			} \
+		} \
+	} while (0)
+
+
+/***************************************************************************** */
+/* Host CRC32 (reflected 0x04C11DB7, with complements) */
+uint32_t crc_compute(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	uint32_t i = 0, b = 0;
+
+	crc = ~crc;
+	for (i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (b = 0; b < 8; b++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+		}
+	}
+	return ~crc;
+}
+
+
+/***************************************************************************** */
+/* Simulated card */
+#define CARD_NB_BLOCKS  64
+#define LOG_FIRST       5
+#define MAX_SEQ         40000
+
+static uint8_t card_mem[CARD_NB_BLOCKS][SDLOG_BLOCK_SIZE];
+static unsigned int write_fail_rate = 0;   /* Out of 1000 writes */
+static unsigned int reset_rate = 0;        /* Out of 1000 writes */
+static jmp_buf reset_jmp;
+
+static struct sdlog sd_log;
+static uint32_t log_buf[SDLOG_BLOCK_SIZE / 4];
+static uint32_t log_nb_blocks = 0;
+
+/* Test model */
+#define MAX_BLOCK_RECORDS  (SDLOG_PAYLOAD_SIZE / SDLOG_RECORD_HEADER_SIZE)
+static struct block_model {
+	uint8_t written;
+	uint16_t nb;
+	uint32_t ids[MAX_BLOCK_RECORDS];
+	uint32_t tail;      /* Replay position saved in the block */
+	uint8_t replayed;
+	uint8_t again;      /* May be replayed once more after a reset */
+	uint8_t destroyed;  /* Partly overwritten by an interrupted write */
+} blocks[MAX_SEQ];
+static uint32_t pending_ids[MAX_BLOCK_RECORDS];
+static unsigned int nb_pending = 0;
+static int32_t last_written = -1;
+static unsigned int nb_resets = 0, nb_write_fails = 0, nb_records = 0;
+
+int sdmmc_read_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t* buffer)
+{
+	if (block_number >= CARD_NB_BLOCKS) {
+		return -EINVAL;
+	}
+	memcpy(buffer, card_mem[block_number], SDLOG_BLOCK_SIZE);
+	return 0;
+}
+
+int sdmmc_write_block(const struct sdmmc_card* mmc, uint32_t block_number, uint8_t* buffer)
+{
+	struct sdlog_block_header* hdr = (struct sdlog_block_header*)buffer;
+	unsigned int len = SDLOG_BLOCK_SIZE;
+	int reset = 0;
+
+	CHECK((block_number >= LOG_FIRST) && (block_number < (LOG_FIRST + log_nb_blocks)),
+			"Write out of the log : block %u", block_number);
+	if ((unsigned int)(rand() % 1000) < write_fail_rate) {
+		nb_write_fails++;
+		return -EIO;
+	}
+	if ((unsigned int)(rand() % 1000) < reset_rate) {
+		reset = 1;
+		len = rand() % (SDLOG_BLOCK_SIZE + 1);
+	}
+	if ((memcmp(card_mem[block_number], buffer, len) != 0) && (hdr->seq >= log_nb_blocks)) {
+		blocks[hdr->seq - log_nb_blocks].destroyed = 1;
+	}
+	memcpy(card_mem[block_number], buffer, len);
+	if (len == SDLOG_BLOCK_SIZE) {
+		/* Fully written, the records waiting are in this block */
+		struct block_model* blk = &blocks[hdr->seq];
+		CHECK(hdr->seq == (uint32_t)(last_written + 1), "Block %u written after %d",
+				hdr->seq, last_written);
+		CHECK(block_number == (LOG_FIRST + (hdr->seq % log_nb_blocks)),
+				"Block %u written for sequence number %u", block_number, hdr->seq);
+		memset(blk, 0, sizeof(*blk));
+		blk->written = 1;
+		blk->nb = nb_pending;
+		memcpy(blk->ids, pending_ids, (nb_pending * sizeof(uint32_t)));
+		blk->tail = hdr->tail_seq;
+		CHECK(hdr->tail_seq == ((sd_log.tail_seq + log_nb_blocks > hdr->seq + 1) ?
+								sd_log.tail_seq : (hdr->seq + 1 - log_nb_blocks)),
+				"Block %u : replay position %u saved with %u in RAM",
+				hdr->seq, hdr->tail_seq, sd_log.tail_seq);
+		nb_pending = 0;
+		last_written = hdr->seq;
+	}
+	if (reset) {
+		longjmp(reset_jmp, 1);
+	}
+	return 0;
+}
+
+
+/***************************************************************************** */
+static struct sdmmc_card card = {
+	.block_size = SDLOG_BLOCK_SIZE,
+};
+
+static void record_data(uint32_t id, uint8_t* data, uint8_t len)
+{
+	unsigned int i = 0;
+	for (i = 0; i < len; i++) {
+		data[i] = ((id * 7) + i) & 0xFF;
+	}
+}
+
+/* Replay callback data */
+static uint32_t replay_seq = 0;
+static unsigned int replay_idx = 0;
+
+static void replay_callback(uint32_t timestamp, const uint8_t* data, uint8_t len)
+{
+	struct block_model* blk = &blocks[replay_seq];
+	uint8_t ref[SDLOG_MAX_RECORD_SIZE];
+
+	if (replay_idx >= blk->nb) {
+		CHECK(0, "Block %u : extra record %u", replay_seq, replay_idx);
+		return;
+	}
+	record_data(timestamp, ref, len);
+	CHECK((timestamp == blk->ids[replay_idx]) && (memcmp(data, ref, len) == 0),
+			"Block %u, record %u : %u instead of %u or bad data", replay_seq, replay_idx,
+			timestamp, blk->ids[replay_idx]);
+	replay_idx++;
+}
+
+static void replay_one(void)
+{
+	struct block_model* blk = NULL;
+	int ret = 0;
+
+	if (sd_log.fill != 0) {
+		CHECK(sdlog_replay(&sd_log, replay_callback) == -EBUSY, "Replay with records waiting");
+		return;
+	}
+	if (sd_log.tail_seq == sd_log.head_seq) {
+		CHECK(sdlog_replay(&sd_log, replay_callback) == 0, "Replay with nothing to replay");
+		return;
+	}
+	replay_seq = sd_log.tail_seq;
+	replay_idx = 0;
+	blk = &blocks[replay_seq];
+	ret = sdlog_replay(&sd_log, replay_callback);
+	if (blk->destroyed) {
+		CHECK(ret == -EIO, "Replay of block %u, overwritten : %d", replay_seq, ret);
+		return;
+	}
+	CHECK(blk->written, "Replay of block %u, never written", replay_seq);
+	CHECK(ret == blk->nb, "Replay of block %u : %d instead of %u records", replay_seq, ret, blk->nb);
+	CHECK(replay_idx == blk->nb, "Replay of block %u : %u records", replay_seq, replay_idx);
+	CHECK(!blk->replayed || blk->again, "Block %u replayed twice", replay_seq);
+	blk->again = 0;
+	blk->replayed = 1;
+}
+
+/* After a reset */
+static void check_init(void)
+{
+	uint32_t head = (uint32_t)(last_written + 1);
+	uint32_t tail = 0, seq = 0;
+	int ret = 0;
+
+	memset(&sd_log, 0x5A, sizeof(sd_log));
+	memset(log_buf, 0x5A, sizeof(log_buf));
+	nb_pending = 0;
+	ret = sdlog_init(&sd_log, &card, LOG_FIRST, log_nb_blocks, (uint8_t*)log_buf);
+	CHECK(ret == 0, "sdlog_init() : %d", ret);
+	if (last_written >= 0) {
+		tail = blocks[last_written].tail;
+	}
+	CHECK((sd_log.head_seq == head) && (sd_log.tail_seq == tail),
+			"Init after %u resets : head %u tail %u instead of %u %u",
+			nb_resets, sd_log.head_seq, sd_log.tail_seq, head, tail);
+	/* Replayed since the last write : may be replayed again */
+	for (seq = tail; seq < head; seq++) {
+		if (blocks[seq].replayed) {
+			blocks[seq].again = 1;
+		}
+	}
+}
+
+static void run(uint32_t nb_blocks, unsigned int nb_ops, unsigned int fail_rate, unsigned int rst_rate)
+{
+	volatile unsigned int op = 0;
+	uint32_t seq = 0;
+	uint8_t data[SDLOG_MAX_RECORD_SIZE];
+
+	memset(card_mem, 0, sizeof(card_mem));
+	for (seq = 0; seq < CARD_NB_BLOCKS; seq++) {
+		record_data(rand(), card_mem[seq], 255);
+	}
+	memset(blocks, 0, sizeof(blocks));
+	last_written = -1;
+	log_nb_blocks = nb_blocks;
+	write_fail_rate = fail_rate;
+	reset_rate = rst_rate;
+
+	if (setjmp(reset_jmp) != 0) {
+		nb_resets++;
+	}
+	check_init();
+
+	for (; op < nb_ops; op++) {
+		int action = rand() % 100;
+		if (last_written >= (MAX_SEQ - 2)) {
+			break;
+		}
+		if (action < 70) {
+			/* Append, mostly small records */
+			uint8_t len = ((rand() % 10) == 0) ? (rand() % 256) : (rand() % 40);
+			uint32_t id = nb_records++;
+			int ret = 0;
+			record_data(id, data, len);
+			ret = sdlog_append(&sd_log, id, data, len);
+			if (ret == 0) {
+				pending_ids[nb_pending++] = id;
+			}
+		} else if (action < 72) {
+			sdlog_flush(&sd_log);
+		} else {
+			replay_one();
+		}
+	}
+	/* Drain : everything still in the ring gets replayed */
+	write_fail_rate = 0;
+	reset_rate = 0;
+	CHECK(sdlog_flush(&sd_log) == 0, "Final flush");
+	while (sd_log.tail_seq != sd_log.head_seq) {
+		replay_one();
+	}
+	for (seq = ((sd_log.head_seq > nb_blocks) ? (sd_log.head_seq - nb_blocks) : 0); seq < sd_log.head_seq; seq++) {
+		CHECK(blocks[seq].written && (blocks[seq].replayed || blocks[seq].destroyed),
+				"Block %u never replayed", seq);
+	}
+}
+
+
+/***************************************************************************** */
+int main(int argc, char* argv[])
+{
+	static const uint32_t sizes[] = { 2, 3, 13, 16, 50 };
+	unsigned int nb_ops = 200000, seed = 1, i = 0;
+
+	if (argc > 1) {
+		nb_ops = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		seed = strtoul(argv[2], NULL, 0);
+	}
+	srand(seed);
+
+	for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++) {
+		nb_resets = 0;
+		nb_write_fails = 0;
+		nb_records = 0;
+		run(sizes[i], nb_ops, 20, 50);
+		printf("%2u blocks ring : %u records, %d blocks written, %u write errors, %u resets\n",
+				sizes[i], nb_records, (last_written + 1), nb_write_fails, nb_resets);
+	}
+	printf("SD card log checked : %u error(s)\n", errors);
+	return (errors == 0) ? 0 : 1;
+}
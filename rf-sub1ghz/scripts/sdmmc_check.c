@@ -0,0 +1,729 @@
+/****************************************************************************
+ *   scripts/sdmmc_check.c
+ *
+ * Host check of the SD card multiple blocks transfers, using a SPI mode card model
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -DLIB_STDINT_H -DLIB_STDDEF_H -include stdint.h -include stddef.h \
+ *       -Iinclude -I. -o /tmp/sdmmc_check scripts/sdmmc_check.c
+ *   /tmp/sdmmc_check
+ *
+ * extdrv/sdmmc.c is included in this file, with the SPI, GPIO and CRC functions replaced
+ *   by host versions. Each SPI byte is exchanged with a model of a card in SPI mode,
+ *   which checks the command CRC and addresses, the order of the commands and tokens,
+ *   and that the host does not send anything but 0xFF while the card is busy.
+ * The model sends a data byte with R1 error bits as the stuff byte following CMD12, so
+ *   the read of a multiple blocks transfer fails if this byte is not dropped. It keeps
+ *   the block count given by ACMD23 for the next CMD25, and goes busy after the byte
+ *   following the "Stop Tran" token.
+ * Checks, on SDHC (block number) and standard capacity (byte address) cards :
+ *  - Writes and reads of 0 to 64 blocks, with the multiple blocks and single block
+ *    functions, and the pre-erase count.
+ *  - Errors in the middle of a transfer : bad CRC of a read block, missing start token,
+ *    CRC and write errors reported by the data response token, card busy for longer
+ *    than the timeout, and command errors. The function must return the error, the
+ *    blocks written before the error must be on the card and not the following ones,
+ *    and the transfer must be ended properly : any protocol error is counted and the
+ *    next transfer must succeed.
+ * Throughput : the number of bytes on the bus per block, and the time per block for a
+ *   12MHz SPI clock with the card timings of the model (read access time, programming
+ *   time), which are typical values and not those of a given card.
+ * Returns 0 if all checks pass, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/***************************************************************************** */
+/* Host versions of the functions used by extdrv/sdmmc.c */
+#define CORE_SYSTEM_H
+#define DRIVERS_GPIO_H
+#define DRIVERS_SSP_H
+#define LIB_STRING_H
+#define LIB_UTILS_H
+#define LIB_CRC_H
+
+#include "lib/crc_ccitt.c"
+
+enum crc_types {
+	CRC_TYPE_CCITT = 0,
+};
+static uint32_t crc_compute(uint8_t type, uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+	return crc_ccitt((crc & 0xFFFF), (uint8_t*)buf, len);
+}
+
+static uint8_t clz(uint32_t x)
+{
+	return (x == 0) ? 32 : __builtin_clz(x);
+}
+static uint32_t ntohs(uint32_t val)
+{
+	return (((val & 0xFF) << 8) | ((val >> 8) & 0xFF));
+}
+static void msleep(uint32_t ms)
+{
+}
+
+#include "core/pio.h"
+#define GPIO_DIR_OUT  1
+static void config_gpio(const struct pio* gpio, uint32_t mode, uint8_t dir, uint8_t ini_val)
+{
+}
+static void card_select(int active);
+#define gpio_clear(gpio)  card_select(1)
+#define gpio_set(gpio)    card_select(0)
+
+static int spi_get_mutex(uint8_t ssp_num)
+{
+	return 1;
+}
+static void spi_release_mutex(uint8_t ssp_num)
+{
+}
+static uint8_t card_exchange(uint8_t in);
+static uint16_t spi_transfer_single_frame(uint8_t ssp_num, uint16_t data)
+{
+	return card_exchange(data);
+}
+/* Like the driver, sends the content of data_in when data_out is NULL */
+static int spi_transfer_multiple_frames(uint8_t ssp_num, void* data_out, void* data_in, int size, int width)
+{
+	uint8_t* out = data_out;
+	uint8_t* in = data_in;
+	int i = 0;
+
+	for (i = 0; i < size; i++) {
+		uint8_t val = 0xFF;
+		if (out != NULL) {
+			val = out[i];
+		} else if (in != NULL) {
+			val = in[i];
+		}
+		val = card_exchange(val);
+		if (in != NULL) {
+			in[i] = val;
+		}
+	}
+	return size;
+}
+
+#include "extdrv/sdmmc.c"
+
+
+/***************************************************************************** */
+static unsigned int errors = 0;
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			if (errors++ < 20) { \
+				printf(__VA_ARGS__); \
+				printf("\n"); \
+			} \
+		} \
+	} while (0)
+
+
+/***************************************************************************** */
+/* Card model */
+#define CARD_NB_BLOCKS  128
+#define BLOCK_SIZE      512
+#define STUFF_BYTE      0x3C  /* Read data, with R1 error bits */
+
+/* Card timings, in bytes on the bus at 12MHz (1.5MB/s) */
+#define READ_ACCESS     150   /* 100us before the first block of a read */
+#define READ_GAP        15    /* 10us between the blocks of a multiple blocks read */
+#define PROG_SINGLE     750   /* 500us to program a single block write */
+#define PROG_MULTI      150   /* 100us per pre-erased block of a multiple blocks write */
+#define PROG_STOP       300   /* 200us after the "Stop Tran" token */
+#define STOP_BUSY       8     /* Busy after CMD12 */
+
+enum card_states {
+	CARD_IDLE = 0,
+	CARD_READ,         /* Sending data blocks */
+	CARD_WRITE,        /* Waiting for or receiving data blocks */
+};
+
+/* Errors injected at the given block of the next transfer */
+enum card_faults {
+	FAULT_NONE = 0,
+	FAULT_CMD,         /* R1 address error for the read or write command */
+	FAULT_READ_CRC,    /* Bad CRC sent with the block */
+	FAULT_READ_STALL,  /* No start token, the card stops sending data */
+	FAULT_WRITE_CRC,   /* CRC error data response */
+	FAULT_WRITE_ERR,   /* Write error data response */
+	FAULT_WRITE_BUSY,  /* Busy for longer than the driver timeout */
+};
+
+struct card {
+	int high_capacity;
+	uint8_t mem[CARD_NB_BLOCKS][BLOCK_SIZE];
+	int selected;
+	/* Bytes sent before the busy state or the generated ones */
+	uint8_t out[1024];
+	unsigned int out_pos, out_len;
+	unsigned int busy;
+	/* Command being received */
+	uint8_t cmd[MMC_CMD_SIZE];
+	unsigned int cmd_len;
+	int app_cmd;
+	uint32_t erase_count;
+	/* Data transfer */
+	int state;
+	int multi;
+	uint32_t block;
+	unsigned int index;      /* Block index in the transfer */
+	int receiving;
+	uint8_t data[BLOCK_SIZE + 2];
+	unsigned int data_len;
+	/* Faults and statistics */
+	int fault;
+	unsigned int fault_block;
+	uint32_t last_erase_count;
+	unsigned int nb_cmd[64];
+	unsigned long bytes;
+	unsigned int protocol_errors;
+};
+static struct card card;
+
+static void protocol_error(const char* msg, int val)
+{
+	if (card.protocol_errors++ < 10) {
+		printf("Card model : %s (0x%02x)\n", msg, val);
+	}
+}
+
+static uint16_t card_crc16(const uint8_t* buf, unsigned int len)
+{
+	uint16_t crc = 0;
+	unsigned int i = 0, b = 0;
+	for (i = 0; i < len; i++) {
+		crc ^= (buf[i] << 8);
+		for (b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void card_queue(uint8_t val)
+{
+	if (card.out_len >= sizeof(card.out)) {
+		memmove(card.out, (card.out + card.out_pos), (card.out_len - card.out_pos));
+		card.out_len -= card.out_pos;
+		card.out_pos = 0;
+	}
+	card.out[card.out_len++] = val;
+}
+
+static void card_reset_output(void)
+{
+	card.out_pos = 0;
+	card.out_len = 0;
+}
+
+static void card_select(int active)
+{
+	if (!active && card.selected) {
+		if (card.cmd_len != 0) {
+			protocol_error("chip select released during a command", card.cmd[0]);
+		}
+		if (card.state == CARD_READ) {
+			protocol_error("chip select released during a multiple blocks read", card.index);
+		} else if (card.state == CARD_WRITE) {
+			protocol_error("chip select released during a write", card.index);
+		}
+		card.state = CARD_IDLE;
+		card.cmd_len = 0;
+		card_reset_output();
+	}
+	card.selected = active;
+}
+
+static int card_address(uint32_t arg, uint32_t* block)
+{
+	if (!card.high_capacity) {
+		if (arg & (BLOCK_SIZE - 1)) {
+			return -1;
+		}
+		arg = arg / BLOCK_SIZE;
+	}
+	*block = arg;
+	return (arg < CARD_NB_BLOCKS) ? 0 : -1;
+}
+
+static void card_command(void)
+{
+	uint8_t index = (card.cmd[0] & 0x3F);
+	uint32_t arg = (card.cmd[1] << 24) | (card.cmd[2] << 16) | (card.cmd[3] << 8) | card.cmd[4];
+	int app_cmd = card.app_cmd;
+	uint8_t r1 = MMC_R1_NO_ERROR;
+
+	card.nb_cmd[index]++;
+	card.app_cmd = 0;
+	if (card.cmd[5] != sdmmc_crc7(card.cmd, 5)) {
+		protocol_error("bad command CRC", index);
+		card_queue(0xFF);
+		card_queue(MMC_R1_COM_CRC_ERROR);
+		return;
+	}
+	if (card.state == CARD_READ) {
+		/* The card stops sending data after the stuff byte */
+		card_reset_output();
+		card.state = CARD_IDLE;
+		if (index != MMC_STOP_TRANSMISSION) {
+			protocol_error("command other than CMD12 during a multiple blocks read", index);
+		}
+		card_queue(STUFF_BYTE);
+		card_queue(MMC_R1_NO_ERROR);
+		card.busy = STOP_BUSY;
+		return;
+	}
+	if (card.state == CARD_WRITE) {
+		protocol_error("command during a write", index);
+		card.state = CARD_IDLE;
+	}
+	card_queue(0xFF);
+
+	switch (index) {
+		case MMC_APP_CMD:
+			card.app_cmd = 1;
+			break;
+		case MMC_SD_SET_WR_BLK_ERASE_COUNT:
+			if (!app_cmd) {
+				r1 = MMC_R1_ILLEGAL_CMD;
+				break;
+			}
+			card.erase_count = (arg & 0x007FFFFF);
+			break;
+		case MMC_STOP_TRANSMISSION:
+			protocol_error("CMD12 outside of a multiple blocks read", index);
+			break;
+		case MMC_READ_SINGLE_BLOCK:
+		case MMC_READ_MULTIPLE_BLOCK:
+		case MMC_WRITE_SINGLE_BLOCK:
+		case MMC_WRITE_MULTIPLE_BLOCK:
+			if ((card_address(arg, &card.block) != 0) || (card.fault == FAULT_CMD)) {
+				r1 = MMC_R1_ADDRESS_ERROR;
+				card.fault = FAULT_NONE;
+				break;
+			}
+			card.multi = ((index == MMC_READ_MULTIPLE_BLOCK) || (index == MMC_WRITE_MULTIPLE_BLOCK));
+			card.index = 0;
+			card.receiving = 0;
+			if ((index == MMC_READ_SINGLE_BLOCK) || (index == MMC_READ_MULTIPLE_BLOCK)) {
+				card.state = CARD_READ;
+				/* Send R1 now, the data follows */
+				card_queue(r1);
+				return;
+			}
+			card.state = CARD_WRITE;
+			card.last_erase_count = 0;
+			if (index == MMC_WRITE_MULTIPLE_BLOCK) {
+				card.last_erase_count = card.erase_count;
+			}
+			card.erase_count = 0;
+			break;
+		default:
+			r1 = MMC_R1_ILLEGAL_CMD;
+			break;
+	}
+	card_queue(r1);
+}
+
+/* Next data block of a read, or nothing once the transfer is over (or stalled) */
+static void card_read_next(void)
+{
+	unsigned int i = 0;
+	uint16_t crc = 0;
+
+	if ((card.index > 0) && !card.multi) {
+		card.state = CARD_IDLE;
+		return;
+	}
+	if ((card.fault == FAULT_READ_STALL) && (card.fault_block == card.index)) {
+		return;
+	}
+	if (card.block >= CARD_NB_BLOCKS) {
+		return;
+	}
+	for (i = 0; i < ((card.index == 0) ? READ_ACCESS : READ_GAP); i++) {
+		card_queue(0xFF);
+	}
+	card_queue(MMC_START_DATA_BLOCK_TOCKEN);
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		card_queue(card.mem[card.block][i]);
+	}
+	crc = card_crc16(card.mem[card.block], BLOCK_SIZE);
+	if ((card.fault == FAULT_READ_CRC) && (card.fault_block == card.index)) {
+		crc ^= 0x0100;
+	}
+	card_queue(crc >> 8);
+	card_queue(crc & 0xFF);
+	card.block++;
+	card.index++;
+}
+
+/* Byte received during a write */
+static void card_write_byte(uint8_t in)
+{
+	if (card.receiving) {
+		card.data[card.data_len++] = in;
+		if (card.data_len == (BLOCK_SIZE + 2)) {
+			uint16_t crc = (card.data[BLOCK_SIZE] << 8) | card.data[BLOCK_SIZE + 1];
+			int fault = (card.fault_block == card.index) ? card.fault : FAULT_NONE;
+			card.receiving = 0;
+			if ((crc != card_crc16(card.data, BLOCK_SIZE)) || (fault == FAULT_WRITE_CRC)) {
+				card_queue(0x0B);
+			} else if ((fault == FAULT_WRITE_ERR) || (card.block >= CARD_NB_BLOCKS)) {
+				card_queue(0x0D);
+			} else {
+				memcpy(card.mem[card.block], card.data, BLOCK_SIZE);
+				card_queue(0x05);
+				card.busy = (card.multi ? PROG_MULTI : PROG_SINGLE);
+				if (fault == FAULT_WRITE_BUSY) {
+					card.busy = MMC_MAX_TIMEOUT + 100;
+				}
+			}
+			card.block++;
+			card.index++;
+			if (!card.multi) {
+				card.state = CARD_IDLE;
+			}
+		}
+		return;
+	}
+	if (in == 0xFF) {
+		return;
+	}
+	if (!card.multi && (in == MMC_START_DATA_BLOCK_TOCKEN)) {
+		card.receiving = 1;
+	} else if (card.multi && (in == MMC_START_MULTI_WRITE_TOCKEN)) {
+		card.receiving = 1;
+	} else if (card.multi && (in == MMC_STOP_MULTI_WRITE_TOCKEN)) {
+		/* One more byte, then busy */
+		card_queue(0xFF);
+		card.busy = PROG_STOP;
+		card.state = CARD_IDLE;
+	} else {
+		protocol_error("unexpected byte while waiting for a data token", in);
+	}
+	card.data_len = 0;
+}
+
+/* One byte exchange : returns the byte sent by the card while receiving "in" */
+static uint8_t card_exchange(uint8_t in)
+{
+	uint8_t out = 0xFF;
+
+	card.bytes++;
+	if (!card.selected) {
+		protocol_error("byte sent with the card not selected", in);
+		return 0xFF;
+	}
+	/* Output */
+	if ((card.out_pos == card.out_len) && (card.busy == 0) && (card.state == CARD_READ)) {
+		card_reset_output();
+		card_read_next();
+	}
+	if (card.out_pos < card.out_len) {
+		out = card.out[card.out_pos++];
+	} else if (card.busy > 0) {
+		card.busy--;
+		out = 0x00;
+		if (in != 0xFF) {
+			protocol_error("byte sent while the card is busy", in);
+		}
+		return out;
+	}
+
+	/* Input */
+	if (card.cmd_len > 0) {
+		card.cmd[card.cmd_len++] = in;
+		if (card.cmd_len == MMC_CMD_SIZE) {
+			card.cmd_len = 0;
+			card_command();
+		}
+	} else if ((card.state == CARD_WRITE) && (card.receiving || ((in & 0xC0) != 0x40))) {
+		card_write_byte(in);
+	} else if ((in & 0xC0) == 0x40) {
+		card.cmd[card.cmd_len++] = in;
+	} else if ((in != 0xFF) && (card.state != CARD_READ)) {
+		protocol_error("unexpected byte", in);
+	}
+	return out;
+}
+
+static void card_setup(int high_capacity)
+{
+	unsigned int b = 0, i = 0;
+
+	memset(&card, 0, sizeof(card));
+	card.high_capacity = high_capacity;
+	for (b = 0; b < CARD_NB_BLOCKS; b++) {
+		for (i = 0; i < BLOCK_SIZE; i++) {
+			card.mem[b][i] = rand();
+		}
+	}
+}
+
+
+/***************************************************************************** */
+#define MAX_BLOCKS  64
+
+static uint8_t wbuf[MAX_BLOCKS * BLOCK_SIZE];
+static uint8_t rbuf[MAX_BLOCKS * BLOCK_SIZE];
+static uint8_t before[CARD_NB_BLOCKS][BLOCK_SIZE];
+
+static void fill_random(uint8_t* buf, size_t len)
+{
+	size_t i = 0;
+	for (i = 0; i < len; i++) {
+		buf[i] = rand();
+	}
+}
+
+/* The card must be ready for a new transfer */
+static void check_card_idle(const char* what, unsigned int nb)
+{
+	CHECK((card.state == CARD_IDLE) && (card.cmd_len == 0) && (card.out_pos == card.out_len),
+			"%s of %u blocks : transfer not ended", what, nb);
+	CHECK(card.busy == 0, "%s of %u blocks : card still busy", what, nb);
+	card.state = CARD_IDLE;
+	card.busy = 0;
+	card_reset_output();
+}
+
+static void check_transfers(struct sdmmc_card* mmc)
+{
+	static const unsigned int sizes[] = { 0, 1, 2, 3, 8, 17, 32, 64 };
+	unsigned int s = 0, i = 0;
+	int ret = 0;
+
+	for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+		unsigned int nb = sizes[s];
+		uint32_t first = rand() % (CARD_NB_BLOCKS - nb + 1);
+		unsigned int cmd24 = card.nb_cmd[MMC_WRITE_SINGLE_BLOCK];
+		unsigned int cmd25 = card.nb_cmd[MMC_WRITE_MULTIPLE_BLOCK];
+		unsigned long bytes = card.bytes;
+
+		fill_random(wbuf, nb * BLOCK_SIZE);
+		memcpy(before, card.mem, sizeof(before));
+		ret = sdmmc_write_blocks(mmc, first, nb, wbuf);
+		CHECK(ret == 0, "Write of %u blocks at %u : %d", nb, first, ret);
+		check_card_idle("Write", nb);
+		CHECK(memcmp(card.mem[first], wbuf, nb * BLOCK_SIZE) == 0,
+				"Write of %u blocks at %u : bad data on card", nb, first);
+		CHECK((memcmp(before, card.mem, first * BLOCK_SIZE) == 0) &&
+				(memcmp(before[first + nb], card.mem[first + nb],
+						(CARD_NB_BLOCKS - first - nb) * BLOCK_SIZE) == 0),
+				"Write of %u blocks at %u : other blocks modified", nb, first);
+		if (nb == 0) {
+			CHECK(card.bytes == bytes, "Write of 0 blocks : bus used");
+		} else if (nb == 1) {
+			CHECK(card.nb_cmd[MMC_WRITE_SINGLE_BLOCK] == (cmd24 + 1), "Write of 1 block : no CMD24");
+		} else {
+			CHECK(card.nb_cmd[MMC_WRITE_MULTIPLE_BLOCK] == (cmd25 + 1), "Write of %u blocks : no CMD25", nb);
+			CHECK(card.last_erase_count == nb, "Write of %u blocks : pre-erase count %u",
+					nb, card.last_erase_count);
+		}
+
+		memset(rbuf, 0, nb * BLOCK_SIZE);
+		ret = sdmmc_read_blocks(mmc, first, nb, rbuf);
+		CHECK(ret == 0, "Read of %u blocks at %u : %d", nb, first, ret);
+		check_card_idle("Read", nb);
+		CHECK(memcmp(rbuf, wbuf, nb * BLOCK_SIZE) == 0,
+				"Read of %u blocks at %u : bad data", nb, first);
+
+		/* Blocks written one at a time, read with a single command */
+		for (i = 0; i < nb; i++) {
+			fill_random(wbuf + (i * BLOCK_SIZE), BLOCK_SIZE);
+			ret = sdmmc_write_block(mmc, first + i, wbuf + (i * BLOCK_SIZE));
+			CHECK(ret == 0, "Single block write at %u : %d", first + i, ret);
+		}
+		ret = sdmmc_read_blocks(mmc, first, nb, rbuf);
+		CHECK((ret == 0) && (memcmp(rbuf, wbuf, nb * BLOCK_SIZE) == 0),
+				"Read of %u single blocks writes at %u : %d or bad data", nb, first, ret);
+		check_card_idle("Read", nb);
+	}
+}
+
+static void check_read_errors(struct sdmmc_card* mmc)
+{
+	static const struct { int fault; int ret; const char* name; } faults[] = {
+		{ FAULT_READ_CRC, -EIO, "bad CRC" },
+		{ FAULT_READ_STALL, -EBUSY, "missing start token" },
+		{ FAULT_CMD, -ENODEV, "command error" },
+	};
+	static const unsigned int at[] = { 0, 1, 5, 7 };
+	unsigned int f = 0, a = 0;
+	int ret = 0;
+
+	for (f = 0; f < (sizeof(faults) / sizeof(faults[0])); f++) {
+		for (a = 0; a < (sizeof(at) / sizeof(at[0])); a++) {
+			unsigned int nb = 8;
+			card.fault = faults[f].fault;
+			card.fault_block = at[a];
+			ret = sdmmc_read_blocks(mmc, 10, nb, rbuf);
+			card.fault = FAULT_NONE;
+			CHECK(ret == faults[f].ret, "Read with %s at block %u : %d instead of %d",
+					faults[f].name, at[a], ret, faults[f].ret);
+			check_card_idle("Read with error", nb);
+			CHECK(memcmp(rbuf, card.mem[10], (at[a] * BLOCK_SIZE)) == 0,
+					"Read with %s at block %u : bad data before the error", faults[f].name, at[a]);
+			/* Next transfer */
+			ret = sdmmc_read_blocks(mmc, 20, nb, rbuf);
+			CHECK((ret == 0) && (memcmp(rbuf, card.mem[20], nb * BLOCK_SIZE) == 0),
+					"Read after %s at block %u : %d or bad data", faults[f].name, at[a], ret);
+			check_card_idle("Read", nb);
+			if (faults[f].fault == FAULT_CMD) {
+				break;
+			}
+		}
+	}
+	/* Out of the card */
+	ret = sdmmc_read_blocks(mmc, CARD_NB_BLOCKS + 4, 4, rbuf);
+	CHECK(ret == -ENODEV, "Read out of the card : %d", ret);
+	check_card_idle("Read out of the card", 4);
+}
+
+static void check_write_errors(struct sdmmc_card* mmc)
+{
+	static const struct { int fault; int ret; int written; const char* name; } faults[] = {
+		{ FAULT_WRITE_CRC, -EIO, 0, "CRC error" },
+		{ FAULT_WRITE_ERR, -EPERM, 0, "write error" },
+		{ FAULT_WRITE_BUSY, -EBUSY, 1, "busy timeout" },
+		{ FAULT_CMD, -ENODEV, 0, "command error" },
+	};
+	static const unsigned int at[] = { 0, 1, 5, 7 };
+	unsigned int f = 0, a = 0;
+	int ret = 0;
+
+	for (f = 0; f < (sizeof(faults) / sizeof(faults[0])); f++) {
+		for (a = 0; a < (sizeof(at) / sizeof(at[0])); a++) {
+			unsigned int nb = 8, ok = at[a];
+			if (faults[f].fault == FAULT_CMD) {
+				ok = 0;
+			} else if (faults[f].written) {
+				ok++;
+			}
+			fill_random(wbuf, nb * BLOCK_SIZE);
+			memcpy(before, card.mem, sizeof(before));
+			card.fault = faults[f].fault;
+			card.fault_block = at[a];
+			ret = sdmmc_write_blocks(mmc, 40, nb, wbuf);
+			card.fault = FAULT_NONE;
+			CHECK(ret == faults[f].ret, "Write with %s at block %u : %d instead of %d",
+					faults[f].name, at[a], ret, faults[f].ret);
+			check_card_idle("Write with error", nb);
+			CHECK(memcmp(card.mem[40], wbuf, (ok * BLOCK_SIZE)) == 0,
+					"Write with %s at block %u : blocks before the error not written",
+					faults[f].name, at[a]);
+			CHECK(memcmp(card.mem[40 + ok], before[40 + ok], ((nb - ok) * BLOCK_SIZE)) == 0,
+					"Write with %s at block %u : blocks written after the error",
+					faults[f].name, at[a]);
+			/* Next transfer */
+			fill_random(wbuf, nb * BLOCK_SIZE);
+			ret = sdmmc_write_blocks(mmc, 60, nb, wbuf);
+			CHECK((ret == 0) && (memcmp(card.mem[60], wbuf, nb * BLOCK_SIZE) == 0),
+					"Write after %s at block %u : %d or bad data", faults[f].name, at[a], ret);
+			check_card_idle("Write", nb);
+			if (faults[f].fault == FAULT_CMD) {
+				break;
+			}
+		}
+	}
+}
+
+
+/***************************************************************************** */
+/* Bytes on the bus, including the card latencies, for nb blocks */
+static void throughput(struct sdmmc_card* mmc)
+{
+	static const unsigned int sizes[] = { 1, 2, 4, 8, 16, 64 };
+	unsigned int s = 0, i = 0;
+
+	printf("\nBus bytes per block and time per block at 12MHz (card timings of the model) :\n");
+	printf("%7s | %-26s | %-26s | %-26s | %-26s\n", "blocks", "write, one command each",
+			"write, CMD25", "read, one command each", "read, CMD18");
+	for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+		unsigned int nb = sizes[s];
+		unsigned long bytes[4];
+		unsigned long start = 0;
+
+		start = card.bytes;
+		for (i = 0; i < nb; i++) {
+			sdmmc_write_block(mmc, i, wbuf + (i * BLOCK_SIZE));
+		}
+		bytes[0] = card.bytes - start;
+		check_card_idle("Write", nb);
+		start = card.bytes;
+		sdmmc_write_blocks(mmc, 0, nb, wbuf);
+		bytes[1] = card.bytes - start;
+		check_card_idle("Write", nb);
+		start = card.bytes;
+		for (i = 0; i < nb; i++) {
+			sdmmc_read_block(mmc, i, rbuf + (i * BLOCK_SIZE));
+		}
+		bytes[2] = card.bytes - start;
+		check_card_idle("Read", nb);
+		start = card.bytes;
+		sdmmc_read_blocks(mmc, 0, nb, rbuf);
+		bytes[3] = card.bytes - start;
+		check_card_idle("Read", nb);
+
+		printf("%7u", nb);
+		for (i = 0; i < 4; i++) {
+			double us = (bytes[i] / (double)nb) / 1.5;
+			printf(" | %5lu B %6.0f us %4.0f kB/s", (bytes[i] / nb), us, (BLOCK_SIZE * 1000000.0) / (us * 1024));
+		}
+		printf("\n");
+	}
+}
+
+
+/***************************************************************************** */
+int main(int argc, char* argv[])
+{
+	struct sdmmc_card mmc = {
+		.ssp_bus_num = 0,
+		.block_size = BLOCK_SIZE,
+		.block_shift = 9,
+	};
+	int hc = 0;
+
+	srand(1);
+	for (hc = 1; hc >= 0; hc--) {
+		card_setup(hc);
+		mmc.card_type = (hc ? MMC_CARDTYPE_SDV2_HC : MMC_CARDTYPE_SDV2_SC);
+		check_transfers(&mmc);
+		check_read_errors(&mmc);
+		check_write_errors(&mmc);
+		printf("%s card : %u protocol error(s)\n", (hc ? "SDHC" : "Standard capacity"),
+				card.protocol_errors);
+		errors += card.protocol_errors;
+	}
+	printf("Multiple blocks transfers checked : %u error(s)\n", errors);
+
+	card_setup(1);
+	mmc.card_type = MMC_CARDTYPE_SDV2_HC;
+	throughput(&mmc);
+	return (errors == 0) ? 0 : 1;
+}
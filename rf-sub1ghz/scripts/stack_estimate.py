@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+#
+# scripts/stack_estimate.py
+#
+# Worst case stack usage estimate.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+# Usage : arm-none-eabi-objdump -d app.elf | stack_estimate.py objs_dir
+#
+# The stack frame size of each function is read from the .su files generated by gcc
+#   with -fstack-usage, and the call graph from the disassembly of the linked image, so
+#   that only the functions actually kept by the linker are taken into account.
+# The result is an estimate :
+#  - Indirect calls (function pointers, ROM division helpers) cannot be followed, the
+#    functions doing such calls are marked with '*'.
+#  - Recursive calls are marked with '!' and counted only once.
+#  - Functions without .su information (assembly) are counted as using no stack.
+# Interrupts add an exception frame of 32 bytes on the stack in use, and may nest when
+#   they have different priorities.
+
+import os
+import re
+import sys
+
+EXCEPTION_FRAME = 32
+
+func_re = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+call_re = re.compile(r'\sbl\s+[0-9a-f]+ <([^>+]+)>')
+indirect_re = re.compile(r'\sblx\s+r')
+
+
+def read_frames(objdir):
+    frames = {}
+    for root, dirs, files in os.walk(objdir):
+        for name in files:
+            if not name.endswith('.su'):
+                continue
+            with open(os.path.join(root, name)) as su:
+                for line in su:
+                    fields = line.split('\t')
+                    if len(fields) < 2:
+                        continue
+                    func = fields[0].split(':')[-1]
+                    size = int(fields[1])
+                    # Static functions may have the same name in different files
+                    frames[func] = max(size, frames.get(func, 0))
+    return frames
+
+
+def read_call_graph(stream):
+    calls = {}
+    indirect = set()
+    current = None
+    for line in stream:
+        line = line.rstrip()
+        match = func_re.match(line)
+        if match:
+            current = match.group(1)
+            calls[current] = set()
+            continue
+        if current is None:
+            continue
+        match = call_re.search(line)
+        if match:
+            calls[current].add(match.group(1))
+        elif indirect_re.search(line):
+            indirect.add(current)
+    return calls, indirect
+
+
+def depth(func, frames, calls, stack, cache, flags):
+    if func in cache:
+        return cache[func]
+    if func in stack:
+        flags.add('!')
+        return 0
+    stack.append(func)
+    deepest = 0
+    for callee in calls.get(func, ()):
+        deepest = max(deepest, depth(callee, frames, calls, stack, cache, flags))
+    stack.pop()
+    cache[func] = frames.get(func, 0) + deepest
+    return cache[func]
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("Usage: objdump -d app.elf | %s objs_dir\n" % sys.argv[0])
+        return 1
+    frames = read_frames(sys.argv[1])
+    calls, indirect = read_call_graph(sys.stdin)
+
+    roots = [f for f in calls if (f == 'main') or f.endswith('_Handler')]
+    roots.sort(key=lambda f: (f != 'main', f))
+    cache = {}
+    results = {}
+    for root in roots:
+        flags = set()
+        size = depth(root, frames, calls, [], cache, flags)
+        # Look for indirect calls in the whole call tree of this root
+        todo, seen = [root], set()
+        while todo:
+            func = todo.pop()
+            if func in seen:
+                continue
+            seen.add(func)
+            if func in indirect:
+                flags.add('*')
+            todo.extend(calls.get(func, ()))
+        results[root] = size
+        print("%-24s %6d %s" % (root, size, ''.join(sorted(flags))))
+
+    handlers = [results[f] for f in results if f.endswith('_Handler') and f != 'Reset_Handler']
+    if 'main' in results:
+        worst = results['main']
+        if handlers:
+            worst += max(handlers) + EXCEPTION_FRAME
+        print("Worst case (main and one interrupt, no nesting): %d bytes" % worst)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
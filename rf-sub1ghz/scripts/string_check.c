@@ -0,0 +1,421 @@
+/****************************************************************************
+ *   scripts/string_check.c
+ *
+ * Host check and benchmark of the memory and string functions of lib/string.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************** */
+
+/* Build and run on the host, from the rf-sub1ghz directory :
+ *   gcc -O2 -fno-builtin -fno-tree-loop-distribute-patterns -DLIB_STDINT_H \
+ *       -DLIB_STDDEF_H -include stdint.h -include stddef.h -Iinclude -I. \
+ *       -o /tmp/string_check scripts/string_check.c
+ *   /tmp/string_check [bench_loops]
+ *
+ * lib/string.c is included in this file with its functions renamed (lpc_memcpy(), ...)
+ *   so that they can be compared with the libc ones. The LDM / STM blocks are replaced
+ *   by their C equivalent on the host, all the other paths are the target ones.
+ * "-fno-tree-loop-distribute-patterns" keeps gcc from turning the byte loops into calls
+ *   to the libc memcpy() and memset(), which would hide the code under test.
+ * Checks :
+ *  - memcpy() and memset() against the libc for every size from 0 to 1030 bytes and
+ *    every source and destination alignment, with guard bytes around the destination.
+ *  - memcpy() source reads : the source is placed against an inaccessible page, before
+ *    and after it, with the aligned words holding the source bytes touching the page.
+ *    Any read outside of these words crashes the check (reported by the signal handler).
+ *  - The string functions against the libc, for all lengths up to 70 and alignments.
+ * The benchmark gives the host time for sizes 1 to 1024, for lib/string.c, the previous
+ *   word or byte version and the libc. This is only useful to compare the paths : the
+ *   host has no LDM / STM equivalent and a different memory system. For the cycles on
+ *   the target, put the calls between PROF_ENTER() and PROF_EXIT() (lib/prof.h).
+ * Returns 0 if all checks pass, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+
+/***************************************************************************** */
+#define memcpy   lpc_memcpy
+#define memset   lpc_memset
+#define strcpy   lpc_strcpy
+#define strncpy  lpc_strncpy
+#define strcmp   lpc_strcmp
+#define strncmp  lpc_strncmp
+#define strchr   lpc_strchr
+#define strlen   lpc_strlen
+#define strrchr  lpc_strrchr
+#define strnlen  lpc_strnlen
+
+#include "lib/string.c"
+
+#undef memcpy
+#undef memset
+#undef strcpy
+#undef strncpy
+#undef strcmp
+#undef strncmp
+#undef strchr
+#undef strlen
+#undef strrchr
+#undef strnlen
+
+
+/***************************************************************************** */
+/* Previous versions, word accesses only when the pointers are already aligned */
+static void* old_memcpy(void* dest, const void* src, size_t count)
+{
+	uint32_t* dl = (uint32_t*)dest;
+	const uint32_t* sl = (const uint32_t*)src;
+	uint8_t* d8 = NULL;
+	const uint8_t* s8 = NULL;
+
+	if (src == dest)
+		return dest;
+
+	if ((((uintptr_t)dest | (uintptr_t)src) & 0x03) == 0) {
+		while (count >= 4) {
+			*dl++ = *sl++;
+			count -= 4;
+		}
+	}
+	d8 = (uint8_t*)dl;
+	s8 = (const uint8_t*)sl;
+	while (count--) {
+		*d8++ = *s8++;
+	}
+	return dest;
+}
+
+static void* old_memset(void* s, int c, size_t count)
+{
+	uint32_t* sl = (uint32_t*)s;
+	uint32_t cl = (c & 0xFF);
+	uint8_t* s8 = NULL;
+
+	if (((uintptr_t)s & 0x03) == 0) {
+		cl |= (cl << 8);
+		cl |= (cl << 16);
+		while (count >= 4) {
+			*sl++ = cl;
+			count -= 4;
+		}
+	}
+	s8 = (uint8_t*)sl;
+	while (count--) {
+		*s8++ = c;
+	}
+	return s;
+}
+
+
+/***************************************************************************** */
+static unsigned int errors = 0;
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			if (errors++ < 10) { \
+				printf(__VA_ARGS__); \
+				printf("\n"); \
+			} \
+		} \
+	} while (0)
+
+/* Current case, reported if a read outside of the source words faults */
+static volatile size_t case_size = 0;
+static volatile int case_align = 0;
+static volatile const char* case_place = "";
+
+static void fault_handler(int sig)
+{
+	static char msg[128];
+	int len = snprintf(msg, sizeof(msg), "memcpy: fault reading %s the source, size %zu,"
+						" source alignment %d\n", case_place, case_size, case_align);
+	write(2, msg, len);
+	_exit(1);
+}
+
+
+/***************************************************************************** */
+#define MAX_SIZE    1030
+#define GUARD       16
+#define BUF_SIZE    (MAX_SIZE + 2 * GUARD + 8)
+
+static uint8_t src_buf[BUF_SIZE];
+static uint8_t dst_buf[BUF_SIZE];
+static uint8_t ref_buf[BUF_SIZE];
+
+static void fill_random(uint8_t* buf, size_t len)
+{
+	size_t i = 0;
+	for (i = 0; i < len; i++) {
+		buf[i] = rand();
+	}
+}
+
+static void check_memcpy(void)
+{
+	size_t size = 0;
+	int sa = 0, da = 0;
+
+	for (size = 0; size <= MAX_SIZE; size++) {
+		for (sa = 0; sa < 4; sa++) {
+			for (da = 0; da < 4; da++) {
+				uint8_t* src = src_buf + GUARD + sa;
+				uint8_t* ret = NULL;
+				fill_random(src_buf, BUF_SIZE);
+				fill_random(dst_buf, BUF_SIZE);
+				memcpy(ref_buf, dst_buf, BUF_SIZE);
+				memcpy(ref_buf + GUARD + da, src, size);
+				ret = lpc_memcpy(dst_buf + GUARD + da, src, size);
+				CHECK(ret == (dst_buf + GUARD + da),
+						"memcpy: bad return value, size %zu, alignments %d/%d", size, sa, da);
+				CHECK(memcmp(dst_buf, ref_buf, BUF_SIZE) == 0,
+						"memcpy: bad copy, size %zu, alignments %d/%d", size, sa, da);
+			}
+		}
+	}
+	/* Same source and destination */
+	fill_random(src_buf, BUF_SIZE);
+	memcpy(ref_buf, src_buf, BUF_SIZE);
+	lpc_memcpy(src_buf + 3, src_buf + 3, 100);
+	CHECK(memcmp(src_buf, ref_buf, BUF_SIZE) == 0, "memcpy: src == dest modified the area");
+}
+
+/* The source is placed against an inaccessible page : at the start of an accessible
+ *   page, and at the end of an accessible page with the aligned word holding the last
+ *   source byte ending on the page boundary. */
+static void check_memcpy_reads(void)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t pages = (MAX_SIZE + 8 + page - 1) / page;
+	size_t len = (pages + 2) * page;
+	uint8_t* area = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	uint8_t* first = NULL;
+	uint8_t* last = NULL;
+	size_t size = 0;
+	int sa = 0, da = 0;
+
+	if (area == MAP_FAILED) {
+		printf("memcpy: mmap failed, source reads not checked\n");
+		errors++;
+		return;
+	}
+	mprotect(area, page, PROT_NONE);
+	mprotect(area + (pages + 1) * page, page, PROT_NONE);
+	first = area + page;
+	last = area + (pages + 1) * page;
+	fill_random(first, pages * page);
+	signal(SIGSEGV, fault_handler);
+	signal(SIGBUS, fault_handler);
+
+	for (size = 0; size <= MAX_SIZE; size++) {
+		for (sa = 0; sa < 4; sa++) {
+			size_t words = (sa + size + 3) & ~0x03;
+			uint8_t* src = NULL;
+			case_size = size;
+			case_align = sa;
+			for (da = 0; da < 4; da++) {
+				case_place = "before";
+				src = first + sa;
+				lpc_memcpy(dst_buf + GUARD + da, src, size);
+				CHECK(memcmp(dst_buf + GUARD + da, src, size) == 0,
+						"memcpy: bad copy at page start, size %zu, alignments %d/%d", size, sa, da);
+				case_place = "past the end of";
+				src = last - words + sa;
+				lpc_memcpy(dst_buf + GUARD + da, src, size);
+				CHECK(memcmp(dst_buf + GUARD + da, src, size) == 0,
+						"memcpy: bad copy at page end, size %zu, alignments %d/%d", size, sa, da);
+			}
+		}
+	}
+	signal(SIGSEGV, SIG_DFL);
+	signal(SIGBUS, SIG_DFL);
+	munmap(area, len);
+}
+
+static void check_memset(void)
+{
+	static const int values[] = { 0x00, 0xA5, 0xFF, 0x15A, -1 };
+	size_t size = 0;
+	unsigned int v = 0;
+	int da = 0;
+
+	for (size = 0; size <= MAX_SIZE; size++) {
+		for (da = 0; da < 4; da++) {
+			for (v = 0; v < (sizeof(values) / sizeof(values[0])); v++) {
+				uint8_t* ret = NULL;
+				fill_random(dst_buf, BUF_SIZE);
+				memcpy(ref_buf, dst_buf, BUF_SIZE);
+				memset(ref_buf + GUARD + da, values[v], size);
+				ret = lpc_memset(dst_buf + GUARD + da, values[v], size);
+				CHECK(ret == (dst_buf + GUARD + da),
+						"memset: bad return value, size %zu, alignment %d", size, da);
+				CHECK(memcmp(dst_buf, ref_buf, BUF_SIZE) == 0,
+						"memset: bad fill, size %zu, alignment %d, value 0x%x", size, da, values[v]);
+			}
+		}
+	}
+}
+
+
+/***************************************************************************** */
+#define STR_MAX_LEN  70
+
+static int sign(int val)
+{
+	return (val > 0) - (val < 0);
+}
+
+static void check_strings(void)
+{
+	char a[STR_MAX_LEN + 8], b[STR_MAX_LEN + 8], d1[STR_MAX_LEN + 8], d2[STR_MAX_LEN + 8];
+	size_t len = 0, n = 0;
+	int al = 0;
+
+	for (len = 0; len <= STR_MAX_LEN; len++) {
+		for (al = 0; al < 4; al++) {
+			char* s = a + al;
+			size_t i = 0;
+			for (i = 0; i < len; i++) {
+				s[i] = 'a' + (rand() % 4);
+			}
+			s[len] = '\0';
+			memcpy(b, s, len + 1);
+
+			CHECK(lpc_strlen(s) == strlen(s), "strlen: length %zu, alignment %d", len, al);
+			CHECK(lpc_strcmp(s, b) == 0, "strcmp: equal strings, length %zu", len);
+			CHECK(lpc_strchr(s, 'c') == strchr(s, 'c'), "strchr: length %zu", len);
+			CHECK(lpc_strchr(s, '\0') == strchr(s, '\0'), "strchr: nul, length %zu", len);
+			CHECK(lpc_strrchr(s, 'c') == strrchr(s, 'c'), "strrchr: length %zu", len);
+			CHECK(lpc_strrchr(s, '\0') == strrchr(s, '\0'), "strrchr: nul, length %zu", len);
+
+			memset(d1, 0x5A, sizeof(d1));
+			memset(d2, 0x5A, sizeof(d2));
+			CHECK(lpc_strcpy(d1 + al, s) == (d1 + al), "strcpy: bad return value");
+			strcpy(d2 + al, s);
+			CHECK(memcmp(d1, d2, sizeof(d1)) == 0, "strcpy: length %zu, alignment %d", len, al);
+
+			for (n = 0; n <= (len + 2); n++) {
+				CHECK(lpc_strnlen(s, n) == strnlen(s, n), "strnlen: length %zu, limit %zu", len, n);
+				/* Unlike the libc one, strncpy() does not pad with nul bytes */
+				memset(d1, 0x5A, sizeof(d1));
+				memset(d2, 0x5A, sizeof(d2));
+				lpc_strncpy(d1, s, n);
+				memcpy(d2, s, ((n <= len) ? n : (len + 1)));
+				CHECK(memcmp(d1, d2, sizeof(d1)) == 0, "strncpy: length %zu, limit %zu", len, n);
+				if (len > 0) {
+					b[len - 1] = 'a' + (rand() % 4);
+				}
+				CHECK(sign(lpc_strncmp(s, b, n)) == sign(strncmp(s, b, n)),
+						"strncmp: length %zu, limit %zu", len, n);
+				CHECK(sign(lpc_strcmp(s, b)) == sign(strcmp(s, b)), "strcmp: length %zu", len);
+			}
+			/* Bytes above 0x7F compare as unsigned */
+			if (len > 0) {
+				memcpy(b, s, len + 1);
+				b[len / 2] = (char)0xC0;
+				CHECK(sign(lpc_strcmp(s, b)) == sign(strcmp(s, b)), "strcmp: high byte, length %zu", len);
+				CHECK(sign(lpc_strncmp(s, b, len)) == sign(strncmp(s, b, len)),
+						"strncmp: high byte, length %zu", len);
+			}
+		}
+	}
+}
+
+
+/***************************************************************************** */
+/* Called through pointers so that the compiler cannot inline or drop the calls */
+typedef void* (*copy_func)(void*, const void*, size_t);
+typedef void* (*fill_func)(void*, int, size_t);
+static volatile copy_func copy_funcs[] = { lpc_memcpy, old_memcpy, memcpy };
+static volatile fill_func fill_funcs[] = { lpc_memset, old_memset, memset };
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+static void bench(unsigned int loops)
+{
+	static const size_t sizes[] = { 1, 2, 3, 4, 7, 8, 12, 15, 16, 24, 31, 32, 48, 63, 64,
+									100, 128, 255, 256, 512, 1000, 1024 };
+	static const struct { int sa, da; const char* name; } cases[] = {
+		{ 0, 0, "memcpy aligned" }, { 1, 1, "memcpy same misalign" }, { 1, 0, "memcpy mutual misalign" },
+	};
+	unsigned int s = 0, c = 0, f = 0, i = 0;
+
+	printf("\nHost time (ns per call), lib/string.c / previous version / libc :\n");
+	printf("%6s", "size");
+	for (c = 0; c < (sizeof(cases) / sizeof(cases[0])); c++) {
+		printf(" | %-23s", cases[c].name);
+	}
+	printf(" | %-23s\n", "memset misaligned");
+	for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+		size_t size = sizes[s];
+		printf("%6zu", size);
+		for (c = 0; c < (sizeof(cases) / sizeof(cases[0])); c++) {
+			printf(" |");
+			for (f = 0; f < 3; f++) {
+				copy_func func = copy_funcs[f];
+				double start = now_ns();
+				for (i = 0; i < loops; i++) {
+					func(dst_buf + GUARD + cases[c].da, src_buf + GUARD + cases[c].sa, size);
+				}
+				printf(" %7.1f", (now_ns() - start) / loops);
+			}
+		}
+		printf(" |");
+		for (f = 0; f < 3; f++) {
+			fill_func func = fill_funcs[f];
+			double start = now_ns();
+			for (i = 0; i < loops; i++) {
+				func(dst_buf + GUARD + 1, i, size);
+			}
+			printf(" %7.1f", (now_ns() - start) / loops);
+		}
+		printf("\n");
+	}
+}
+
+
+/***************************************************************************** */
+int main(int argc, char* argv[])
+{
+	unsigned int loops = 200000;
+
+	if (argc > 1) {
+		loops = strtoul(argv[1], NULL, 0);
+	}
+	srand(1);
+
+	check_memcpy();
+	check_memcpy_reads();
+	check_memset();
+	check_strings();
+	printf("memcpy, memset and string functions checked : %u error(s)\n", errors);
+
+	if (loops != 0) {
+		bench(loops);
+	}
+	return (errors == 0) ? 0 : 1;
+}
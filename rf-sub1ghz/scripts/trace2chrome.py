@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+#
+# scripts/trace2chrome.py
+#
+# Convert the binary events trace sent by trace_drain() to the Chrome "trace_event"
+# JSON format, which can be opened with chrome://tracing or https://ui.perfetto.dev
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+# Usage : trace2chrome.py capture.bin [out.json]
+#
+# The capture is the raw data received on the UART after sending the trace dump command
+#   ('t' for the sensors app, "TRC" for the receptor app). Any data before the "TRC"
+#   header is skipped, and several dumps may follow each other in the same capture.
+# Each interrupt handler gets its own track, events are drawn as instant events on the
+#   track of the interrupt handler they occured in, or on the "main" track.
+# The ids must be kept in sync with include/lib/trace.h
+
+import json
+import struct
+import sys
+
+TRACE_ENTER = 0
+TRACE_EXIT = 1
+TRACE_EVENT = 2
+
+TRACE_IDS = {
+    0: "SysTick",
+    1: "PIO_0",
+    2: "PIO_1",
+    3: "PIO_2",
+    4: "I2C_0",
+    5: "UART_0",
+    6: "UART_1",
+    7: "TIMER_0",
+    8: "TIMER_1",
+    9: "TIMER_2",
+    10: "TIMER_3",
+    11: "SSP_0",
+    12: "ADC",
+    16: "radio_cmd",
+    17: "i2c_xfer",
+    18: "rf_tx",
+    19: "rf_rx",
+}
+TRACE_ID_APP = 32
+
+HEADER = struct.Struct('<3sBIHH')
+RECORD = struct.Struct('<IHBB')
+
+
+def id_name(num):
+    if num >= TRACE_ID_APP:
+        return "app_%d" % (num - TRACE_ID_APP)
+    return TRACE_IDS.get(num, "id_%d" % num)
+
+
+def event_args(num, arg):
+    if num == 16:
+        return {"strobe": "0x%02x" % arg}
+    if num == 17:
+        return {"addr": "0x%02x" % (arg & 0xFF), "len": arg >> 8}
+    if num in (18, 19):
+        return {"len": arg >> 8, "addr": "0x%02x" % (arg & 0xFF)}
+    return {"arg": arg}
+
+
+def parse_dumps(data):
+    """Yield (clock, lost, records) for each dump found in the capture"""
+    pos = 0
+    while True:
+        pos = data.find(b'TRC', pos)
+        if (pos < 0) or ((pos + HEADER.size) > len(data)):
+            return
+        magic, version, clock, count, lost = HEADER.unpack_from(data, pos)
+        if version != 1:
+            pos += 3
+            continue
+        pos += HEADER.size
+        records = []
+        for i in range(count):
+            if (pos + RECORD.size) > len(data):
+                sys.stderr.write("Truncated dump, %d records missing\n" % (count - i))
+                break
+            records.append(RECORD.unpack_from(data, pos))
+            pos += RECORD.size
+        yield clock, lost, records
+
+
+def convert(data):
+    events = []
+    offset = 0.0
+    for dump, (clock, lost, records) in enumerate(parse_dumps(data)):
+        if lost:
+            sys.stderr.write("Dump %d : %d records lost\n" % (dump, lost))
+        # Records are in order, unwrap the 32 bits cycles counter (this assumes less than
+        # 2^32 cycles between two records, about 179s at 48MHz, the cycles counter running
+        # at half the main clock)
+        base = 0
+        last = None
+        stack = []
+        start = None
+        for cycles, arg, num, rtype in records:
+            if (last is not None) and (cycles < last):
+                base += (1 << 32)
+            last = cycles
+            ts = (base + cycles) * 1000000.0 / clock
+            if start is None:
+                start = ts
+            ts = ts - start + offset
+            if rtype == TRACE_ENTER:
+                stack.append(num)
+                events.append({"name": id_name(num), "ph": "B", "ts": ts, "pid": 0,
+                               "tid": id_name(num)})
+            elif rtype == TRACE_EXIT:
+                if num in stack:
+                    stack.remove(num)
+                events.append({"name": id_name(num), "ph": "E", "ts": ts, "pid": 0,
+                               "tid": id_name(num)})
+            else:
+                tid = id_name(stack[-1]) if stack else "main"
+                events.append({"name": id_name(num), "ph": "i", "s": "t", "ts": ts,
+                               "pid": 0, "tid": tid, "args": event_args(num, arg)})
+        # Successive dumps are placed one after the other, with a 1ms gap
+        if events:
+            offset = events[-1]["ts"] + 1000.0
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write("Usage: %s capture.bin [out.json]\n" % sys.argv[0])
+        return 1
+    with open(sys.argv[1], 'rb') as capture:
+        trace = convert(capture.read())
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as out:
+            json.dump(trace, out)
+    else:
+        json.dump(trace, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())